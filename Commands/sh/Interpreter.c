@@ -29,6 +29,8 @@ extern int cmd_pwd(ShellContextRef _Nonnull pContext, int argc, char** argv);
 extern int cmd_makedir(ShellContextRef _Nonnull pContext, int argc, char** argv);
 extern int cmd_delete(ShellContextRef _Nonnull pContext, int argc, char** argv);
 extern int cmd_echo(ShellContextRef _Nonnull pContext, int argc, char** argv);
+extern int cmd_ps(ShellContextRef _Nonnull pContext, int argc, char** argv);
+extern int cmd_trace(ShellContextRef _Nonnull pContext, int argc, char** argv);
 
 
 // Keep this table sorted by names, in ascending order
@@ -39,7 +41,9 @@ static const InterpreterCommand gBuiltinCommands[] = {
     {"history", cmd_history},
     {"list", cmd_list},
     {"makedir", cmd_makedir},
+    {"ps", cmd_ps},
     {"pwd", cmd_pwd},
+    {"trace", cmd_trace},
 };
 
 
@@ -0,0 +1,88 @@
+//
+//  ps.c
+//  sh
+//
+//  Created by Dietmar Planitzer on 4/6/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "Interpreter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void print_stats(const ExecutionStatistics* _Nonnull pStats)
+{
+    printf("%4ld.%03ld %4ld.%03ld %4ld.%03ld %6lu %6lu",
+        (long)pStats->userTime.tv_sec, (long)(pStats->userTime.tv_nsec / 1000000),
+        (long)pStats->kernelTime.tv_sec, (long)(pStats->kernelTime.tv_nsec / 1000000),
+        (long)pStats->waitTime.tv_sec, (long)(pStats->waitTime.tv_nsec / 1000000),
+        (unsigned long)pStats->voluntarySwitchCount,
+        (unsigned long)pStats->involuntarySwitchCount);
+}
+
+static void print_process(const ProcessInfo* _Nonnull pInfo, bool showQueues)
+{
+    printf("%5d %5d  ", pInfo->pid, pInfo->ppid);
+    print_stats(&pInfo->stats);
+    printf("  %s\n", pInfo->name);
+
+    if (showQueues) {
+        for (int i = 0; i < pInfo->dispatchQueueCount; i++) {
+            const DispatchQueueInfo* pQueue = &pInfo->dispatchQueues[i];
+
+            printf("   od %3d  ", pQueue->od);
+            print_stats(&pQueue->stats);
+            printf("  qos %d, priority %d, vps %d\n", pQueue->qos, pQueue->priority, pQueue->concurrency);
+        }
+    }
+}
+
+int cmd_ps(ShellContextRef _Nonnull pContext, int argc, char** argv)
+{
+    decl_try_err();
+    ProcessInfo* pInfo = NULL;
+    bool showQueues = false;
+    MonotonicClockInfo clockInfo;
+    ProcessId pid = 1;
+
+    if (argc > 1) {
+        if (!strcmp(argv[1], "-q")) {
+            showQueues = true;
+        }
+        else {
+            printf("%s: unknown option '%s'.\n", argv[0], argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc > 2) {
+        printf("%s: unexpected extra arguments\n", argv[0]);
+    }
+
+    try_null(pInfo, malloc(sizeof(ProcessInfo)), ENOMEM);
+
+    printf("  PID  PPID      USER   KERNEL     WAIT   VCSW   ICSW  NAME\n");
+    while (pid > 0) {
+        err = Process_GetInfo(pid, pInfo);
+        if (err == ESRCH) {
+            // The process has exited since we've learned about its PID. Skip it
+            err = EOK;
+        }
+        else if (err != EOK) {
+            throw(err);
+        }
+        else {
+            print_process(pInfo, showQueues);
+        }
+        pid = pInfo->nextPid;
+    }
+
+    try(MonotonicClock_GetInfo(&clockInfo));
+    printf("%lu clock interrupts since boot (%s)\n", (unsigned long)clockInfo.interruptCount, (clockInfo.isTickless) ? "tickless" : "periodic");
+
+catch:
+    free(pInfo);
+    if (err != EOK) { printf("%s: %s.\n", argv[0], strerror(err)); }
+    return (err == EOK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
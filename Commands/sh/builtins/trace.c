@@ -0,0 +1,125 @@
+//
+//  trace.c
+//  sh
+//
+//  Created by Dietmar Planitzer on 4/2/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "Interpreter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char* _Nonnull gEventNames[] = {
+    "none",
+    "switch-out",
+    "switch-in",
+    "wait",
+    "wakeup",
+    "timeout",
+    "irq-enter",
+    "irq-exit",
+    "item-start",
+    "item-end",
+    "timer-due",
+};
+
+static const char* _Nonnull gWakeUpReasons[] = {
+    "none",
+    "finished",
+    "interrupted",
+    "timed out",
+};
+
+static const char* _Nonnull gVpStates[] = {
+    "ready",
+    "running",
+    "waiting",
+};
+
+
+static void print_event(const TraceEvent* _Nonnull pEvent)
+{
+    const char* name = (pEvent->type >= 0 && pEvent->type <= kTraceEvent_DispatchTimerDue) ? gEventNames[pEvent->type] : "?";
+
+    printf("%5ld.%06ld  vp %3d  %-10s  ", (long)pEvent->time.tv_sec, (long)(pEvent->time.tv_nsec / 1000), pEvent->vpid, name);
+
+    switch (pEvent->type) {
+        case kTraceEvent_SwitchOut:
+            printf("%s, next vp %lu\n", (pEvent->arg0 <= 2) ? gVpStates[pEvent->arg0] : "?", (unsigned long)pEvent->arg1);
+            break;
+
+        case kTraceEvent_SwitchIn:
+            printf("priority %lu\n", (unsigned long)pEvent->arg0);
+            break;
+
+        case kTraceEvent_WaitStart:
+            printf("queue %p%s\n", (void*)pEvent->arg0, (pEvent->arg1) ? ", interruptible" : "");
+            break;
+
+        case kTraceEvent_WakeUp:
+            printf("%s, queue %p\n", (pEvent->arg0 <= kTraceWakeUpReason_TimedOut) ? gWakeUpReasons[pEvent->arg0] : "?", (void*)pEvent->arg1);
+            break;
+
+        case kTraceEvent_TimeoutFired:
+            printf("queue %p\n", (void*)pEvent->arg0);
+            break;
+
+        case kTraceEvent_InterruptEnter:
+        case kTraceEvent_InterruptExit:
+            printf("irq %lu\n", (unsigned long)pEvent->arg0);
+            break;
+
+        case kTraceEvent_DispatchItemStart:
+        case kTraceEvent_DispatchItemEnd:
+            printf("queue %p, item %p\n", (void*)pEvent->arg0, (void*)pEvent->arg1);
+            break;
+
+        case kTraceEvent_DispatchTimerDue:
+            printf("queue %p, %lu us late\n", (void*)pEvent->arg0, (unsigned long)pEvent->arg1);
+            break;
+
+        default:
+            printf("%lx %lx\n", (unsigned long)pEvent->arg0, (unsigned long)pEvent->arg1);
+            break;
+    }
+}
+
+int cmd_trace(ShellContextRef _Nonnull pContext, int argc, char** argv)
+{
+    decl_try_err();
+    TraceEvent* pEvents = NULL;
+    size_t count = 0;
+
+    if (argc > 2) {
+        printf("%s: unexpected extra arguments\n", argv[0]);
+    }
+
+    if (argc > 1) {
+        if (!strcmp(argv[1], "on")) {
+            try(Trace_SetEnabled(true));
+        }
+        else if (!strcmp(argv[1], "off")) {
+            try(Trace_SetEnabled(false));
+        }
+        else {
+            printf("%s: expected 'on' or 'off'.\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    try_null(pEvents, malloc(sizeof(TraceEvent) * kTrace_MaxEventCount), ENOMEM);
+    try(Trace_Snapshot(pEvents, kTrace_MaxEventCount, &count));
+
+    for (size_t i = 0; i < count; i++) {
+        print_event(&pEvents[i]);
+    }
+
+catch:
+    free(pEvents);
+    if (err != EOK) { printf("%s: %s.\n", argv[0], strerror(err)); }
+    return (err == EOK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
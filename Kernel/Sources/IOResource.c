@@ -7,8 +7,12 @@
 //
 
 #include "IOResource.h"
+#include <filesystem/Filesystem.h>
 #include <System/IOChannel.h>
 
+// Size of the kernel buffer that the abstract spliceFrom() implementation uses
+#define SPLICE_BUFFER_SIZE  4096
+
 ////////////////////////////////////////////////////////////////////////////////
 // MARK: -
 // MARK: IOChannel
@@ -24,7 +28,7 @@ errno_t IOChannel_AbstractCreate(ClassRef _Nonnull pClass, IOResourceRef _Nonnul
 
     try(_Object_Create(pClass, 0, (ObjectRef*)&pChannel));
     pChannel->resource = Object_RetainAs(pResource, IOResource);
-    pChannel->mode = mode & (kOpen_ReadWrite | kOpen_Append);
+    pChannel->mode = mode & (kOpen_ReadWrite | kOpen_Append | kOpen_NonBlocking);
 
 catch:
     *pOutChannel = pChannel;
@@ -59,6 +63,14 @@ errno_t IOChannel_ioctl(IOChannelRef _Nonnull self, int cmd, va_list ap)
             *((unsigned int*) va_arg(ap, unsigned int*)) = self->mode;
             return EOK;
 
+        case kIOChannelCommand_SetNonBlocking:
+            if (va_arg(ap, int)) {
+                self->mode |= kOpen_NonBlocking;
+            } else {
+                self->mode &= ~kOpen_NonBlocking;
+            }
+            return EOK;
+
         default:
             return ENOTIOCTLCMD;
     }}
@@ -110,6 +122,47 @@ void IOChannel_deinit(IOChannelRef _Nonnull self)
     self->resource = NULL;
 }
 
+// Moves up to 'nBytesToSplice' bytes from the I/O channel 'pInChannel' to the
+// I/O channel 'pOutChannel' without passing the data through user space.
+errno_t IOChannel_Splice(IOChannelRef _Nonnull pInChannel, IOChannelRef _Nonnull pOutChannel, ssize_t nBytesToSplice, ssize_t* _Nonnull nOutBytesSpliced)
+{
+    *nOutBytesSpliced = 0;
+
+    if ((pInChannel->mode & kOpen_Read) != kOpen_Read || (pOutChannel->mode & kOpen_Write) != kOpen_Write) {
+        return EBADF;
+    }
+    if (pInChannel == pOutChannel) {
+        return EINVAL;
+    }
+    // All file channels of a filesystem share the filesystem as their resource.
+    // Only a splice from a file into the same file is an error.
+    if (Object_InstanceOf(pInChannel, File) && Object_InstanceOf(pOutChannel, File)
+        && Inode_Equals(File_GetInode(pInChannel), File_GetInode(pOutChannel))) {
+        return EINVAL;
+    }
+    if (nBytesToSplice <= 0) {
+        return EOK;
+    }
+
+    return IOResource_SpliceFrom(pOutChannel->resource, pOutChannel, pInChannel, nBytesToSplice, nOutBytesSpliced);
+}
+
+// Returns the subset of 'events' for which the I/O channel is ready plus the
+// hangup and error conditions. Adds 'pEntry' to the poll queue of the resource
+// if 'pEntry' is not NULL. A channel is never readable or writable if it wasn't
+// opened for reading or writing.
+int IOChannel_Poll(IOChannelRef _Nonnull self, int events, PollEntry* _Nullable pEntry)
+{
+    if ((self->mode & kOpen_Read) == 0) {
+        events &= ~kPollEvent_Readable;
+    }
+    if ((self->mode & kOpen_Write) == 0) {
+        events &= ~kPollEvent_Writable;
+    }
+
+    return IOResource_Poll(self->resource, self, events, pEntry);
+}
+
 CLASS_METHODS(IOChannel, Object,
 METHOD_IMPL(dup, IOChannel)
 METHOD_IMPL(ioctl, IOChannel)
@@ -158,6 +211,45 @@ errno_t IOResource_write(IOResourceRef _Nonnull self, IOChannelRef _Nonnull pCha
     return EBADF;
 }
 
+// Reads up to 'nBytesToSplice' bytes from 'pInChannel' into a kernel buffer and
+// writes them to the resource. Stops at EOF, at the first error and at the
+// first short write.
+errno_t IOResource_spliceFrom(IOResourceRef _Nonnull self, IOChannelRef _Nonnull pChannel, IOChannelRef _Nonnull pInChannel, ssize_t nBytesToSplice, ssize_t* _Nonnull nOutBytesSpliced)
+{
+    decl_try_err();
+    char* pBuffer = NULL;
+    ssize_t nBytesSpliced = 0;
+
+    try(kalloc(__min(nBytesToSplice, SPLICE_BUFFER_SIZE), (void**) &pBuffer));
+
+    while (nBytesSpliced < nBytesToSplice) {
+        ssize_t nBytesRead, nBytesWritten;
+
+        try(IOChannel_Read(pInChannel, pBuffer, __min(nBytesToSplice - nBytesSpliced, SPLICE_BUFFER_SIZE), &nBytesRead));
+        if (nBytesRead == 0) {
+            break;
+        }
+
+        try(IOResource_Write(self, pChannel, pBuffer, nBytesRead, &nBytesWritten));
+        nBytesSpliced += nBytesWritten;
+        if (nBytesWritten < nBytesRead) {
+            break;
+        }
+    }
+
+catch:
+    kfree(pBuffer);
+    *nOutBytesSpliced = nBytesSpliced;
+    return (nBytesSpliced > 0) ? EOK : err;
+}
+
+// Reports the channel as always readable and writable. Resources which may
+// block a reader or a writer must override this method.
+int IOResource_poll(IOResourceRef _Nonnull self, IOChannelRef _Nonnull pChannel, int events, PollEntry* _Nullable pEntry)
+{
+    return events & (kPollEvent_Readable | kPollEvent_Writable);
+}
+
 // See IOChannel.close()
 errno_t IOResource_close(IOResourceRef _Nonnull self, IOChannelRef _Nonnull pChannel)
 {
@@ -177,5 +269,7 @@ METHOD_IMPL(dup, IOResource)
 METHOD_IMPL(ioctl, IOResource)
 METHOD_IMPL(read, IOResource)
 METHOD_IMPL(write, IOResource)
+METHOD_IMPL(spliceFrom, IOResource)
+METHOD_IMPL(poll, IOResource)
 METHOD_IMPL(close, IOResource)
 );
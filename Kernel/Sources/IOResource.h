@@ -11,6 +11,7 @@
 
 #include <klib/klib.h>
 #include <filesystem/Inode.h>
+#include <dispatcher/PollQueue.h>
 
 CLASS_FORWARD(IOResource);
 
@@ -74,6 +75,25 @@ extern errno_t IOChannel_AbstractCreateCopy(IOChannelRef _Nonnull pInChannel, IO
 // Returns the I/O channel mode.
 #define IOChannel_GetMode(__self) \
     ((IOChannelRef)__self)->mode
+
+// Returns true if the I/O channel is in non-blocking mode.
+#define IOChannel_IsNonBlocking(__self) \
+    ((((IOChannelRef)__self)->mode & kOpen_NonBlocking) == kOpen_NonBlocking)
+
+
+// Returns the subset of 'events' for which the I/O channel is ready plus the
+// hangup and error conditions. Adds 'pEntry' to the poll queue of the resource
+// if 'pEntry' is not NULL. See IOResource.poll().
+extern int IOChannel_Poll(IOChannelRef _Nonnull self, int events, PollEntry* _Nullable pEntry);
+
+
+// Moves up to 'nBytesToSplice' bytes from the I/O channel 'pInChannel' to the
+// I/O channel 'pOutChannel' without passing the data through user space. The
+// resource behind 'pOutChannel' decides how the data is moved. See
+// IOResource.spliceFrom(). 'pInChannel' must be readable and 'pOutChannel' must
+// be writable. Returns EINVAL if a channel is spliced into itself or a file is
+// spliced into the same file.
+extern errno_t IOChannel_Splice(IOChannelRef _Nonnull pInChannel, IOChannelRef _Nonnull pOutChannel, ssize_t nBytesToSplice, ssize_t* _Nonnull nOutBytesSpliced);
     
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -105,6 +125,23 @@ typedef struct _IOResourceMethodTable {
     errno_t   (*read)(void* _Nonnull self, IOChannelRef _Nonnull pChannel, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nBytesRead);
     errno_t   (*write)(void* _Nonnull self, IOChannelRef _Nonnull pChannel, const void* _Nonnull pBuffer, ssize_t nBytesToWrite, ssize_t* _Nonnull nOutBytesWritten);
 
+    // Reads up to 'nBytesToSplice' bytes from 'pInChannel' and writes them to
+    // the resource through 'pChannel'. Resources which are able to read the
+    // data straight into their own storage should override this method. The
+    // abstract implementation moves the data through a kernel buffer with the
+    // help of read() and write(). It returns the number of bytes written. Bytes
+    // which were read but could not be written are lost.
+    errno_t   (*spliceFrom)(void* _Nonnull self, IOChannelRef _Nonnull pChannel, IOChannelRef _Nonnull pInChannel, ssize_t nBytesToSplice, ssize_t* _Nonnull nOutBytesSpliced);
+
+    // Returns the subset of the poll events 'events' for which 'pChannel' is
+    // ready right now plus the hangup and error conditions. Adds 'pEntry' to
+    // the resource's poll queue if 'pEntry' is not NULL. The readiness check
+    // and the enqueue must be atomic with respect to state changes of the
+    // resource. The resource signals its poll queue every time it may have
+    // become ready. The abstract implementation reports the channel as always
+    // ready. This is the right thing for resources that never block.
+    int       (*poll)(void* _Nonnull self, IOChannelRef _Nonnull pChannel, int events, PollEntry* _Nullable pEntry);
+
     // Executes the resource specific command 'cmd'.
     errno_t   (*ioctl)(void* _Nonnull self, int cmd, va_list ap);
 
@@ -133,6 +170,12 @@ Object_InvokeN(read, IOResource, __self, __pChannel, __pBuffer, __nBytesToRead,
 #define IOResource_Write(__self, __pChannel, __pBuffer, __nBytesToWrite, __nOutBytesWritten) \
 Object_InvokeN(write, IOResource, __self, __pChannel, __pBuffer, __nBytesToWrite, __nOutBytesWritten)
 
+#define IOResource_SpliceFrom(__self, __pChannel, __pInChannel, __nBytesToSplice, __nOutBytesSpliced) \
+Object_InvokeN(spliceFrom, IOResource, __self, __pChannel, __pInChannel, __nBytesToSplice, __nOutBytesSpliced)
+
+#define IOResource_Poll(__self, __pChannel, __events, __pEntry) \
+Object_InvokeN(poll, IOResource, __self, __pChannel, __events, __pEntry)
+
 #define IOResource_vIOControl(__self, __cmd, __ap) \
 Object_InvokeN(ioctl, IOResource, __self, __cmd, __ap)
 
@@ -9,6 +9,9 @@
 #include "Pipe.h"
 #include <dispatcher/ConditionVariable.h>
 #include <dispatcher/Lock.h>
+#include <dispatcher/PollQueue.h>
+#include <filesystem/Filesystem.h>
+#include <System/IOChannel.h>
 
 
 enum {
@@ -20,7 +23,13 @@ CLASS_IVARS(Pipe, IOResource,
     Lock                lock;
     ConditionVariable   reader;
     ConditionVariable   writer;
+    PollQueue           pollQueue;      // Pollers waiting for the pipe to become readable or writable
     RingBuffer          buffer;
+    size_t              lowWatermark;   // A blocked writer is woken up once the readers have drained the buffer down to this level
+    size_t              highWatermark;  // A blocked reader is woken up once the writers have filled the buffer up to this level
+    int                 readerWaitingCount; // Number of readers blocked on 'reader'
+    int                 writerWaitingCount; // Number of writers blocked on 'writer'
+    bool                isWriteReserved;    // A splice is reading data straight into the writable span of the buffer. Nobody else may write until it is done
     int8_t              readSideState;  // current state of the reader side
     int8_t              writeSideState; // current state of the writer side
 );
@@ -38,7 +47,10 @@ errno_t Pipe_Create(size_t bufferSize, PipeRef _Nullable * _Nonnull pOutPipe)
     Lock_Init(&self->lock);
     ConditionVariable_Init(&self->reader);
     ConditionVariable_Init(&self->writer);
+    PollQueue_Init(&self->pollQueue);
     try(RingBuffer_Init(&self->buffer, __max(bufferSize, 1)));
+    self->lowWatermark = self->buffer.capacity / 4;
+    self->highWatermark = self->buffer.capacity - self->lowWatermark;
     self->readSideState = kPipeState_Open;
     self->writeSideState = kPipeState_Open;
 
@@ -54,6 +66,7 @@ catch:
 void Pipe_deinit(PipeRef _Nullable self)
 {
     RingBuffer_Deinit(&self->buffer);
+    PollQueue_Deinit(&self->pollQueue);
     ConditionVariable_Deinit(&self->reader);
     ConditionVariable_Deinit(&self->writer);
     Lock_Deinit(&self->lock);
@@ -108,7 +121,8 @@ errno_t Pipe_close(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel)
     }
 
     // Always wake the reader and the writer since the close may be triggered
-    // by an unrelated 3rd process.
+    // by an unrelated 3rd process. Pollers learn about the hangup.
+    PollQueue_Wakeup(&self->pollQueue);
     ConditionVariable_BroadcastAndUnlock(&self->reader, NULL);
     ConditionVariable_BroadcastAndUnlock(&self->writer, &self->lock);
     return EOK;
@@ -118,6 +132,9 @@ errno_t Pipe_close(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel)
 // Which ever comes first. Blocks the caller if it is asking for more data than
 // is available in the pipe. Otherwise all available data is read from the pipe
 // and the amount of data read is returned.
+// A blocked writer is only woken up once the buffer has been drained down to
+// the low watermark. This way the writer can make real progress each time it
+// runs instead of being woken up for every byte that we drain.
 errno_t Pipe_read(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
     decl_try_err();
@@ -127,39 +144,60 @@ errno_t Pipe_read(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, void* _
         Lock_Lock(&self->lock);
 
         while (nBytesRead < nBytesToRead && self->readSideState == kPipeState_Open) {
-            const int nChunkSize = RingBuffer_GetBytes(&self->buffer, &((char*)pBuffer)[nBytesRead], nBytesToRead - nBytesRead);
+            const size_t nChunkSize = RingBuffer_GetBytes(&self->buffer, &((char*)pBuffer)[nBytesRead], nBytesToRead - nBytesRead);
 
             nBytesRead += nChunkSize;
-            if (nChunkSize == 0) {
-                if (self->writeSideState == kPipeState_Closed) {
-                    err = EOK;
-                    break;
+            if (nChunkSize > 0) {
+                // Note that the buffer is always below the low watermark before
+                // we go to sleep. So a blocked writer is guaranteed to be woken
+                // up before we wait for it to produce more data.
+                if (self->writerWaitingCount > 0 && RingBuffer_ReadableCount(&self->buffer) <= self->lowWatermark) {
+                    ConditionVariable_SignalAndUnlock(&self->writer, NULL);
                 }
+                continue;
+            }
+
+            if (self->writeSideState == kPipeState_Closed) {
+                err = EOK;
+                break;
+            }
                 
-                if (true /*allowBlocking*/) {
-                    // Be sure to wake the writer before we go to sleep and drop the lock
-                    // so that it can produce and add data for us.
-                    ConditionVariable_BroadcastAndUnlock(&self->writer, NULL);
-                    
-                    // Wait for the writer to make data available
-                    if ((err = ConditionVariable_Wait(&self->reader, &self->lock, kTimeInterval_Infinity)) != EOK) {
-                        err = (nBytesRead == 0) ? EINTR : EOK;
-                        break;
-                    }
-                } else {
-                    err = (nBytesRead == 0) ? EAGAIN : EOK;
+            if (!IOChannel_IsNonBlocking(pChannel)) {
+                // Wait for the writer to make data available
+                self->readerWaitingCount++;
+                err = ConditionVariable_Wait(&self->reader, &self->lock, kTimeInterval_Infinity);
+                self->readerWaitingCount--;
+
+                if (err != EOK) {
+                    err = (nBytesRead == 0) ? EINTR : EOK;
                     break;
                 }
+            } else {
+                err = (nBytesRead == 0) ? EAGAIN : EOK;
+                break;
             }
         }
 
-        Lock_Unlock(&self->lock);
+        // Let pollers know that there's space available now
+        if (nBytesRead > 0 && PollQueue_HasEntries(&self->pollQueue)) {
+            PollQueue_Wakeup(&self->pollQueue);
+        }
+
+        // Hand the data that we've left behind to the next blocked reader
+        if (self->readerWaitingCount > 0 && !RingBuffer_IsEmpty(&self->buffer)) {
+            ConditionVariable_SignalAndUnlock(&self->reader, &self->lock);
+        } else {
+            Lock_Unlock(&self->lock);
+        }
     }
 
     *nOutBytesRead = nBytesRead;
     return err;
 }
 
+// Writes up to 'nBytesToWrite' bytes to the pipe. Blocks the caller while the
+// pipe is full. A blocked reader is woken up once the buffer has been filled
+// up to the high watermark and when we are done writing.
 errno_t Pipe_write(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, const void* _Nonnull pBytes, ssize_t nBytesToWrite, ssize_t* _Nonnull nOutBytesWritten)
 {
     decl_try_err();
@@ -169,33 +207,60 @@ errno_t Pipe_write(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, const
         Lock_Lock(&self->lock);
         
         while (nBytesWritten < nBytesToWrite && self->writeSideState == kPipeState_Open) {
-            const int nChunkSize = RingBuffer_PutBytes(&self->buffer, &((char*)pBytes)[nBytesWritten], nBytesToWrite - nBytesWritten);
+            const size_t nChunkSize = (!self->isWriteReserved) ? RingBuffer_PutBytes(&self->buffer, &((const char*)pBytes)[nBytesWritten], nBytesToWrite - nBytesWritten) : 0;
             
             nBytesWritten += nChunkSize;
-            if (nChunkSize == 0) {
-                if (self->readSideState == kPipeState_Closed) {
-                    err = (nBytesWritten == 0) ? EPIPE : EOK;
-                    break;
+            if (nChunkSize > 0) {
+                // Note that the buffer is always above the high watermark before
+                // we go to sleep unless a splice holds the write reservation.
+                // So a blocked reader is guaranteed to be woken up before we wait
+                // for it to consume data. The splice wakes the reader itself.
+                if (self->readerWaitingCount > 0 && RingBuffer_ReadableCount(&self->buffer) >= self->highWatermark) {
+                    ConditionVariable_SignalAndUnlock(&self->reader, NULL);
                 }
+                continue;
+            }
+
+            if (self->readSideState == kPipeState_Closed) {
+                err = (nBytesWritten == 0) ? EPIPE : EOK;
+                break;
+            }
 
-                if (true /*allowBlocking*/) {
-                    // Be sure to wake the reader before we go to sleep and drop the lock
-                    // so that it can consume data and make space available to us.
-                    ConditionVariable_BroadcastAndUnlock(&self->reader, NULL);
-                    
-                    // Wait for the reader to make space available
-                    if (( err = ConditionVariable_Wait(&self->writer, &self->lock, kTimeInterval_Infinity)) != EOK) {
-                        err = (nBytesWritten == 0) ? EINTR : EOK;
-                        break;
-                    }
-                } else {
-                    err = (nBytesWritten == 0) ? EAGAIN : EOK;
+            if (!IOChannel_IsNonBlocking(pChannel)) {
+                // Wait for the reader to make space available
+                self->writerWaitingCount++;
+                err = ConditionVariable_Wait(&self->writer, &self->lock, kTimeInterval_Infinity);
+                self->writerWaitingCount--;
+
+                if (err != EOK) {
+                    err = (nBytesWritten == 0) ? EINTR : EOK;
                     break;
                 }
+            } else {
+                err = (nBytesWritten == 0) ? EAGAIN : EOK;
+                break;
             }
         }
 
-        Lock_Unlock(&self->lock);
+        // Let pollers know that there's data available now
+        if (nBytesWritten > 0 && PollQueue_HasEntries(&self->pollQueue)) {
+            PollQueue_Wakeup(&self->pollQueue);
+        }
+
+        // Let a blocked reader consume what we've written and hand the space
+        // that we've left behind to the next blocked writer
+        const bool wakeReader = (self->readerWaitingCount > 0 && !RingBuffer_IsEmpty(&self->buffer));
+        const bool wakeWriter = (self->writerWaitingCount > 0 && RingBuffer_WritableCount(&self->buffer) > 0);
+
+        if (wakeWriter) {
+            ConditionVariable_SignalAndUnlock(&self->writer, (wakeReader) ? NULL : &self->lock);
+        }
+        if (wakeReader) {
+            ConditionVariable_SignalAndUnlock(&self->reader, &self->lock);
+        }
+        if (!wakeReader && !wakeWriter) {
+            Lock_Unlock(&self->lock);
+        }
     }
 
     *nOutBytesWritten = nBytesWritten;    
@@ -203,11 +268,128 @@ errno_t Pipe_write(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, const
 }
 
 
+// Reads up to 'nBytesToSplice' bytes from 'pInChannel' straight into the pipe
+// buffer. The splice reserves the contiguous free span of the buffer, drops the
+// pipe lock and then reads into the span. Readers continue to consume the data
+// in front of the span in the meantime while other writers wait for the splice
+// to finish. A file read drops whole blocks directly into the pipe buffer this
+// way. Input channels which are not files are spliced through a kernel buffer
+// because a read from a pipe or a device may block indefinitely.
+errno_t Pipe_spliceFrom(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, IOChannelRef _Nonnull pInChannel, ssize_t nBytesToSplice, ssize_t* _Nonnull nOutBytesSpliced)
+{
+    decl_try_err();
+    ssize_t nBytesSpliced = 0;
+
+    if (!Object_InstanceOf(IOChannel_GetResource(pInChannel), Filesystem)) {
+        return Object_SuperN(spliceFrom, IOResource, self, pChannel, pInChannel, nBytesToSplice, nOutBytesSpliced);
+    }
+
+    Lock_Lock(&self->lock);
+        
+    while (nBytesSpliced < nBytesToSplice && self->writeSideState == kPipeState_Open) {
+        char* pSpan;
+        const size_t nSpanSize = (!self->isWriteReserved) ? RingBuffer_GetWritableSpan(&self->buffer, &pSpan) : 0;
+
+        if (nSpanSize == 0) {
+            if (self->readSideState == kPipeState_Closed) {
+                err = (nBytesSpliced == 0) ? EPIPE : EOK;
+                break;
+            }
+            if (IOChannel_IsNonBlocking(pChannel)) {
+                err = (nBytesSpliced == 0) ? EAGAIN : EOK;
+                break;
+            }
+
+            // Wait for the reader to make space available
+            self->writerWaitingCount++;
+            err = ConditionVariable_Wait(&self->writer, &self->lock, kTimeInterval_Infinity);
+            self->writerWaitingCount--;
+
+            if (err != EOK) {
+                err = (nBytesSpliced == 0) ? EINTR : EOK;
+                break;
+            }
+            continue;
+        }
+
+        ssize_t nChunkBytesRead = 0;
+        self->isWriteReserved = true;
+        Lock_Unlock(&self->lock);
+        const errno_t e1 = IOChannel_Read(pInChannel, pSpan, __min(nSpanSize, nBytesToSplice - nBytesSpliced), &nChunkBytesRead);
+        Lock_Lock(&self->lock);
+        self->isWriteReserved = false;
+
+        RingBuffer_CommitWrite(&self->buffer, nChunkBytesRead);
+        nBytesSpliced += nChunkBytesRead;
+
+        // Every chunk is a (potentially slow) read of the input channel. So let
+        // a blocked reader have the data right away
+        if (nChunkBytesRead > 0 && self->readerWaitingCount > 0) {
+            ConditionVariable_SignalAndUnlock(&self->reader, NULL);
+        }
+        if (nChunkBytesRead > 0 && PollQueue_HasEntries(&self->pollQueue)) {
+            PollQueue_Wakeup(&self->pollQueue);
+        }
+        if (e1 != EOK) {
+            err = (nBytesSpliced == 0) ? e1 : EOK;
+            break;
+        }
+        if (nChunkBytesRead == 0) {
+            // EOF
+            break;
+        }
+    }
+
+    // Hand the space that we've left behind to the next blocked writer or
+    // poller. It may have been waiting for our reservation to go away
+    if (PollQueue_HasEntries(&self->pollQueue)) {
+        PollQueue_Wakeup(&self->pollQueue);
+    }
+    if (self->writerWaitingCount > 0 && RingBuffer_WritableCount(&self->buffer) > 0) {
+        ConditionVariable_SignalAndUnlock(&self->writer, &self->lock);
+    } else {
+        Lock_Unlock(&self->lock);
+    }
+
+    *nOutBytesSpliced = nBytesSpliced;
+    return err;
+}
+
+// The read side of the pipe is readable if data is buffered or if the write
+// side has been closed. The write side is writable if there's free space in the
+// buffer that isn't reserved by a splice. A side hangs up once the other side
+// has been closed.
+int Pipe_poll(PipeRef _Nonnull self, IOChannelRef _Nonnull pChannel, int events, PollEntry* _Nullable pEntry)
+{
+    const bool isReadSide = ((IOChannel_GetMode(pChannel) & kOpen_ReadWrite) == kOpen_Read);
+    int revents = 0;
+
+    Lock_Lock(&self->lock);
+    if ((events & kPollEvent_Readable) != 0 && (!RingBuffer_IsEmpty(&self->buffer) || self->writeSideState == kPipeState_Closed)) {
+        revents |= kPollEvent_Readable;
+    }
+    if ((events & kPollEvent_Writable) != 0 && !self->isWriteReserved && RingBuffer_WritableCount(&self->buffer) > 0) {
+        revents |= kPollEvent_Writable;
+    }
+    if ((isReadSide && self->writeSideState == kPipeState_Closed) || (!isReadSide && self->readSideState == kPipeState_Closed)) {
+        revents |= kPollEvent_Hangup;
+    }
+
+    if (pEntry) {
+        PollQueue_Add(&self->pollQueue, pEntry);
+    }
+    Lock_Unlock(&self->lock);
+
+    return revents;
+}
+
 CLASS_METHODS(Pipe, IOResource,
 OVERRIDE_METHOD_IMPL(open, Pipe, IOResource)
 OVERRIDE_METHOD_IMPL(dup, Pipe, IOResource)
 OVERRIDE_METHOD_IMPL(close, Pipe, IOResource)
 OVERRIDE_METHOD_IMPL(read, Pipe, IOResource)
 OVERRIDE_METHOD_IMPL(write, Pipe, IOResource)
+OVERRIDE_METHOD_IMPL(spliceFrom, Pipe, IOResource)
+OVERRIDE_METHOD_IMPL(poll, Pipe, IOResource)
 OVERRIDE_METHOD_IMPL(deinit, Pipe, Object)
 );
@@ -15,6 +15,9 @@
 // Recommended pipe buffer size
 #define kPipe_DefaultBufferSize 256
 
+// Largest pipe buffer size that user space may request
+#define kPipe_MaxBufferSize     65536
+
 
 OPAQUE_CLASS(Pipe, IOResource);
 typedef struct _PipeMethodTable {
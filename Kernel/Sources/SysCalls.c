@@ -6,11 +6,15 @@
 //  Copyright © 2021 Dietmar Planitzer. All rights reserved.
 //
 
+#include <dispatcher/Trace.h>
 #include <dispatcher/VirtualProcessor.h>
 #include <dispatchqueue/DispatchQueue.h>
 #include <driver/DriverManager.h>
 #include <process/Process.h>
+#include <process/ProcessManager.h>
 #include "IOResource.h"
+#include "Pipe.h"
+#include <System/Clock.h>
 
 typedef intptr_t (*SystemCall)(void* _Nonnull);
 
@@ -117,13 +121,14 @@ SYSCALL_2(opendir, const char* _Nullable path, int* _Nullable pOutIoc)
     return Process_OpenDirectory(Process_GetCurrent(), pArgs->path, pArgs->pOutIoc);
 }
 
-SYSCALL_2(mkpipe, int* _Nullable  pOutReadChannel, int* _Nullable  pOutWriteChannel)
+SYSCALL_3(mkpipe, int* _Nullable  pOutReadChannel, int* _Nullable  pOutWriteChannel, size_t bufferSize)
 {
-    if (pArgs->pOutReadChannel == NULL || pArgs->pOutWriteChannel == NULL) {
+    if (pArgs->pOutReadChannel == NULL || pArgs->pOutWriteChannel == NULL || pArgs->bufferSize > kPipe_MaxBufferSize) {
         return EINVAL;
     }
 
-    return Process_CreatePipe(Process_GetCurrent(), pArgs->pOutReadChannel, pArgs->pOutWriteChannel);
+    const size_t bufferSize = (pArgs->bufferSize > 0) ? pArgs->bufferSize : kPipe_DefaultBufferSize;
+    return Process_CreatePipe(Process_GetCurrent(), bufferSize, pArgs->pOutReadChannel, pArgs->pOutWriteChannel);
 }
 
 SYSCALL_1(close, int ioc)
@@ -152,6 +157,15 @@ SYSCALL_4(read, int ioc, void* _Nonnull buffer, size_t nBytesToRead, ssize_t* _N
     return err;
 }
 
+SYSCALL_3(read_async, int ioc, int od, IOChannelAsyncRequest* _Nullable pRequest)
+{
+    if (pArgs->pRequest == NULL) {
+        return EINVAL;
+    }
+
+    return Process_ReadWriteAsync(Process_GetCurrent(), pArgs->ioc, pArgs->od, pArgs->pRequest, false);
+}
+
 SYSCALL_4(write, int ioc, const void* _Nonnull buffer, size_t nBytesToWrite, ssize_t* _Nonnull nBytesWritten)
 {
     decl_try_err();
@@ -164,6 +178,47 @@ SYSCALL_4(write, int ioc, const void* _Nonnull buffer, size_t nBytesToWrite, ssi
     return err;
 }
 
+SYSCALL_3(write_async, int ioc, int od, IOChannelAsyncRequest* _Nullable pRequest)
+{
+    if (pArgs->pRequest == NULL) {
+        return EINVAL;
+    }
+
+    return Process_ReadWriteAsync(Process_GetCurrent(), pArgs->ioc, pArgs->od, pArgs->pRequest, true);
+}
+
+SYSCALL_5(splice, int iocIn, int iocOut, size_t nBytesToSplice, unsigned int flags, ssize_t* _Nullable nBytesSpliced)
+{
+    decl_try_err();
+    IOChannelRef pInChannel = NULL, pOutChannel = NULL;
+
+    if (pArgs->nBytesSpliced == NULL || pArgs->flags != 0) {
+        return EINVAL;
+    }
+    *(pArgs->nBytesSpliced) = 0;
+
+    try(Process_CopyIOChannelForDescriptor(Process_GetCurrent(), pArgs->iocIn, &pInChannel));
+    try(Process_CopyIOChannelForDescriptor(Process_GetCurrent(), pArgs->iocOut, &pOutChannel));
+    err = IOChannel_Splice(pInChannel, pOutChannel, __SSizeByClampingSize(pArgs->nBytesToSplice), pArgs->nBytesSpliced);
+
+catch:
+    Object_Release(pOutChannel);
+    Object_Release(pInChannel);
+    return err;
+}
+
+SYSCALL_4(poll, IOChannelPollEntry* _Nullable entries, int count, TimeInterval timeout, int* _Nullable nReadyCount)
+{
+    if ((pArgs->entries == NULL && pArgs->count > 0) || pArgs->nReadyCount == NULL) {
+        return EINVAL;
+    }
+    if (pArgs->timeout.tv_nsec < 0 || pArgs->timeout.tv_nsec >= ONE_SECOND_IN_NANOS) {
+        return EINVAL;
+    }
+
+    return Process_Poll(Process_GetCurrent(), pArgs->entries, pArgs->count, pArgs->timeout, pArgs->nReadyCount);
+}
+
 SYSCALL_4(seek, int ioc, FileOffset offset, FileOffset* _Nullable pOutOldPosition, int whence)
 {
     decl_try_err();
@@ -312,12 +367,43 @@ SYSCALL_1(get_monotonic_time, TimeInterval* _Nullable time)
     return EOK;
 }
 
-SYSCALL_4(dispatch, int od, unsigned long options, const Closure1Arg_Func _Nullable pUserClosure, void* _Nullable pContext)
+SYSCALL_1(get_monotonic_clock_info, MonotonicClockInfo* _Nullable pOutInfo)
+{
+    if (pArgs->pOutInfo == NULL) {
+        return EINVAL;
+    }
+
+    pArgs->pOutInfo->interruptCount = MonotonicClock_GetInterruptCount();
+    pArgs->pOutInfo->isTickless = MonotonicClock_IsTickless();
+    return EOK;
+}
+
+// Batch: 'pContext' points to an array of 'arg' Dispatch_Work entries and
+//        'pUserClosure' is unused
+// Apply: 'pUserClosure' is a Dispatch_ApplyClosure which is invoked 'arg' times
+// Group: 'arg' is the descriptor of the dispatch group the closure belongs to
+SYSCALL_5(dispatch, int od, unsigned long options, const Closure1Arg_Func _Nullable pUserClosure, void* _Nullable pContext, uintptr_t arg)
 {
+    if ((pArgs->options & kDispatchOption_Batch) == kDispatchOption_Batch) {
+        if (pArgs->pContext == NULL && pArgs->arg > 0) {
+            return EINVAL;
+        }
+
+        return Process_DispatchUserClosureBatch(Process_GetCurrent(), pArgs->od, (const Dispatch_Work*)pArgs->pContext, pArgs->arg);
+    }
+
     if (pArgs->pUserClosure == NULL) {
         return EINVAL;
     }
 
+    if ((pArgs->options & kDispatchOption_Apply) == kDispatchOption_Apply) {
+        return Process_DispatchUserApply(Process_GetCurrent(), pArgs->od, pArgs->arg, (Dispatch_ApplyClosure)pArgs->pUserClosure, pArgs->pContext);
+    }
+
+    if ((pArgs->options & kDispatchOption_Group) == kDispatchOption_Group) {
+        return Process_DispatchUserClosureInGroup(Process_GetCurrent(), pArgs->od, (int)pArgs->arg, pArgs->pUserClosure, pArgs->pContext);
+    }
+
     return Process_DispatchUserClosure(Process_GetCurrent(), pArgs->od, pArgs->options, pArgs->pUserClosure, pArgs->pContext);
 }
 
@@ -344,6 +430,85 @@ SYSCALL_0(dispatch_queue_current)
     return Process_GetCurrentDispatchQueue(Process_GetCurrent());
 }
 
+SYSCALL_1(dispatch_group_create, int* _Nullable pOutGroup)
+{
+    if (pArgs->pOutGroup == NULL) {
+        return EINVAL;
+    }
+
+    return Process_CreateDispatchGroup(Process_GetCurrent(), pArgs->pOutGroup);
+}
+
+SYSCALL_1(dispatch_group_enter, int gd)
+{
+    return Process_EnterLeaveDispatchGroup(Process_GetCurrent(), pArgs->gd, true);
+}
+
+SYSCALL_1(dispatch_group_leave, int gd)
+{
+    return Process_EnterLeaveDispatchGroup(Process_GetCurrent(), pArgs->gd, false);
+}
+
+SYSCALL_2(dispatch_group_wait, int gd, TimeInterval deadline)
+{
+    return Process_WaitDispatchGroup(Process_GetCurrent(), pArgs->gd, pArgs->deadline);
+}
+
+SYSCALL_4(dispatch_group_notify, int gd, int od, const Closure1Arg_Func _Nullable pUserClosure, void* _Nullable pContext)
+{
+    if (pArgs->pUserClosure == NULL) {
+        return EINVAL;
+    }
+
+    return Process_NotifyDispatchGroup(Process_GetCurrent(), pArgs->gd, pArgs->od, pArgs->pUserClosure, pArgs->pContext);
+}
+
+SYSCALL_5(dispatch_source_create, int od, const Dispatch_SourceParams* _Nullable pParams, Dispatch_SourceClosure _Nullable pUserClosure, void* _Nullable pContext, int* _Nullable pOutSource)
+{
+    const Dispatch_SourceParams* pParams = pArgs->pParams;
+
+    if (pParams == NULL || pArgs->pUserClosure == NULL || pArgs->pOutSource == NULL) {
+        return EINVAL;
+    }
+    if (pParams->type == kDispatchSourceType_Timer
+        && (pParams->deadline.tv_nsec < 0 || pParams->deadline.tv_nsec >= ONE_SECOND_IN_NANOS
+            || pParams->interval.tv_nsec < 0 || pParams->interval.tv_nsec >= ONE_SECOND_IN_NANOS
+            || TimeInterval_IsNegative(pParams->interval))) {
+        return EINVAL;
+    }
+
+    return Process_CreateDispatchSource(Process_GetCurrent(), pArgs->od, pParams, pArgs->pUserClosure, pArgs->pContext, pArgs->pOutSource);
+}
+
+// The DispatchSync() benchmark is only available in DEBUG builds. The slot in
+// the system call table is kept in release builds to keep the numbering stable.
+SYSCALL_3(dispatch_sync_benchmark, int count, TimeInterval* _Nullable pOutInlineTime, TimeInterval* _Nullable pOutQueuedTime)
+{
+#if DEBUG
+    if (pArgs->count < 0 || pArgs->pOutInlineTime == NULL || pArgs->pOutQueuedTime == NULL) {
+        return EINVAL;
+    }
+
+    return DispatchQueue_BenchmarkSync(Process_GetCurrent(), pArgs->count, pArgs->pOutInlineTime, pArgs->pOutQueuedTime);
+#else
+    return ENOSYS;
+#endif
+}
+
+SYSCALL_1(trace_enable, int enabled)
+{
+    return Trace_SetEnabled(pArgs->enabled != 0);
+}
+
+SYSCALL_3(trace_snapshot, TraceEvent* _Nullable pBuffer, size_t bufferCount, size_t* _Nullable pOutCount)
+{
+    if ((pArgs->pBuffer == NULL && pArgs->bufferCount > 0) || pArgs->pOutCount == NULL) {
+        return EINVAL;
+    }
+
+    return Trace_Snapshot(pArgs->pBuffer, pArgs->bufferCount, pArgs->pOutCount);
+}
+
 SYSCALL_1(dispose, int od)
 {
     return Process_DisposePrivateResource(Process_GetCurrent(), pArgs->od);
@@ -419,6 +584,26 @@ SYSCALL_2(waitpid, ProcessId pid, ProcessTerminationStatus* _Nullable pOutStatus
     return Process_WaitForTerminationOfChild(Process_GetCurrent(), pArgs->pid, pArgs->pOutStatus);
 }
 
+SYSCALL_2(getprocinfo, ProcessId pid, ProcessInfo* _Nullable pOutInfo)
+{
+    if (pArgs->pOutInfo == NULL) {
+        return EINVAL;
+    }
+
+    ProcessRef pProc = ProcessManager_CopyProcessForPid(gProcessManager, pArgs->pid);
+    if (pProc == NULL) {
+        // Let the caller continue an enumeration past a process that has exited
+        pArgs->pOutInfo->nextPid = ProcessManager_GetNextPid(gProcessManager, pArgs->pid);
+        return ESRCH;
+    }
+
+    Process_GetInfo(pProc, pArgs->pOutInfo);
+    pArgs->pOutInfo->nextPid = ProcessManager_GetNextPid(gProcessManager, pArgs->pid);
+    Object_Release(pProc);
+
+    return EOK;
+}
+
 
 SystemCall gSystemCallTable[] = {
     REF_SYSCALL(read),
@@ -459,4 +644,19 @@ SystemCall gSystemCallTable[] = {
     REF_SYSCALL(dispatch_queue_current),
     REF_SYSCALL(dispose),
     REF_SYSCALL(get_monotonic_time),
+    REF_SYSCALL(dispatch_group_create),
+    REF_SYSCALL(dispatch_group_enter),
+    REF_SYSCALL(dispatch_group_leave),
+    REF_SYSCALL(dispatch_group_wait),
+    REF_SYSCALL(dispatch_group_notify),
+    REF_SYSCALL(trace_enable),
+    REF_SYSCALL(trace_snapshot),
+    REF_SYSCALL(getprocinfo),
+    REF_SYSCALL(splice),
+    REF_SYSCALL(poll),
+    REF_SYSCALL(dispatch_source_create),
+    REF_SYSCALL(read_async),
+    REF_SYSCALL(write_async),
+    REF_SYSCALL(dispatch_sync_benchmark),
+    REF_SYSCALL(get_monotonic_clock_info),
 };
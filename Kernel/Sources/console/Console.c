@@ -740,21 +740,28 @@ static void Console_ReadReports_NonBlocking_Locked(ConsoleRef _Nonnull pConsole,
     *nOutBytesRead = nBytesRead;
 }
 
+// Reads key events and maps them to byte sequences. Blocks until the first
+// byte is available unless the channel is in non-blocking mode. Stops as soon
+// as no more events are queued once at least one byte has been read.
 static errno_t Console_ReadEvents_Locked(ConsoleRef _Nonnull pConsole, ConsoleChannelRef _Nonnull pChannel, char* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
     decl_try_err();
     HIDEvent evt;
     ssize_t nBytesRead = 0;
     ssize_t nEvtBytesRead;
+    const bool isNonBlocking = IOChannel_IsNonBlocking(pChannel);
 
     while (nBytesRead < nBytesToRead) {
+        if ((nBytesRead > 0 || isNonBlocking) && IOChannel_Poll(pConsole->eventDriverChannel, kPollEvent_Readable, NULL) == 0) {
+            err = (nBytesRead == 0) ? EAGAIN : EOK;
+            break;
+        }
+
         // Drop the console lock while getting an event since the get events call
         // may block and holding the lock while being blocked for a potentially
         // long time would prevent any other process from working with the
         // console
         Lock_Unlock(&pConsole->lock);
-        // XXX Need an API that allows me to read as many events as possible without blocking and that only blocks if there are no events available
-        // XXX Or, probably, that's how the event driver read() should work in general
         const errno_t e1 = IOChannel_Read(pConsole->eventDriverChannel, &evt, sizeof(evt), &nEvtBytesRead);
         Lock_Lock(&pConsole->lock);
         // XXX we are currently assuming here that no relevant console state has
@@ -792,7 +799,8 @@ static errno_t Console_ReadEvents_Locked(ConsoleRef _Nonnull pConsole, ConsoleCh
 // Note that this read implementation will only block if there is no buffered
 // data, no terminal reports and no events are available. It tries to do a
 // non-blocking read as hard as possible even if it can't fully fill the user
-// provided buffer. 
+// provided buffer. Returns EAGAIN instead of blocking if the channel is in
+// non-blocking mode.
 errno_t Console_read(ConsoleRef _Nonnull pConsole, ConsoleChannelRef _Nonnull pChannel, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
     decl_try_err();
@@ -859,11 +867,31 @@ errno_t Console_write(ConsoleRef _Nonnull pConsole, ConsoleChannelRef _Nonnull p
     return EOK;
 }
 
+// The console is readable if buffered key bytes, terminal reports or input
+// events are available. Note that not every input event produces bytes. A read
+// may thus still return EAGAIN after the console was reported as readable. The
+// console is always writable. Pollers are only woken up by input events. Not
+// by terminal reports since those are generated by writes of the reader itself.
+int Console_poll(ConsoleRef _Nonnull pConsole, ConsoleChannelRef _Nonnull pChannel, int events, PollEntry* _Nullable pEntry)
+{
+    int revents = events & kPollEvent_Writable;
+
+    Lock_Lock(&pConsole->lock);
+    if (pChannel->rdCount > 0 || !RingBuffer_IsEmpty(&pConsole->reportsQueue)) {
+        revents |= events & kPollEvent_Readable;
+    }
+    Lock_Unlock(&pConsole->lock);
+
+    revents |= IOChannel_Poll(pConsole->eventDriverChannel, events & kPollEvent_Readable, pEntry);
+    return revents;
+}
+
 
 CLASS_METHODS(Console, IOResource,
 OVERRIDE_METHOD_IMPL(open, Console, IOResource)
 OVERRIDE_METHOD_IMPL(dup, Console, IOResource)
 OVERRIDE_METHOD_IMPL(read, Console, IOResource)
 OVERRIDE_METHOD_IMPL(write, Console, IOResource)
+OVERRIDE_METHOD_IMPL(poll, Console, IOResource)
 OVERRIDE_METHOD_IMPL(deinit, Console, Object)
 );
@@ -0,0 +1,220 @@
+//
+//  PollQueue.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/14/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "PollQueue.h"
+#include "VirtualProcessorScheduler.h"
+
+
+void PollWaiter_Init(PollWaiter* _Nonnull pWaiter)
+{
+    List_Init(&pWaiter->wait_queue);
+    SList_Init(&pWaiter->pending);
+    pWaiter->signalCount = 0;
+}
+
+void PollWaiter_Deinit(PollWaiter* _Nonnull pWaiter)
+{
+    assert(List_IsEmpty(&pWaiter->wait_queue));
+    List_Deinit(&pWaiter->wait_queue);
+    // A waiter that never looks at its pending list may still have entries on
+    // it. The entries are owned by the caller
+    SList_Deinit(&pWaiter->pending);
+}
+
+// Blocks the caller until the waiter has been signaled or 'deadline' has passed.
+// Returns EOK if the waiter was signaled and ETIMEDOUT or EINTR otherwise.
+// Consumes all pending signals.
+errno_t PollWaiter_Wait(PollWaiter* _Nonnull pWaiter, TimeInterval deadline)
+{
+    decl_try_err();
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+
+    while (pWaiter->signalCount == 0) {
+        err = VirtualProcessorScheduler_WaitOn(gVirtualProcessorScheduler, &pWaiter->wait_queue, deadline, true);
+        if (err != EOK) {
+            break;
+        }
+    }
+
+    // A signal that races with a timeout wins
+    if (pWaiter->signalCount > 0) {
+        err = EOK;
+    }
+    pWaiter->signalCount = 0;
+
+    VirtualProcessorScheduler_RestorePreemption(sps);
+    return err;
+}
+
+// Signals the given waiter and returns the virtual processor that was blocked
+// on it, if any. Expects to be called with preemption disabled.
+static VirtualProcessor* _Nullable PollWaiter_Signal_Locked(PollWaiter* _Nonnull pWaiter)
+{
+    VirtualProcessor* pVP = (VirtualProcessor*)pWaiter->wait_queue.first;
+
+    pWaiter->signalCount++;
+    if (pVP) {
+        VirtualProcessorScheduler_WakeUpOne(gVirtualProcessorScheduler, &pWaiter->wait_queue, pVP, WAKEUP_REASON_FINISHED, false);
+    }
+    return pVP;
+}
+
+// Signals the waiter without marking any of its entries as pending.
+void PollWaiter_Signal(PollWaiter* _Nonnull pWaiter)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+    VirtualProcessor* pVP = PollWaiter_Signal_Locked(pWaiter);
+
+    if (pVP && pVP->state == kVirtualProcessorState_Ready && pVP->suspension_count == 0) {
+        VirtualProcessorScheduler_MaybeSwitchTo(gVirtualProcessorScheduler, pVP);
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+// Removes the oldest signaled entry from the pending list of the waiter and
+// returns it. Returns NULL if no entry is pending.
+PollEntry* _Nullable PollWaiter_RemoveFirstPending(PollWaiter* _Nonnull pWaiter)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+    SListNode* pNode = SList_RemoveFirst(&pWaiter->pending);
+    PollEntry* pEntry = NULL;
+
+    if (pNode) {
+        pEntry = PollEntryFromPendingNode(pNode);
+        pEntry->isPending = false;
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+    return pEntry;
+}
+
+// Removes the given entry from the pending list of the waiter if it is on it.
+void PollWaiter_RemovePending(PollWaiter* _Nonnull pWaiter, PollEntry* _Nonnull pEntry)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+
+    if (pEntry->isPending) {
+        SListNode* pPrevNode = NULL;
+        SListNode* pCurNode = pWaiter->pending.first;
+
+        while (pCurNode && pCurNode != &pEntry->pending_node) {
+            pPrevNode = pCurNode;
+            pCurNode = pCurNode->next;
+        }
+        if (pCurNode) {
+            SList_Remove(&pWaiter->pending, pPrevNode, pCurNode);
+        }
+        pEntry->isPending = false;
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+void PollEntry_Init(PollEntry* _Nonnull pEntry, PollWaiter* _Nonnull pWaiter)
+{
+    ListNode_Init(&pEntry->node);
+    SListNode_Init(&pEntry->pending_node);
+    pEntry->waiter = pWaiter;
+    pEntry->queue = NULL;
+    pEntry->isPending = false;
+}
+
+// Puts the entry on the pending list of its waiter and signals the waiter.
+// Expects to be called with preemption disabled.
+static VirtualProcessor* _Nullable PollEntry_Signal_Locked(PollEntry* _Nonnull pEntry)
+{
+    PollWaiter* pWaiter = pEntry->waiter;
+
+    if (!pEntry->isPending) {
+        SList_InsertAfterLast(&pWaiter->pending, &pEntry->pending_node);
+        pEntry->isPending = true;
+    }
+    return PollWaiter_Signal_Locked(pWaiter);
+}
+
+// Marks the entry as pending and signals its waiter. This is the same thing a
+// poll queue does to its entries when the resource changes state.
+void PollEntry_Signal(PollEntry* _Nonnull pEntry)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+    VirtualProcessor* pVP = PollEntry_Signal_Locked(pEntry);
+
+    if (pVP && pVP->state == kVirtualProcessorState_Ready && pVP->suspension_count == 0) {
+        VirtualProcessorScheduler_MaybeSwitchTo(gVirtualProcessorScheduler, pVP);
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+
+void PollQueue_Init(PollQueue* _Nonnull pQueue)
+{
+    List_Init(&pQueue->entries);
+}
+
+void PollQueue_Deinit(PollQueue* _Nonnull pQueue)
+{
+    assert(List_IsEmpty(&pQueue->entries));
+    List_Deinit(&pQueue->entries);
+}
+
+// Adds the given poll entry to the queue. Does nothing if the entry is already
+// on a queue.
+void PollQueue_Add(PollQueue* _Nonnull pQueue, PollEntry* _Nonnull pEntry)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+
+    if (pEntry->queue == NULL) {
+        List_InsertAfterLast(&pQueue->entries, &pEntry->node);
+        pEntry->queue = pQueue;
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+// Removes the given poll entry from the queue that it is on.
+void PollQueue_Remove(PollEntry* _Nonnull pEntry)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+
+    if (pEntry->queue) {
+        List_Remove(&pEntry->queue->entries, &pEntry->node);
+        pEntry->queue = NULL;
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+// Signals all poll waiters on the queue. Their entries stay on the queue. The
+// context switch to a woken up waiter is deferred until we are done walking
+// the queue because the waiter is free to remove its entry once it runs.
+void PollQueue_Wakeup(PollQueue* _Nonnull pQueue)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+    VirtualProcessor* pRunCandidate = NULL;
+
+    List_ForEach(&pQueue->entries, PollEntry, {
+        VirtualProcessor* pVP = PollEntry_Signal_Locked(pCurNode);
+
+        if (pRunCandidate == NULL && pVP && pVP->state == kVirtualProcessorState_Ready && pVP->suspension_count == 0) {
+            pRunCandidate = pVP;
+        }
+    });
+
+    if (pRunCandidate) {
+        VirtualProcessorScheduler_MaybeSwitchTo(gVirtualProcessorScheduler, pRunCandidate);
+    }
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+// Same as PollQueue_Wakeup() but for use from an interrupt context. Does not
+// trigger an immediate context switch.
+void PollQueue_WakeupFromInterruptContext(PollQueue* _Nonnull pQueue)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+
+    List_ForEach(&pQueue->entries, PollEntry, {
+        (void) PollEntry_Signal_Locked(pCurNode);
+    });
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
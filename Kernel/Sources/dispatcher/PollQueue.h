@@ -0,0 +1,100 @@
+//
+//  PollQueue.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/14/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef PollQueue_h
+#define PollQueue_h
+
+#include <klib/klib.h>
+
+
+// A poll waiter represents a virtual processor that waits for one of many I/O
+// resources to change state. The waiter is signaled by the resources through
+// poll entries. A signal that arrives while the waiter isn't blocked yet is
+// remembered and ends the next wait right away. The waiter additionally keeps
+// track of the entries that have been signaled since they were last taken off
+// its pending list. This allows a single waiter to serve many resources without
+// having to re-poll all of them on every wakeup.
+typedef struct _PollWaiter {
+    List            wait_queue;
+    SList           pending;
+    volatile int    signalCount;
+} PollWaiter;
+
+
+struct _PollQueue;
+
+// A poll entry connects a poll waiter to the poll queue of a single resource.
+// An entry is on at most one poll queue at a time.
+typedef struct _PollEntry {
+    ListNode                            node;
+    SListNode                           pending_node;   // On the pending list of the waiter while signaled
+    PollWaiter* _Nonnull                waiter;
+    struct _PollQueue* _Nullable        queue;
+    bool                                isPending;
+} PollEntry;
+
+#define PollEntryFromPendingNode(__pNode) \
+    ((PollEntry*)(((char*)(__pNode)) - offsetof(PollEntry, pending_node)))
+
+
+// A poll queue is a per-resource list of poll entries. A resource signals its
+// poll queue every time it becomes readable or writable or is closed. All
+// functions may be called with IRQs disabled.
+typedef struct _PollQueue {
+    List    entries;
+} PollQueue;
+
+
+extern void PollWaiter_Init(PollWaiter* _Nonnull pWaiter);
+extern void PollWaiter_Deinit(PollWaiter* _Nonnull pWaiter);
+
+// Blocks the caller until the waiter has been signaled or 'deadline' has passed.
+// Returns EOK if the waiter was signaled and ETIMEDOUT or EINTR otherwise.
+// Consumes all pending signals.
+extern errno_t PollWaiter_Wait(PollWaiter* _Nonnull pWaiter, TimeInterval deadline);
+
+// Signals the waiter without marking any of its entries as pending.
+extern void PollWaiter_Signal(PollWaiter* _Nonnull pWaiter);
+
+// Removes the oldest signaled entry from the pending list of the waiter and
+// returns it. Returns NULL if no entry is pending.
+extern PollEntry* _Nullable PollWaiter_RemoveFirstPending(PollWaiter* _Nonnull pWaiter);
+
+// Removes the given entry from the pending list of the waiter if it is on it.
+extern void PollWaiter_RemovePending(PollWaiter* _Nonnull pWaiter, PollEntry* _Nonnull pEntry);
+
+
+extern void PollEntry_Init(PollEntry* _Nonnull pEntry, PollWaiter* _Nonnull pWaiter);
+
+// Marks the entry as pending and signals its waiter. This is the same thing a
+// poll queue does to its entries when the resource changes state.
+extern void PollEntry_Signal(PollEntry* _Nonnull pEntry);
+
+
+extern void PollQueue_Init(PollQueue* _Nonnull pQueue);
+extern void PollQueue_Deinit(PollQueue* _Nonnull pQueue);
+
+// Adds the given poll entry to the queue. Does nothing if the entry is already
+// on a queue.
+extern void PollQueue_Add(PollQueue* _Nonnull pQueue, PollEntry* _Nonnull pEntry);
+
+// Removes the given poll entry from the queue that it is on.
+extern void PollQueue_Remove(PollEntry* _Nonnull pEntry);
+
+// Returns true if at least one poll entry is on the queue.
+#define PollQueue_HasEntries(__pQueue) \
+    !List_IsEmpty(&(__pQueue)->entries)
+
+// Signals all poll waiters on the queue. Their entries stay on the queue.
+extern void PollQueue_Wakeup(PollQueue* _Nonnull pQueue);
+
+// Same as PollQueue_Wakeup() but for use from an interrupt context. Does not
+// trigger an immediate context switch.
+extern void PollQueue_WakeupFromInterruptContext(PollQueue* _Nonnull pQueue);
+
+#endif /* PollQueue_h */
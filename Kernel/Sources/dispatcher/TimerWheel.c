@@ -0,0 +1,274 @@
+//
+//  TimerWheel.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/26/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "TimerWheel.h"
+
+
+#define kTimerWheel_SlotMask        (kTimerWheel_SlotsPerLevel - 1)
+#define kTimerWheel_ExpiredSlot     kTimerWheel_SlotCount
+#define kTimerWheel_MaxDelta        ((Quantums)1 << (kTimerWheel_LevelCount * kTimerWheel_SlotBits))
+
+// Number of quantums covered by a single slot of the given level
+#define QuantumsPerSlot(__level) \
+    ((Quantums)1 << ((__level) * kTimerWheel_SlotBits))
+
+
+// Initializes the timer wheel. 'now' is the current time.
+void TimerWheel_Init(TimerWheel* _Nonnull self, Quantums now)
+{
+    self->time = now;
+    self->armedCount = 0;
+    for (int i = 0; i < kTimerWheel_LevelCount; i++) {
+        self->occupied[i] = 0;
+    }
+    for (int i = 0; i < kTimerWheel_SlotCount; i++) {
+        List_Init(&self->slots[i]);
+    }
+    List_Init(&self->expired);
+}
+
+// Deinitializes the timer wheel. The wheel must not have any armed entries.
+void TimerWheel_Deinit(TimerWheel* _Nonnull self)
+{
+    assert(TimerWheel_IsEmpty(self));
+
+    for (int i = 0; i < kTimerWheel_SlotCount; i++) {
+        List_Deinit(&self->slots[i]);
+    }
+    List_Deinit(&self->expired);
+}
+
+// Initializes a timer wheel entry. The entry starts out unarmed.
+void TimerWheelEntry_Init(TimerWheelEntry* _Nonnull pEntry)
+{
+    ListNode_Init(&pEntry->node);
+    pEntry->deadline = kQuantums_Infinity;
+    pEntry->slot = -1;
+}
+
+// Puts the given entry on the slot that covers its deadline relative to the
+// current wheel time.
+static void TimerWheel_Insert(TimerWheel* _Nonnull self, TimerWheelEntry* _Nonnull pEntry)
+{
+    const Quantums delta = pEntry->deadline - self->time;
+
+    if (delta <= 0) {
+        List_InsertAfterLast(&self->expired, &pEntry->node);
+        pEntry->slot = kTimerWheel_ExpiredSlot;
+        return;
+    }
+
+    // Park entries which are too far out on the highest level. They are put
+    // back on the wheel with their real deadline when their slot comes up
+    const Quantums deadline = (delta < kTimerWheel_MaxDelta) ? pEntry->deadline : self->time + kTimerWheel_MaxDelta - 1;
+    int level = 0;
+
+    while (level < kTimerWheel_LevelCount - 1 && delta >= QuantumsPerSlot(level + 1)) {
+        level++;
+    }
+
+    const int idx = (deadline >> (level * kTimerWheel_SlotBits)) & kTimerWheel_SlotMask;
+    const int slot = level * kTimerWheel_SlotsPerLevel + idx;
+
+    List_InsertAfterLast(&self->slots[slot], &pEntry->node);
+    self->occupied[level] |= (1u << idx);
+    self->armedCount++;
+    pEntry->slot = slot;
+}
+
+// Takes the given entry off its slot.
+static void TimerWheel_Remove(TimerWheel* _Nonnull self, TimerWheelEntry* _Nonnull pEntry)
+{
+    const int slot = pEntry->slot;
+
+    if (slot == kTimerWheel_ExpiredSlot) {
+        List_Remove(&self->expired, &pEntry->node);
+    }
+    else {
+        List_Remove(&self->slots[slot], &pEntry->node);
+        if (List_IsEmpty(&self->slots[slot])) {
+            self->occupied[slot >> kTimerWheel_SlotBits] &= ~(1u << (slot & kTimerWheel_SlotMask));
+        }
+        self->armedCount--;
+    }
+    pEntry->slot = -1;
+}
+
+// Arms the given entry with the absolute deadline 'deadline'. The entry expires
+// right away if the deadline is in the past. The entry must not be armed.
+void TimerWheel_Arm(TimerWheel* _Nonnull self, TimerWheelEntry* _Nonnull pEntry, Quantums deadline)
+{
+    assert(!TimerWheelEntry_IsArmed(pEntry));
+
+    pEntry->deadline = deadline;
+    TimerWheel_Insert(self, pEntry);
+}
+
+// Cancels the given entry. Does nothing if the entry is not armed.
+void TimerWheel_Cancel(TimerWheel* _Nonnull self, TimerWheelEntry* _Nonnull pEntry)
+{
+    if (TimerWheelEntry_IsArmed(pEntry)) {
+        TimerWheel_Remove(self, pEntry);
+    }
+}
+
+// Moves all entries on the given slot to the slots that cover their deadlines
+// relative to the current wheel time. This moves them down at least one level.
+static void TimerWheel_Cascade(TimerWheel* _Nonnull self, int level, int idx)
+{
+    const int slot = level * kTimerWheel_SlotsPerLevel + idx;
+    List entries = self->slots[slot];
+
+    if (List_IsEmpty(&entries)) {
+        return;
+    }
+
+    List_Init(&self->slots[slot]);
+    self->occupied[level] &= ~(1u << idx);
+
+    ListNode* pCurNode = entries.first;
+    while (pCurNode) {
+        ListNode* pNextNode = pCurNode->next;
+        TimerWheelEntry* pEntry = (TimerWheelEntry*)pCurNode;
+
+        self->armedCount--;
+        ListNode_Init(pCurNode);
+        TimerWheel_Insert(self, pEntry);
+        pCurNode = pNextNode;
+    }
+}
+
+// Advances the wheel time to 'now'. Moves all entries that expire by 'now' to
+// the expired list. Skips over stretches of time in which there is nothing to
+// do: a level only needs attention at its slot boundaries if all the levels
+// below it are empty.
+static void TimerWheel_AdvanceTo(TimerWheel* _Nonnull self, Quantums now)
+{
+    while (self->time < now) {
+        if (self->armedCount == 0) {
+            self->time = now;
+            break;
+        }
+
+        int level = 0;
+        while (self->occupied[level] == 0) {
+            level++;
+        }
+
+        const Quantums step = QuantumsPerSlot(level);
+        const Quantums t = (self->time & ~(step - 1)) + step;
+        if (t > now) {
+            self->time = now;
+            break;
+        }
+        self->time = t;
+
+
+        // Move entries down from the higher levels if the level below has
+        // completed a revolution
+        if ((t & kTimerWheel_SlotMask) == 0) {
+            for (int i = 1; i < kTimerWheel_LevelCount; i++) {
+                const int idx = (t >> (i * kTimerWheel_SlotBits)) & kTimerWheel_SlotMask;
+
+                TimerWheel_Cascade(self, i, idx);
+                if (idx != 0) {
+                    break;
+                }
+            }
+        }
+
+
+        // Expire the level 0 slot of the new time
+        const int idx = t & kTimerWheel_SlotMask;
+        if ((self->occupied[0] & (1u << idx)) != 0) {
+            List* pSlot = &self->slots[idx];
+            ListNode* pCurNode = pSlot->first;
+
+            while (pCurNode) {
+                ListNode* pNextNode = pCurNode->next;
+
+                ((TimerWheelEntry*)pCurNode)->slot = kTimerWheel_ExpiredSlot;
+                ListNode_Init(pCurNode);
+                List_InsertAfterLast(&self->expired, pCurNode);
+                self->armedCount--;
+                pCurNode = pNextNode;
+            }
+            List_Init(pSlot);
+            self->occupied[0] &= ~(1u << idx);
+        }
+    }
+}
+
+// Advances the wheel to the time 'now' and removes the next entry that has
+// expired by 'now'. Returns NULL if no entry has expired. The returned entry is
+// no longer armed.
+TimerWheelEntry* _Nullable TimerWheel_RemoveExpired(TimerWheel* _Nonnull self, Quantums now)
+{
+    TimerWheel_AdvanceTo(self, now);
+
+    TimerWheelEntry* pEntry = (TimerWheelEntry*)List_RemoveFirst(&self->expired);
+    if (pEntry) {
+        pEntry->slot = -1;
+    }
+    return pEntry;
+}
+
+// Removes an arbitrary armed entry from the wheel. Returns NULL if the wheel is
+// empty. Use this to drain the wheel.
+TimerWheelEntry* _Nullable TimerWheel_RemoveAny(TimerWheel* _Nonnull self)
+{
+    TimerWheelEntry* pEntry = (TimerWheelEntry*)self->expired.first;
+
+    for (int i = 0; i < kTimerWheel_SlotCount && pEntry == NULL && self->armedCount > 0; i++) {
+        pEntry = (TimerWheelEntry*)self->slots[i].first;
+    }
+
+    if (pEntry) {
+        TimerWheel_Remove(self, pEntry);
+    }
+    return pEntry;
+}
+
+// Returns the time at which TimerWheel_RemoveExpired() should be called next to
+// pick up the earliest armed entry. This is the deadline of the earliest entry
+// if it sits on the lowest level and otherwise the time at which the entry
+// will be moved down a level. Returns kQuantums_Infinity if the wheel is empty.
+Quantums TimerWheel_GetNextDeadline(TimerWheel* _Nonnull self)
+{
+    if (!List_IsEmpty(&self->expired)) {
+        return self->time;
+    }
+
+    Quantums deadline = kQuantums_Infinity;
+
+    // The level 0 slots cover the next 32 quantums
+    if (self->occupied[0] != 0) {
+        const int startIdx = (self->time + 1) & kTimerWheel_SlotMask;
+
+        for (int i = 0; i < kTimerWheel_SlotsPerLevel; i++) {
+            if ((self->occupied[0] & (1u << ((startIdx + i) & kTimerWheel_SlotMask))) != 0) {
+                deadline = self->time + 1 + i;
+                break;
+            }
+        }
+    }
+
+
+    // Entries on a higher level do not expire before the next slot boundary of
+    // that level. The lowest occupied level has the earliest boundary
+    for (int level = 1; level < kTimerWheel_LevelCount; level++) {
+        if (self->occupied[level] != 0) {
+            const Quantums step = QuantumsPerSlot(level);
+
+            deadline = __min(deadline, (self->time & ~(step - 1)) + step);
+            break;
+        }
+    }
+
+    return deadline;
+}
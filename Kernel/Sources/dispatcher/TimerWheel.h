@@ -0,0 +1,88 @@
+//
+//  TimerWheel.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/26/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include <klib/klib.h>
+#include <driver/MonotonicClock.h>
+
+
+#define kTimerWheel_SlotBits        5
+#define kTimerWheel_SlotsPerLevel   (1 << kTimerWheel_SlotBits)
+#define kTimerWheel_LevelCount      4
+#define kTimerWheel_SlotCount       (kTimerWheel_LevelCount * kTimerWheel_SlotsPerLevel)
+
+
+// An entry in a timer wheel. Embed this in the data structure that should be
+// put on the wheel.
+typedef struct _TimerWheelEntry {
+    ListNode    node;
+    Quantums    deadline;       // Absolute deadline in quantums
+    int16_t     slot;           // Wheel slot the entry is on; -1 if the entry is not armed
+    int8_t      reserved[2];
+} TimerWheelEntry;
+
+
+// A hierarchical timing wheel. Level 0 has a slot per quantum, level 1 a slot
+// per 32 quantums, level 2 a slot per 1024 quantums, etc. An entry is put on
+// the lowest level that covers its deadline and it is moved down a level every
+// time the level below has completed a full revolution. Arming and cancelling
+// an entry is O(1) and expiring entries is amortized O(1) per entry. Deadlines
+// further out than the wheel covers are parked on the highest level until they
+// come into range. The timer wheel is not thread-safe. The owner of the wheel
+// is responsible for serializing access.
+typedef struct _TimerWheel {
+    Quantums    time;                                   // All entries with a deadline <= time have expired
+    int         armedCount;                             // Number of armed entries on the wheel slots
+    uint32_t    occupied[kTimerWheel_LevelCount];       // Bit n is set if slot n of the level is occupied
+    List        slots[kTimerWheel_SlotCount];
+    List        expired;                                // Expired entries which haven't been removed yet
+} TimerWheel;
+
+
+// Initializes the timer wheel. 'now' is the current time.
+extern void TimerWheel_Init(TimerWheel* _Nonnull self, Quantums now);
+
+// Deinitializes the timer wheel. The wheel must not have any armed entries.
+extern void TimerWheel_Deinit(TimerWheel* _Nonnull self);
+
+// Returns true if no entry is armed.
+#define TimerWheel_IsEmpty(__self) \
+    ((__self)->armedCount == 0 && List_IsEmpty(&(__self)->expired))
+
+// Initializes a timer wheel entry. The entry starts out unarmed.
+extern void TimerWheelEntry_Init(TimerWheelEntry* _Nonnull pEntry);
+
+// Returns true if the entry is armed.
+#define TimerWheelEntry_IsArmed(__pEntry) \
+    ((__pEntry)->slot >= 0)
+
+// Arms the given entry with the absolute deadline 'deadline'. The entry expires
+// right away if the deadline is in the past. The entry must not be armed.
+extern void TimerWheel_Arm(TimerWheel* _Nonnull self, TimerWheelEntry* _Nonnull pEntry, Quantums deadline);
+
+// Cancels the given entry. Does nothing if the entry is not armed.
+extern void TimerWheel_Cancel(TimerWheel* _Nonnull self, TimerWheelEntry* _Nonnull pEntry);
+
+// Advances the wheel to the time 'now' and removes the next entry that has
+// expired by 'now'. Returns NULL if no entry has expired. The returned entry is
+// no longer armed.
+extern TimerWheelEntry* _Nullable TimerWheel_RemoveExpired(TimerWheel* _Nonnull self, Quantums now);
+
+// Removes an arbitrary armed entry from the wheel. Returns NULL if the wheel is
+// empty. Use this to drain the wheel.
+extern TimerWheelEntry* _Nullable TimerWheel_RemoveAny(TimerWheel* _Nonnull self);
+
+// Returns the time at which TimerWheel_RemoveExpired() should be called next to
+// pick up the earliest armed entry. This is the deadline of the earliest entry
+// if it sits on the lowest level and otherwise the time at which the entry
+// will be moved down a level. Returns kQuantums_Infinity if the wheel is empty.
+extern Quantums TimerWheel_GetNextDeadline(TimerWheel* _Nonnull self);
+
+#endif /* TimerWheel_h */
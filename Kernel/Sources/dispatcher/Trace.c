@@ -0,0 +1,96 @@
+//
+//  Trace.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/2/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "Trace.h"
+#include "VirtualProcessorScheduler.h"
+#include <driver/MonotonicClock.h>
+
+
+#define kTrace_EventIndexMask   (kTrace_MaxEventCount - 1)
+
+TraceBuffer gTraceBuffer;
+
+
+// Appends an event to the trace buffer. Overwrites the oldest event if the
+// buffer is full. Use the Trace_Record() macro instead of calling this function
+// directly.
+void _Trace_Record(int type, int vpid, uint32_t arg0, uint32_t arg1)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+
+    // Tracing may have been disabled since our caller checked the flag
+    if (gTraceBuffer.is_enabled && gTraceBuffer.pause_count == 0) {
+        TraceEvent* pEvent = &gTraceBuffer.events[gTraceBuffer.write_count & kTrace_EventIndexMask];
+
+        gTraceBuffer.write_count++;
+        pEvent->time = MonotonicClock_GetCurrentTime();
+        pEvent->arg0 = arg0;
+        pEvent->arg1 = arg1;
+        pEvent->vpid = vpid;
+        pEvent->type = (int8_t)type;
+    }
+
+    VirtualProcessorScheduler_RestorePreemption(sps);
+}
+
+// Enables or disables tracing. Allocates the trace buffer the first time that
+// tracing is enabled.
+errno_t Trace_SetEnabled(bool enabled)
+{
+    decl_try_err();
+    TraceEvent* pEvents = NULL;
+
+    if (enabled && gTraceBuffer.events == NULL) {
+        try(kalloc_cleared(sizeof(TraceEvent) * kTrace_MaxEventCount, (void**)&pEvents));
+    }
+
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+    if (pEvents) {
+        if (gTraceBuffer.events == NULL) {
+            gTraceBuffer.events = pEvents;
+            gTraceBuffer.write_count = 0;
+            pEvents = NULL;
+        }
+    }
+    gTraceBuffer.is_enabled = enabled;
+    VirtualProcessorScheduler_RestorePreemption(sps);
+
+    // Somebody else beat us to allocating the buffer
+    kfree(pEvents);
+
+catch:
+    return err;
+}
+
+// Copies up to 'bufferCount' of the most recent events to 'pBuffer', ordered
+// from oldest to newest. Recording is paused while we copy the events because
+// copying the whole buffer with preemption disabled would add far too much
+// latency.
+errno_t Trace_Snapshot(TraceEvent* _Nonnull pBuffer, size_t bufferCount, size_t* _Nonnull pOutCount)
+{
+    int sps = VirtualProcessorScheduler_DisablePreemption();
+    const uint32_t writeCount = gTraceBuffer.write_count;
+    const TraceEvent* pEvents = gTraceBuffer.events;
+    gTraceBuffer.pause_count++;
+    VirtualProcessorScheduler_RestorePreemption(sps);
+
+    const size_t count = __min(__min(writeCount, kTrace_MaxEventCount), bufferCount);
+    uint32_t idx = writeCount - count;
+
+    for (size_t i = 0; i < count; i++) {
+        pBuffer[i] = pEvents[idx & kTrace_EventIndexMask];
+        idx++;
+    }
+    *pOutCount = count;
+
+    sps = VirtualProcessorScheduler_DisablePreemption();
+    gTraceBuffer.pause_count--;
+    VirtualProcessorScheduler_RestorePreemption(sps);
+
+    return EOK;
+}
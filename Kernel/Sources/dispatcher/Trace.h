@@ -0,0 +1,42 @@
+//
+//  Trace.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/2/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef Trace_h
+#define Trace_h
+
+#include <klib/klib.h>
+#include <System/Trace.h>
+
+
+// The kernel trace buffer is a fixed size ring buffer which records the most
+// recent scheduler, interrupt and dispatch queue events. Events are recorded
+// with preemption disabled which makes recording safe from any context,
+// including interrupt handlers, without taking a lock. The buffer is allocated
+// the first time that tracing is enabled. Recording an event boils down to a
+// single test of the 'is_enabled' flag while tracing is disabled.
+typedef struct _TraceBuffer {
+    TraceEvent* _Nullable   events;         // kTrace_MaxEventCount entries
+    uint32_t                write_count;    // Number of events written since the buffer was allocated
+    volatile bool           is_enabled;
+    int8_t                  pause_count;    // > 0 while a snapshot is copying events out of the buffer
+    int8_t                  reserved[2];
+} TraceBuffer;
+
+
+extern TraceBuffer gTraceBuffer;
+
+// Records a trace event if tracing is enabled
+#define Trace_Record(__type, __vpid, __arg0, __arg1) \
+    do { if (gTraceBuffer.is_enabled) { _Trace_Record(__type, __vpid, (uint32_t)(__arg0), (uint32_t)(__arg1)); } } while (0)
+
+extern void _Trace_Record(int type, int vpid, uint32_t arg0, uint32_t arg1);
+
+extern errno_t Trace_SetEnabled(bool enabled);
+extern errno_t Trace_Snapshot(TraceEvent* _Nonnull pBuffer, size_t bufferCount, size_t* _Nonnull pOutCount);
+
+#endif /* Trace_h */
@@ -15,7 +15,9 @@ void ULock_Init(ULock*_Nonnull pLock)
 {
     pLock->value = 0;
     List_Init(&pLock->wait_queue);
-    pLock->owner_vpid = 0;
+    pLock->owner = NULL;
+    ListNode_Init(&pLock->owner_entry);
+    pLock->is_contended = false;
 }
 
 // Deinitializes a lock. The lock is automatically unlocked if the calling code
@@ -34,7 +36,7 @@ errno_t ULock_Deinit(ULock* _Nonnull pLock)
 
     pLock->value = 0;
     List_Deinit(&pLock->wait_queue);
-    pLock->owner_vpid = 0;
+    pLock->owner = NULL;
 
     return EOK;
 }
@@ -71,20 +73,140 @@ catch:
     return err;
 }
 
+// Moves the given waiter to its place in the wait queue of the lock. The wait
+// queue is sorted by effective priority. Waiters with the same priority leave
+// the queue in the order in which they have entered it. Expects to be called
+// with preemption disabled.
+static void ULock_RequeueWaiter(ULock* _Nonnull pLock, VirtualProcessor* _Nonnull pVP)
+{
+    register VirtualProcessor* pPrevVP = NULL;
+    register VirtualProcessor* pCurVP;
+
+    List_Remove(&pLock->wait_queue, &pVP->rewa_queue_entry);
+
+    pCurVP = (VirtualProcessor*)pLock->wait_queue.first;
+    while (pCurVP) {
+        if (pCurVP->effectivePriority < pVP->effectivePriority) {
+            break;
+        }
+
+        pPrevVP = pCurVP;
+        pCurVP = (VirtualProcessor*)pCurVP->rewa_queue_entry.next;
+    }
+
+    List_InsertAfter(&pLock->wait_queue, &pVP->rewa_queue_entry, &pPrevVP->rewa_queue_entry);
+}
+
+// Lends 'priority' to the owner of the given lock. The owner is put on the
+// ready queue with the new priority if it is ready to run. The boost is passed
+// on to the owner of the lock that the owner is waiting on, if any. Expects to
+// be called with preemption disabled.
+static void ULock_InheritPriority(ULock* _Nonnull pLock, int priority)
+{
+    for (int i = 0; i < ULOCK_MAX_INHERITANCE_DEPTH; i++) {
+        VirtualProcessor* pOwner = pLock->owner;
+
+        // The owner is not known yet if it was preempted right after it took
+        // the lock in the fast path. Nothing we can do about it in this case
+        if (pOwner == NULL || pOwner->inheritedPriority >= priority) {
+            return;
+        }
+
+        pOwner->inheritedPriority = priority;
+        if (pOwner->effectivePriority >= priority) {
+            return;
+        }
+
+        switch (pOwner->state) {
+            case kVirtualProcessorState_Ready:
+                if (pOwner->suspension_count == 0) {
+                    VirtualProcessorScheduler_RemoveVirtualProcessor_Locked(gVirtualProcessorScheduler, pOwner);
+                    VirtualProcessorScheduler_AddVirtualProcessor_Locked(gVirtualProcessorScheduler, pOwner, priority);
+                } else {
+                    pOwner->effectivePriority = priority;
+                }
+                return;
+
+            case kVirtualProcessorState_Waiting:
+                pOwner->effectivePriority = priority;
+                if (pOwner->waiting_on_lock == NULL) {
+                    return;
+                }
+                pLock = pOwner->waiting_on_lock;
+                ULock_RequeueWaiter(pLock, pOwner);
+                break;
+
+            default:
+                pOwner->effectivePriority = priority;
+                pOwner->quantum_allowance = QuantumAllowanceForPriority(pOwner->effectivePriority);
+                return;
+        }
+    }
+}
+
+// Recomputes the inherited priority of the given running VP after it has
+// dropped one of its contended locks. The VP falls back to the highest priority
+// of the remaining waiters on its locks or its base priority. Expects to be
+// called with preemption disabled.
+static void ULock_RestorePriority(VirtualProcessor* _Nonnull pVP)
+{
+    int inheritedPriority = VP_PRIORITY_LOWEST;
+
+    List_ForEach(&pVP->contended_locks, ListNode, {
+        ULock* pLock = (ULock*)((char*)pCurNode - offsetof(ULock, owner_entry));
+        VirtualProcessor* pWaiter = (VirtualProcessor*)pLock->wait_queue.first;
+
+        if (pWaiter && pWaiter->effectivePriority > inheritedPriority) {
+            inheritedPriority = pWaiter->effectivePriority;
+        }
+    });
+
+    if (inheritedPriority < pVP->inheritedPriority) {
+        pVP->inheritedPriority = inheritedPriority;
+        pVP->effectivePriority = __max(pVP->priority, inheritedPriority);
+        pVP->quantum_allowance = QuantumAllowanceForPriority(pVP->effectivePriority);
+    }
+}
+
 // Invoked by ULock_Lock() if the lock is currently being held by some other VP.
+// Expects to be called with preemption disabled.
 errno_t ULock_OnWait(ULock* _Nonnull pLock, unsigned int options)
 {
+    VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
     const bool isInterruptable = (options & ULOCK_OPTION_INTERRUPTABLE) != 0;
+    errno_t err;
 
-    return VirtualProcessorScheduler_WaitOn(gVirtualProcessorScheduler,
-                                            &pLock->wait_queue,
-                                            kTimeInterval_Infinity,
-                                            isInterruptable);
+    // Remember the lock in the owner so that it can give up the inherited
+    // priority when it unlocks the lock
+    if (!pLock->is_contended && pLock->owner) {
+        List_InsertAfterLast(&pLock->owner->contended_locks, &pLock->owner_entry);
+        pLock->is_contended = true;
+    }
+    ULock_InheritPriority(pLock, pVP->effectivePriority);
+
+    pVP->waiting_on_lock = pLock;
+    err = VirtualProcessorScheduler_WaitOn(gVirtualProcessorScheduler,
+                                           &pLock->wait_queue,
+                                           kTimeInterval_Infinity,
+                                           isInterruptable);
+    pVP->waiting_on_lock = NULL;
+
+    return err;
 }
 
-// Invoked by ULock_Unlock(). Expects to be called with preemption disabled.
+// Invoked by ULock_Unlock() after the lock has been released by the calling VP.
+// Drops the priority that the caller has inherited from the waiters on the lock
+// and wakes the waiters up. Expects to be called with preemption disabled.
 void ULock_WakeUp(ULock* _Nullable pLock)
 {
+    if (pLock->is_contended) {
+        VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
+
+        List_Remove(&pVP->contended_locks, &pLock->owner_entry);
+        pLock->is_contended = false;
+        ULock_RestorePriority(pVP);
+    }
+
     VirtualProcessorScheduler_WakeUpAll(gVirtualProcessorScheduler,
                                         &pLock->wait_queue,
                                         true);
@@ -12,10 +12,20 @@
 #include <klib/klib.h>
 
 
+struct _VirtualProcessor;
+
+
+// A lock that implements priority inheritance. A VP that has to wait for the
+// lock lends its effective priority to the VP that is holding the lock. The
+// owner keeps the highest priority that it has inherited from the waiters on
+// its locks until it unlocks them. The boost is passed along a chain of owners
+// that are themselves waiting on a lock.
 typedef struct _ULock {
-    volatile unsigned int   value;
-    List            wait_queue;
-    int             owner_vpid;     // ID of the VP that is currently holding the lock
+    volatile unsigned int               value;
+    List                                wait_queue;
+    struct _VirtualProcessor* _Nullable owner;          // The VP that is currently holding the lock
+    ListNode                            owner_entry;    // Entry in the contended lock list of the owner
+    bool                                is_contended;   // True if the lock is on the contended lock list of the owner
 } ULock;
 
 
@@ -25,6 +35,10 @@ typedef struct _ULock {
 #define ULOCK_OPTION_INTERRUPTABLE  1 
 
 
+// Maximum number of lock owners that a priority boost is passed along
+#define ULOCK_MAX_INHERITANCE_DEPTH 8
+
+
 // Initializes a new lock.
 extern void ULock_Init(ULock*_Nonnull pLock);
 
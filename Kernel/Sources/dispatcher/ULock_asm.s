@@ -11,7 +11,7 @@
 
     xref _ULock_OnWait
     xref _ULock_WakeUp
-    xref _VirtualProcessor_GetCurrentVpid
+    xref _VirtualProcessor_GetCurrent
 
     xdef _ULock_TryLock
     xdef _ULock_Lock
@@ -23,8 +23,15 @@
 ulock_value             so.l    1    ; bit #7 == 1 -> lock is in acquired state; bset#7 == 0 -> lock is available for aquisition
 ulock_wait_queue_first  so.l    1
 ulock_wait_queue_last   so.l    1
-ulock_owner_vpid        so.l    1
+ulock_owner             so.l    1    ; VP that is holding the lock
+ulock_owner_entry_next  so.l    1
+ulock_owner_entry_prev  so.l    1
+ulock_is_contended      so.b    1
+ulock_reserved          so.b    3
 ulock_SIZEOF            so
+    ifeq (ulock_SIZEOF == 28)
+        fail "ULock structure size is incorrect."
+    endif
 
 
 ;-------------------------------------------------------------------------------
@@ -43,9 +50,9 @@ _ULock_TryLock:
     bne.s   .lta_lock_is_busy
 
     ; acquired the lock
-    jsr     _VirtualProcessor_GetCurrentVpid
+    jsr     _VirtualProcessor_GetCurrent
     move.l  lta_lock_ptr(sp), a0
-    move.l  d0, ulock_owner_vpid(a0)
+    move.l  d0, ulock_owner(a0)
 
     ; return EOK
     moveq.l #EOK, d0
@@ -103,9 +110,9 @@ _ULock_Lock:
     RESTORE_PREEMPTION d7
 
 .la_acquired_lock:
-    jsr     _VirtualProcessor_GetCurrentVpid
+    jsr     _VirtualProcessor_GetCurrent
     move.l  la_lock_ptr(sp), a0
-    move.l  d0, ulock_owner_vpid(a0)
+    move.l  d0, ulock_owner(a0)
 
     ; return EOK
     moveq.l #EOK, d0
@@ -132,20 +139,21 @@ _ULock_Unlock:
     move.l  d7, -(sp)
 
     ; make sure that we actually own the lock before we attempt to unlock it
-    jsr     _VirtualProcessor_GetCurrentVpid
+    jsr     _VirtualProcessor_GetCurrent
     move.l  lr_lock_ptr(sp), a0
-    move.l  ulock_owner_vpid(a0), d1
+    move.l  ulock_owner(a0), d1
     cmp.l   d0, d1
     bne.s   .lr_does_not_own_error
 
-    ; unlock the lock 
-    clr.l   ulock_owner_vpid(a0)
     DISABLE_PREEMPTION d7
 
-    ; release the lock
+    ; release the lock. Clear the owner with preemption disabled so that a
+    ; contender never sees a held lock without an owner that it could boost
+    clr.l   ulock_owner(a0)
     bclr    #7, ulock_value(a0)
 
-    ; move all the waiters back to the ready queue
+    ; give up the inherited priority and move all the waiters back to the
+    ; ready queue
     move.l  a0, -(sp)
     jsr     _ULock_WakeUp
     addq.l  #4, sp
@@ -184,7 +192,12 @@ _ULock_GetOwnerVpid:
     bra.s   .lgovpid_done
 
 .lgovpid_is_locked:
-    move.l  ulock_owner_vpid(a0), d0
+    ; the owner is not known yet if the owner was preempted right after it
+    ; took the lock
+    move.l  ulock_owner(a0), d0
+    beq.s   .lgovpid_done
+    move.l  d0, a0
+    move.l  vp_vpid(a0), d0
 
 .lgovpid_done:
     RESTORE_PREEMPTION d7
@@ -109,23 +109,26 @@ void VirtualProcessor_CommonInit(VirtualProcessor*_Nonnull pVP, int priority)
     ListNode_Init(&pVP->owner.queue_entry);
     pVP->owner.self = pVP;
     
-    ListNode_Init(&pVP->timeout.queue_entry);
-    
-    pVP->timeout.deadline = kQuantums_Infinity;
+    TimerWheelEntry_Init(&pVP->timeout.entry);
     pVP->timeout.owner = (void*)pVP;
-    pVP->timeout.is_valid = false;
     pVP->waiting_on_wait_queue = NULL;
     pVP->wakeup_reason = WAKEUP_REASON_NONE;
     
     pVP->state = kVirtualProcessorState_Ready;
     pVP->flags = 0;
     pVP->priority = (int8_t)priority;
+    pVP->inheritedPriority = VP_PRIORITY_LOWEST;
     pVP->suspension_count = 1;
     
     pVP->vpid = AtomicInt_Add(&gNextAvailableVpid, 1);
 
     pVP->dispatchQueue = NULL;
     pVP->dispatchQueueConcurrencyLaneIndex = -1;
+
+    List_Init(&pVP->contended_locks);
+    pVP->waiting_on_lock = NULL;
+
+    Bytes_ClearRange(&pVP->stats, sizeof(ExecutionStats));
 }
 
 // Creates a new virtual processor.
@@ -156,12 +159,13 @@ void VirtualProcessor_Destroy(VirtualProcessor* _Nullable pVP)
 
 // Sets the dispatch queue that has acquired the virtual processor and owns it
 // until the virtual processor is relinquished back to the virtual processor
-// pool.
-void VirtualProcessor_SetDispatchQueue(VirtualProcessor*_Nonnull pVP, void* _Nullable pQueue, int concurrencyLaneIndex)
+// pool. The VP charges its CPU time and context switches to 'pQueueStats' too.
+void VirtualProcessor_SetDispatchQueue(VirtualProcessor*_Nonnull pVP, void* _Nullable pQueue, ExecutionStats* _Nullable pQueueStats, int concurrencyLaneIndex)
 {
     VP_ASSERT_ALIVE(pVP);
     pVP->dispatchQueue = pQueue;
     pVP->dispatchQueueConcurrencyLaneIndex = concurrencyLaneIndex;
+    pVP->stats.parent = pQueueStats;
 }
 
 // Sets the closure which the virtual processor should run when it is resumed.
@@ -227,15 +231,31 @@ catch:
     return err;
 }
 
-// Invokes the given closure in user space. Preserves the kernel integer register
-// state. Note however that this function does not preserve the floating point 
-// register state. Call-as-user invocations can not be nested.
-void VirtualProcessor_CallAsUser(VirtualProcessor* _Nonnull pVP, Closure1Arg_Func _Nonnull pClosure, void* _Nullable pContext)
+// Returns a consistent copy of the given execution statistics with the quantum
+// counts converted to time intervals.
+void ExecutionStats_Get(const ExecutionStats* _Nonnull pStats, ExecutionStatistics* _Nonnull pOutStats)
+{
+    const int sps = VirtualProcessorScheduler_DisablePreemption();
+    const ExecutionStats stats = *pStats;
+    VirtualProcessorScheduler_RestorePreemption(sps);
+
+    pOutStats->userTime = TimeInterval_MakeFromQuantums(stats.user_quantums);
+    pOutStats->kernelTime = TimeInterval_MakeFromQuantums(stats.kernel_quantums);
+    pOutStats->waitTime = TimeInterval_MakeFromQuantums(stats.wait_quantums);
+    pOutStats->voluntarySwitchCount = stats.voluntary_csw_count;
+    pOutStats->involuntarySwitchCount = stats.involuntary_csw_count;
+}
+
+// Invokes the given closure in user space. 'arg' is passed to the closure as its
+// second argument. Preserves the kernel integer register state. Note however
+// that this function does not preserve the floating point register state.
+// Call-as-user invocations can not be nested.
+void VirtualProcessor_CallAsUser(VirtualProcessor* _Nonnull pVP, Closure1Arg_Func _Nonnull pClosure, void* _Nullable pContext, uintptr_t arg)
 {
     assert((pVP->flags & VP_FLAG_CAU_IN_PROGRESS) == 0);
 
     pVP->flags |= VP_FLAG_CAU_IN_PROGRESS;
-    cpu_call_as_user((Cpu_UserClosure) pClosure, pContext);
+    cpu_call_as_user((Cpu_UserClosure) pClosure, pContext, arg);
     pVP->flags &= ~(VP_FLAG_CAU_IN_PROGRESS|VP_FLAG_CAU_ABORTED);
 }
 
@@ -405,7 +425,7 @@ void VirtualProcessor_SetPriority(VirtualProcessor* _Nonnull pVP, int priority)
                 
             case kVirtualProcessorState_Running:
                 pVP->priority = priority;
-                pVP->effectivePriority = priority;
+                pVP->effectivePriority = __max(priority, pVP->inheritedPriority);
                 pVP->quantum_allowance = QuantumAllowanceForPriority(pVP->effectivePriority);
                 break;
         }
@@ -13,6 +13,8 @@
 #include <driver/MonotonicClock.h>
 #include <hal/Platform.h>
 #include <hal/SystemDescription.h>
+#include <System/Process.h>
+#include "TimerWheel.h"
 
 
 // A kernel or user execution stack
@@ -107,15 +109,13 @@ typedef enum _VirtualProcessorState {
 
 
 struct _VirtualProcessor;
+struct _ULock;
 
 
 // A timeout
 typedef struct _Timeout {
-    ListNode                            queue_entry;            // Timeout queue if the VP is waiting with a timeout
-    Quantums                            deadline;               // Absolute timeout in quantums
+    TimerWheelEntry                     entry;                  // Armed on the scheduler timer wheel if the VP is waiting with a timeout
     struct VirtualProcessor* _Nullable  owner;
-    bool                                is_valid;               // True if we are waiting with a timeout; false otherwise
-    int8_t                              reserved[3];
 } Timeout;
 
 
@@ -125,6 +125,21 @@ typedef struct _VirtualProcessorOwner {
 } VirtualProcessorOwner;
 
 
+// CPU time and context switch counters. A VP charges everything to its own
+// counters and to the chain of parent counters. The parent of a VP is the
+// dispatch queue that the VP is currently working for and the parent of a
+// dispatch queue is the process that owns the queue. The counters are only
+// modified with preemption disabled.
+typedef struct _ExecutionStats {
+    struct _ExecutionStats* _Nullable   parent;
+    uint32_t                            user_quantums;          // Quantums consumed while running in user mode
+    uint32_t                            kernel_quantums;        // Quantums consumed while running in kernel mode
+    uint32_t                            wait_quantums;          // Quantums spent waiting
+    uint32_t                            voluntary_csw_count;    // Number of times the CPU was given up to wait
+    uint32_t                            involuntary_csw_count;  // Number of times the CPU was taken away by a more important VP
+} ExecutionStats;
+
+
 // Overridable functions for virtual processors
 typedef struct _VirtualProcessorVTable {
     void    (* _Nonnull destroy)(struct _VirtualProcessor* _Nonnull pVP);
@@ -159,12 +174,19 @@ typedef struct _VirtualProcessor {
     uint8_t                                 flags;
     int8_t                                  quantum_allowance;      // How many continuous quantums this VP may run for before the scheduler will consider scheduling some other VP
     int8_t                                  suspension_count;       // > 0 -> VP is suspended
-    int8_t                                  reserved[1];
+    int8_t                                  inheritedPriority;      // Highest priority of a VP waiting on a lock that we hold; the effective priority does not fall below this
 
     // Dispatch queue state
     void* _Nullable _Weak                   dispatchQueue;                      // Dispatch queue this VP is currently assigned to
     int8_t                                  dispatchQueueConcurrencyLaneIndex;  // Index of the concurrency lane in the dispatch queue this VP is assigned to
     int8_t                                  reserved2[3];
+
+    // Priority inheritance state
+    List                                    contended_locks;        // Locks held by this VP that other VPs have waited on
+    struct _ULock* _Nullable                waiting_on_lock;        // The lock this VP is waiting on; NULL if not waiting on a lock
+
+    // Accounting
+    ExecutionStats                          stats;
 } VirtualProcessor;
 
 
@@ -210,17 +232,22 @@ extern void VirtualProcessor_Resume(VirtualProcessor* _Nonnull pVP, bool force);
 
 // Sets the dispatch queue that has acquired the virtual processor and owns it
 // until the virtual processor is relinquished back to the virtual processor
-// pool.
-extern void VirtualProcessor_SetDispatchQueue(VirtualProcessor*_Nonnull pVP, void* _Nullable pQueue, int concurrencyLaneIndex);
+// pool. The VP charges its CPU time and context switches to 'pQueueStats' too.
+extern void VirtualProcessor_SetDispatchQueue(VirtualProcessor*_Nonnull pVP, void* _Nullable pQueue, ExecutionStats* _Nullable pQueueStats, int concurrencyLaneIndex);
 
 // Sets the closure which the virtual processor should run when it is resumed.
 // This function may only be called while the VP is suspended.
 extern errno_t VirtualProcessor_SetClosure(VirtualProcessor*_Nonnull pVP, VirtualProcessorClosure closure);
 
-// Invokes the given closure in user space. Preserves the kernel integer register
-// state. Note however that this function does not preserve the floating point 
-// register state. Call-as-user invocations can not be nested.
-extern void VirtualProcessor_CallAsUser(VirtualProcessor* _Nonnull pVP, Closure1Arg_Func _Nonnull pClosure, void* _Nullable pContext);
+// Returns a consistent copy of the given execution statistics with the quantum
+// counts converted to time intervals.
+extern void ExecutionStats_Get(const ExecutionStats* _Nonnull pStats, ExecutionStatistics* _Nonnull pOutStats);
+
+// Invokes the given closure in user space. 'arg' is passed to the closure as its
+// second argument. Preserves the kernel integer register state. Note however
+// that this function does not preserve the floating point register state.
+// Call-as-user invocations can not be nested.
+extern void VirtualProcessor_CallAsUser(VirtualProcessor* _Nonnull pVP, Closure1Arg_Func _Nonnull pClosure, void* _Nullable pContext, uintptr_t arg);
 
 // Aborts an on-going call-as-user invocation and causes the
 // VirtualProcessor_CallAsUser() call to return. Does nothing if the VP is not
@@ -124,7 +124,7 @@ _Noreturn VirtualProcessorPool_RelinquishVirtualProcessor(VirtualProcessorPoolRe
 
     // Null out the dispatch queue reference in any case since the VP should no
     // longer be associated with a queue.
-    VirtualProcessor_SetDispatchQueue(pVP, NULL, -1);
+    VirtualProcessor_SetDispatchQueue(pVP, NULL, NULL, -1);
 
 
     // Try to cache the VP
@@ -7,6 +7,7 @@
 //
 
 #include "VirtualProcessorScheduler.h"
+#include "Trace.h"
 #include <driver/InterruptController.h>
 #include <driver/MonotonicClock.h>
 #include <hal/Platform.h>
@@ -24,6 +25,45 @@ VirtualProcessorScheduler   gVirtualProcessorSchedulerStorage;
 VirtualProcessorScheduler*  gVirtualProcessorScheduler = &gVirtualProcessorSchedulerStorage;
 
 
+// Charges 'quantums' of CPU time to the given statistics and all its parents.
+// Expects to be called with preemption disabled.
+static void ExecutionStats_ChargeQuantums(ExecutionStats* _Nullable pStats, uint32_t quantums, bool isUser)
+{
+    while (pStats) {
+        if (isUser) {
+            pStats->user_quantums += quantums;
+        } else {
+            pStats->kernel_quantums += quantums;
+        }
+        pStats = pStats->parent;
+    }
+}
+
+// Charges a context switch to the given statistics and all its parents.
+// Expects to be called with preemption disabled.
+static void ExecutionStats_ChargeSwitch(ExecutionStats* _Nullable pStats, bool isVoluntary)
+{
+    while (pStats) {
+        if (isVoluntary) {
+            pStats->voluntary_csw_count++;
+        } else {
+            pStats->involuntary_csw_count++;
+        }
+        pStats = pStats->parent;
+    }
+}
+
+// Charges 'quantums' of wait time to the given statistics and all its parents.
+// Expects to be called with preemption disabled.
+static void ExecutionStats_ChargeWait(ExecutionStats* _Nullable pStats, uint32_t quantums)
+{
+    while (pStats) {
+        pStats->wait_quantums += quantums;
+        pStats = pStats->parent;
+    }
+}
+
+
 // Initializes the virtual processor scheduler and sets up the boot virtual
 // processor plus the idle virtual processor. The 'pFunc' function will be
 // invoked in the context of the boot virtual processor and it will receive the
@@ -48,8 +88,11 @@ void VirtualProcessorScheduler_CreateForLocalCPU(SystemDescription* _Nonnull pSy
     if (pSysDesc->fpu_model != FPU_MODEL_NONE) {
         pScheduler->csw_hw |= CSW_HW_HAS_FPU;
     }
+    if (pSysDesc->fpu_model == FPU_MODEL_68060) {
+        pScheduler->csw_hw |= CSW_HW_FPU_IS_68060;
+    }
     
-    List_Init(&pScheduler->timeout_queue);
+    TimerWheel_Init(&pScheduler->timeout_wheel, 0);
     List_Init(&pScheduler->sleep_queue);
     List_Init(&pScheduler->scheduler_wait_queue);
     List_Init(&pScheduler->finalizer_queue);
@@ -105,7 +148,8 @@ catch:
 
 // Adds the given virtual processor with the given effective priority to the
 // ready queue and resets its time slice length to the length implied by its
-// effective priority.
+// effective priority. The effective priority is raised to the priority that
+// the VP has inherited from the waiters on its locks if it is lower.
 void VirtualProcessorScheduler_AddVirtualProcessor_Locked(VirtualProcessorScheduler* _Nonnull pScheduler, VirtualProcessor* _Nonnull pVP, int effectivePriority)
 {
     assert(pVP != NULL);
@@ -114,7 +158,7 @@ void VirtualProcessorScheduler_AddVirtualProcessor_Locked(VirtualProcessorSchedu
     assert(pVP->suspension_count == 0);
     
     pVP->state = kVirtualProcessorState_Ready;
-    pVP->effectivePriority = effectivePriority;
+    pVP->effectivePriority = __max(effectivePriority, pVP->inheritedPriority);
     pVP->quantum_allowance = QuantumAllowanceForPriority(pVP->effectivePriority);
     pVP->wait_start_time = MonotonicClock_GetCurrentQuantums();
     
@@ -173,30 +217,52 @@ VirtualProcessor* _Nullable VirtualProcessorScheduler_GetHighestPriorityReady(Vi
     return NULL;
 }
 
-// Invoked at the end of every quantum.
+// Tickless mode only: programs the quantum timer for the earliest of the next
+// timeout deadline and the end of the time slice of the VP that will run next.
+// There is no time slice deadline if the idle VP will run next. Note that this
+// covers the dispatch queue timers too since a dispatch queue waits for its next
+// timer with a timeout.
+static void VirtualProcessorScheduler_UpdateQuantumTimer(VirtualProcessorScheduler* _Nonnull pScheduler, bool isInterruptContext)
+{
+    if (!MonotonicClock_IsTickless()) {
+        return;
+    }
+
+    const VirtualProcessor* pNextVP = ((pScheduler->csw_signals & CSW_SIGNAL_SWITCH) != 0) ? pScheduler->scheduled : (const VirtualProcessor*)pScheduler->running;
+    Quantums deadline = TimerWheel_GetNextDeadline(&pScheduler->timeout_wheel);
+
+    if (pNextVP != pScheduler->idleVirtualProcessor) {
+        deadline = __min(deadline, MonotonicClock_GetCurrentQuantums() + pNextVP->quantum_allowance);
+    }
+
+    MonotonicClock_SetNextDeadline(deadline, isInterruptContext);
+}
+
+// Invoked at the end of every quantum in periodic mode and whenever the quantum
+// timer fires in tickless mode.
 void VirtualProcessorScheduler_OnEndOfQuantum(VirtualProcessorScheduler * _Nonnull pScheduler)
 {
-    // First, go through the timeout queue and move all VPs whose timeouts have
+    // First, advance the timer wheel and move all VPs whose timeouts have
     // expired to the ready queue.
     const Quantums curTime = MonotonicClock_GetCurrentQuantums();
+    register Timeout* pCurTimeout;
     
-    while (pScheduler->timeout_queue.first) {
-        register Timeout* pCurTimeout = (Timeout*)pScheduler->timeout_queue.first;
-        
-        if (pCurTimeout->deadline > curTime) {
-            break;
-        }
-        
+    while ((pCurTimeout = (Timeout*)TimerWheel_RemoveExpired(&pScheduler->timeout_wheel, curTime)) != NULL) {
         VirtualProcessor* pVP = (VirtualProcessor*)pCurTimeout->owner;
+        Trace_Record(kTraceEvent_TimeoutFired, pVP->vpid, pVP->waiting_on_wait_queue, 0);
         VirtualProcessorScheduler_WakeUpOne(pScheduler, pVP->waiting_on_wait_queue, pVP, WAKEUP_REASON_TIMEOUT, false);
     }
     
     
-    // Second, update the time slice info for the currently running VP
+    // Second, update the time slice info for the currently running VP. The
+    // timer period that just ended may have spanned multiple quantums in
+    // tickless mode
     register VirtualProcessor* curRunning = (VirtualProcessor*)pScheduler->running;
     
-    curRunning->quantum_allowance--;
+    ExecutionStats_ChargeQuantums(&curRunning->stats, gMonotonicClock->tick_quantums, pScheduler->irq_from_user);
+    curRunning->quantum_allowance -= __min(gMonotonicClock->tick_quantums, curRunning->quantum_allowance);
     if (curRunning->quantum_allowance > 0) {
+        VirtualProcessorScheduler_UpdateQuantumTimer(pScheduler, true);
         return;
     }
 
@@ -204,14 +270,16 @@ void VirtualProcessorScheduler_OnEndOfQuantum(VirtualProcessorScheduler * _Nonnu
     // The time slice has expired. Lower our priority and then check whether
     // there's another VP on the ready queue which is more important. If so we
     // context switch to that guy. Otherwise we'll continue to run for another
-    // time slice.
-    curRunning->effectivePriority = __max(curRunning->effectivePriority - 1, VP_PRIORITY_LOWEST);
+    // time slice. We do not decay below the priority that we have inherited
+    // from the waiters on our locks.
+    curRunning->effectivePriority = __max(curRunning->effectivePriority - 1, curRunning->inheritedPriority);
     curRunning->quantum_allowance = QuantumAllowanceForPriority(curRunning->effectivePriority);
 
     register VirtualProcessor* pBestReady = VirtualProcessorScheduler_GetHighestPriorityReady(pScheduler);
     if (pBestReady == NULL || pBestReady->effectivePriority <= curRunning->effectivePriority) {
         // We didn't find anything better to run. Continue running the currently
         // running VP.
+        VirtualProcessorScheduler_UpdateQuantumTimer(pScheduler, true);
         return;
     }
     
@@ -223,40 +291,26 @@ void VirtualProcessorScheduler_OnEndOfQuantum(VirtualProcessorScheduler * _Nonnu
 
     
     // Request a context switch
+    ExecutionStats_ChargeSwitch(&curRunning->stats, false);
+    Trace_Record(kTraceEvent_SwitchOut, curRunning->vpid, curRunning->state, pBestReady->vpid);
+    Trace_Record(kTraceEvent_SwitchIn, pBestReady->vpid, pBestReady->effectivePriority, 0);
     pScheduler->scheduled = pBestReady;
     pScheduler->csw_signals |= CSW_SIGNAL_SWITCH;
+    VirtualProcessorScheduler_UpdateQuantumTimer(pScheduler, true);
 }
 
-// Arms a timeout for the given virtual processor. This puts the VP on the timeout
-// queue.
+// Arms a timeout for the given virtual processor. This puts the VP on the timer
+// wheel.
 static void VirtualProcessorScheduler_ArmTimeout(VirtualProcessorScheduler* _Nonnull pScheduler, VirtualProcessor* pVP, TimeInterval deadline)
 {
-    pVP->timeout.deadline = Quantums_MakeFromTimeInterval(deadline, QUANTUM_ROUNDING_AWAY_FROM_ZERO);
-    pVP->timeout.is_valid = true;
-    
-    register Timeout* pPrevTimeout = NULL;
-    register Timeout* pCurTimeout = (Timeout*)pScheduler->timeout_queue.first;
-    while (pCurTimeout) {
-        if (pCurTimeout->deadline > pVP->timeout.deadline) {
-            break;
-        }
-        
-        pPrevTimeout = pCurTimeout;
-        pCurTimeout = (Timeout*)pCurTimeout->queue_entry.next;
-    }
-    
-    List_InsertAfter(&pScheduler->timeout_queue, &pVP->timeout.queue_entry, &pPrevTimeout->queue_entry);
+    TimerWheel_Arm(&pScheduler->timeout_wheel, &pVP->timeout.entry, Quantums_MakeFromTimeInterval(deadline, QUANTUM_ROUNDING_AWAY_FROM_ZERO));
 }
 
 // Cancels an armed timeout for the given virtual processor. Does nothing if
 // no timeout is armed.
 static void VirtualProcessorScheduler_CancelTimeout(VirtualProcessorScheduler* _Nonnull pScheduler, VirtualProcessor* pVP)
 {
-    if (pVP->timeout.is_valid) {
-        List_Remove(&pScheduler->timeout_queue, &pVP->timeout.queue_entry);
-        pVP->timeout.deadline = kQuantums_Infinity;
-        pVP->timeout.is_valid = false;
-    }
+    TimerWheel_Cancel(&pScheduler->timeout_wheel, &pVP->timeout.entry);
 }
 
 // Put the currently running VP (the caller) on the given wait queue. Then runs
@@ -320,9 +374,11 @@ errno_t VirtualProcessorScheduler_WaitOn(VirtualProcessorScheduler* _Nonnull pSc
     } else {
         pVP->flags &= ~VP_FLAG_INTERRUPTABLE_WAIT;
     }
+    Trace_Record(kTraceEvent_WaitStart, pVP->vpid, pWaitQueue, isInterruptable);
 
     
     // Find another VP to run and context switch to it
+    ExecutionStats_ChargeSwitch(&pVP->stats, true);
     VirtualProcessorScheduler_SwitchTo(pScheduler,
                                        VirtualProcessorScheduler_GetHighestPriorityReady(pScheduler));
     
@@ -410,16 +466,20 @@ void VirtualProcessorScheduler_WakeUpOne(VirtualProcessorScheduler* _Nonnull pSc
     List_Remove(pWaitQueue, &pVP->rewa_queue_entry);
     
     VirtualProcessorScheduler_CancelTimeout(pScheduler, pVP);
+    Trace_Record(kTraceEvent_WakeUp, pVP->vpid, wakeUpReason, pWaitQueue);
     
     pVP->waiting_on_wait_queue = NULL;
     pVP->wakeup_reason = wakeUpReason;
     pVP->flags &= ~VP_FLAG_INTERRUPTABLE_WAIT;
+
+    const Quantums quantumsWaited = MonotonicClock_GetCurrentQuantums() - pVP->wait_start_time;
+    ExecutionStats_ChargeWait(&pVP->stats, quantumsWaited);
     
     
     if (pVP->suspension_count == 0) {
         // Make the VP ready and adjust it's effective priority based on the
         // time it has spent waiting
-        const int32_t quatersSlept = (MonotonicClock_GetCurrentQuantums() - pVP->wait_start_time) / pScheduler->quantums_per_quarter_second;
+        const int32_t quatersSlept = quantumsWaited / pScheduler->quantums_per_quarter_second;
         const int8_t boostedPriority = __min(pVP->effectivePriority + __min(quatersSlept, VP_PRIORITY_HIGHEST), VP_PRIORITY_HIGHEST);
         VirtualProcessorScheduler_AddVirtualProcessor_Locked(pScheduler, pVP, boostedPriority);
         
@@ -449,6 +509,7 @@ void VirtualProcessorScheduler_MaybeSwitchTo(VirtualProcessorScheduler* _Nonnull
             VirtualProcessor* pCurRunning = (VirtualProcessor*)pScheduler->running;
             
             VirtualProcessorScheduler_AddVirtualProcessor_Locked(pScheduler, pCurRunning, pCurRunning->priority);
+            ExecutionStats_ChargeSwitch(&pCurRunning->stats, false);
             VirtualProcessorScheduler_SwitchTo(pScheduler, pVP);
         }
     }
@@ -461,8 +522,11 @@ void VirtualProcessorScheduler_MaybeSwitchTo(VirtualProcessorScheduler* _Nonnull
 void VirtualProcessorScheduler_SwitchTo(VirtualProcessorScheduler* _Nonnull pScheduler, VirtualProcessor* _Nonnull pVP)
 {
     VirtualProcessorScheduler_RemoveVirtualProcessor_Locked(pScheduler, pVP);
+    Trace_Record(kTraceEvent_SwitchOut, pScheduler->running->vpid, pScheduler->running->state, pVP->vpid);
+    Trace_Record(kTraceEvent_SwitchIn, pVP->vpid, pVP->effectivePriority, 0);
     pScheduler->scheduled = pVP;
     pScheduler->csw_signals |= CSW_SIGNAL_SWITCH;
+    VirtualProcessorScheduler_UpdateQuantumTimer(pScheduler, false);
     VirtualProcessorScheduler_SwitchContext();
 }
 
@@ -657,10 +721,22 @@ static VirtualProcessor* _Nonnull IdleVirtualProcessor_Create(BootAllocator* _No
 }
 
 // Puts the CPU to sleep until an interrupt occurs. The interrupt will give the
-// scheduler a chance to run some other virtual processor if one is ready.
+// scheduler a chance to run some other virtual processor if one is ready. We
+// switch to a VP that was made ready by an interrupt handler right away since
+// the next quantum interrupt may be far out in tickless mode.
 static void IdleVirtualProcessor_Run(void* _Nullable pContext)
 {
+    VirtualProcessorScheduler* pScheduler = gVirtualProcessorScheduler;
+
     while (true) {
         cpu_sleep(gSystemDescription->cpu_model);
+
+        const int sps = VirtualProcessorScheduler_DisablePreemption();
+        VirtualProcessor* pBestReadyVP = VirtualProcessorScheduler_GetHighestPriorityReady(pScheduler);
+
+        if (pBestReadyVP) {
+            VirtualProcessorScheduler_MaybeSwitchTo(pScheduler, pBestReadyVP);
+        }
+        VirtualProcessorScheduler_RestorePreemption(sps);
     }
 }
@@ -24,6 +24,10 @@
 // 68040+ only.
 #define CSW_HW_HAS_FPU      0x01
 
+// Set if the FPU is a 68060 FPU. The 68060 stores the format byte of a FPU state
+// frame at a different offset than the older FPUs.
+#define CSW_HW_FPU_IS_68060 0x02
+
 
 // Set if voluntary context switches are enabled (which is the default). Disabling this will stop wakeup() calls from doing CSWs
 #define SCHED_FLAG_VOLUNTARY_CSW_ENABLED   0x01
@@ -48,9 +52,9 @@ typedef struct _VirtualProcessorScheduler {
     volatile uint8_t                      csw_signals;                    // Signals to the context switcher
     uint8_t                               csw_hw;                         // Hardware characteristics relevant for context switches
     uint8_t                               flags;                          // Scheduler flags
-    int8_t                                reserved[1];
+    volatile bool                         irq_from_user;                  // True if the interrupt that is currently being handled interrupted user mode code
     Quantums                            quantums_per_quarter_second;    // 1/4 second in terms of quantums
-    List                                timeout_queue;                  // Timeout queue managed by the scheduler. Sorted ascending by timer deadlines
+    TimerWheel                          timeout_wheel;                  // Timeouts of waiting VPs
     List                                sleep_queue;                    // VPs which block in a sleep() call wait on this wait queue
     List                                scheduler_wait_queue;           // The scheduler VP waits on this queue
     List                                finalizer_queue;
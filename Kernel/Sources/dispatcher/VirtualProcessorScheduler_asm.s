@@ -177,8 +177,20 @@ __rtecall_VirtualProcessorScheduler_SwitchContext:
     beq.s   __rtecall_VirtualProcessorScheduler_RestoreContext
 
     ; save the FPU state. Note that the 68060 fmovem.l instruction does not
-    ; support moving > 1 register at a time
+    ; support moving > 1 register at a time.
+    ; The FPU hands us a NULL state frame if the outgoing VP hasn't executed a
+    ; FPU instruction since its FPU state was last reset. The data registers
+    ; hold no state of the VP in this case and we skip saving them. The format
+    ; byte of the frame is at offset 0 on the 68881/68882/68040 and at offset 2
+    ; on the 68060.
     fsave       cpu_fsave(a0)
+    lea         cpu_fsave(a0), a1
+    btst    #CSWB_HW_FPU_IS_68060, _gVirtualProcessorSchedulerStorage + vps_csw_hw
+    beq.s   .2
+    addq.l  #2, a1
+.2:
+    tst.b   (a1)
+    beq.s   __rtecall_VirtualProcessorScheduler_RestoreContext
     fmovem      fp0 - fp7, cpu_fp0(a0)
     fmovem.l    fpcr, cpu_fpcr(a0)
     fmovem.l    fpsr, cpu_fpsr(a0)
@@ -201,17 +213,28 @@ __rtecall_VirtualProcessorScheduler_RestoreContext:
 
     ; check whether we should restore the FPU state
     btst    #CSWB_HW_HAS_FPU, _gVirtualProcessorSchedulerStorage + vps_csw_hw
-    beq.s   .2
+    beq.s   .5
 
     ; restore the FPU state. Note that the 68060 fmovem.l instruction does not
-    ; support moving > 1 register at a time
+    ; support moving > 1 register at a time.
+    ; Only the frestore is needed if the incoming VP has a NULL state frame
+    ; because restoring a NULL frame resets the FPU. This is also the case for
+    ; a VP that has never used the FPU since its save area starts out zeroed.
+    lea         cpu_fsave(a0), a1
+    btst    #CSWB_HW_FPU_IS_68060, _gVirtualProcessorSchedulerStorage + vps_csw_hw
+    beq.s   .3
+    addq.l  #2, a1
+.3:
+    tst.b   (a1)
+    beq.s   .4
     fmovem      cpu_fp0(a0), fp0 - fp7
     fmovem.l    cpu_fpcr(a0), fpcr
     fmovem.l    cpu_fpsr(a0), fpsr
     fmovem.l    cpu_fpiar(a0), fpiar
+.4:
     frestore    cpu_fsave(a0)
 
-.2:
+.5:
     ; restore the usp
     move.l  cpu_usp(a0), a1
     move.l  a1, usp
@@ -0,0 +1,190 @@
+//
+//  DispatchGroup.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/28/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "DispatchQueuePriv.h"
+
+CLASS_METHODS(DispatchGroup, Object,
+OVERRIDE_METHOD_IMPL(deinit, DispatchGroup, Object)
+);
+
+
+// Creates a dispatch group. A dispatch group tracks a set of outstanding tasks.
+// A task is added to the group by entering the group and it is removed from the
+// group by leaving it.
+errno_t DispatchGroup_Create(DispatchGroupRef _Nullable * _Nonnull pOutGroup)
+{
+    decl_try_err();
+    DispatchGroupRef self;
+
+    try(Object_Create(DispatchGroup, &self));
+    Lock_Init(&self->lock);
+    SList_Init(&self->waiters);
+    SList_Init(&self->notifications);
+    self->count = 0;
+
+    *pOutGroup = self;
+    return EOK;
+
+catch:
+    *pOutGroup = NULL;
+    return err;
+}
+
+static void GroupNotification_Destroy(GroupNotification* _Nullable pNote)
+{
+    if (pNote) {
+        Object_Release(pNote->queue);
+        pNote->queue = NULL;
+        SListNode_Deinit(&pNote->node);
+        kfree(pNote);
+    }
+}
+
+void DispatchGroup_deinit(DispatchGroupRef _Nonnull self)
+{
+    GroupNotification* pNote;
+
+    // Notifications of a group that never became empty are dropped
+    assert(SList_IsEmpty(&self->waiters));
+    while ((pNote = (GroupNotification*) SList_RemoveFirst(&self->notifications)) != NULL) {
+        GroupNotification_Destroy(pNote);
+    }
+
+    SList_Deinit(&self->waiters);
+    SList_Deinit(&self->notifications);
+    Lock_Deinit(&self->lock);
+}
+
+// Adds a task to the group.
+void DispatchGroup_Enter(DispatchGroupRef _Nonnull self)
+{
+    Lock_Lock(&self->lock);
+    self->count++;
+    Lock_Unlock(&self->lock);
+}
+
+// Dispatches the given notifications to their queues and frees them.
+static void DispatchGroup_DispatchNotifications(SList* _Nonnull pNotifications)
+{
+    GroupNotification* pNote;
+
+    while ((pNote = (GroupNotification*) SList_RemoveFirst(pNotifications)) != NULL) {
+        DispatchQueue_DispatchAsync(pNote->queue, pNote->closure);
+        GroupNotification_Destroy(pNote);
+    }
+}
+
+// Removes a task from the group. Wakes up all waiters and dispatches all notify
+// closures if this was the last outstanding task. Returns EINVAL if the group
+// has no outstanding task.
+errno_t DispatchGroup_Leave(DispatchGroupRef _Nonnull self)
+{
+    SList notifications;
+    CompletionSignaler* pSignaler;
+
+    Lock_Lock(&self->lock);
+    if (self->count == 0) {
+        Lock_Unlock(&self->lock);
+        return EINVAL;
+    }
+    self->count--;
+    if (self->count > 0) {
+        Lock_Unlock(&self->lock);
+        return EOK;
+    }
+
+
+    // Waiters are woken up while we are holding the lock. A waiter whose wait
+    // timed out uses the lock to find out whether it has been signaled already
+    while ((pSignaler = (CompletionSignaler*) SList_RemoveFirst(&self->waiters)) != NULL) {
+        Semaphore_Release(&pSignaler->semaphore);
+    }
+
+    notifications = self->notifications;
+    SList_Init(&self->notifications);
+    Lock_Unlock(&self->lock);
+
+
+    // We must not hold the group lock while dispatching since a notify closure
+    // may run right away and enter the group again
+    DispatchGroup_DispatchNotifications(&notifications);
+    return EOK;
+}
+
+// Blocks the caller until the group has no more outstanding tasks. Returns
+// ETIMEDOUT if the group is still busy at 'deadline'. Returns EINTR if the wait
+// was interrupted.
+errno_t DispatchGroup_Wait(DispatchGroupRef _Nonnull self, TimeInterval deadline)
+{
+    decl_try_err();
+    CompletionSignaler signaler;
+
+    Lock_Lock(&self->lock);
+    if (self->count == 0) {
+        Lock_Unlock(&self->lock);
+        return EOK;
+    }
+
+    CompletionSignaler_Init(&signaler);
+    Semaphore_Init(&signaler.semaphore, 0);
+    SList_InsertAfterLast(&self->waiters, &signaler.queue_entry);
+    Lock_Unlock(&self->lock);
+
+    err = Semaphore_Acquire(&signaler.semaphore, deadline);
+
+    if (err != EOK) {
+        // Take our signaler off the waiter list if the group did not get a
+        // chance to signal it yet. Otherwise the group did become empty in the
+        // meantime and the wait was successful after all.
+        SListNode* pPrevNode = NULL;
+        SListNode* pCurNode;
+
+        Lock_Lock(&self->lock);
+        pCurNode = self->waiters.first;
+        while (pCurNode && pCurNode != &signaler.queue_entry) {
+            pPrevNode = pCurNode;
+            pCurNode = pCurNode->next;
+        }
+        if (pCurNode) {
+            SList_Remove(&self->waiters, pPrevNode, pCurNode);
+        } else {
+            err = EOK;
+        }
+        Lock_Unlock(&self->lock);
+    }
+
+    CompletionSignaler_Deinit(&signaler);
+    Semaphore_Deinit(&signaler.semaphore);
+    return err;
+}
+
+// Asynchronously executes the given closure on 'pQueue' once the group has no
+// more outstanding tasks. The closure is dispatched right away if the group is
+// empty. The notification is one-shot.
+errno_t DispatchGroup_Notify(DispatchGroupRef _Nonnull self, DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    decl_try_err();
+    GroupNotification* pNote;
+
+    Lock_Lock(&self->lock);
+    if (self->count == 0) {
+        Lock_Unlock(&self->lock);
+        return DispatchQueue_DispatchAsync(pQueue, closure);
+    }
+
+    err = kalloc(sizeof(GroupNotification), (void**) &pNote);
+    if (err == EOK) {
+        SListNode_Init(&pNote->node);
+        pNote->queue = Object_RetainAs(pQueue, DispatchQueue);
+        pNote->closure = closure;
+        SList_InsertAfterLast(&self->notifications, &pNote->node);
+    }
+    Lock_Unlock(&self->lock);
+
+    return err;
+}
@@ -14,6 +14,7 @@ OVERRIDE_METHOD_IMPL(deinit, DispatchQueue, Object)
 
 
 DispatchQueueRef    gMainDispatchQueue;
+DispatchQueueRef    gAsyncIODispatchQueue;
 
 
 errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int qos, int priority, VirtualProcessorPoolRef _Nonnull vpPoolRef, ProcessRef _Nullable _Weak pProc, DispatchQueueRef _Nullable * _Nonnull pOutQueue)
@@ -30,7 +31,7 @@ errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int qos, in
     
     try(Object_CreateWithExtraBytes(DispatchQueue, sizeof(ConcurrencyLane) * (maxConcurrency - 1), &pQueue));
     SList_Init(&pQueue->item_queue);
-    SList_Init(&pQueue->timer_queue);
+    TimerWheel_Init(&pQueue->timer_wheel, MonotonicClock_GetCurrentQuantums());
     SList_Init(&pQueue->item_cache_queue);
     SList_Init(&pQueue->timer_cache_queue);
     SList_Init(&pQueue->completion_signaler_cache_queue);
@@ -39,12 +40,21 @@ errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int qos, in
     ConditionVariable_Init(&pQueue->vp_shutdown_signaler);
     pQueue->owning_process = pProc;
     pQueue->virtual_processor_pool = vpPoolRef;
+    pQueue->stats.parent = (pProc) ? Process_GetExecutionStats(pProc) : NULL;
     pQueue->state = kQueueState_Running;
     pQueue->minConcurrency = (int8_t)minConcurrency;
     pQueue->maxConcurrency = (int8_t)maxConcurrency;
     pQueue->qos = qos;
     pQueue->priority = priority;
 
+    for (int i = 0; i < maxConcurrency; i++) {
+        ConcurrencyLane* pLane = &pQueue->concurrency_lanes[i];
+
+        SList_Init(&pLane->item_queue);
+        SList_Init(&pLane->item_cache_queue);
+        Lock_Init(&pLane->lock);
+    }
+
     for (int i = 0; i < minConcurrency; i++) {
         try(DispatchQueue_AcquireVirtualProcessor_Locked(pQueue));
     }
@@ -58,25 +68,83 @@ catch:
     return err;
 }
 
+// Returns true if the queue spreads its immediate work items across the
+// concurrency lanes. Serial queues keep all items on the queue item queue.
+#define DispatchQueue_UsesLanes(__pQueue) \
+    ((__pQueue)->maxConcurrency > 1)
+
 // Removes all queued work items, one-shot and repeatable timers from the queue.
-static void DispatchQueue_Flush_Locked(DispatchQueueRef _Nonnull pQueue)
+// Work items which belong to a dispatch group are moved to 'pGroupItems'
+// instead of being relinquished. The caller must pass them to
+// DispatchQueue_LeaveGroups() after it has dropped the queue lock.
+static void DispatchQueue_Flush_Locked(DispatchQueueRef _Nonnull pQueue, SList* _Nonnull pGroupItems)
 {
     // Flush the work item queue
     WorkItemRef pItem;
     while ((pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_queue)) != NULL) {
         WorkItem_SignalCompletion(pItem, true);
-        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+        if (pItem->group) {
+            SList_InsertAfterLast(pGroupItems, &pItem->queue_entry);
+        } else {
+            DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+        }
+    }
+    pQueue->items_queued_count = 0;
+    pQueue->barriers_pending_count = (pQueue->is_barrier_executing) ? 1 : 0;
+
+
+    // Flush the concurrency lanes. Taking the lane locks also guarantees that a
+    // dispatch which saw the queue in running state has finished putting its
+    // item on a lane
+    if (DispatchQueue_UsesLanes(pQueue)) {
+        for (int i = 0; i < pQueue->maxConcurrency; i++) {
+            ConcurrencyLane* pLane = &pQueue->concurrency_lanes[i];
+
+            Lock_Lock(&pLane->lock);
+            while ((pItem = (WorkItemRef) SList_RemoveFirst(&pLane->item_queue)) != NULL) {
+                WorkItem_SignalCompletion(pItem, true);
+                if (pItem->group) {
+                    SList_InsertAfterLast(pGroupItems, &pItem->queue_entry);
+                } else {
+                    ConcurrencyLane_RelinquishWorkItem_Locked(pLane, pItem);
+                }
+            }
+            pLane->items_queued_count = 0;
+            Lock_Unlock(&pLane->lock);
+        }
     }
 
 
     // Flush the timers
-    TimerRef pTimer;
-    while ((pTimer = (TimerRef) SList_RemoveFirst(&pQueue->timer_queue)) != NULL) {
-        WorkItem_SignalCompletion(pItem, true);
+    TimerWheelEntry* pEntry;
+    while ((pEntry = TimerWheel_RemoveAny(&pQueue->timer_wheel)) != NULL) {
+        TimerRef pTimer = TimerFromWheelEntry(pEntry);
+
+        WorkItem_SignalCompletion((WorkItemRef) pTimer, true);
         DispatchQueue_RelinquishTimer_Locked(pQueue, pTimer);
     }
 }
 
+// Makes the flushed work items in 'pGroupItems' leave their dispatch groups and
+// relinquishes them. Expects that the caller does not hold the queue lock.
+static void DispatchQueue_LeaveGroups(DispatchQueueRef _Nonnull pQueue, SList* _Nonnull pGroupItems)
+{
+    if (SList_IsEmpty(pGroupItems)) {
+        return;
+    }
+
+    SList_ForEach(pGroupItems, WorkItem, {
+        WorkItem_LeaveGroup(pCurNode);
+    });
+
+    Lock_Lock(&pQueue->lock);
+    WorkItemRef pItem;
+    while ((pItem = (WorkItemRef) SList_RemoveFirst(pGroupItems)) != NULL) {
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+    }
+    Lock_Unlock(&pQueue->lock);
+}
+
 // Terminates the dispatch queue. This does:
 // *) an abort of ongoing call-as-user operations on all VPs attached to the queue
 // *) flushes the queue
@@ -91,6 +159,10 @@ static void DispatchQueue_Flush_Locked(DispatchQueueRef _Nonnull pQueue)
 // returns, that no further work items will execute.
 void DispatchQueue_Terminate(DispatchQueueRef _Nonnull pQueue)
 {
+    SList groupItems;
+
+    SList_Init(&groupItems);
+
     // Request queue termination. This will stop all dispatch calls from
     // accepting new work items and repeatable timers from rescheduling. This
     // will also cause the VPs to exit their work loop and to relinquish
@@ -105,7 +177,7 @@ void DispatchQueue_Terminate(DispatchQueueRef _Nonnull pQueue)
 
     // Flush the dispatch queue which means that we get rid of all still queued
     // work items and timers.
-    DispatchQueue_Flush_Locked(pQueue);
+    DispatchQueue_Flush_Locked(pQueue, &groupItems);
 
 
     // Abort all ongoing call-as-user invocations.
@@ -119,6 +191,8 @@ void DispatchQueue_Terminate(DispatchQueueRef _Nonnull pQueue)
     // We want to wake _all_ VPs up here since all of them need to relinquish
     // themselves.
     ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
+
+    DispatchQueue_LeaveGroups(pQueue, &groupItems);
 }
 
 // Waits until the dispatch queue has reached 'terminated' state which means that
@@ -126,7 +200,7 @@ void DispatchQueue_Terminate(DispatchQueueRef _Nonnull pQueue)
 void DispatchQueue_WaitForTerminationCompleted(DispatchQueueRef _Nonnull pQueue)
 {
     Lock_Lock(&pQueue->lock);
-    while (pQueue->availableConcurrency > 0) {
+    while (pQueue->availableConcurrency > 0 || pQueue->is_executing_inline) {
         ConditionVariable_Wait(&pQueue->vp_shutdown_signaler, &pQueue->lock, kTimeInterval_Infinity);
     }
 
@@ -148,7 +222,7 @@ static void _DispatchQueue_Destroy(DispatchQueueRef _Nonnull pQueue)
     // No more VPs are attached to this queue. We can now go ahead and free
     // all resources.
     SList_Deinit(&pQueue->item_queue);      // guaranteed to be empty at this point
-    SList_Deinit(&pQueue->timer_queue);     // guaranteed to be empty at this point
+    TimerWheel_Deinit(&pQueue->timer_wheel);    // guaranteed to be empty at this point
 
     while ((pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_cache_queue)) != NULL) {
         WorkItem_Destroy(pItem);
@@ -164,6 +238,17 @@ static void _DispatchQueue_Destroy(DispatchQueueRef _Nonnull pQueue)
         CompletionSignaler_Destroy(pCompSignaler);
     }
     SList_Deinit(&pQueue->completion_signaler_cache_queue);
+
+    for (int i = 0; i < pQueue->maxConcurrency; i++) {
+        ConcurrencyLane* pLane = &pQueue->concurrency_lanes[i];
+
+        SList_Deinit(&pLane->item_queue);       // guaranteed to be empty at this point
+        while ((pItem = (WorkItemRef) SList_RemoveFirst(&pLane->item_cache_queue)) != NULL) {
+            WorkItem_Destroy(pItem);
+        }
+        SList_Deinit(&pLane->item_cache_queue);
+        Lock_Deinit(&pLane->lock);
+    }
         
     Lock_Deinit(&pQueue->lock);
     ConditionVariable_Deinit(&pQueue->work_available_signaler);
@@ -183,51 +268,67 @@ void DispatchQueue_deinit(DispatchQueueRef _Nonnull pQueue)
     _DispatchQueue_Destroy(pQueue);
 }
 
-// Makes sure that we have enough virtual processors attached to the dispatch queue
-// and acquires a virtual processor from the virtual processor pool if necessary.
-// The virtual processor is attached to the dispatch queue and remains attached
-// until it is relinquished by the queue.
-static errno_t DispatchQueue_AcquireVirtualProcessor_Locked(DispatchQueueRef _Nonnull pQueue)
+// Acquires a virtual processor from the virtual processor pool and attaches it
+// to a free concurrency lane of the dispatch queue. The virtual processor
+// remains attached until it is relinquished by the queue. Expects that the
+// queue has a free concurrency lane.
+static errno_t DispatchQueue_AttachVirtualProcessor_Locked(DispatchQueueRef _Nonnull pQueue)
 {
     decl_try_err();
+    int conLaneIdx = -1;
+
+    for (int i = 0; i < pQueue->maxConcurrency; i++) {
+        if (pQueue->concurrency_lanes[i].vp == NULL) {
+            conLaneIdx = i;
+            break;
+        }
+    }
+    assert(conLaneIdx != -1);
 
+    const int priority = pQueue->qos * kDispatchPriority_Count + (pQueue->priority + kDispatchPriority_Count / 2) + VP_PRIORITIES_RESERVED_LOW;
+    VirtualProcessor* pVP = NULL;
+    try(VirtualProcessorPool_AcquireVirtualProcessor(
+                                        pQueue->virtual_processor_pool,
+                                        VirtualProcessorParameters_Make((Closure1Arg_Func)DispatchQueue_Run, pQueue, VP_DEFAULT_KERNEL_STACK_SIZE, VP_DEFAULT_USER_STACK_SIZE, priority),
+                                        &pVP));
+
+    VirtualProcessor_SetDispatchQueue(pVP, pQueue, &pQueue->stats, conLaneIdx);
+    pQueue->concurrency_lanes[conLaneIdx].vp = pVP;
+    pQueue->availableConcurrency++;
+
+    VirtualProcessor_Resume(pVP, false);
+    return EOK;
+
+catch:
+    return err;
+}
+
+// Returns true if the queue should acquire another virtual processor given that
+// 'queuedCount' work items are waiting for a virtual processor.
+static bool DispatchQueue_NeedsVirtualProcessor_Locked(DispatchQueueRef _Nonnull pQueue, int queuedCount)
+{
     // Acquire a new virtual processor if we haven't already filled up all
     // concurrency lanes available to us and one of the following is true:
     // - we don't own any virtual processor at all
     // - we have < minConcurrency virtual processors (remember that this can be 0)
     // - we've queued up at least 4 work items and < maxConcurrency virtual processors
-    if (pQueue->state == kQueueState_Running
+    return pQueue->state == kQueueState_Running
         && (pQueue->availableConcurrency == 0
             || pQueue->availableConcurrency < pQueue->minConcurrency
-            || (pQueue->items_queued_count > 4 && pQueue->availableConcurrency < pQueue->maxConcurrency))) {
-        int conLaneIdx = -1;
-
-        for (int i = 0; i < pQueue->maxConcurrency; i++) {
-            if (pQueue->concurrency_lanes[i].vp == NULL) {
-                conLaneIdx = i;
-                break;
-            }
-        }
-        assert(conLaneIdx != -1);
-
-        const int priority = pQueue->qos * kDispatchPriority_Count + (pQueue->priority + kDispatchPriority_Count / 2) + VP_PRIORITIES_RESERVED_LOW;
-        VirtualProcessor* pVP = NULL;
-        try(VirtualProcessorPool_AcquireVirtualProcessor(
-                                            pQueue->virtual_processor_pool,
-                                            VirtualProcessorParameters_Make((Closure1Arg_Func)DispatchQueue_Run, pQueue, VP_DEFAULT_KERNEL_STACK_SIZE, VP_DEFAULT_USER_STACK_SIZE, priority),
-                                            &pVP));
-
-        VirtualProcessor_SetDispatchQueue(pVP, pQueue, conLaneIdx);
-        pQueue->concurrency_lanes[conLaneIdx].vp = pVP;
-        pQueue->availableConcurrency++;
+            || (queuedCount > 4 && pQueue->availableConcurrency < pQueue->maxConcurrency));
+}
 
-        VirtualProcessor_Resume(pVP, false);
+// Makes sure that we have enough virtual processors attached to the dispatch queue
+// and acquires a virtual processor from the virtual processor pool if necessary.
+// The virtual processor is attached to the dispatch queue and remains attached
+// until it is relinquished by the queue.
+static errno_t DispatchQueue_AcquireVirtualProcessor_Locked(DispatchQueueRef _Nonnull pQueue)
+{
+    if (DispatchQueue_NeedsVirtualProcessor_Locked(pQueue, pQueue->items_queued_count)) {
+        return DispatchQueue_AttachVirtualProcessor_Locked(pQueue);
     }
 
     return EOK;
-
-catch:
-    return err;
 }
 
 // Relinquishes the given virtual processor. The associated concurrency lane is
@@ -241,7 +342,7 @@ static void DispatchQueue_RelinquishVirtualProcessor_Locked(DispatchQueueRef _No
 
     assert(conLaneIdx >= 0 && conLaneIdx < pQueue->maxConcurrency);
 
-    VirtualProcessor_SetDispatchQueue(pVP, NULL, -1);
+    VirtualProcessor_SetDispatchQueue(pVP, NULL, NULL, -1);
     pQueue->concurrency_lanes[conLaneIdx].vp = NULL;
     pQueue->availableConcurrency--;
 }
@@ -286,6 +387,46 @@ static void DispatchQueue_RelinquishWorkItem_Locked(DispatchQueue* _Nonnull pQue
     }
 }
 
+// Creates a work item for the given closure from the item cache of the given
+// concurrency lane whenever possible. Expects that the caller holds the lane
+// lock.
+static errno_t ConcurrencyLane_AcquireWorkItem_Locked(ConcurrencyLane* _Nonnull pLane, DispatchQueueClosure closure, WorkItemRef _Nullable * _Nonnull pOutItem)
+{
+    decl_try_err();
+    WorkItemRef pItem = (WorkItemRef) SList_RemoveFirst(&pLane->item_cache_queue);
+
+    if (pItem != NULL) {
+        WorkItem_Init(pItem, kItemType_Immediate, closure, true);
+        pLane->item_cache_count--;
+        *pOutItem = pItem;
+    } else {
+        try(WorkItem_Create_Internal(closure, true, pOutItem));
+    }
+    return EOK;
+
+catch:
+    *pOutItem = NULL;
+    return err;
+}
+
+// Relinquishes the given work item to the item cache of the given concurrency
+// lane. Does nothing if the dispatch queue does not own the item. Expects that
+// the caller holds the lane lock.
+static void ConcurrencyLane_RelinquishWorkItem_Locked(ConcurrencyLane* _Nonnull pLane, WorkItemRef _Nonnull pItem)
+{
+    if (!pItem->is_owned_by_queue) {
+        return;
+    }
+
+    if (pLane->item_cache_count < MAX_LANE_ITEM_CACHE_COUNT) {
+        WorkItem_Deinit(pItem);
+        SList_InsertBeforeFirst(&pLane->item_cache_queue, &pItem->queue_entry);
+        pLane->item_cache_count++;
+    } else {
+        WorkItem_Destroy(pItem);
+    }
+}
+
 // Creates a timer for the given closure and closure context. Tries to reuse
 // an existing timer from the timer cache whenever possible. Expects that the
 // caller holds the dispatch queue lock.
@@ -361,6 +502,151 @@ static void DispatchQueue_RelinquishCompletionSignaler_Locked(DispatchQueue* _No
     }
 }
 
+// Makes sure that no new work item is put on a concurrency lane until the
+// barriers on the item queue have executed. Dispatchers check the barrier count
+// while holding a lane lock. So once we have taken and dropped every lane lock,
+// all dispatchers that did not see the updated count have finished putting their
+// item on a lane. The items that are on the lanes at this point were dispatched
+// before the barrier and they execute before it.
+static void DispatchQueue_CloseLanes_Locked(DispatchQueueRef _Nonnull pQueue)
+{
+    if (DispatchQueue_UsesLanes(pQueue)) {
+        for (int i = 0; i < pQueue->maxConcurrency; i++) {
+            Lock_Lock(&pQueue->concurrency_lanes[i].lock);
+            Lock_Unlock(&pQueue->concurrency_lanes[i].lock);
+        }
+    }
+}
+
+// Returns true if all concurrency lanes are empty. Expects that the caller
+// holds the queue lock.
+static bool DispatchQueue_AreLanesEmpty_Locked(DispatchQueueRef _Nonnull pQueue)
+{
+    if (DispatchQueue_UsesLanes(pQueue)) {
+        for (int i = 0; i < pQueue->maxConcurrency; i++) {
+            if (pQueue->concurrency_lanes[i].items_queued_count > 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Tries to put an immediate work item on a concurrency lane without taking the
+// queue lock. 'pItem' is the item that should be dispatched or NULL if a queue
+// owned item for 'closure' should be created. The item joins 'pGroup' if it is
+// not NULL. Items dispatched from a VP of the queue go on the lane of the VP and
+// all other items are spread round-robin across the lanes. Returns false if the
+// caller should fall back to the queue item queue instead. This is the case if
+// the queue is serial, it has no VP, it is terminating, a barrier is pending
+// or the item could not be created.
+static bool DispatchQueue_TryDispatchOnLane(DispatchQueueRef _Nonnull pQueue, WorkItemRef _Nullable pItem, DispatchQueueClosure closure, DispatchGroupRef _Nullable pGroup)
+{
+    VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
+    ConcurrencyLane* pLane;
+    int queuedCount;
+
+    if (!DispatchQueue_UsesLanes(pQueue) || pQueue->availableConcurrency == 0) {
+        return false;
+    }
+
+    if (pVP->dispatchQueue == pQueue && pVP->dispatchQueueConcurrencyLaneIndex >= 0) {
+        pLane = &pQueue->concurrency_lanes[pVP->dispatchQueueConcurrencyLaneIndex];
+    } else {
+        pLane = &pQueue->concurrency_lanes[(unsigned int)AtomicInt_Increment(&pQueue->next_lane) % (unsigned int)pQueue->maxConcurrency];
+    }
+
+
+    // The queue state and the barrier count are only changed while the queue
+    // lock is held. The writer then takes all lane locks. See
+    // DispatchQueue_CloseLanes_Locked()
+    Lock_Lock(&pLane->lock);
+    if (pQueue->state != kQueueState_Running || pQueue->barriers_pending_count > 0) {
+        Lock_Unlock(&pLane->lock);
+        return false;
+    }
+
+    if (pItem == NULL) {
+        if (ConcurrencyLane_AcquireWorkItem_Locked(pLane, closure, &pItem) != EOK) {
+            Lock_Unlock(&pLane->lock);
+            return false;
+        }
+    }
+    if (pGroup) {
+        DispatchGroup_Enter(pGroup);
+        pItem->group = Object_RetainAs(pGroup, DispatchGroup);
+    }
+
+    SList_InsertAfterLast(&pLane->item_queue, &pItem->queue_entry);
+    pLane->items_queued_count++;
+    queuedCount = pLane->items_queued_count;
+    Lock_Unlock(&pLane->lock);
+
+
+    // We only need the queue lock if a VP is idle and needs to be woken up or
+    // if the lane is backing up and we are allowed to acquire another VP. An
+    // idle VP counts itself as idle before it checks the lanes for the last
+    // time. So it either sees our item or we see it as idle here.
+    if (pQueue->idle_vp_count > 0
+        || pQueue->availableConcurrency == 0
+        || (queuedCount > 4 && pQueue->availableConcurrency < pQueue->maxConcurrency)) {
+        Lock_Lock(&pQueue->lock);
+        if (DispatchQueue_NeedsVirtualProcessor_Locked(pQueue, queuedCount)) {
+            // Failing to acquire a VP is fine as long as we have at least one.
+            // The item stays on the lane otherwise and it is picked up by the
+            // next VP that the queue acquires
+            (void) DispatchQueue_AttachVirtualProcessor_Locked(pQueue);
+        }
+        ConditionVariable_SignalAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
+    }
+
+    return true;
+}
+
+// Removes the next work item from the concurrency lane 'laneIdx' or steals one
+// from the other lanes if 'laneIdx' is empty. 'pDoneItem' is a lane item that
+// the caller has finished executing or NULL. It is moved to the item cache of
+// 'laneIdx' while we are holding the lane lock anyway. Lanes that look empty
+// are skipped without taking their lock. The returned item is already counted
+// as executing. Returns NULL if all lanes are empty.
+static WorkItemRef _Nullable DispatchQueue_DequeueLaneItem(DispatchQueueRef _Nonnull pQueue, int laneIdx, WorkItemRef _Nullable pDoneItem)
+{
+    WorkItemRef pItem = NULL;
+
+    for (int i = 0; i < pQueue->maxConcurrency && pItem == NULL; i++) {
+        ConcurrencyLane* pLane = &pQueue->concurrency_lanes[(laneIdx + i) % pQueue->maxConcurrency];
+
+        if (pLane->items_queued_count == 0 && (i > 0 || pDoneItem == NULL)) {
+            continue;
+        }
+
+        Lock_Lock(&pLane->lock);
+        if (i == 0 && pDoneItem) {
+            ConcurrencyLane_RelinquishWorkItem_Locked(pLane, pDoneItem);
+        }
+        pItem = (WorkItemRef) SList_RemoveFirst(&pLane->item_queue);
+        if (pItem) {
+            // Count the item as executing before it leaves the lane. A barrier
+            // checks the lanes and then the executing count
+            AtomicInt_Increment(&pQueue->items_executing_count);
+            pLane->items_queued_count--;
+        }
+        Lock_Unlock(&pLane->lock);
+    }
+
+    return pItem;
+}
+
+// Moves the given lane item to the item cache of the lane 'laneIdx'.
+static void DispatchQueue_RelinquishLaneWorkItem(DispatchQueueRef _Nonnull pQueue, int laneIdx, WorkItemRef _Nonnull pItem)
+{
+    ConcurrencyLane* pLane = &pQueue->concurrency_lanes[laneIdx];
+
+    Lock_Lock(&pLane->lock);
+    ConcurrencyLane_RelinquishWorkItem_Locked(pLane, pItem);
+    Lock_Unlock(&pLane->lock);
+}
+
 // Asynchronously executes the given work item. The work item is executed as
 // soon as possible. Expects to be called with the dispatch queue held. Returns
 // with the dispatch queue unlocked.
@@ -368,16 +654,76 @@ static errno_t DispatchQueue_DispatchWorkItemAsyncAndUnlock_Locked(DispatchQueue
 {
     decl_try_err();
 
-    SList_InsertAfterLast(&pQueue->item_queue, &pItem->queue_entry);
+    // Failing to acquire an additional VP is fine as long as we have at least
+    // one VP that will execute the item. The item is not enqueued and the queue
+    // stays locked if we have none
     pQueue->items_queued_count++;
+    err = DispatchQueue_AcquireVirtualProcessor_Locked(pQueue);
+    if (err != EOK && pQueue->availableConcurrency == 0) {
+        pQueue->items_queued_count--;
+        return err;
+    }
 
-    try(DispatchQueue_AcquireVirtualProcessor_Locked(pQueue));
+    SList_InsertAfterLast(&pQueue->item_queue, &pItem->queue_entry);
+    if (pItem->is_barrier) {
+        pQueue->barriers_pending_count++;
+        DispatchQueue_CloseLanes_Locked(pQueue);
+    }
     ConditionVariable_SignalAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
     
     return EOK;
+}
 
-catch:
-    return err;
+// Asynchronously executes the 'count' work items on the list 'pItems'. Makes
+// sure that the queue has enough virtual processors to work on the items in
+// parallel. Expects to be called with the dispatch queue held. Returns with the
+// dispatch queue unlocked if the items were enqueued. Returns with the dispatch
+// queue still locked and the items still on 'pItems' if the queue has no
+// virtual processor and it was not able to acquire one.
+static errno_t DispatchQueue_DispatchWorkItemsAsyncAndUnlock_Locked(DispatchQueueRef _Nonnull pQueue, SList* _Nonnull pItems, int count)
+{
+    decl_try_err();
+    const int nLanes = __min(count, pQueue->maxConcurrency);
+    SListNode* pCurNode;
+
+    // Failing to acquire additional lanes is fine as long as we have at least
+    // one lane to work on the items
+    while (pQueue->availableConcurrency < nLanes) {
+        err = DispatchQueue_AttachVirtualProcessor_Locked(pQueue);
+        if (err != EOK) {
+            if (pQueue->availableConcurrency == 0) {
+                return err;
+            }
+            break;
+        }
+    }
+
+    if (DispatchQueue_UsesLanes(pQueue) && pQueue->barriers_pending_count == 0) {
+        // Hand every lane an equally sized run of the batch. This takes every
+        // lane lock once no matter how large the batch is
+        const int nPerLane = (count + pQueue->maxConcurrency - 1) / pQueue->maxConcurrency;
+        const int firstLaneIdx = (unsigned int)AtomicInt_Add(&pQueue->next_lane, pQueue->maxConcurrency) % (unsigned int)pQueue->maxConcurrency;
+
+        for (int i = 0; i < pQueue->maxConcurrency && !SList_IsEmpty(pItems); i++) {
+            ConcurrencyLane* pLane = &pQueue->concurrency_lanes[(firstLaneIdx + i) % pQueue->maxConcurrency];
+
+            Lock_Lock(&pLane->lock);
+            for (int j = 0; j < nPerLane && (pCurNode = SList_RemoveFirst(pItems)) != NULL; j++) {
+                SList_InsertAfterLast(&pLane->item_queue, pCurNode);
+                pLane->items_queued_count++;
+            }
+            Lock_Unlock(&pLane->lock);
+        }
+    }
+    else {
+        while ((pCurNode = SList_RemoveFirst(pItems)) != NULL) {
+            SList_InsertAfterLast(&pQueue->item_queue, pCurNode);
+        }
+        pQueue->items_queued_count += count;
+    }
+
+    ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
+    return EOK;
 }
 
 // Synchronously executes the given work item. The work item is executed as
@@ -430,6 +776,70 @@ catch:
     return err;
 }
 
+// Returns true if the caller of a DispatchSync() may execute 'closure' directly
+// on its own virtual processor instead of handing it to a queue VP and waiting
+// for it. This is the case if the queue is serial, nothing is queued up or
+// executing and the caller runs on behalf of the process that owns the queue.
+// User closures always go through a queue VP because call-as-user invocations
+// can not be nested.
+static bool DispatchQueue_CanExecuteInline_Locked(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    DispatchQueueRef pCurQueue = DispatchQueue_GetCurrent();
+    ProcessRef pCurProc = (pCurQueue) ? pCurQueue->owning_process : NULL;
+
+    return pQueue->maxConcurrency == 1
+        && !closure.isUser
+        && pCurQueue != pQueue
+        && pCurProc == pQueue->owning_process
+        && pQueue->items_executing_count == 0
+        && SList_IsEmpty(&pQueue->item_queue);
+}
+
+// Executes 'closure' on the caller's virtual processor. The caller owns the
+// queue while the closure is executing: the queue VPs do not start any other
+// item or timer until the closure has returned. DispatchQueue_GetCurrent()
+// returns 'pQueue' while the closure is executing. Expects that the caller
+// holds the dispatch queue lock. Returns with the dispatch queue unlocked.
+static errno_t DispatchQueue_ExecuteInlineAndUnlock_Locked(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
+    void* pPrevQueue = pVP->dispatchQueue;
+    ExecutionStats* pPrevStats = pVP->stats.parent;
+    const int prevConLaneIdx = pVP->dispatchQueueConcurrencyLaneIndex;
+    bool wasInterrupted;
+
+    AtomicInt_Increment(&pQueue->items_executing_count);
+    pQueue->is_executing_inline = true;
+    Lock_Unlock(&pQueue->lock);
+
+    VirtualProcessor_SetDispatchQueue(pVP, pQueue, &pQueue->stats, -1);
+    Trace_Record(kTraceEvent_DispatchItemStart, pVP->vpid, pQueue, 0);
+    closure.func(closure.context);
+    Trace_Record(kTraceEvent_DispatchItemEnd, pVP->vpid, pQueue, 0);
+    VirtualProcessor_SetDispatchQueue(pVP, pPrevQueue, pPrevStats, prevConLaneIdx);
+
+    Lock_Lock(&pQueue->lock);
+    AtomicInt_Decrement(&pQueue->items_executing_count);
+    pQueue->is_executing_inline = false;
+
+
+    // A DispatchQueue_WaitForTerminationCompleted() caller waits for us to
+    // give up the queue. Otherwise hand the queue back to its VPs if they have
+    // work waiting
+    wasInterrupted = (pQueue->state >= kQueueState_Terminating);
+    if (wasInterrupted) {
+        ConditionVariable_BroadcastAndUnlock(&pQueue->vp_shutdown_signaler, &pQueue->lock);
+    }
+    else if (!SList_IsEmpty(&pQueue->item_queue) || !TimerWheel_IsEmpty(&pQueue->timer_wheel)) {
+        ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
+    }
+    else {
+        Lock_Unlock(&pQueue->lock);
+    }
+
+    return (wasInterrupted) ? EINTR : EOK;
+}
+
 // Removes all scheduled instances of the given work item from the dispatch
 // queue.
 static void DispatchQueue_RemoveWorkItem_Locked(DispatchQueueRef _Nonnull pQueue, WorkItemRef _Nonnull pItem)
@@ -444,6 +854,9 @@ static void DispatchQueue_RemoveWorkItem_Locked(DispatchQueueRef _Nonnull pQueue
             WorkItem_SignalCompletion(pCurItem, true);
             SList_Remove(&pQueue->item_queue, &pPrevItem->queue_entry, &pCurItem->queue_entry);
             pQueue->items_queued_count--;
+            if (pCurItem->is_barrier) {
+                pQueue->barriers_pending_count--;
+            }
             DispatchQueue_RelinquishWorkItem_Locked(pQueue, pCurItem);
             // pPrevItem doesn't change here
             pCurItem = pNextItem;
@@ -453,25 +866,39 @@ static void DispatchQueue_RemoveWorkItem_Locked(DispatchQueueRef _Nonnull pQueue
             pCurItem = (WorkItemRef) pCurItem->queue_entry.next;
         }
     }
+
+    if (DispatchQueue_UsesLanes(pQueue)) {
+        for (int i = 0; i < pQueue->maxConcurrency; i++) {
+            ConcurrencyLane* pLane = &pQueue->concurrency_lanes[i];
+
+            Lock_Lock(&pLane->lock);
+            pCurItem = (WorkItemRef) pLane->item_queue.first;
+            pPrevItem = NULL;
+            while (pCurItem) {
+                if (pCurItem == pItem) {
+                    WorkItemRef pNextItem = (WorkItemRef) pCurItem->queue_entry.next;
+
+                    WorkItem_SignalCompletion(pCurItem, true);
+                    SList_Remove(&pLane->item_queue, &pPrevItem->queue_entry, &pCurItem->queue_entry);
+                    pLane->items_queued_count--;
+                    ConcurrencyLane_RelinquishWorkItem_Locked(pLane, pCurItem);
+                    pCurItem = pNextItem;
+                }
+                else {
+                    pPrevItem = pCurItem;
+                    pCurItem = (WorkItemRef) pCurItem->queue_entry.next;
+                }
+            }
+            Lock_Unlock(&pLane->lock);
+        }
+    }
 }
 
-// Adds the given timer to the timer queue. Expects that the queue is already
+// Adds the given timer to the timer wheel. Expects that the queue is already
 // locked. Does not wake up the queue.
 static void DispatchQueue_AddTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
 {
-    TimerRef pPrevTimer = NULL;
-    TimerRef pCurTimer = (TimerRef)pQueue->timer_queue.first;
-    
-    while (pCurTimer) {
-        if (TimeInterval_Greater(pCurTimer->deadline, pTimer->deadline)) {
-            break;
-        }
-        
-        pPrevTimer = pCurTimer;
-        pCurTimer = (TimerRef)pCurTimer->item.queue_entry.next;
-    }
-    
-    SList_InsertAfter(&pQueue->timer_queue, &pTimer->item.queue_entry, &pPrevTimer->item.queue_entry);
+    TimerWheel_Arm(&pQueue->timer_wheel, &pTimer->wheel_entry, Quantums_MakeFromTimeInterval(pTimer->deadline, QUANTUM_ROUNDING_AWAY_FROM_ZERO));
 }
 
 // Asynchronously executes the given timer when it comes due. Expects that the
@@ -480,36 +907,25 @@ errno_t DispatchQueue_DispatchTimer_Locked(DispatchQueueRef _Nonnull pQueue, Tim
 {
     decl_try_err();
 
+    // See DispatchQueue_DispatchWorkItemAsyncAndUnlock_Locked()
+    err = DispatchQueue_AcquireVirtualProcessor_Locked(pQueue);
+    if (err != EOK && pQueue->availableConcurrency == 0) {
+        return err;
+    }
+
     DispatchQueue_AddTimer_Locked(pQueue, pTimer);
-    try(DispatchQueue_AcquireVirtualProcessor_Locked(pQueue));
     ConditionVariable_SignalAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
 
     return EOK;
-
-catch:
-    return err;
 }
 
-// Removes all scheduled instances of the given work item from the dispatch
-// queue.
+// Removes all scheduled instances of the given timer from the dispatch queue.
+// A timer is armed on the timer wheel at most once.
 static void DispatchQueue_RemoveTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
 {
-    TimerRef pCurItem = (TimerRef) pQueue->timer_queue.first;
-    TimerRef pPrevItem = NULL;
-
-    while (pCurItem) {
-        if (pCurItem == pTimer) {
-            TimerRef pNextItem = (TimerRef) pCurItem->item.queue_entry.next;
-
-            SList_Remove(&pQueue->timer_queue, &pPrevItem->item.queue_entry, &pCurItem->item.queue_entry);
-            DispatchQueue_RelinquishTimer_Locked(pQueue, pCurItem);
-            // pPrevItem doesn't change here
-            pCurItem = pNextItem;
-        }
-        else {
-            pPrevItem = pCurItem;
-            pCurItem = (TimerRef) pCurItem->item.queue_entry.next;
-        }
+    if (TimerWheelEntry_IsArmed(&pTimer->wheel_entry)) {
+        TimerWheel_Cancel(&pQueue->timer_wheel, &pTimer->wheel_entry);
+        DispatchQueue_RelinquishTimer_Locked(pQueue, pTimer);
     }
 }
 
@@ -526,6 +942,20 @@ ProcessRef _Nullable _Weak DispatchQueue_GetOwningProcess(DispatchQueueRef _Nonn
     return pQueue->owning_process;
 }
 
+// Returns information about the dispatch queue. The 'od' field is left alone
+// because the queue does not know under which descriptor it is registered.
+void DispatchQueue_GetInfo(DispatchQueueRef _Nonnull pQueue, DispatchQueueInfo* _Nonnull pOutInfo)
+{
+    Lock_Lock(&pQueue->lock);
+    pOutInfo->qos = pQueue->qos;
+    pOutInfo->priority = pQueue->priority;
+    pOutInfo->concurrency = pQueue->availableConcurrency;
+    pOutInfo->reserved = 0;
+    Lock_Unlock(&pQueue->lock);
+
+    ExecutionStats_Get(&pQueue->stats, &pOutInfo->stats);
+}
+
 // Returns the dispatch queue that is associated with the virtual processor that
 // is running the calling code. This will always return a dispatch queue for
 // callers that are running in a dispatch queue context. It returns NULL though
@@ -537,11 +967,10 @@ DispatchQueueRef _Nullable DispatchQueue_GetCurrent(void)
 }
 
 
-// Synchronously executes the given closure. The closure is executed as soon as
-// possible and the caller remains blocked until the closure has finished
-// execution. This function returns with an EINTR if the queue is flushed or
-// terminated by calling DispatchQueue_Terminate().
-errno_t DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+// Synchronously executes the given closure. Executes the closure on the
+// caller's virtual processor if 'mayExecuteInline' is true and the queue allows
+// it. See DispatchQueue_DispatchSync().
+static errno_t _DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure, bool mayExecuteInline)
 {
     decl_try_err();
     WorkItem* pItem = NULL;
@@ -553,6 +982,9 @@ errno_t DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, DispatchQue
         Lock_Unlock(&pQueue->lock);
         return EOK;
     }
+    if (mayExecuteInline && DispatchQueue_CanExecuteInline_Locked(pQueue, closure)) {
+        return DispatchQueue_ExecuteInlineAndUnlock_Locked(pQueue, closure);
+    }
 
     try(DispatchQueue_AcquireWorkItem_Locked(pQueue, closure, &pItem));
     try(DispatchQueue_DispatchWorkItemSyncAndUnlock_Locked(pQueue, pItem));
@@ -568,6 +1000,55 @@ catch:
     return err;
 }
 
+// Synchronously executes the given closure. The closure is executed as soon as
+// possible and the caller remains blocked until the closure has finished
+// execution. This function returns with an EINTR if the queue is flushed or
+// terminated by calling DispatchQueue_Terminate().
+errno_t DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    return _DispatchQueue_DispatchSync(pQueue, closure, true);
+}
+
+#if DEBUG
+static void DispatchQueue_OnSyncBenchmark(void* _Nullable pContext)
+{
+}
+
+// Measures how long 'count' DispatchSync() round trips of an empty kernel
+// closure on an idle serial queue take. '*pOutInlineTime' is the time with the
+// inline fast path and '*pOutQueuedTime' the time when every closure is handed
+// to the queue VP instead. The queue is owned by 'pProc' and the caller must
+// run on behalf of 'pProc' to qualify for the fast path.
+errno_t DispatchQueue_BenchmarkSync(ProcessRef _Nullable _Weak pProc, int count, TimeInterval* _Nonnull pOutInlineTime, TimeInterval* _Nonnull pOutQueuedTime)
+{
+    decl_try_err();
+    const DispatchQueueClosure closure = DispatchQueueClosure_Make(DispatchQueue_OnSyncBenchmark, NULL);
+    DispatchQueueRef pQueue = NULL;
+    TimeInterval t0;
+
+    try(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, gVirtualProcessorPool, pProc, &pQueue));
+
+    t0 = MonotonicClock_GetCurrentTime();
+    for (int i = 0; i < count; i++) {
+        try(_DispatchQueue_DispatchSync(pQueue, closure, true));
+    }
+    *pOutInlineTime = TimeInterval_Subtract(MonotonicClock_GetCurrentTime(), t0);
+
+    // Warm up the queue so that it has a VP and a cached work item
+    try(_DispatchQueue_DispatchSync(pQueue, closure, false));
+
+    t0 = MonotonicClock_GetCurrentTime();
+    for (int i = 0; i < count; i++) {
+        try(_DispatchQueue_DispatchSync(pQueue, closure, false));
+    }
+    *pOutQueuedTime = TimeInterval_Subtract(MonotonicClock_GetCurrentTime(), t0);
+
+catch:
+    Object_Release(pQueue);
+    return err;
+}
+#endif
+
 // Asynchronously executes the given closure. The closure is executed as soon as
 // possible.
 errno_t DispatchQueue_DispatchAsync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
@@ -576,6 +1057,10 @@ errno_t DispatchQueue_DispatchAsync(DispatchQueueRef _Nonnull pQueue, DispatchQu
     WorkItem* pItem = NULL;
     bool needsUnlock = false;
 
+    if (DispatchQueue_TryDispatchOnLane(pQueue, NULL, closure, NULL)) {
+        return EOK;
+    }
+
     Lock_Lock(&pQueue->lock);
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
@@ -626,6 +1111,291 @@ catch:
     return err;
 }
 
+// Asynchronously executes the given closure as a member of the group 'pGroup'.
+// The closure enters the group before this function returns and it leaves the
+// group once it has finished executing or it has been flushed from the queue.
+errno_t DispatchQueue_DispatchGroupAsync(DispatchQueueRef _Nonnull pQueue, DispatchGroupRef _Nonnull pGroup, DispatchQueueClosure closure)
+{
+    decl_try_err();
+    WorkItem* pItem = NULL;
+
+    if (DispatchQueue_TryDispatchOnLane(pQueue, NULL, closure, pGroup)) {
+        return EOK;
+    }
+
+    Lock_Lock(&pQueue->lock);
+    if (pQueue->state >= kQueueState_Terminating) {
+        Lock_Unlock(&pQueue->lock);
+        return EOK;
+    }
+
+    try(DispatchQueue_AcquireWorkItem_Locked(pQueue, closure, &pItem));
+    DispatchGroup_Enter(pGroup);
+    pItem->group = Object_RetainAs(pGroup, DispatchGroup);
+    err = DispatchQueue_DispatchWorkItemAsyncAndUnlock_Locked(pQueue, pItem);
+    if (err != EOK) {
+        // Leaving the group may dispatch the group notifications. So we have
+        // to drop the queue lock first
+        pItem->group = NULL;
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+        Lock_Unlock(&pQueue->lock);
+
+        DispatchGroup_Leave(pGroup);
+        Object_Release(pGroup);
+    }
+    return err;
+
+catch:
+    Lock_Unlock(&pQueue->lock);
+    return err;
+}
+
+// Synchronously executes the given closure as a barrier. A barrier waits until
+// all items that were dispatched before it have finished executing and it then
+// executes exclusively.
+errno_t DispatchQueue_DispatchBarrierSync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    decl_try_err();
+    WorkItem* pItem = NULL;
+    bool needsUnlock = false;
+
+    Lock_Lock(&pQueue->lock);
+    needsUnlock = true;
+    if (pQueue->state >= kQueueState_Terminating) {
+        Lock_Unlock(&pQueue->lock);
+        return EOK;
+    }
+    if (DispatchQueue_CanExecuteInline_Locked(pQueue, closure)) {
+        return DispatchQueue_ExecuteInlineAndUnlock_Locked(pQueue, closure);
+    }
+
+    try(DispatchQueue_AcquireWorkItem_Locked(pQueue, closure, &pItem));
+    pItem->is_barrier = true;
+    try(DispatchQueue_DispatchWorkItemSyncAndUnlock_Locked(pQueue, pItem));
+    return EOK;
+
+catch:
+    if (pItem) {
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+    }
+    if (needsUnlock) {
+        Lock_Unlock(&pQueue->lock);
+    }
+    return err;
+}
+
+// Asynchronously executes the given closure as a barrier.
+errno_t DispatchQueue_DispatchBarrierAsync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    decl_try_err();
+    WorkItem* pItem = NULL;
+    bool needsUnlock = false;
+
+    Lock_Lock(&pQueue->lock);
+    needsUnlock = true;
+    if (pQueue->state >= kQueueState_Terminating) {
+        Lock_Unlock(&pQueue->lock);
+        return EOK;
+    }
+
+    try(DispatchQueue_AcquireWorkItem_Locked(pQueue, closure, &pItem));
+    pItem->is_barrier = true;
+    try(DispatchQueue_DispatchWorkItemAsyncAndUnlock_Locked(pQueue, pItem));
+    return EOK;
+
+catch:
+    if (pItem) {
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+    }
+    if (needsUnlock) {
+        Lock_Unlock(&pQueue->lock);
+    }
+    return err;
+}
+
+// Asynchronously executes the 'count' closures in 'pClosures'. The closures are
+// enqueued in array order with a single acquisition of the queue lock and a
+// single wakeup of the queue. The queue acquires as many virtual processors as
+// it needs to work on the batch in parallel. Either all closures are enqueued
+// or none of them is.
+errno_t DispatchQueue_DispatchAsyncBatch(DispatchQueueRef _Nonnull pQueue, const DispatchQueueClosure* _Nonnull pClosures, int count)
+{
+    decl_try_err();
+    WorkItemRef pItem;
+    SList items;
+
+    if (count <= 0) {
+        return (count == 0) ? EOK : EINVAL;
+    }
+
+    SList_Init(&items);
+    Lock_Lock(&pQueue->lock);
+    if (pQueue->state >= kQueueState_Terminating) {
+        Lock_Unlock(&pQueue->lock);
+        return EOK;
+    }
+
+    for (int i = 0; i < count; i++) {
+        try(DispatchQueue_AcquireWorkItem_Locked(pQueue, pClosures[i], &pItem));
+        SList_InsertAfterLast(&items, &pItem->queue_entry);
+    }
+    try(DispatchQueue_DispatchWorkItemsAsyncAndUnlock_Locked(pQueue, &items, count));
+    return EOK;
+
+catch:
+    while ((pItem = (WorkItemRef) SList_RemoveFirst(&items)) != NULL) {
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+    }
+    Lock_Unlock(&pQueue->lock);
+    return err;
+}
+
+
+// The state of a DispatchQueue_Apply() call. The caller dispatches one worker
+// per concurrency lane and every worker keeps claiming the next unclaimed
+// iteration until all iterations are taken. Every worker signals 'completion'
+// when it is done or when it was flushed from the queue before it got a chance
+// to run.
+typedef struct _ApplyState {
+    CompletionSignaler          completion;
+    DispatchQueueApplyClosure   closure;
+    DispatchQueueRef _Nonnull   queue;
+    int                         iterations;
+    int                         workerCount;
+    volatile AtomicInt          nextIndex;          // Next iteration that should be claimed by a worker
+    volatile AtomicInt          finishedCount;      // Number of iterations that have finished executing
+} ApplyState;
+
+static errno_t ApplyState_Create(DispatchQueueRef _Nonnull pQueue, int iterations, DispatchQueueApplyClosure closure, ApplyState* _Nullable * _Nonnull pOutState)
+{
+    decl_try_err();
+    ApplyState* pState;
+
+    try(kalloc(sizeof(ApplyState), (void**) &pState));
+    CompletionSignaler_Init(&pState->completion);
+    Semaphore_Init(&pState->completion.semaphore, 0);
+    pState->closure = closure;
+    pState->queue = pQueue;
+    pState->iterations = iterations;
+    pState->workerCount = 0;
+    pState->nextIndex = 0;
+    pState->finishedCount = 0;
+
+    *pOutState = pState;
+    return EOK;
+
+catch:
+    *pOutState = NULL;
+    return err;
+}
+
+static void ApplyState_Destroy(ApplyState* _Nullable pState)
+{
+    if (pState) {
+        CompletionSignaler_Deinit(&pState->completion);
+        Semaphore_Deinit(&pState->completion.semaphore);
+        kfree(pState);
+    }
+}
+
+// Waits until all workers are done with the state and then frees it. This runs
+// on the kernel main queue if the DispatchQueue_Apply() caller was interrupted
+// while it was waiting for the workers.
+static void ApplyState_WaitAndDestroy(ApplyState* _Nonnull pState)
+{
+    Semaphore_AcquireMultiple(&pState->completion.semaphore, pState->workerCount, kTimeInterval_Infinity);
+    ApplyState_Destroy(pState);
+}
+
+// Executes iterations until all of them have been claimed. A worker stops early
+// if the queue is terminating.
+static void DispatchQueue_ApplyWorker(ApplyState* _Nonnull pState)
+{
+    DispatchQueueRef pQueue = pState->queue;
+    VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
+
+    while (pQueue->state == kQueueState_Running) {
+        const int idx = AtomicInt_Increment(&pState->nextIndex) - 1;
+
+        if (idx >= pState->iterations) {
+            break;
+        }
+
+        if (pState->closure.isUser) {
+            VirtualProcessor_CallAsUser(pVP, (Closure1Arg_Func)pState->closure.func, pState->closure.context, idx);
+        } else {
+            pState->closure.func(pState->closure.context, idx);
+        }
+        AtomicInt_Increment(&pState->finishedCount);
+    }
+}
+
+// Invokes the given closure 'iterations' times with the indices 0 to
+// 'iterations - 1'. The iterations are spread across the concurrency lanes of
+// the queue and the caller remains blocked until all iterations have finished
+// execution. Returns EINTR if the queue is flushed or terminated before all
+// iterations have executed. Must not be called from a closure that is executing
+// on 'pQueue'.
+errno_t DispatchQueue_Apply(DispatchQueueRef _Nonnull pQueue, size_t iterations, DispatchQueueApplyClosure closure)
+{
+    decl_try_err();
+    ApplyState* pState = NULL;
+    WorkItemRef pItem;
+    SList items;
+    bool needsUnlock = false;
+
+    if (iterations > INT_MAX) {
+        return EINVAL;
+    }
+    if (iterations == 0) {
+        return EOK;
+    }
+
+    SList_Init(&items);
+    try(ApplyState_Create(pQueue, (int)iterations, closure, &pState));
+
+    Lock_Lock(&pQueue->lock);
+    needsUnlock = true;
+    if (pQueue->state >= kQueueState_Terminating) {
+        Lock_Unlock(&pQueue->lock);
+        ApplyState_Destroy(pState);
+        return EOK;
+    }
+
+    pState->workerCount = __min(pState->iterations, pQueue->maxConcurrency);
+    for (int i = 0; i < pState->workerCount; i++) {
+        try(DispatchQueue_AcquireWorkItem_Locked(pQueue, DispatchQueueClosure_Make((Closure1Arg_Func)DispatchQueue_ApplyWorker, pState), &pItem));
+        pItem->completion = &pState->completion;
+        SList_InsertAfterLast(&items, &pItem->queue_entry);
+    }
+    try(DispatchQueue_DispatchWorkItemsAsyncAndUnlock_Locked(pQueue, &items, pState->workerCount));
+    needsUnlock = false;
+
+
+    // Wait for all workers to finish. The workers may still be using the apply
+    // state if our wait is interrupted. Let the kernel main queue wait for them
+    // and free the state in this case.
+    err = Semaphore_AcquireMultiple(&pState->completion.semaphore, pState->workerCount, kTimeInterval_Infinity);
+    if (err != EOK) {
+        DispatchQueue_DispatchAsync(gMainDispatchQueue, DispatchQueueClosure_Make((Closure1Arg_Func)ApplyState_WaitAndDestroy, pState));
+        return err;
+    }
+
+    err = (pState->finishedCount < pState->iterations) ? EINTR : EOK;
+    ApplyState_Destroy(pState);
+    return err;
+
+catch:
+    while ((pItem = (WorkItemRef) SList_RemoveFirst(&items)) != NULL) {
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+    }
+    if (needsUnlock) {
+        Lock_Unlock(&pQueue->lock);
+    }
+    ApplyState_Destroy(pState);
+    return err;
+}
+
 
 // Synchronously executes the given work item. The work item is executed as
 // soon as possible and the caller remains blocked until the work item has
@@ -670,6 +1440,10 @@ errno_t DispatchQueue_DispatchWorkItemAsync(DispatchQueueRef _Nonnull pQueue, Wo
         return EBUSY;
     }
 
+    if (DispatchQueue_TryDispatchOnLane(pQueue, pItem, pItem->closure, NULL)) {
+        return EOK;
+    }
+
     Lock_Lock(&pQueue->lock);
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
@@ -754,9 +1528,14 @@ void DispatchQueue_RemoveTimer(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnu
 // Removes all queued work items, one-shot and repeatable timers from the queue.
 void DispatchQueue_Flush(DispatchQueueRef _Nonnull pQueue)
 {
+    SList groupItems;
+
+    SList_Init(&groupItems);
     Lock_Lock(&pQueue->lock);
-    DispatchQueue_Flush_Locked(pQueue);
+    DispatchQueue_Flush_Locked(pQueue, &groupItems);
     Lock_Unlock(&pQueue->lock);
+
+    DispatchQueue_LeaveGroups(pQueue, &groupItems);
 }
 
 
@@ -778,99 +1557,226 @@ static void DispatchQueue_RearmTimer_Locked(DispatchQueueRef _Nonnull pQueue, Ti
     DispatchQueue_AddTimer_Locked(pQueue, pTimer);
 }
 
-void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
+// Returns true if the item at the head of the item queue is a barrier.
+#define DispatchQueue_IsBarrierQueued_Locked(__pQueue) \
+    ((__pQueue)->item_queue.first != NULL && ((WorkItemRef)(__pQueue)->item_queue.first)->is_barrier)
+
+// Returns true if no item or timer may start executing right now because a
+// barrier is executing, a barrier is waiting for the items that are currently
+// executing or that are still on the lanes to drain or a DispatchSync() caller
+// is executing its closure inline. Items on the lanes were dispatched before
+// the barrier and they may always execute.
+static bool DispatchQueue_IsBlockedByBarrier_Locked(DispatchQueueRef _Nonnull pQueue)
 {
-    VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
+    // Check the lanes before the executing count. A lane item is counted as
+    // executing before it leaves its lane
+    return pQueue->is_barrier_executing || pQueue->is_executing_inline
+        || (DispatchQueue_IsBarrierQueued_Locked(pQueue)
+            && (!DispatchQueue_AreLanesEmpty_Locked(pQueue) || pQueue->items_executing_count > 0));
+}
 
-    // We hold the lock at all times except:
-    // - while waiting for work
-    // - while executing a work item
-    Lock_Lock(&pQueue->lock);
+// Returns true if a VP may look for work on the lanes without taking the queue
+// lock. VPs go through the queue lock while timers are armed since timers take
+// precedence over immediate work items.
+#define DispatchQueue_MayDequeueUnlocked(__pQueue) \
+    (DispatchQueue_UsesLanes(__pQueue) && (__pQueue)->state == kQueueState_Running && TimerWheel_IsEmpty(&(__pQueue)->timer_wheel))
+
+// Returns how many microseconds have passed since the deadline of the given
+// timer. Used to trace when a timer is taken off the timer wheel and becomes
+// ready to execute.
+static uint32_t DispatchQueue_GetTimerLatenessMicros(TimerRef _Nonnull pTimer)
+{
+    const TimeInterval now = MonotonicClock_GetCurrentTime();
+
+    if (TimeInterval_LessEquals(now, pTimer->deadline)) {
+        return 0;
+    }
+
+    const TimeInterval lateness = TimeInterval_Subtract(now, pTimer->deadline);
+    if (lateness.tv_sec >= 4294) {
+        return 0xffffffff;
+    }
+    return (uint32_t)lateness.tv_sec * 1000000 + (uint32_t)lateness.tv_nsec / 1000;
+}
 
+void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
+{
+    VirtualProcessor* pVP = VirtualProcessor_GetCurrent();
+    const int laneIdx = pVP->dispatchQueueConcurrencyLaneIndex;
+    WorkItemRef pDoneLaneItem = NULL;
+
+    // We hold the queue lock only while:
+    // - looking for timers and items on the item queue
+    // - waiting for work
+    // - putting a timer or an item from the item queue back into the cache
+    // Items on the lanes are dequeued and cached with the lane locks only
     while (true) {
         WorkItemRef pItem = NULL;
+        bool isLaneItem = false;
         bool mayRelinquish = false;
-        
-        // Wait for work items to arrive or for timers to fire
-        while (true) {
-            // Grab the first timer that's due. We give preference to timers because
-            // they are tied to a specific deadline time while immediate work items
-            // do not guarantee that they will execute at a specific time. So it's
-            // acceptable to push them back on the timeline.
-            Timer* pFirstTimer = (Timer*)pQueue->timer_queue.first;
-            if (pFirstTimer && TimeInterval_LessEquals(pFirstTimer->deadline, MonotonicClock_GetCurrentTime())) {
-                pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->timer_queue);
-            }
 
+        if (DispatchQueue_MayDequeueUnlocked(pQueue)) {
+            pItem = DispatchQueue_DequeueLaneItem(pQueue, laneIdx, pDoneLaneItem);
+            pDoneLaneItem = NULL;
+            isLaneItem = (pItem != NULL);
+        }
+        else if (pDoneLaneItem) {
+            DispatchQueue_RelinquishLaneWorkItem(pQueue, laneIdx, pDoneLaneItem);
+            pDoneLaneItem = NULL;
+        }
 
-            // Grab the first work item if no timer is due
-            if (pItem == NULL) {
-                pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_queue);
-                pQueue->items_queued_count--;
-            }
+        if (pItem == NULL) {
+            Lock_Lock(&pQueue->lock);
 
+            // We count as idle until we've found work or we are relinquished.
+            // See DispatchQueue_TryDispatchOnLane()
+            AtomicInt_Increment(&pQueue->idle_vp_count);
+
+            // Wait for work items to arrive or for timers to fire
+            while (true) {
+                // Grab the first timer that's due. We give preference to timers because
+                // they are tied to a specific deadline time while immediate work items
+                // do not guarantee that they will execute at a specific time. So it's
+                // acceptable to push them back on the timeline.
+                // Nothing may start executing while a barrier is executing or while
+                // the barrier at the head of the item queue is waiting for the
+                // items that are currently executing to finish
+                if (!DispatchQueue_IsBlockedByBarrier_Locked(pQueue)) {
+                    TimerWheelEntry* pDueEntry = TimerWheel_RemoveExpired(&pQueue->timer_wheel, MonotonicClock_GetCurrentQuantums());
+                    if (pDueEntry) {
+                        pItem = (WorkItemRef) TimerFromWheelEntry(pDueEntry);
+                        Trace_Record(kTraceEvent_DispatchTimerDue, pVP->vpid, pQueue, DispatchQueue_GetTimerLatenessMicros((TimerRef)pItem));
+                    }
+                }
 
 
-            // We're done with this loop if we got an item to execute, we're
-            // supposed to terminate or we got no item and it's okay to relinqish
-            // this VP
-            if (pItem != NULL || pQueue->state >= kQueueState_Terminating || (pItem == NULL && mayRelinquish)) {
-                break;
-            }
-            
+                // Grab a work item from the lanes if no timer is due. The lanes
+                // are empty while a barrier is executing
+                if (pItem == NULL && DispatchQueue_UsesLanes(pQueue)) {
+                    pItem = DispatchQueue_DequeueLaneItem(pQueue, laneIdx, NULL);
+                    isLaneItem = (pItem != NULL);
+                }
 
-            // Compute a deadline for the wait. We do not wait if the deadline
-            // is equal to the current time or it's in the past
-            TimeInterval deadline;
 
-            if (pQueue->timer_queue.first) {
-                deadline = ((TimerRef)pQueue->timer_queue.first)->deadline;
-            } else {
-                deadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), TimeInterval_MakeSeconds(2));
-            }
+                // Grab the first work item from the item queue otherwise. A
+                // barrier item that makes it to here has the queue to itself
+                // since nothing else is executing
+                if (pItem == NULL && !DispatchQueue_IsBlockedByBarrier_Locked(pQueue)) {
+                    pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_queue);
+                    if (pItem) {
+                        pQueue->items_queued_count--;
+                    }
+                }
+
+
+
+                // We're done with this loop if we got an item to execute, we're
+                // supposed to terminate or we got no item and it's okay to relinqish
+                // this VP
+                if (pItem != NULL || pQueue->state >= kQueueState_Terminating || (pItem == NULL && mayRelinquish)) {
+                    break;
+                }
+            
+
+                // Compute a deadline for the wait. We do not wait if the deadline
+                // is equal to the current time or it's in the past. Note that the
+                // timer wheel deadline may be earlier than the deadline of the
+                // earliest timer. Due timers stay in the wheel while a barrier
+                // blocks the queue, so their deadline is in the past. We wait
+                // for the barrier to finish instead which signals us
+                TimeInterval deadline;
+
+                if (!TimerWheel_IsEmpty(&pQueue->timer_wheel) && !DispatchQueue_IsBlockedByBarrier_Locked(pQueue)) {
+                    deadline = TimeInterval_MakeFromQuantums(TimerWheel_GetNextDeadline(&pQueue->timer_wheel));
+                } else {
+                    deadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), TimeInterval_MakeSeconds(2));
+                }
 
 
-            // Wait for work. This drops the queue lock while we're waiting. This
-            // call may return with a ETIMEDOUT error. This is fine. Either some
-            // new work has arrived in the meantime or if not then we are free
-            // to relinquish the VP since it hasn't done anything useful for a
-            // longer time.
-            const int err = ConditionVariable_Wait(&pQueue->work_available_signaler, &pQueue->lock, deadline);
-            if (err == ETIMEDOUT && pQueue->availableConcurrency > pQueue->minConcurrency) {
-                mayRelinquish = true;
+                // Wait for work. This drops the queue lock while we're waiting. This
+                // call may return with a ETIMEDOUT error. This is fine. Either some
+                // new work has arrived in the meantime or if not then we are free
+                // to relinquish the VP since it hasn't done anything useful for a
+                // longer time.
+                // We keep at least one VP around while timers are pending since
+                // we may have woken up before the earliest timer is due.
+                const int err = ConditionVariable_Wait(&pQueue->work_available_signaler, &pQueue->lock, deadline);
+                if (err == ETIMEDOUT && pQueue->availableConcurrency > pQueue->minConcurrency
+                    && (TimerWheel_IsEmpty(&pQueue->timer_wheel) || pQueue->availableConcurrency > 1)) {
+                    mayRelinquish = true;
+                }
             }
-        }
 
         
-        // Relinquish this VP if we did not get an item to execute or the queue
-        // is terminating
-        if (pItem == NULL || pQueue->state >= kQueueState_Terminating) {
-            break;
-        }
+            // Relinquish this VP if we did not get an item to execute or the queue
+            // is terminating
+            if (pItem == NULL || pQueue->state >= kQueueState_Terminating) {
+                break;
+            }
+            AtomicInt_Decrement(&pQueue->idle_vp_count);
 
 
-        // Drop the lock. We do not want to hold it while the closure is executing
-        // and we are (if needed) signaling completion.
-        Lock_Unlock(&pQueue->lock);
+            // Lane items are already counted as executing
+            if (!isLaneItem) {
+                AtomicInt_Increment(&pQueue->items_executing_count);
+                if (pItem->is_barrier) {
+                    pQueue->is_barrier_executing = true;
+                }
+            }
+
+
+            // Drop the lock. We do not want to hold it while the closure is executing
+            // and we are (if needed) signaling completion.
+            Lock_Unlock(&pQueue->lock);
+        }
 
 
         // Execute the work item
+        Trace_Record(kTraceEvent_DispatchItemStart, pVP->vpid, pQueue, pItem);
         if (pItem->closure.isUser) {
-            VirtualProcessor_CallAsUser(pVP, pItem->closure.func, pItem->closure.context);
+            VirtualProcessor_CallAsUser(pVP, pItem->closure.func, pItem->closure.context, 0);
         } else {
             pItem->closure.func(pItem->closure.context);
         }
+        Trace_Record(kTraceEvent_DispatchItemEnd, pVP->vpid, pQueue, pItem);
 
         // Signal the work item's completion semaphore if needed
         if (pItem->completion != NULL) {
             WorkItem_SignalCompletion(pItem, false);
         }
+        WorkItem_LeaveGroup(pItem);
+
+
+        // A lane item goes back to the cache of our lane the next time we take
+        // our lane lock. We only need the queue lock if a barrier is waiting
+        // for us to finish
+        if (isLaneItem) {
+            if (AtomicInt_Decrement(&pQueue->items_executing_count) == 0 && pQueue->barriers_pending_count > 0) {
+                Lock_Lock(&pQueue->lock);
+                ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
+            }
+            pDoneLaneItem = pItem;
+            continue;
+        }
 
 
         // Reacquire the lock
         Lock_Lock(&pQueue->lock);
 
 
+        // Wake up the other VPs if they are waiting for a barrier to finish or
+        // if a barrier is waiting for us to finish
+        AtomicInt_Decrement(&pQueue->items_executing_count);
+        if (pItem->is_barrier) {
+            pQueue->is_barrier_executing = false;
+            pQueue->barriers_pending_count--;
+            ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, NULL);
+        }
+        else if (pQueue->items_executing_count == 0 && DispatchQueue_IsBarrierQueued_Locked(pQueue)) {
+            ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, NULL);
+        }
+
+
         // Move the work item back to the item cache if possible or destroy it
         switch (pItem->type) {
             case kItemType_Immediate:
@@ -896,9 +1802,13 @@ void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
                 abort();
                 break;
         }
+        Lock_Unlock(&pQueue->lock);
     }
 
+    // We are still counted as idle and we hold the queue lock. A dispatcher
+    // which sees us as no longer idle must also see that we are gone
     DispatchQueue_RelinquishVirtualProcessor_Locked(pQueue, pVP);
+    AtomicInt_Decrement(&pQueue->idle_vp_count);
 
     if (pQueue->state >= kQueueState_Terminating) {
         ConditionVariable_SignalAndUnlock(&pQueue->vp_shutdown_signaler, &pQueue->lock);
@@ -22,12 +22,25 @@ typedef struct _WorkItem* WorkItemRef;
 struct _Timer;
 typedef struct _Timer* TimerRef;
 
+struct _DispatchGroup;
+typedef struct _DispatchGroup* DispatchGroupRef;
+
 
 OPAQUE_CLASS(DispatchQueue, Object);
 typedef struct _DispatchQueueMethodTable {
     ObjectMethodTable   super;
 } DispatchQueueMethodTable;
 
+OPAQUE_CLASS(DispatchGroup, Object);
+typedef struct _DispatchGroupMethodTable {
+    ObjectMethodTable   super;
+} DispatchGroupMethodTable;
+
+OPAQUE_CLASS(DispatchSource, Object);
+typedef struct _DispatchSourceMethodTable {
+    ObjectMethodTable   super;
+} DispatchSourceMethodTable;
+
 
 
 //
@@ -48,6 +61,41 @@ typedef struct _DispatchQueueClosure {
     ((DispatchQueueClosure) {__pFunc, __pContext, true, {0, 0, 0}})
 
 
+// A closure that is invoked once per iteration by DispatchQueue_Apply()
+typedef void (* _Nonnull DispatchQueueApply_Func)(void* _Nullable pContext, size_t index);
+
+typedef struct _DispatchQueueApplyClosure {
+    DispatchQueueApply_Func _Nonnull    func;
+    void* _Nullable _Weak               context;
+    bool                                isUser;
+    int8_t                              reserved[3];
+} DispatchQueueApplyClosure;
+
+#define DispatchQueueApplyClosure_Make(__pFunc, __pContext) \
+    ((DispatchQueueApplyClosure) {__pFunc, __pContext, false, {0, 0, 0}})
+
+#define DispatchQueueApplyClosure_MakeUser(__pFunc, __pContext) \
+    ((DispatchQueueApplyClosure) {__pFunc, __pContext, true, {0, 0, 0}})
+
+
+// A closure that is invoked by a dispatch source. 'events' are the poll events
+// of an I/O channel source and the number of expirations of a timer source.
+typedef void (* _Nonnull DispatchSource_Func)(void* _Nullable pContext, unsigned int events);
+
+typedef struct _DispatchSourceClosure {
+    DispatchSource_Func _Nonnull    func;
+    void* _Nullable _Weak           context;
+    bool                            isUser;
+    int8_t                          reserved[3];
+} DispatchSourceClosure;
+
+#define DispatchSourceClosure_Make(__pFunc, __pContext) \
+    ((DispatchSourceClosure) {__pFunc, __pContext, false, {0, 0, 0}})
+
+#define DispatchSourceClosure_MakeUser(__pFunc, __pContext) \
+    ((DispatchSourceClosure) {__pFunc, __pContext, true, {0, 0, 0}})
+
+
 //
 // Work Items
 //
@@ -104,6 +152,77 @@ extern void Timer_Destroy(TimerRef _Nullable pTimer);
     WorkItem_IsCancelled((WorkItemRef)__pTimer)
 
 
+//
+// Dispatch Groups
+//
+
+// Creates a dispatch group. A dispatch group tracks a set of outstanding tasks.
+// A task is added to the group by entering the group and it is removed from the
+// group by leaving it. Work items which are dispatched with
+// DispatchQueue_DispatchGroupAsync() enter the group when they are dispatched
+// and leave it when they have finished executing or they are flushed from the
+// queue. Code may wait for the group to become empty or it may ask the group to
+// dispatch a closure once it has become empty.
+// Object_Release() to destroy the group.
+extern errno_t DispatchGroup_Create(DispatchGroupRef _Nullable * _Nonnull pOutGroup);
+
+// Adds a task to the group.
+extern void DispatchGroup_Enter(DispatchGroupRef _Nonnull self);
+
+// Removes a task from the group. Wakes up all waiters and dispatches all notify
+// closures if this was the last outstanding task. Calls to leave must be
+// balanced with calls to enter. Returns EINVAL if the group has no outstanding
+// task.
+extern errno_t DispatchGroup_Leave(DispatchGroupRef _Nonnull self);
+
+// Blocks the caller until the group has no more outstanding tasks. Returns
+// ETIMEDOUT if the group is still busy at 'deadline'. Returns EINTR if the wait
+// was interrupted.
+extern errno_t DispatchGroup_Wait(DispatchGroupRef _Nonnull self, TimeInterval deadline);
+
+// Asynchronously executes the given closure on 'pQueue' once the group has no
+// more outstanding tasks. The closure is dispatched right away if the group is
+// empty. The notification is one-shot.
+extern errno_t DispatchGroup_Notify(DispatchGroupRef _Nonnull self, DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
+
+
+//
+// Dispatch Sources
+//
+
+// Starts the dispatch source services. A single kernel virtual processor
+// watches all dispatch sources in the system. It is acquired when the first
+// source is created.
+extern errno_t DispatchSource_InitServices(void);
+
+// Creates a dispatch source which monitors the I/O channel 'pChannel' for the
+// poll events 'events' (kPollEvent_XXX). The closure is dispatched
+// asynchronously on 'pQueue' every time the channel becomes ready. Readiness
+// changes which happen while the closure is queued or executing are coalesced
+// into a single invocation. The source is level-triggered: it keeps firing as
+// long as the channel remains ready. Hangup and error events are always
+// reported.
+extern errno_t DispatchSource_CreateIOChannel(IOChannelRef _Nonnull pChannel, unsigned int events, DispatchQueueRef _Nonnull pQueue, DispatchSourceClosure closure, DispatchSourceRef _Nullable * _Nonnull pOutSource);
+
+// Creates a dispatch source which fires on or after 'deadline' and then every
+// 'interval' if 'interval' is greater than 0. The closure receives the number
+// of expirations since its last invocation.
+extern errno_t DispatchSource_CreateTimer(TimeInterval deadline, TimeInterval interval, DispatchQueueRef _Nonnull pQueue, DispatchSourceClosure closure, DispatchSourceRef _Nullable * _Nonnull pOutSource);
+
+// Cancels the source. The closure is not invoked anymore once this function
+// has returned, unless it is executing right now. Object_Release() to destroy
+// the source. The source lets go of its queue once the closure is no longer
+// scheduled. The final release of a cancelled source always happens on a
+// kernel queue.
+extern void DispatchSource_Cancel(DispatchSourceRef _Nonnull self);
+
+// Retires the cancelled sources whose closure was flushed from a queue that has
+// terminated in the meantime. Call this after DispatchQueue_Terminate() and
+// DispatchQueue_WaitForTerminationCompleted() have returned for a queue that
+// may be the target of a source.
+extern void DispatchSource_ReclaimFlushed(void);
+
+
 //
 // Dispatch Queues
 //
@@ -111,6 +230,10 @@ extern void Timer_Destroy(TimerRef _Nullable pTimer);
 // The kernel main queue. This is a serial queue
 extern DispatchQueueRef _Nonnull    gMainDispatchQueue;
 
+// The kernel queue which executes asynchronous reads and writes on behalf of
+// user processes. This is a concurrent queue
+extern DispatchQueueRef _Nonnull    gAsyncIODispatchQueue;
+
 // Creates a new dispatch queue. A dispatch queue maintains a list of work items
 // and timers and it dispatches those things for execution to a pool of virtual
 // processors. Virtual processors are automatically acquired and relinquished
@@ -162,6 +285,10 @@ extern void DispatchQueue_WaitForTerminationCompleted(DispatchQueueRef _Nonnull
 // queue is not owned by any particular process. Eg the kernel main dispatch queue.
 extern ProcessRef _Nullable _Weak DispatchQueue_GetOwningProcess(DispatchQueueRef _Nonnull pQueue);
 
+// Returns information about the dispatch queue: its QoS, priority, current
+// concurrency and the execution statistics of the VPs that have worked for it.
+extern void DispatchQueue_GetInfo(DispatchQueueRef _Nonnull pQueue, DispatchQueueInfo* _Nonnull pOutInfo);
+
 // Returns the dispatch queue that is associated with the virtual processor that
 // is running the calling code. This will always return a dispatch queue for
 // callers that are running in a dispatch queue context. It returns NULL though
@@ -173,9 +300,19 @@ extern DispatchQueueRef _Nullable DispatchQueue_GetCurrent(void);
 // Synchronously executes the given closure. The closure is executed as soon as
 // possible and the caller remains blocked until the closure has finished
 // execution. This function returns with an EINTR if the queue is flushed or
-// terminated by calling DispatchQueue_Terminate().
+// terminated by calling DispatchQueue_Terminate(). A kernel closure is executed
+// directly on the caller's virtual processor if the queue is serial and idle and
+// the caller belongs to the process that owns the queue. The caller owns the
+// queue while the closure is executing and DispatchQueue_GetCurrent() returns
+// the queue.
 extern errno_t DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
 
+#if DEBUG
+// Measures the round trip time of DispatchSync() with and without the inline
+// fast path. See DispatchQueue_DispatchSync(). DEBUG builds only.
+extern errno_t DispatchQueue_BenchmarkSync(ProcessRef _Nullable _Weak pProc, int count, TimeInterval* _Nonnull pOutInlineTime, TimeInterval* _Nonnull pOutQueuedTime);
+#endif
+
 // Asynchronously executes the given closure. The closure is executed as soon as
 // possible.
 extern errno_t DispatchQueue_DispatchAsync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
@@ -184,6 +321,38 @@ extern errno_t DispatchQueue_DispatchAsync(DispatchQueueRef _Nonnull pQueue, Dis
 // queue will try to execute the closure as close to 'deadline' as possible.
 extern errno_t DispatchQueue_DispatchAsyncAfter(DispatchQueueRef _Nonnull pQueue, TimeInterval deadline, DispatchQueueClosure closure);
 
+// Asynchronously executes the given closure as a member of the group 'pGroup'.
+// The closure enters the group before this function returns and it leaves the
+// group once it has finished executing or it has been flushed from the queue.
+extern errno_t DispatchQueue_DispatchGroupAsync(DispatchQueueRef _Nonnull pQueue, DispatchGroupRef _Nonnull pGroup, DispatchQueueClosure closure);
+
+// Synchronously executes the given closure as a barrier. A barrier waits until
+// all items that were dispatched before it have finished executing and it then
+// executes exclusively: no other item or timer of the queue executes while the
+// barrier is executing. Items dispatched after the barrier execute once the
+// barrier has finished. Barriers make no difference on a serial queue. See
+// DispatchQueue_DispatchSync() for the error semantics.
+extern errno_t DispatchQueue_DispatchBarrierSync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
+
+// Asynchronously executes the given closure as a barrier. See
+// DispatchQueue_DispatchBarrierSync().
+extern errno_t DispatchQueue_DispatchBarrierAsync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
+
+// Asynchronously executes the 'count' closures in 'pClosures'. The closures are
+// enqueued in array order with a single acquisition of the queue lock and a
+// single wakeup of the queue. The queue acquires as many virtual processors as
+// it needs to work on the batch in parallel. Either all closures are enqueued
+// or none of them is.
+extern errno_t DispatchQueue_DispatchAsyncBatch(DispatchQueueRef _Nonnull pQueue, const DispatchQueueClosure* _Nonnull pClosures, int count);
+
+// Invokes the given closure 'iterations' times with the indices 0 to
+// 'iterations - 1'. The iterations are spread across the concurrency lanes of
+// the queue and the caller remains blocked until all iterations have finished
+// execution. Returns EINTR if the queue is flushed or terminated before all
+// iterations have executed. Must not be called from a closure that is executing
+// on 'pQueue'.
+extern errno_t DispatchQueue_Apply(DispatchQueueRef _Nonnull pQueue, size_t iterations, DispatchQueueApplyClosure closure);
+
 
 // Synchronously executes the given work item. The work item is executed as
 // soon as possible and the caller remains blocked until the work item has
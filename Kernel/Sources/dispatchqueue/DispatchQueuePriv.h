@@ -12,7 +12,10 @@
 #include "DispatchQueue.h"
 #include <dispatcher/ConditionVariable.h>
 #include <dispatcher/Lock.h>
+#include <dispatcher/PollQueue.h>
 #include <dispatcher/Semaphore.h>
+#include <dispatcher/TimerWheel.h>
+#include <dispatcher/Trace.h>
 #include <dispatcher/VirtualProcessorScheduler.h>
 #include <driver/MonotonicClock.h>
 
@@ -54,12 +57,15 @@ typedef struct _WorkItem {
     AtomicBool                              is_being_dispatched;    // shared between all dispatch queues (set to true while the work item is in the process of being dispatched by a queue; false if no queue is using it)
     AtomicBool                              cancelled;              // shared between dispatch queue and queue user
     int8_t                                  type;
+    bool                                    is_barrier;             // item waits for all earlier items to finish and then executes exclusively
+    DispatchGroupRef _Nullable              group;                  // the item leaves this group once it has finished executing or was flushed (strong reference)
 } WorkItem;
 
 extern errno_t WorkItem_Create_Internal(DispatchQueueClosure closure, bool isOwnedByQueue, WorkItemRef _Nullable * _Nonnull pOutItem);
 extern void WorkItem_Init(WorkItemRef _Nonnull pItem, enum ItemType type, DispatchQueueClosure closure, bool isOwnedByQueue);
 extern void WorkItem_Deinit(WorkItemRef _Nonnull pItem);
 extern void WorkItem_SignalCompletion(WorkItemRef _Nonnull pItem, bool isInterrupted);
+extern void WorkItem_LeaveGroup(WorkItemRef _Nonnull pItem);
 
 
 //
@@ -70,14 +76,78 @@ typedef struct _Timer {
     WorkItem        item;
     TimeInterval    deadline;           // Time when the timer closure should be executed
     TimeInterval    interval;
+    TimerWheelEntry wheel_entry;        // Armed on the queue timer wheel while the timer is waiting for its deadline
 } Timer;
 
+#define TimerFromWheelEntry(__pEntry) \
+    ((TimerRef)(((char*)(__pEntry)) - offsetof(Timer, wheel_entry)))
+
 extern errno_t Timer_Create_Internal(TimeInterval deadline, TimeInterval interval, DispatchQueueClosure closure, bool isOwnedByQueue, TimerRef _Nullable * _Nonnull pOutTimer);
 extern void _Nullable Timer_Init(TimerRef _Nonnull pTimer, TimeInterval deadline, TimeInterval interval, DispatchQueueClosure closure, bool isOwnedByQueue);
 #define Timer_Deinit(__pTimer) \
     WorkItem_Deinit((WorkItemRef) __pTimer)
 
 
+//
+// Dispatch Group
+//
+
+// A closure which is dispatched on 'queue' once the group becomes empty
+typedef struct _GroupNotification {
+    SListNode                   node;
+    DispatchQueueRef _Nonnull   queue;      // strong reference
+    DispatchQueueClosure        closure;
+} GroupNotification;
+
+
+CLASS_IVARS(DispatchGroup, Object,
+    Lock    lock;
+    SList   waiters;            // Completion signalers of DispatchGroup_Wait() callers
+    SList   notifications;      // Closures which should be dispatched once the group is empty
+    int     count;              // Number of outstanding tasks
+);
+
+extern void DispatchGroup_deinit(DispatchGroupRef _Nonnull self);
+
+
+//
+// Dispatch Source
+//
+
+enum SourceType {
+    kSourceType_IOChannel = 0,
+    kSourceType_Timer
+};
+
+// All sources are protected by the source manager lock
+CLASS_IVARS(DispatchSource, Object,
+    TimerWheelEntry             wheel_entry;        // On the manager timer wheel while the timer is armed
+    ListNode                    cancelled_node;     // On the manager list of cancelled sources while the trampoline is still scheduled
+    PollEntry                   poll_entry;         // On the channel poll queue while the source is active (I/O channel sources only)
+    IOChannelRef _Nullable      channel;            // strong reference
+    DispatchQueueRef _Nullable  queue;              // strong reference. Released once the source is cancelled and the trampoline is no longer scheduled
+    DispatchSourceClosure       closure;
+    TimeInterval                deadline;           // Next time the timer should fire
+    TimeInterval                interval;           // Repeat interval of the timer; 0 for a one-shot timer
+    unsigned int                events;             // Poll events the source is interested in
+    unsigned int                pendingEvents;      // Poll events or timer expirations which have not been delivered yet
+    int8_t                      type;
+    bool                        isClosureScheduled; // The trampoline is queued or executing and it holds a reference to the source
+    bool                        isCancelled;
+);
+
+#define DispatchSourceFromPollEntry(__pEntry) \
+    ((DispatchSourceRef)(((char*)(__pEntry)) - offsetof(DispatchSource, poll_entry)))
+
+#define DispatchSourceFromWheelEntry(__pEntry) \
+    ((DispatchSourceRef)(((char*)(__pEntry)) - offsetof(DispatchSource, wheel_entry)))
+
+#define DispatchSourceFromCancelledNode(__pNode) \
+    ((DispatchSourceRef)(((char*)(__pNode)) - offsetof(DispatchSource, cancelled_node)))
+
+extern void DispatchSource_deinit(DispatchSourceRef _Nonnull self);
+
+
 //
 // Dispatch Queue
 //
@@ -86,8 +156,18 @@ extern void _Nullable Timer_Init(TimerRef _Nonnull pTimer, TimeInterval deadline
 // resources are specific to this virtual processor and shall only be used in
 // connection with this virtual processor. There's one concurrency lane per
 // dispatch queue concurrency level.
+// A concurrent queue additionally uses the lanes to spread its immediate work
+// items. Every lane has its own item queue and item cache which are protected
+// by the lane lock. A lane VP works on the items of its own lane first and it
+// steals items from the other lanes once its own lane is empty. The items on a
+// lane may be executed by any lane VP, whether the lane has a VP or not.
 typedef struct _ConcurrencyLane {
-    VirtualProcessor* _Nullable  vp;     // The virtual processor assigned to this concurrency lane
+    VirtualProcessor* _Nullable         vp;                 // The virtual processor assigned to this concurrency lane
+    SList                               item_queue;         // Work items queued on this lane (concurrent queues only)
+    SList                               item_cache_queue;   // Cache of reusable work items
+    Lock                                lock;               // Protects the item queue and item cache of this lane
+    volatile int                        items_queued_count; // Number of work items on 'item_queue'. May be read without holding the lane lock as a hint
+    int8_t                              item_cache_count;
 } ConcurrencyLane;
 
 
@@ -99,11 +179,12 @@ enum QueueState {
 
 
 #define MAX_ITEM_CACHE_COUNT    8
+#define MAX_LANE_ITEM_CACHE_COUNT   8
 #define MAX_TIMER_CACHE_COUNT   8
 #define MAX_COMPLETION_SIGNALER_CACHE_COUNT 8
 CLASS_IVARS(DispatchQueue, Object,
     SList                               item_queue;         // Queue of work items that should be executed as soon as possible
-    SList                               timer_queue;        // Queue of items that should be executed on or after their deadline
+    TimerWheel                          timer_wheel;        // Timers that should be executed on or after their deadline
     SList                               item_cache_queue;   // Cache of reusable work items
     SList                               timer_cache_queue;  // Cache of reusable timers
     SList                               completion_signaler_cache_queue;    // Cache of reusable completion signalers
@@ -112,7 +193,12 @@ CLASS_IVARS(DispatchQueue, Object,
     ConditionVariable                   vp_shutdown_signaler;       // Used by a VP to indicate that it has relinqushed itself because the queue is in the process of shutting down
     ProcessRef _Nullable _Weak          owning_process;             // The process that owns this queue
     VirtualProcessorPoolRef _Nonnull    virtual_processor_pool;     // Pool from which the queue should retrieve virtual processors
+    ExecutionStats                      stats;                      // Accumulated execution statistics of all VPs while they are attached to this queue. Rolls up into the owning process
     int                                 items_queued_count;         // Number of work items queued up (item_queue)
+    volatile AtomicInt                  items_executing_count;      // Number of work items and timers which are currently executing
+    volatile AtomicInt                  idle_vp_count;              // Number of VPs which are looking for work or are waiting for work while holding or waiting on the queue lock
+    volatile AtomicInt                  next_lane;                  // Round-robin counter that selects the lane for items dispatched from outside the queue
+    int                                 barriers_pending_count;     // Number of barrier items which are queued up or executing. The lanes do not accept new items while this is > 0
     int8_t                              state;                      // The current dispatch queue state
     int8_t                              minConcurrency;             // Minimum number of concurrency lanes that we are required to maintain. So we should not allow availableConcurrency to fall below this when we think we want to voluntarily relinquish a VP
     int8_t                              maxConcurrency;             // Maximum number of concurrency lanes we are allowed to allocate and use
@@ -122,6 +208,8 @@ CLASS_IVARS(DispatchQueue, Object,
     int8_t                              item_cache_count;
     int8_t                              timer_cache_count;
     int8_t                              completion_signaler_count;
+    bool                                is_barrier_executing;       // A barrier item is executing. Nothing else may execute until it is done
+    bool                                is_executing_inline;        // A DispatchSync() caller owns the queue and is executing its closure on its own VP. Nothing else may execute until it is done
     ConcurrencyLane                     concurrency_lanes[1];       // Up to 'maxConcurrency' concurrency lanes
 );
 
@@ -132,5 +220,6 @@ extern void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue);
 static errno_t DispatchQueue_AcquireVirtualProcessor_Locked(DispatchQueueRef _Nonnull pQueue);
 static void DispatchQueue_RelinquishWorkItem_Locked(DispatchQueue* _Nonnull pQueue, WorkItemRef _Nonnull pItem);
 static void DispatchQueue_RelinquishTimer_Locked(DispatchQueue* _Nonnull pQueue, TimerRef _Nonnull pTimer);
+static void ConcurrencyLane_RelinquishWorkItem_Locked(ConcurrencyLane* _Nonnull pLane, WorkItemRef _Nonnull pItem);
 
 #endif /* DispatchQueuePriv_h */
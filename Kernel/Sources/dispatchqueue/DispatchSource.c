@@ -0,0 +1,437 @@
+//
+//  DispatchSource.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/16/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "DispatchQueuePriv.h"
+#include <System/IOChannel.h>
+
+
+// The source manager watches all dispatch sources in the system with the help
+// of a single virtual processor. An I/O channel source registers a poll entry
+// with its channel and the channel marks the entry as pending every time it
+// changes state. The manager then re-polls the channel and dispatches the
+// source closure if the channel is ready. Timer sources are kept on a timer
+// wheel. Sources which are idle do not cost anything beyond their memory.
+typedef struct _DispatchSourceManager {
+    Lock                        lock;
+    PollWaiter                  waiter;
+    TimerWheel                  timers;         // Armed timer sources
+    List                        cancelled;      // Cancelled sources whose trampoline is scheduled. The trampoline may have been flushed
+    DispatchQueueRef _Nonnull   queue;          // Serial queue which runs the manager loop
+    bool                        isRunning;      // The manager loop has been dispatched
+} DispatchSourceManager;
+
+static DispatchSourceManager gDispatchSourceManager;
+
+
+CLASS_METHODS(DispatchSource, Object,
+OVERRIDE_METHOD_IMPL(deinit, DispatchSource, Object)
+);
+
+
+static void DispatchSourceManager_Run(DispatchSourceManager* _Nonnull self);
+static void DispatchSource_Trampoline(DispatchSourceRef _Nonnull self);
+
+
+// Starts the dispatch source services.
+errno_t DispatchSource_InitServices(void)
+{
+    DispatchSourceManager* self = &gDispatchSourceManager;
+
+    Lock_Init(&self->lock);
+    PollWaiter_Init(&self->waiter);
+    TimerWheel_Init(&self->timers, MonotonicClock_GetCurrentQuantums());
+    List_Init(&self->cancelled);
+    self->isRunning = false;
+
+    return DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, gVirtualProcessorPool, NULL, &self->queue);
+}
+
+// Dispatches the manager loop if it isn't running yet. The loop holds on to its
+// virtual processor from then on.
+static errno_t DispatchSourceManager_EnsureRunning_Locked(DispatchSourceManager* _Nonnull self)
+{
+    decl_try_err();
+
+    if (!self->isRunning) {
+        err = DispatchQueue_DispatchAsync(self->queue, DispatchQueueClosure_Make((Closure1Arg_Func)DispatchSourceManager_Run, self));
+        if (err == EOK) {
+            self->isRunning = true;
+        }
+    }
+    return err;
+}
+
+// Arms the given timer source on the timer wheel. The wheel works with whole
+// quantums and so the timer fires at the first quantum boundary on or after
+// its deadline.
+static void DispatchSourceManager_ArmTimer_Locked(DispatchSourceManager* _Nonnull self, DispatchSourceRef _Nonnull pSource)
+{
+    TimerWheel_Arm(&self->timers, &pSource->wheel_entry, Quantums_MakeFromTimeInterval(pSource->deadline, QUANTUM_ROUNDING_AWAY_FROM_ZERO));
+}
+
+// Records the given events and dispatches the source closure trampoline if it
+// isn't already queued or executing. An I/O channel source replaces its
+// undelivered events with the latest poll result while a timer source adds up
+// its expirations. The trampoline holds a strong reference to the source.
+static void DispatchSource_Fire_Locked(DispatchSourceRef _Nonnull self, unsigned int events)
+{
+    if (self->isCancelled) {
+        return;
+    }
+
+    if (self->type == kSourceType_Timer) {
+        self->pendingEvents += events;
+    } else {
+        self->pendingEvents = events;
+    }
+
+    if (!self->isClosureScheduled) {
+        Object_Retain(self);
+        self->isClosureScheduled = true;
+
+        if (DispatchQueue_DispatchAsync(self->queue, DispatchQueueClosure_Make((Closure1Arg_Func)DispatchSource_Trampoline, self)) != EOK) {
+            // The owner of the source still holds a reference since the source
+            // isn't cancelled
+            self->isClosureScheduled = false;
+            Object_Release(self);
+        }
+    }
+}
+
+// Fires all timer sources whose deadline has passed and rearms the repeating
+// ones. A repeating timer skips the deadlines that it has missed and reports
+// them as additional expirations instead.
+static void DispatchSourceManager_FireTimers_Locked(DispatchSourceManager* _Nonnull self)
+{
+    const Quantums now = MonotonicClock_GetCurrentQuantums();
+    const TimeInterval curTime = MonotonicClock_GetCurrentTime();
+    TimerWheelEntry* pEntry;
+
+    while ((pEntry = TimerWheel_RemoveExpired(&self->timers, now)) != NULL) {
+        DispatchSourceRef pSource = DispatchSourceFromWheelEntry(pEntry);
+        const bool isRepeating = TimeInterval_Greater(pSource->interval, kTimeInterval_Zero);
+        unsigned int count = 0;
+
+        do {
+            count++;
+            pSource->deadline = TimeInterval_Add(pSource->deadline, pSource->interval);
+        } while (isRepeating && TimeInterval_LessEquals(pSource->deadline, curTime));
+
+        DispatchSource_Fire_Locked(pSource, count);
+        if (isRepeating) {
+            DispatchSourceManager_ArmTimer_Locked(self, pSource);
+        }
+    }
+}
+
+// The manager loop. Waits until a channel changes state or the earliest timer
+// comes due and then fires the affected sources.
+static void DispatchSourceManager_Run(DispatchSourceManager* _Nonnull self)
+{
+    PollEntry* pEntry;
+
+    Lock_Lock(&self->lock);
+    while (true) {
+        const Quantums nextQuantum = TimerWheel_GetNextDeadline(&self->timers);
+        const TimeInterval deadline = (nextQuantum != kQuantums_Infinity) ? TimeInterval_MakeFromQuantums(nextQuantum) : kTimeInterval_Infinity;
+
+        Lock_Unlock(&self->lock);
+        (void) PollWaiter_Wait(&self->waiter, deadline);
+        Lock_Lock(&self->lock);
+
+
+        // Cancelling a source takes its entry off the pending list while
+        // holding the manager lock. So every entry we get here belongs to a
+        // live source
+        while ((pEntry = PollWaiter_RemoveFirstPending(&self->waiter)) != NULL) {
+            DispatchSourceRef pSource = DispatchSourceFromPollEntry(pEntry);
+            const int revents = IOChannel_Poll(pSource->channel, pSource->events, NULL);
+
+            if (revents != 0) {
+                DispatchSource_Fire_Locked(pSource, revents);
+            }
+        }
+
+        DispatchSourceManager_FireTimers_Locked(self);
+    }
+}
+
+// Lets go of the queue and of a reference to the source. This may be the final
+// release of the source and of the queue.
+static void DispatchSource_Retire(DispatchSourceRef _Nonnull self)
+{
+    DispatchQueueRef pQueue = self->queue;
+
+    self->queue = NULL;
+    Object_Release(pQueue);
+    Object_Release(self);
+}
+
+// Hands the retirement of a cancelled source to the kernel main queue. The
+// caller may execute on the target queue of the source and the queue can not
+// be deallocated on one of its own virtual processors. Consumes a reference to
+// the source.
+static void DispatchSource_RetireOnKernelQueue(DispatchSourceRef _Nonnull self)
+{
+    if (DispatchQueue_DispatchAsync(gMainDispatchQueue, DispatchQueueClosure_Make((Closure1Arg_Func)DispatchSource_Retire, self)) != EOK) {
+        DispatchSource_Retire(self);
+    }
+}
+
+// Executes on the target queue of the source and invokes the source closure
+// with all events that have accumulated since the last invocation. An I/O
+// channel source re-polls its channel once the closure has returned because
+// the closure may have left the channel in a ready state and the channel
+// would not report another state change in this case.
+static void DispatchSource_Trampoline(DispatchSourceRef _Nonnull self)
+{
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+    unsigned int events;
+    bool isCancelled;
+
+    Lock_Lock(&pMgr->lock);
+    events = self->pendingEvents;
+    self->pendingEvents = 0;
+    isCancelled = self->isCancelled;
+    Lock_Unlock(&pMgr->lock);
+
+    if (!isCancelled && events != 0) {
+        if (self->closure.isUser) {
+            VirtualProcessor_CallAsUser(VirtualProcessor_GetCurrent(), (Closure1Arg_Func)self->closure.func, self->closure.context, events);
+        } else {
+            self->closure.func(self->closure.context, events);
+        }
+    }
+
+    Lock_Lock(&pMgr->lock);
+    self->isClosureScheduled = false;
+    if (!self->isCancelled) {
+        if (self->type == kSourceType_IOChannel) {
+            PollEntry_Signal(&self->poll_entry);
+        }
+        else if (self->pendingEvents > 0) {
+            DispatchSource_Fire_Locked(self, 0);
+        }
+    } else {
+        List_Remove(&pMgr->cancelled, &self->cancelled_node);
+    }
+    isCancelled = self->isCancelled;
+    Lock_Unlock(&pMgr->lock);
+
+    // The owner of a source which isn't cancelled still holds a reference. The
+    // trampoline's reference may be the last one of a cancelled source though
+    if (isCancelled) {
+        DispatchSource_RetireOnKernelQueue(self);
+    } else {
+        Object_Release(self);
+    }
+}
+
+static errno_t DispatchSource_Create(int type, DispatchQueueRef _Nonnull pQueue, DispatchSourceClosure closure, DispatchSourceRef _Nullable * _Nonnull pOutSource)
+{
+    decl_try_err();
+    DispatchSourceRef self;
+
+    try(Object_Create(DispatchSource, &self));
+    TimerWheelEntry_Init(&self->wheel_entry);
+    ListNode_Init(&self->cancelled_node);
+    PollEntry_Init(&self->poll_entry, &gDispatchSourceManager.waiter);
+    self->queue = Object_RetainAs(pQueue, DispatchQueue);
+    self->closure = closure;
+    self->type = type;
+
+    *pOutSource = self;
+    return EOK;
+
+catch:
+    *pOutSource = NULL;
+    return err;
+}
+
+// Creates a dispatch source which monitors the I/O channel 'pChannel' for the
+// poll events 'events'. See the header for the delivery rules.
+errno_t DispatchSource_CreateIOChannel(IOChannelRef _Nonnull pChannel, unsigned int events, DispatchQueueRef _Nonnull pQueue, DispatchSourceClosure closure, DispatchSourceRef _Nullable * _Nonnull pOutSource)
+{
+    decl_try_err();
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+    DispatchSourceRef self = NULL;
+
+    try(DispatchSource_Create(kSourceType_IOChannel, pQueue, closure, &self));
+    self->channel = Object_RetainAs(pChannel, IOChannel);
+    self->events = events & (kPollEvent_Readable | kPollEvent_Writable);
+
+    Lock_Lock(&pMgr->lock);
+    err = DispatchSourceManager_EnsureRunning_Locked(pMgr);
+    if (err == EOK) {
+        // Put the entry on the channel poll queue and let the manager do the
+        // initial poll since the channel may be ready already
+        (void) IOChannel_Poll(self->channel, self->events, &self->poll_entry);
+        PollEntry_Signal(&self->poll_entry);
+    }
+    Lock_Unlock(&pMgr->lock);
+    if (err != EOK) {
+        throw(err);
+    }
+
+    *pOutSource = self;
+    return EOK;
+
+catch:
+    Object_Release(self);
+    *pOutSource = NULL;
+    return err;
+}
+
+// Creates a dispatch source which fires on or after 'deadline' and then every
+// 'interval' if 'interval' is greater than 0.
+errno_t DispatchSource_CreateTimer(TimeInterval deadline, TimeInterval interval, DispatchQueueRef _Nonnull pQueue, DispatchSourceClosure closure, DispatchSourceRef _Nullable * _Nonnull pOutSource)
+{
+    decl_try_err();
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+    DispatchSourceRef self = NULL;
+
+    try(DispatchSource_Create(kSourceType_Timer, pQueue, closure, &self));
+    self->deadline = deadline;
+    self->interval = interval;
+
+    Lock_Lock(&pMgr->lock);
+    err = DispatchSourceManager_EnsureRunning_Locked(pMgr);
+    if (err == EOK) {
+        DispatchSourceManager_ArmTimer_Locked(pMgr, self);
+        // The manager may have to wait for a shorter time now
+        PollWaiter_Signal(&pMgr->waiter);
+    }
+    Lock_Unlock(&pMgr->lock);
+    if (err != EOK) {
+        throw(err);
+    }
+
+    *pOutSource = self;
+    return EOK;
+
+catch:
+    Object_Release(self);
+    *pOutSource = NULL;
+    return err;
+}
+
+// Returns true if the given queue has finished terminating. A terminated queue
+// will never execute another work item.
+static bool DispatchSource_IsQueueTerminated(DispatchQueueRef _Nonnull pQueue)
+{
+    bool isTerminated;
+
+    Lock_Lock(&pQueue->lock);
+    isTerminated = (pQueue->state == kQueueState_Terminated);
+    Lock_Unlock(&pQueue->lock);
+
+    return isTerminated;
+}
+
+// Marks the source as cancelled and takes it off the channel poll queue, the
+// pending list and the timer wheel.
+static void DispatchSource_Disarm_Locked(DispatchSourceRef _Nonnull self)
+{
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+
+    self->isCancelled = true;
+
+    if (self->type == kSourceType_IOChannel) {
+        // Take the entry off the channel poll queue first so that the channel
+        // can not mark it as pending again
+        PollQueue_Remove(&self->poll_entry);
+        PollWaiter_RemovePending(&pMgr->waiter, &self->poll_entry);
+    }
+
+    TimerWheel_Cancel(&pMgr->timers, &self->wheel_entry);
+}
+
+// Cancels the source. The closure is not invoked anymore once this function
+// has returned, unless it is executing right now. Must be called before the
+// last reference to the source is released.
+// A scheduled trampoline retires the source once it has executed. A trampoline
+// that was flushed from a terminated queue never executes. The source takes
+// back the trampoline's reference in this case. The source is put on the
+// cancelled list if its queue is still in the process of terminating and it is
+// retired by DispatchSource_ReclaimFlushed() once the queue has terminated.
+void DispatchSource_Cancel(DispatchSourceRef _Nonnull self)
+{
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+    bool doRetire = false;
+
+    Lock_Lock(&pMgr->lock);
+    if (!self->isCancelled) {
+        DispatchSource_Disarm_Locked(self);
+
+        if (!self->isClosureScheduled) {
+            Object_Retain(self);
+            doRetire = true;
+        }
+        else if (DispatchSource_IsQueueTerminated(self->queue)) {
+            self->isClosureScheduled = false;
+            doRetire = true;
+        }
+        else {
+            List_InsertAfterLast(&pMgr->cancelled, &self->cancelled_node);
+        }
+    }
+    Lock_Unlock(&pMgr->lock);
+
+    if (doRetire) {
+        DispatchSource_RetireOnKernelQueue(self);
+    }
+}
+
+// Retires the cancelled sources whose trampoline was flushed from a queue that
+// has terminated. Such a trampoline will never execute and release the source.
+void DispatchSource_ReclaimFlushed(void)
+{
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+    List flushed;
+    ListNode* pNode;
+
+    List_Init(&flushed);
+
+    Lock_Lock(&pMgr->lock);
+    pNode = pMgr->cancelled.first;
+    while (pNode) {
+        ListNode* pNextNode = pNode->next;
+        DispatchSourceRef pSource = DispatchSourceFromCancelledNode(pNode);
+
+        if (DispatchSource_IsQueueTerminated(pSource->queue)) {
+            List_Remove(&pMgr->cancelled, pNode);
+            List_InsertAfterLast(&flushed, pNode);
+            pSource->isClosureScheduled = false;
+        }
+        pNode = pNextNode;
+    }
+    Lock_Unlock(&pMgr->lock);
+
+    while ((pNode = List_RemoveFirst(&flushed)) != NULL) {
+        DispatchSource_RetireOnKernelQueue(DispatchSourceFromCancelledNode(pNode));
+    }
+}
+
+// A source which was cancelled has already been retired and it has let go of
+// its queue. A source which failed to start up was never cancelled.
+void DispatchSource_deinit(DispatchSourceRef _Nonnull self)
+{
+    DispatchSourceManager* pMgr = &gDispatchSourceManager;
+
+    Lock_Lock(&pMgr->lock);
+    if (!self->isCancelled) {
+        DispatchSource_Disarm_Locked(self);
+    }
+    Lock_Unlock(&pMgr->lock);
+
+    Object_Release(self->channel);
+    self->channel = NULL;
+    Object_Release(self->queue);
+    self->queue = NULL;
+    ListNode_Deinit(&self->cancelled_node);
+}
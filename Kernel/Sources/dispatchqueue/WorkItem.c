@@ -21,6 +21,8 @@ void WorkItem_Init(WorkItemRef _Nonnull pItem, enum ItemType type, DispatchQueue
     pItem->is_being_dispatched = false;
     pItem->cancelled = false;
     pItem->type = type;
+    pItem->is_barrier = false;
+    pItem->group = NULL;
 }
 
 // Creates a work item which will invoke the given closure. Note that work items
@@ -56,6 +58,8 @@ void WorkItem_Deinit(WorkItemRef _Nonnull pItem)
     pItem->closure.context = NULL;
     pItem->closure.isUser = false;
     pItem->completion = NULL;
+    pItem->is_barrier = false;
+    assert(pItem->group == NULL);
     // Leave is_owned_by_queue alone
     AtomicBool_Set(&pItem->is_being_dispatched, false);
     pItem->cancelled = false;
@@ -99,6 +103,20 @@ void WorkItem_SignalCompletion(WorkItemRef _Nonnull pItem, bool isInterrupted)
     }
 }
 
+// Removes the work item from its dispatch group. Does nothing if the item
+// doesn't belong to a group. Must not be called with the dispatch queue lock
+// held since leaving the group may dispatch the group notifications.
+void WorkItem_LeaveGroup(WorkItemRef _Nonnull pItem)
+{
+    DispatchGroupRef pGroup = pItem->group;
+
+    if (pGroup) {
+        pItem->group = NULL;
+        DispatchGroup_Leave(pGroup);
+        Object_Release(pGroup);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // MARK: -
 // MARK: Timers
@@ -111,6 +129,7 @@ void _Nullable Timer_Init(TimerRef _Nonnull pTimer, TimeInterval deadline, TimeI
     WorkItem_Init((WorkItem*)pTimer, type, closure, isOwnedByQueue);
     pTimer->deadline = deadline;
     pTimer->interval = interval;
+    TimerWheelEntry_Init(&pTimer->wheel_entry);
 }
 
 // Creates a new timer. The timer will fire on or after 'deadline'. If 'interval'
@@ -48,6 +48,36 @@ errno_t DiskDriver_putBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pB
     return EIO;
 }
 
+// Reads the blocks described by the 'nSegments' segments in 'pSegments'.
+// The segments are processed in the order given. Stops at the first block
+// that can not be read and returns the error.
+errno_t DiskDriver_getBlocks(DiskDriverRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+
+    for (int i = 0; i < nSegments; i++) {
+        try(DiskDriver_GetBlock(self, pSegments[i].buffer, pSegments[i].lba));
+    }
+
+catch:
+    return err;
+}
+
+// Writes the blocks described by the 'nSegments' segments in 'pSegments'.
+// The segments are processed in the order given. Stops at the first block
+// that can not be written and returns the error.
+errno_t DiskDriver_putBlocks(DiskDriverRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+
+    for (int i = 0; i < nSegments; i++) {
+        try(DiskDriver_PutBlock(self, pSegments[i].buffer, pSegments[i].lba));
+    }
+
+catch:
+    return err;
+}
+
 
 CLASS_METHODS(DiskDriver, IOResource,
 METHOD_IMPL(getBlockSize, DiskDriver)
@@ -55,4 +85,6 @@ METHOD_IMPL(getBlockCount, DiskDriver)
 METHOD_IMPL(isReadOnly, DiskDriver)
 METHOD_IMPL(getBlock, DiskDriver)
 METHOD_IMPL(putBlock, DiskDriver)
+METHOD_IMPL(getBlocks, DiskDriver)
+METHOD_IMPL(putBlocks, DiskDriver)
 );
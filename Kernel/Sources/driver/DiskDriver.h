@@ -19,6 +19,15 @@ typedef uint32_t    LogicalBlockAddress;
 typedef LogicalBlockAddress LogicalBlockCount;
 
 
+// Describes the transfer of a single block between the disk and memory. The
+// buffer must be big enough to hold a full block. It is only read from when
+// the segment is passed to a putBlocks() call.
+typedef struct DiskBlockSegment {
+    void* _Nonnull      buffer;
+    LogicalBlockAddress lba;
+} DiskBlockSegment;
+
+
 // A disk driver manages the data stored on a disk. It provides read and write
 // access to the disk data. Data on a disk is organized in blocks. All blocks
 // are of the same size. Blocks are addresses with an index in the range
@@ -56,6 +65,22 @@ typedef struct _DiskDriverMethodTable {
     // The abstract implementation returns EIO.
     errno_t (*putBlock)(void* _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba);
 
+    // Reads the blocks described by the 'nSegments' segments in 'pSegments'.
+    // The segments are processed in the order given. Stops at the first block
+    // that can not be read and returns the error. The contents of the buffers
+    // of this and all following segments are undefined in this case. Disks
+    // should override this method if they are able to transfer multiple blocks
+    // faster than one block at a time.
+    // The abstract implementation calls getBlock() for each segment.
+    errno_t (*getBlocks)(void* _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments);
+
+    // Writes the blocks described by the 'nSegments' segments in 'pSegments'.
+    // The segments are processed in the order given. Stops at the first block
+    // that can not be written and returns the error. The contents of this and
+    // all following blocks on disk is indeterminate in this case.
+    // The abstract implementation calls putBlock() for each segment.
+    errno_t (*putBlocks)(void* _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments);
+
 } DiskDriverMethodTable;
 
 
@@ -78,4 +103,10 @@ Object_InvokeN(getBlock, DiskDriver, __self, __pBuffer, __lba)
 #define DiskDriver_PutBlock(__self, __pBuffer, __lba) \
 Object_InvokeN(putBlock, DiskDriver, __self, __pBuffer, __lba)
 
+#define DiskDriver_GetBlocks(__self, __pSegments, __nSegments) \
+Object_InvokeN(getBlocks, DiskDriver, __self, __pSegments, __nSegments)
+
+#define DiskDriver_PutBlocks(__self, __pSegments, __nSegments) \
+Object_InvokeN(putBlocks, DiskDriver, __self, __pSegments, __nSegments)
+
 #endif /* DiskDriver_h */
@@ -7,6 +7,8 @@
 //
 
 #include "InterruptControllerPriv.h"
+#include <dispatcher/Trace.h>
+#include <dispatcher/VirtualProcessor.h>
 
 
 InterruptController     gInterruptControllerStorage;
@@ -336,6 +338,8 @@ void InterruptController_OnInterrupt(InterruptHandlerArray* _Nonnull pArray)
     register const InterruptHandler* pCur = &pArray->start[0];
     register const InterruptHandler* pEnd = &pArray->start[pArray->count];
 
+    Trace_Record(kTraceEvent_InterruptEnter, VirtualProcessor_GetCurrentVpid(), pArray - gInterruptControllerStorage.handlers, 0);
+
     while (pCur != pEnd) {
         if ((pCur->flags & INTERRUPT_HANDLER_FLAG_ENABLED) != 0) {
             pCur->closure(pCur->context);
@@ -343,4 +347,6 @@ void InterruptController_OnInterrupt(InterruptHandlerArray* _Nonnull pArray)
 
         pCur++;
     }
+
+    Trace_Record(kTraceEvent_InterruptExit, VirtualProcessor_GetCurrentVpid(), pArray - gInterruptControllerStorage.handlers, 0);
 }
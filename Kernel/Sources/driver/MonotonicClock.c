@@ -20,9 +20,15 @@ MonotonicClock* gMonotonicClock = &gMonotonicClockStorage;
 // CIA B timer A: monotonic clock tick counter
 
 
+// Number of timer cycles that we need to have left in the current quantum to
+// be able to shorten the current quantum timer period to end at the end of this
+// quantum. We end the period at the end of the next quantum otherwise.
+#define kMinRemainingCycles 128
+
+
 // Initializes the monotonic clock. The monotonic clock uses the quantum timer
 // as its time base.
-errno_t MonotonicClock_CreateForLocalCPU(const SystemDescription* pSysDesc)
+errno_t MonotonicClock_CreateForLocalCPU(const SystemDescription* pSysDesc, int options)
 {
     MonotonicClock* pClock = &gMonotonicClockStorage;
     decl_try_err();
@@ -30,6 +36,11 @@ errno_t MonotonicClock_CreateForLocalCPU(const SystemDescription* pSysDesc)
     pClock->current_time = kTimeInterval_Zero;
     pClock->current_quantum = 0;
     pClock->ns_per_quantum = pSysDesc->quantum_duration_ns;
+    pClock->tick_quantums = 1;
+    pClock->interrupt_count = 0;
+    pClock->cycles_per_quantum = pSysDesc->quantum_duration_cycles;
+    pClock->max_tick_quantums = UINT16_MAX / pSysDesc->quantum_duration_cycles;
+    pClock->is_tickless = (options & MONOTONIC_CLOCK_OPTION_TICKLESS) != 0;
 
     InterruptHandlerID irqHandler;
     try(InterruptController_AddDirectInterruptHandler(gInterruptController,
@@ -54,39 +65,95 @@ TimeInterval MonotonicClock_GetCurrentTime(void)
     register time_t cur_secs;
     register long cur_nanos;
     register long chk_quantum;
+    register long chk_tick_quantums;
     
     do {
         cur_secs = pClock->current_time.tv_sec;
         cur_nanos = pClock->current_time.tv_nsec;
         chk_quantum = pClock->current_quantum;
+        chk_tick_quantums = pClock->tick_quantums;
         
-        cur_nanos += chipset_get_quantum_timer_elapsed_ns();
+        if (pClock->is_tickless) {
+            // The current timer period may span multiple quantums
+            cur_nanos += chipset_get_quantum_timer_elapsed_cycles(chk_tick_quantums * pClock->cycles_per_quantum) * gSystemDescription->ns_per_quantum_timer_cycle;
+        } else {
+            cur_nanos += chipset_get_quantum_timer_elapsed_ns();
+        }
         if (cur_nanos >= ONE_SECOND_IN_NANOS) {
             cur_secs++;
             cur_nanos -= ONE_SECOND_IN_NANOS;
         }
         
-        // Do it again if there was a quantum transition while we were busy computing
-        // the time
-    } while (pClock->current_quantum != chk_quantum);
+        // Do it again if there was a quantum transition or the timer was
+        // reprogrammed while we were busy computing the time
+    } while (pClock->current_quantum != chk_quantum || pClock->tick_quantums != chk_tick_quantums);
 
     return TimeInterval_Make(cur_secs, cur_nanos);
 }
 
+// Returns the number of quantum timer interrupts that the clock has taken since
+// boot.
+uint32_t MonotonicClock_GetInterruptCount(void)
+{
+    return gMonotonicClock->interrupt_count;
+}
+
 static void MonotonicClock_OnInterrupt(MonotonicClock* _Nonnull pClock)
 {
-    // update the scheduler clock
-    pClock->current_quantum++;
+    // update the scheduler clock. The timer period that just ended may have
+    // spanned multiple quantums in tickless mode
+    pClock->current_quantum += pClock->tick_quantums;
+    pClock->interrupt_count++;
     
     
-    // update the metric time
-    pClock->current_time.tv_nsec += pClock->ns_per_quantum;
+    // update the metric time. A timer period is always shorter than a second
+    pClock->current_time.tv_nsec += pClock->tick_quantums * pClock->ns_per_quantum;
     if (pClock->current_time.tv_nsec >= ONE_SECOND_IN_NANOS) {
         pClock->current_time.tv_sec++;
         pClock->current_time.tv_nsec -= ONE_SECOND_IN_NANOS;
     }
 }
 
+// Tickless mode only: programs the quantum timer such that the next quantum
+// timer interrupt happens at the quantum 'deadline'. The timer always runs in
+// continuous mode and a timer period is always a whole number of quantums long.
+// This way the clock stays accurate no matter how often we reprogram the timer.
+void MonotonicClock_SetNextDeadline(Quantums deadline, bool isInterruptContext)
+{
+    register MonotonicClock* pClock = gMonotonicClock;
+
+    if (!pClock->is_tickless) {
+        return;
+    }
+
+    // The timer period and 'tick_quantums' are updated together with IRQs masked.
+    // The interrupt handler would otherwise account the period that just ended
+    // with the length of the new period
+    const int irs = cpu_disable_irqs();
+
+    // The quantum timer interrupt handler takes care of the timer if the current
+    // period has already ended. Note that we can not tell the quantum timer
+    // interrupt apart from the other CIA A interrupts without acknowledging it.
+    if (!isInterruptContext && chipset_is_ports_interrupt_pending()) {
+        cpu_restore_irqs(irs);
+        return;
+    }
+
+    const int curPeriodCycles = pClock->tick_quantums * pClock->cycles_per_quantum;
+    const int elapsedCycles = chipset_get_quantum_timer_elapsed_cycles(curPeriodCycles);
+    const Quantums minTickQuantums = (elapsedCycles + kMinRemainingCycles) / pClock->cycles_per_quantum + 1;
+    Quantums tickQuantums = (deadline > pClock->current_quantum) ? deadline - pClock->current_quantum : 1;
+
+    tickQuantums = __min(tickQuantums, pClock->max_tick_quantums);
+    tickQuantums = __max(tickQuantums, minTickQuantums);
+    if (tickQuantums != pClock->tick_quantums && tickQuantums <= pClock->max_tick_quantums) {
+        chipset_set_quantum_timer_period(curPeriodCycles, tickQuantums * pClock->cycles_per_quantum);
+        pClock->tick_quantums = tickQuantums;
+    }
+
+    cpu_restore_irqs(irs);
+}
+
 // Blocks the caller until 'deadline'. Returns true if the function did the
 // necessary delay and false if the caller should do something else instead to
 // achieve the desired delay. Eg context switch to another virtual processor.
@@ -122,6 +189,14 @@ Quantums Quantums_MakeFromTimeInterval(TimeInterval ti, int rounding)
     const int64_t nanos = (int64_t)ti.tv_sec * (int64_t)ONE_SECOND_IN_NANOS + (int64_t)ti.tv_nsec;
     const int64_t quants = nanos / (int64_t)pClock->ns_per_quantum;
     
+    // Saturate time intervals that do not fit in the quantum range
+    if (quants >= (int64_t)kQuantums_Infinity) {
+        return kQuantums_Infinity;
+    }
+    else if (quants <= (int64_t)kQuantums_MinusInfinity) {
+        return kQuantums_MinusInfinity;
+    }
+
     switch (rounding) {
         case QUANTUM_ROUNDING_TOWARDS_ZERO:
             return quants;
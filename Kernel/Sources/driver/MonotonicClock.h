@@ -13,23 +13,55 @@
 #include <hal/SystemDescription.h>
 
 
-typedef int32_t Quantums;             // Time unit of the scheduler clock which increments monotonically and once per quantum interrupt
+typedef int32_t Quantums;             // Time unit of the scheduler clock which increments monotonically and once per quantum
+
+// MonotonicClock_CreateForLocalCPU() options
+#define MONOTONIC_CLOCK_OPTION_TICKLESS 1   // Program the quantum timer for the next deadline instead of taking an interrupt every quantum
+
 
 // Note: Keep in sync with lowmem.i
 typedef struct _MonotonicClock {
     volatile TimeInterval   current_time;
     volatile Quantums       current_quantum;    // Current scheduler time in terms of elapsed quantums since boot
     int32_t                 ns_per_quantum;     // duration of a quantum in terms of nanoseconds
+    volatile Quantums       tick_quantums;      // Length of the current quantum timer period in terms of quantums. Always 1 in periodic mode
+    volatile uint32_t       interrupt_count;    // Number of quantum timer interrupts since boot
+    Quantums                max_tick_quantums;  // Longest quantum timer period that the hardware supports in terms of quantums
+    int16_t                 cycles_per_quantum; // duration of a quantum in terms of quantum timer cycles
+    bool                    is_tickless;
+    int8_t                  reserved[1];
 } MonotonicClock;
 
 
 extern MonotonicClock* _Nonnull gMonotonicClock;
 
-extern errno_t MonotonicClock_CreateForLocalCPU(const SystemDescription* pSysDesc);
+// Initializes the monotonic clock. 'options' is a combination of
+// MONOTONIC_CLOCK_OPTION_XXX flags. The clock takes a quantum timer interrupt
+// at the end of every quantum in periodic mode. It only takes an interrupt when
+// the next deadline set with MonotonicClock_SetNextDeadline() is reached in
+// tickless mode.
+extern errno_t MonotonicClock_CreateForLocalCPU(const SystemDescription* pSysDesc, int options);
 
 extern Quantums MonotonicClock_GetCurrentQuantums(void);
 extern TimeInterval MonotonicClock_GetCurrentTime(void);
 
+// Returns true if the clock runs in tickless mode.
+#define MonotonicClock_IsTickless() \
+    gMonotonicClock->is_tickless
+
+// Returns the number of quantum timer interrupts that the clock has taken since
+// boot.
+extern uint32_t MonotonicClock_GetInterruptCount(void);
+
+// Tickless mode only: programs the quantum timer such that the next quantum
+// timer interrupt happens at the quantum 'deadline'. The interrupt happens
+// earlier if 'deadline' is further out than the longest period that the timer
+// supports and it happens at the next quantum boundary if 'deadline' is in the
+// past. 'isInterruptContext' should be true if the caller is the quantum timer
+// interrupt handler. Must be called with preemption disabled. Does nothing in
+// periodic mode.
+extern void MonotonicClock_SetNextDeadline(Quantums deadline, bool isInterruptContext);
+
 // Blocks the caller until 'deadline'. Returns true if the function did the
 // necessary delay and false if the caller should do something else instead to
 // achieve the desired delay. Eg context switch to another virtual processor.
@@ -184,6 +184,79 @@ catch:
     return err;
 }
 
+// Returns true if the block 'lba' is stored in the extent 'pExtent'.
+static inline bool RamDisk_ExtentContainsBlock(RamDiskRef _Nonnull self, const DiskExtent* _Nullable pExtent, LogicalBlockAddress lba)
+{
+    return pExtent && lba >= pExtent->firstBlockIndex && lba < pExtent->firstBlockIndex + self->extentBlockCount;
+}
+
+// Reads the blocks described by the 'nSegments' segments in 'pSegments'.
+// The segments are processed in the order given. Stops at the first block
+// that can not be read and returns the error. The extent list is only searched
+// when a segment isn't stored in the same extent as the previous segment.
+errno_t RamDisk_getBlocks(RamDiskRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+    DiskExtent* pExtent = NULL;
+
+    Lock_Lock(&self->lock);
+    for (int i = 0; i < nSegments; i++) {
+        const LogicalBlockAddress lba = pSegments[i].lba;
+
+        if (lba >= self->blockCount) {
+            throw(EIO);
+        }
+
+        if (!RamDisk_ExtentContainsBlock(self, pExtent, lba)) {
+            pExtent = RamDisk_GetDiskExtentForBlockIndex_Locked(self, lba, NULL);
+        }
+        if (pExtent) {
+            Bytes_CopyRange(pSegments[i].buffer, &pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize], self->blockSize);
+        }
+        else {
+            Bytes_ClearRange(pSegments[i].buffer, self->blockSize);
+        }
+    }
+
+catch:
+    Lock_Unlock(&self->lock);
+    return err;
+}
+
+// Writes the blocks described by the 'nSegments' segments in 'pSegments'.
+// The segments are processed in the order given. Stops at the first block
+// that can not be written and returns the error. The extent list is only
+// searched when a segment isn't stored in the same extent as the previous
+// segment.
+errno_t RamDisk_putBlocks(RamDiskRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+    DiskExtent* pExtent = NULL;
+
+    Lock_Lock(&self->lock);
+    for (int i = 0; i < nSegments; i++) {
+        const LogicalBlockAddress lba = pSegments[i].lba;
+
+        if (lba >= self->blockCount) {
+            throw(EIO);
+        }
+
+        if (!RamDisk_ExtentContainsBlock(self, pExtent, lba)) {
+            DiskExtent* pPrevExtent;
+
+            pExtent = RamDisk_GetDiskExtentForBlockIndex_Locked(self, lba, &pPrevExtent);
+            if (pExtent == NULL) {
+                try(RamDisk_AddExtentAfter_Locked(self, (lba / self->extentBlockCount) * self->extentBlockCount, pPrevExtent, &pExtent));
+            }
+        }
+        Bytes_CopyRange(&pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize], pSegments[i].buffer, self->blockSize);
+    }
+
+catch:
+    Lock_Unlock(&self->lock);
+    return err;
+}
+
 
 CLASS_METHODS(RamDisk, DiskDriver,
 OVERRIDE_METHOD_IMPL(deinit, RamDisk, Object)
@@ -192,4 +265,6 @@ OVERRIDE_METHOD_IMPL(getBlockCount, RamDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(isReadOnly, RamDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlock, RamDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(putBlock, RamDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlocks, RamDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(putBlocks, RamDisk, DiskDriver)
 );
@@ -74,10 +74,28 @@ errno_t RomDisk_getBlock(RomDiskRef _Nonnull self, void* _Nonnull pBuffer, Logic
     }
 }
 
+// Reads the blocks described by the 'nSegments' segments in 'pSegments'.
+// The segments are processed in the order given. Stops at the first block
+// that can not be read and returns the error.
+errno_t RomDisk_getBlocks(RomDiskRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    for (int i = 0; i < nSegments; i++) {
+        const LogicalBlockAddress lba = pSegments[i].lba;
+
+        if (lba >= self->blockCount) {
+            return EIO;
+        }
+        Bytes_CopyRange(pSegments[i].buffer, self->diskImage + lba * self->blockSize, self->blockSize);
+    }
+
+    return EOK;
+}
+
 
 CLASS_METHODS(RomDisk, DiskDriver,
 OVERRIDE_METHOD_IMPL(deinit, RomDisk, Object)
 OVERRIDE_METHOD_IMPL(getBlockSize, RomDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlockCount, RomDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlock, RomDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlocks, RomDisk, DiskDriver)
 );
@@ -735,6 +735,15 @@ bool FloppyDisk_isReadOnly(FloppyDiskRef _Nonnull self)
     return false;
 }
 
+// Converts a logical block address to a cylinder, head and sector number.
+static void FloppyDisk_ChsFromLba(LogicalBlockAddress lba, size_t* _Nonnull pOutCylinder, size_t* _Nonnull pOutHead, size_t* _Nonnull pOutSector)
+{
+    // XXX hardcoded to HD for now
+    *pOutCylinder = lba / (ADF_HD_HEADS_PER_CYL * ADF_HD_SECS_PER_TRACK);
+    *pOutHead = (lba / ADF_HD_SECS_PER_TRACK) % ADF_HD_HEADS_PER_CYL;
+    *pOutSector = lba % ADF_HD_SECS_PER_TRACK;
+}
+
 // Reads the contents of the block at index 'lba'. 'buffer' must be big
 // enough to hold the data of a block. Blocks the caller until the read
 // operation has completed. Note that this function will never return a
@@ -742,11 +751,9 @@ bool FloppyDisk_isReadOnly(FloppyDiskRef _Nonnull self)
 // returned, or it fails and no block data is returned.
 errno_t FloppyDisk_getBlock(FloppyDiskRef _Nonnull self, void* _Nonnull pBuffer, LogicalBlockAddress lba)
 {
-    // XXX hardcoded to HD for now
-    const size_t c = lba / (ADF_HD_HEADS_PER_CYL * ADF_HD_SECS_PER_TRACK);
-    const size_t h = (lba / ADF_HD_SECS_PER_TRACK) % ADF_HD_HEADS_PER_CYL;
-    const size_t s = lba % ADF_HD_SECS_PER_TRACK;
+    size_t c, h, s;
 
+    FloppyDisk_ChsFromLba(lba, &c, &h, &s);
     return FloppyDisk_ReadSector(self, h, c, s, pBuffer);
 }
 
@@ -757,14 +764,62 @@ errno_t FloppyDisk_getBlock(FloppyDiskRef _Nonnull self, void* _Nonnull pBuffer,
 // block may contain a mix of old and new data.
 errno_t FloppyDisk_putBlock(FloppyDiskRef _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba)
 {
-    // XXX hardcoded to HD for now
-    const size_t c = lba / (ADF_HD_HEADS_PER_CYL * ADF_HD_SECS_PER_TRACK);
-    const size_t h = (lba / ADF_HD_SECS_PER_TRACK) % ADF_HD_HEADS_PER_CYL;
-    const size_t s = lba % ADF_HD_SECS_PER_TRACK;
-    
+    size_t c, h, s;
+
+    FloppyDisk_ChsFromLba(lba, &c, &h, &s);
     return FloppyDisk_WriteSector(self, h, c, s, pBuffer);
 }
 
+// Reads the blocks described by the 'nSegments' segments in 'pSegments'. Each
+// track is read at most once per run of segments that fall on the same track.
+errno_t FloppyDisk_getBlocks(FloppyDiskRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+
+    for (int i = 0; i < nSegments; i++) {
+        size_t c, h, s;
+
+        FloppyDisk_ChsFromLba(pSegments[i].lba, &c, &h, &s);
+        try(FloppyDisk_ReadSector(self, h, c, s, pSegments[i].buffer));
+    }
+
+catch:
+    return err;
+}
+
+// Writes the blocks described by the 'nSegments' segments in 'pSegments'. All
+// sectors of a run of segments that fall on the same track are encoded into the
+// track buffer first and the track is then written back to disk with a single
+// DMA transfer.
+errno_t FloppyDisk_putBlocks(FloppyDiskRef _Nonnull self, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+    int i = 0;
+
+    while (i < nSegments) {
+        const LogicalBlockAddress trackIdx = pSegments[i].lba / ADF_HD_SECS_PER_TRACK;
+        size_t c, h, s;
+
+        FloppyDisk_ChsFromLba(pSegments[i].lba, &c, &h, &s);
+        try(FloppyDisk_ReadTrack(self, h, c));
+
+        do {
+            const int16_t idx = self->track_sectors[pSegments[i].lba % ADF_HD_SECS_PER_TRACK];
+            if (idx == 0) {
+                throw(EIO);
+            }
+
+            mfm_encode_sector((const uint32_t*)pSegments[i].buffer, (uint32_t*)&self->track_buffer[idx + 28], ADF_SECTOR_SIZE / sizeof(uint32_t));
+            i++;
+        } while (i < nSegments && pSegments[i].lba / ADF_HD_SECS_PER_TRACK == trackIdx);
+
+        try(FloppyDisk_WriteTrack(self, h, c));
+    }
+
+catch:
+    return err;
+}
+
 
 
 CLASS_METHODS(FloppyDisk, DiskDriver,
@@ -774,4 +829,6 @@ OVERRIDE_METHOD_IMPL(getBlockCount, FloppyDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(isReadOnly, FloppyDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlock, FloppyDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(putBlock, FloppyDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlocks, FloppyDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(putBlocks, FloppyDisk, DiskDriver)
 );
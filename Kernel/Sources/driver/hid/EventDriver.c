@@ -7,6 +7,7 @@
 //
 
 #include "EventDriverPriv.h"
+#include <System/IOChannel.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // MARK: -
@@ -582,37 +583,48 @@ catch:
 
 // Returns events in the order oldest to newest. As many events are returned as
 // fit in the provided buffer. Only blocks the caller if no events are queued.
+// Returns EAGAIN instead of blocking if the channel is in non-blocking mode.
 errno_t EventDriver_read(EventDriverRef _Nonnull pDriver, EventDriverChannelRef _Nonnull pChannel, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
     decl_try_err();
     HIDEvent* pEvent = (HIDEvent*)pBuffer;
     ssize_t nBytesRead = 0;
-    int i;
+    const bool mayBlock = !IOChannel_IsNonBlocking(pChannel);
 
     while ((nBytesRead + sizeof(HIDEvent)) <= nBytesToRead) {
-        const errno_t e1 = HIDEventQueue_Get(pDriver->eventQueue, pEvent, (i > 0) ? pChannel->timeout : kTimeInterval_Zero);
+        const errno_t e1 = HIDEventQueue_Get(pDriver->eventQueue, pEvent, (nBytesRead == 0 && mayBlock) ? pChannel->timeout : kTimeInterval_Zero);
 
         if (e1 != EOK) {
             // Return with an error if we were not able to read any event data at
             // all and return with the data we were able to read otherwise.
-            err = (nBytesRead == 0) ? e1 : EOK;
+            if (nBytesRead == 0) {
+                err = (e1 == ETIMEDOUT && !mayBlock) ? EAGAIN : e1;
+            }
             break;
         }
         //assert(HIDEventQueue_GetOverflowCount(pDriver->eventQueue) == 0);
         
         nBytesRead += sizeof(HIDEvent);
         pEvent++;
-        i++;
     }
 
     *nOutBytesRead = nBytesRead;
     return err;
 }
 
+// The event driver is readable while events are queued.
+int EventDriver_poll(EventDriverRef _Nonnull pDriver, EventDriverChannelRef _Nonnull pChannel, int events, PollEntry* _Nullable pEntry)
+{
+    const bool hasEvents = HIDEventQueue_Poll(pDriver->eventQueue, pEntry);
+
+    return (hasEvents) ? (events & kPollEvent_Readable) : 0;
+}
+
 
 CLASS_METHODS(EventDriver, IOResource,
 OVERRIDE_METHOD_IMPL(open, EventDriver, IOResource)
 OVERRIDE_METHOD_IMPL(dup, EventDriver, IOResource)
 OVERRIDE_METHOD_IMPL(read, EventDriver, IOResource)
+OVERRIDE_METHOD_IMPL(poll, EventDriver, IOResource)
 OVERRIDE_METHOD_IMPL(deinit, EventDriver, Object)
 );
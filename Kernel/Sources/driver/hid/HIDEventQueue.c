@@ -15,6 +15,7 @@
 // See: <https://www.snellman.net/blog/archive/2016-12-13-ring-buffers/>
 typedef struct _HIDEventQueue {
     Semaphore   semaphore;
+    PollQueue   pollQueue;
     uint8_t     capacity;
     uint8_t     capacityMask;
     uint8_t     readIdx;
@@ -39,6 +40,7 @@ errno_t HIDEventQueue_Create(int capacity, HIDEventQueueRef _Nullable * _Nonnull
     assert(powerOfTwoCapacity <= UINT8_MAX/2);
     try(kalloc_cleared(sizeof(HIDEventQueue) + (powerOfTwoCapacity - 1) * sizeof(HIDEvent), (void**) &pQueue));
     Semaphore_Init(&pQueue->semaphore, 0);
+    PollQueue_Init(&pQueue->pollQueue);
     pQueue->capacity = powerOfTwoCapacity;
     pQueue->capacityMask = powerOfTwoCapacity - 1;
     pQueue->readIdx = 0;
@@ -58,6 +60,7 @@ void HIDEventQueue_Destroy(HIDEventQueueRef _Nonnull pQueue)
 {
     if (pQueue) {
         Semaphore_Deinit(&pQueue->semaphore);
+        PollQueue_Deinit(&pQueue->pollQueue);
         kfree(pQueue);
     }
 }
@@ -97,6 +100,20 @@ bool HIDEventQueue_IsEmpty(HIDEventQueueRef _Nonnull pQueue)
     return r;
 }
 
+// Returns true if the queue is not empty. Adds 'pEntry' to the poll queue of
+// the event queue if 'pEntry' is not NULL.
+bool HIDEventQueue_Poll(HIDEventQueueRef _Nonnull pQueue, PollEntry* _Nullable pEntry)
+{
+    const int irs = cpu_disable_irqs();
+    const bool r = !HIDEventQueue_IsEmpty_Locked(pQueue);
+    if (pEntry) {
+        PollQueue_Add(&pQueue->pollQueue, pEntry);
+    }
+    cpu_restore_irqs(irs);
+
+    return r;
+}
+
 // Returns the number of times the queue overflowed. Note that the queue drops
 // the oldest event every time it overflows.
 int HIDEventQueue_GetOverflowCount(HIDEventQueueRef _Nonnull pQueue)
@@ -136,6 +153,7 @@ void HIDEventQueue_Put(HIDEventQueueRef _Nonnull pQueue, HIDEventType type, cons
     cpu_restore_irqs(irs);
 
     Semaphore_ReleaseFromInterruptContext(&pQueue->semaphore);
+    PollQueue_WakeupFromInterruptContext(&pQueue->pollQueue);
 }
 
 // Removes the oldest event from the queue and returns a copy of it. Blocks the
@@ -10,6 +10,7 @@
 #define HIDEventQueue_h
 
 #include <klib/klib.h>
+#include <dispatcher/PollQueue.h>
 #include "HIDEvent.h"
 
 struct _HIDEventQueue;
@@ -31,6 +32,11 @@ bool HIDEventQueue_IsEmpty(HIDEventQueueRef _Nonnull pQueue);
 // the oldest event every time it overflows.
 extern int HIDEventQueue_GetOverflowCount(HIDEventQueueRef _Nonnull pQueue);
 
+// Returns true if the queue is not empty. Adds 'pEntry' to the poll queue of
+// the event queue if 'pEntry' is not NULL. The poll queue is signaled every
+// time an event is posted to the queue.
+extern bool HIDEventQueue_Poll(HIDEventQueueRef _Nonnull pQueue, PollEntry* _Nullable pEntry);
+
 // Removes all events from the queue.
 extern void HIDEventQueue_RemoveAll(HIDEventQueueRef _Nonnull pQueue);
 
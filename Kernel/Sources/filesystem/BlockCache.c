@@ -0,0 +1,469 @@
+//
+//  BlockCache.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/18/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "BlockCache.h"
+#include <dispatcher/ConditionVariable.h>
+#include <dispatcher/Lock.h>
+#include <dispatchqueue/DispatchQueue.h>
+#include <driver/MonotonicClock.h>
+
+
+#define kBlockCacheHashChainsCount  32
+#define kBlockCacheHashChainsMask   (kBlockCacheHashChainsCount - 1)
+
+// How long a dirty block may sit in the cache before the flusher writes it back
+#define kBlockCacheFlushDelayMillis 500
+
+
+typedef struct _DiskBlock {
+    ListNode                lruNode;        // Must be the first field
+    ListNode                hashNode;
+    DiskDriverRef _Nullable driver;         // Strong reference
+    LogicalBlockAddress     lba;
+    size_t                  capacity;       // Size of the data area in bytes
+    bool                    isPinned;       // [cache lock] Block is in use by someone and not on the LRU list
+    bool                    isDirty;        // [cache lock] Block contents needs to be written back to disk
+    bool                    hasData;        // Block contents has been read from disk or initialized
+    int8_t                  reserved[1];
+    uint8_t                 data[1];
+} DiskBlock;
+
+#define DiskBlockFromHashNode(__pNode) \
+    ((DiskBlock*)(((char*)(__pNode)) - offsetof(DiskBlock, hashNode)))
+
+
+typedef struct _BlockCache {
+    Lock                        lock;
+    ConditionVariable           condition;          // Signaled when a block is unpinned
+    DispatchQueueRef _Nonnull   flushQueue;
+    List                        lru;                // Unpinned blocks. Least recently used block first
+    size_t                      maxByteSize;
+    size_t                      byteSize;           // Number of bytes used by all cached blocks
+    int                         dirtyCount;
+    bool                        isFlushScheduled;
+    List                        chains[kBlockCacheHashChainsCount];
+} BlockCache;
+
+
+BlockCacheRef   gBlockCache;
+
+
+// Creates a block cache that will cache at most 'maxByteSize' bytes worth of
+// disk blocks. Note that the cache may temporarily exceed this budget if all
+// cached blocks are in use. Dirty blocks are written back to disk by a flusher
+// that runs on its own kernel dispatch queue.
+errno_t BlockCache_Create(size_t maxByteSize, BlockCacheRef _Nullable * _Nonnull pOutSelf)
+{
+    decl_try_err();
+    BlockCacheRef self;
+
+    try(kalloc_cleared(sizeof(BlockCache), (void**) &self));
+    Lock_Init(&self->lock);
+    ConditionVariable_Init(&self->condition);
+    List_Init(&self->lru);
+    for (int i = 0; i < kBlockCacheHashChainsCount; i++) {
+        List_Init(&self->chains[i]);
+    }
+    self->maxByteSize = maxByteSize;
+    try(DispatchQueue_Create(0, 1, kDispatchQos_Utility, kDispatchPriority_Normal, gVirtualProcessorPool, NULL, &self->flushQueue));
+
+    *pOutSelf = self;
+    return EOK;
+
+catch:
+    *pOutSelf = NULL;
+    return err;
+}
+
+static List* _Nonnull BlockCache_GetChain(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    return &self->chains[(((uintptr_t)pDriver >> 4) ^ lba) & kBlockCacheHashChainsMask];
+}
+
+static DiskBlock* _Nullable BlockCache_FindBlock_Locked(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    ListNode* pCurNode = BlockCache_GetChain(self, pDriver, lba)->first;
+
+    while (pCurNode) {
+        DiskBlock* pBlock = DiskBlockFromHashNode(pCurNode);
+
+        if (pBlock->lba == lba && pBlock->driver == pDriver) {
+            return pBlock;
+        }
+        pCurNode = pCurNode->next;
+    }
+
+    return NULL;
+}
+
+// Removes the given unpinned block from the cache and frees it.
+static void BlockCache_DestroyBlock_Locked(BlockCacheRef _Nonnull self, DiskBlock* _Nonnull pBlock)
+{
+    if (pBlock->driver) {
+        List_Remove(BlockCache_GetChain(self, pBlock->driver, pBlock->lba), &pBlock->hashNode);
+        Object_Release(pBlock->driver);
+        pBlock->driver = NULL;
+    }
+    self->byteSize -= pBlock->capacity;
+    kfree(pBlock);
+}
+
+// Frees clean and unpinned blocks, starting with the least recently used one,
+// until the cache is back within its memory budget.
+static void BlockCache_TrimToBudget_Locked(BlockCacheRef _Nonnull self)
+{
+    List_ForEach(&self->lru, DiskBlock, {
+        if (self->byteSize <= self->maxByteSize) {
+            break;
+        }
+
+        if (!pCurNode->isDirty) {
+            List_Remove(&self->lru, &pCurNode->lruNode);
+            BlockCache_DestroyBlock_Locked(self, pCurNode);
+        }
+    });
+}
+
+// Returns a block with a capacity of at least 'blockSize' bytes which is not
+// on the LRU list and not in the hash table. Reuses the least recently used
+// clean block if the cache has reached its budget. Allocates a new block
+// otherwise or if all cached blocks are in use or dirty.
+static errno_t BlockCache_GetReusableBlock_Locked(BlockCacheRef _Nonnull self, size_t blockSize, DiskBlock* _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    DiskBlock* pBlock = NULL;
+
+    if (self->byteSize + blockSize > self->maxByteSize) {
+        List_ForEach(&self->lru, DiskBlock, {
+            if (!pCurNode->isDirty && pCurNode->capacity >= blockSize) {
+                pBlock = pCurNode;
+                break;
+            }
+        });
+    }
+
+    if (pBlock) {
+        List_Remove(&self->lru, &pBlock->lruNode);
+        List_Remove(BlockCache_GetChain(self, pBlock->driver, pBlock->lba), &pBlock->hashNode);
+        Object_Release(pBlock->driver);
+        pBlock->driver = NULL;
+    }
+    else {
+        try(kalloc(sizeof(DiskBlock) - 1 + blockSize, (void**) &pBlock));
+        pBlock->driver = NULL;
+        pBlock->capacity = blockSize;
+        self->byteSize += blockSize;
+    }
+    ListNode_Init(&pBlock->lruNode);
+    ListNode_Init(&pBlock->hashNode);
+    pBlock->isDirty = false;
+    pBlock->hasData = false;
+
+catch:
+    *pOutBlock = pBlock;
+    return err;
+}
+
+// Blocks the caller until the block 'lba' of 'pDriver' is either not cached or
+// not pinned anymore. Returns the block if it is cached and NULL otherwise.
+static errno_t BlockCache_WaitForUnpinnedBlock_Locked(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, DiskBlock* _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    DiskBlock* pBlock;
+
+    while (true) {
+        pBlock = BlockCache_FindBlock_Locked(self, pDriver, lba);
+        if (pBlock == NULL || !pBlock->isPinned) {
+            break;
+        }
+
+        err = ConditionVariable_Wait(&self->condition, &self->lock, kTimeInterval_Infinity);
+        if (err != EOK) {
+            pBlock = NULL;
+            break;
+        }
+    }
+
+    *pOutBlock = pBlock;
+    return err;
+}
+
+// Acquires the block 'lba' on the disk 'pDriver'. The returned block is pinned:
+// it will not be evicted and the caller has exclusive access to the block until
+// it relinquishes the block. Callers which try to acquire a block that is
+// already pinned are blocked until the block is relinquished.
+errno_t BlockCache_AcquireBlock(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, AcquireBlock mode, DiskBlockRef _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    const size_t blockSize = DiskDriver_GetBlockSize(pDriver);
+    DiskBlock* pBlock;
+
+    Lock_Lock(&self->lock);
+    try(BlockCache_WaitForUnpinnedBlock_Locked(self, pDriver, lba, &pBlock));
+
+    if (pBlock) {
+        List_Remove(&self->lru, &pBlock->lruNode);
+    }
+    else {
+        try(BlockCache_GetReusableBlock_Locked(self, blockSize, &pBlock));
+        pBlock->driver = Object_RetainAs(pDriver, DiskDriver);
+        pBlock->lba = lba;
+        List_InsertBeforeFirst(BlockCache_GetChain(self, pDriver, lba), &pBlock->hashNode);
+    }
+    pBlock->isPinned = true;
+    Lock_Unlock(&self->lock);
+
+
+    // We have exclusive access to the block at this point. Do the I/O without
+    // holding the cache lock.
+    switch (mode) {
+        case kAcquireBlock_ReadOnly:
+        case kAcquireBlock_Update:
+            if (!pBlock->hasData) {
+                err = DiskDriver_GetBlock(pDriver, pBlock->data, lba);
+            }
+            break;
+
+        case kAcquireBlock_Cleared:
+            Bytes_ClearRange(pBlock->data, blockSize);
+            break;
+
+        case kAcquireBlock_Replace:
+            break;
+
+        default:
+            abort();
+    }
+
+    if (err != EOK) {
+        // Don't leave a block with undefined content behind in the cache
+        Lock_Lock(&self->lock);
+        BlockCache_DestroyBlock_Locked(self, pBlock);
+        ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+        *pOutBlock = NULL;
+        return err;
+    }
+
+    pBlock->hasData = true;
+    *pOutBlock = pBlock;
+    return EOK;
+
+catch:
+    Lock_Unlock(&self->lock);
+    *pOutBlock = NULL;
+    return err;
+}
+
+// Puts the given pinned block back on the LRU list and wakes up everyone who
+// is waiting for a block to become available. Unlocks the cache.
+static void BlockCache_UnpinBlockAndUnlock(BlockCacheRef _Nonnull self, DiskBlock* _Nonnull pBlock)
+{
+    pBlock->isPinned = false;
+    List_InsertAfterLast(&self->lru, &pBlock->lruNode);
+    BlockCache_TrimToBudget_Locked(self);
+    ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+}
+
+static void BlockCache_OnFlush(BlockCacheRef _Nonnull self)
+{
+    Lock_Lock(&self->lock);
+    self->isFlushScheduled = false;
+    Lock_Unlock(&self->lock);
+
+    BlockCache_Sync(self, NULL);
+}
+
+// Relinquishes the given block without writing it back to disk.
+void BlockCache_RelinquishBlock(BlockCacheRef _Nonnull self, DiskBlockRef _Nullable pBlock)
+{
+    if (pBlock) {
+        Lock_Lock(&self->lock);
+        BlockCache_UnpinBlockAndUnlock(self, pBlock);
+    }
+}
+
+// Relinquishes the given block and writes its contents back to disk. A sync
+// write returns the I/O status of the disk write. A deferred write always
+// returns EOK.
+errno_t BlockCache_RelinquishBlockWriting(BlockCacheRef _Nonnull self, DiskBlockRef _Nullable pBlock, WriteBlock mode)
+{
+    decl_try_err();
+
+    if (pBlock == NULL) {
+        return EOK;
+    }
+
+    if (mode == kWriteBlock_Sync) {
+        err = DiskDriver_PutBlock(pBlock->driver, pBlock->data, pBlock->lba);
+    }
+
+    Lock_Lock(&self->lock);
+    if (mode == kWriteBlock_Sync && err == EOK) {
+        if (pBlock->isDirty) {
+            pBlock->isDirty = false;
+            self->dirtyCount--;
+        }
+    }
+    else if (!pBlock->isDirty) {
+        // Deferred write or the sync write has failed. Either way the block
+        // is newer than what is on the disk
+        pBlock->isDirty = true;
+        self->dirtyCount++;
+    }
+
+    if (self->dirtyCount > 0 && !self->isFlushScheduled) {
+        const TimeInterval deadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), TimeInterval_MakeMilliseconds(kBlockCacheFlushDelayMillis));
+
+        if (DispatchQueue_DispatchAsyncAfter(self->flushQueue, deadline, DispatchQueueClosure_Make((Closure1Arg_Func)BlockCache_OnFlush, self)) == EOK) {
+            self->isFlushScheduled = true;
+        }
+    }
+    BlockCache_UnpinBlockAndUnlock(self, pBlock);
+
+    return err;
+}
+
+// Reads the blocks described by 'pSegments' directly into the segment buffers
+// without going through cache blocks. The cached copy of a block is used
+// instead if the block is currently cached. All other blocks are read with a
+// single vectored disk driver call. Note that this function reorders the
+// segments in 'pSegments'. The caller must ensure that no one else is modifying
+// the blocks at the same time.
+errno_t BlockCache_ReadBlocksDirect(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+    const size_t blockSize = DiskDriver_GetBlockSize(pDriver);
+    int nUncachedSegments = 0;
+
+    Lock_Lock(&self->lock);
+    for (int i = 0; i < nSegments; i++) {
+        DiskBlock* pBlock;
+
+        err = BlockCache_WaitForUnpinnedBlock_Locked(self, pDriver, pSegments[i].lba, &pBlock);
+        if (err != EOK) {
+            break;
+        }
+
+        if (pBlock) {
+            // Nobody is able to pin the block and change its contents while we
+            // are holding the cache lock
+            Bytes_CopyRange(pSegments[i].buffer, pBlock->data, blockSize);
+            List_Remove(&self->lru, &pBlock->lruNode);
+            List_InsertAfterLast(&self->lru, &pBlock->lruNode);
+        }
+        else {
+            const DiskBlockSegment seg = pSegments[i];
+
+            pSegments[i] = pSegments[nUncachedSegments];
+            pSegments[nUncachedSegments++] = seg;
+        }
+    }
+    Lock_Unlock(&self->lock);
+
+    if (err == EOK && nUncachedSegments > 0) {
+        err = DiskDriver_GetBlocks(pDriver, pSegments, nUncachedSegments);
+    }
+    return err;
+}
+
+// Writes the contents of the segment buffers in 'pSegments' directly to disk
+// with a single vectored disk driver call. Cached copies of the blocks are
+// dropped from the cache since they are out of date once the write has
+// completed. The caller must ensure that no one else is accessing the blocks
+// at the same time.
+errno_t BlockCache_WriteBlocksDirect(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, const DiskBlockSegment* _Nonnull pSegments, int nSegments)
+{
+    decl_try_err();
+
+    Lock_Lock(&self->lock);
+    for (int i = 0; i < nSegments; i++) {
+        DiskBlock* pBlock;
+
+        err = BlockCache_WaitForUnpinnedBlock_Locked(self, pDriver, pSegments[i].lba, &pBlock);
+        if (err != EOK) {
+            break;
+        }
+
+        if (pBlock) {
+            if (pBlock->isDirty) {
+                self->dirtyCount--;
+            }
+            List_Remove(&self->lru, &pBlock->lruNode);
+            BlockCache_DestroyBlock_Locked(self, pBlock);
+        }
+    }
+    Lock_Unlock(&self->lock);
+
+    return (err == EOK) ? DiskDriver_PutBlocks(pDriver, pSegments, nSegments) : err;
+}
+
+// Writes all dirty blocks which belong to the disk 'pDriver' back to disk.
+// Writes back all dirty blocks of all disks if 'pDriver' is NULL. Blocks the
+// caller until the writes have completed.
+errno_t BlockCache_Sync(BlockCacheRef _Nonnull self, DiskDriverRef _Nullable pDriver)
+{
+    decl_try_err();
+
+    Lock_Lock(&self->lock);
+    while (self->dirtyCount > 0 && err == EOK) {
+        DiskBlock* pBlock = NULL;
+
+        List_ForEach(&self->lru, DiskBlock, {
+            if (pCurNode->isDirty && (pDriver == NULL || pCurNode->driver == pDriver)) {
+                pBlock = pCurNode;
+                break;
+            }
+        });
+        if (pBlock == NULL) {
+            break;
+        }
+
+        List_Remove(&self->lru, &pBlock->lruNode);
+        pBlock->isPinned = true;
+        Lock_Unlock(&self->lock);
+
+        err = DiskDriver_PutBlock(pBlock->driver, pBlock->data, pBlock->lba);
+
+        Lock_Lock(&self->lock);
+        if (err == EOK) {
+            pBlock->isDirty = false;
+            self->dirtyCount--;
+        }
+        pBlock->isPinned = false;
+        List_InsertAfterLast(&self->lru, &pBlock->lruNode);
+    }
+    ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+
+    return err;
+}
+
+// Writes back all dirty blocks that belong to 'pDriver' and removes all blocks
+// of 'pDriver' from the cache. This should be called when a disk is unmounted.
+errno_t BlockCache_PurgeDisk(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver)
+{
+    decl_try_err();
+
+    err = BlockCache_Sync(self, pDriver);
+
+    Lock_Lock(&self->lock);
+    List_ForEach(&self->lru, DiskBlock, {
+        if (pCurNode->driver == pDriver && !pCurNode->isDirty) {
+            List_Remove(&self->lru, &pCurNode->lruNode);
+            BlockCache_DestroyBlock_Locked(self, pCurNode);
+        }
+    });
+    Lock_Unlock(&self->lock);
+
+    return err;
+}
+
+// Returns a pointer to the data of a block. The block must be acquired.
+uint8_t* _Nonnull DiskBlock_GetData(DiskBlockRef _Nonnull self)
+{
+    return self->data;
+}
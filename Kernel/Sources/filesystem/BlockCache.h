@@ -0,0 +1,87 @@
+//
+//  BlockCache.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/18/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef BlockCache_h
+#define BlockCache_h
+
+#include <klib/klib.h>
+#include <driver/DiskDriver.h>
+
+struct _BlockCache;
+typedef struct _BlockCache* BlockCacheRef;
+
+struct _DiskBlock;
+typedef struct _DiskBlock* DiskBlockRef;
+
+
+// Specifies how a block should be acquired
+typedef enum AcquireBlock {
+    kAcquireBlock_ReadOnly = 0,     // Block contents is read from disk if the block isn't already cached
+    kAcquireBlock_Update,           // Same as ReadOnly but the caller intends to modify the block contents
+    kAcquireBlock_Replace,          // Caller will replace the whole block contents. The block is not read from disk
+    kAcquireBlock_Cleared,          // Block contents is cleared. The block is not read from disk
+} AcquireBlock;
+
+// Specifies how a modified block should be written back to disk
+typedef enum WriteBlock {
+    kWriteBlock_Sync = 0,           // Block is written to disk before the relinquish call returns
+    kWriteBlock_Deferred,           // Block is marked dirty and written back to disk by the flusher at a later time
+} WriteBlock;
+
+
+extern BlockCacheRef _Nonnull  gBlockCache;
+
+// Creates a block cache that will cache at most 'maxByteSize' bytes worth of
+// disk blocks. Note that the cache may temporarily exceed this budget if all
+// cached blocks are in use. Dirty blocks are written back to disk by a flusher
+// that runs on its own kernel dispatch queue.
+extern errno_t BlockCache_Create(size_t maxByteSize, BlockCacheRef _Nullable * _Nonnull pOutSelf);
+
+// Acquires the block 'lba' on the disk 'pDriver'. The returned block is pinned:
+// it will not be evicted and the caller has exclusive access to the block until
+// it relinquishes the block. Callers which try to acquire a block that is
+// already pinned are blocked until the block is relinquished.
+extern errno_t BlockCache_AcquireBlock(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, AcquireBlock mode, DiskBlockRef _Nullable * _Nonnull pOutBlock);
+
+// Relinquishes the given block without writing it back to disk.
+extern void BlockCache_RelinquishBlock(BlockCacheRef _Nonnull self, DiskBlockRef _Nullable pBlock);
+
+// Relinquishes the given block and writes its contents back to disk. A sync
+// write returns the I/O status of the disk write. A deferred write always
+// returns EOK.
+extern errno_t BlockCache_RelinquishBlockWriting(BlockCacheRef _Nonnull self, DiskBlockRef _Nullable pBlock, WriteBlock mode);
+
+// Reads the blocks described by 'pSegments' directly into the segment buffers
+// without going through cache blocks. The cached copy of a block is used
+// instead if the block is currently cached. All other blocks are read with a
+// single vectored disk driver call. Note that this function reorders the
+// segments in 'pSegments'. The caller must ensure that no one else is modifying
+// the blocks at the same time.
+extern errno_t BlockCache_ReadBlocksDirect(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, DiskBlockSegment* _Nonnull pSegments, int nSegments);
+
+// Writes the contents of the segment buffers in 'pSegments' directly to disk
+// with a single vectored disk driver call. Cached copies of the blocks are
+// dropped from the cache since they are out of date once the write has
+// completed. The caller must ensure that no one else is accessing the blocks
+// at the same time.
+extern errno_t BlockCache_WriteBlocksDirect(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, const DiskBlockSegment* _Nonnull pSegments, int nSegments);
+
+// Writes all dirty blocks which belong to the disk 'pDriver' back to disk.
+// Writes back all dirty blocks of all disks if 'pDriver' is NULL. Blocks the
+// caller until the writes have completed.
+extern errno_t BlockCache_Sync(BlockCacheRef _Nonnull self, DiskDriverRef _Nullable pDriver);
+
+// Writes back all dirty blocks that belong to 'pDriver' and removes all blocks
+// of 'pDriver' from the cache. This should be called when a disk is unmounted.
+extern errno_t BlockCache_PurgeDisk(BlockCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver);
+
+
+// Returns a pointer to the data of a block. The block must be acquired.
+extern uint8_t* _Nonnull DiskBlock_GetData(DiskBlockRef _Nonnull self);
+
+#endif /* BlockCache_h */
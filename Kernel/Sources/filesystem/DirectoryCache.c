@@ -0,0 +1,266 @@
+//
+//  DirectoryCache.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/24/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "DirectoryCache.h"
+#include <dispatcher/Lock.h>
+
+
+#define kDirectoryCacheHashChainsCount  32
+#define kDirectoryCacheHashChainsMask   (kDirectoryCacheHashChainsCount - 1)
+
+
+typedef struct _DirectoryCacheEntry {
+    ListNode        lruNode;        // Must be the first field
+    ListNode        hashNode;
+    FilesystemId    fsid;
+    InodeId         parentId;
+    InodeId         id;             // Inode named by the entry; only valid if 'exists' is true
+    bool            exists;         // false if this is a negative entry
+    int8_t          nameLength;
+    int8_t          reserved[2];
+    char            name[kDirectoryCacheMaxNameLength];
+} DirectoryCacheEntry;
+
+#define DirectoryCacheEntryFromHashNode(__pNode) \
+    ((DirectoryCacheEntry*)(((char*)(__pNode)) - offsetof(DirectoryCacheEntry, hashNode)))
+
+
+typedef struct _DirectoryCache {
+    Lock                            lock;
+    List                            lru;                // Entries in use. Least recently used entry first
+    List                            freeEntries;
+    DirectoryCacheEntry* _Nonnull   entries;
+    int                             capacity;
+    int                             count;
+    uint32_t                        hitCount;
+    uint32_t                        negativeHitCount;
+    uint32_t                        missCount;
+    List                            chains[kDirectoryCacheHashChainsCount];
+} DirectoryCache;
+
+
+DirectoryCacheRef   gDirectoryCache;
+
+
+// Creates a directory cache which remembers up to 'capacity' (filesystem,
+// parent directory, name) -> inode id mappings. The cache also remembers names
+// that do not exist in a directory. The least recently used mapping is replaced
+// once the cache is full.
+errno_t DirectoryCache_Create(int capacity, DirectoryCacheRef _Nullable * _Nonnull pOutSelf)
+{
+    decl_try_err();
+    DirectoryCacheRef self;
+
+    try(kalloc_cleared(sizeof(DirectoryCache), (void**) &self));
+    try(kalloc_cleared(sizeof(DirectoryCacheEntry) * capacity, (void**) &self->entries));
+    Lock_Init(&self->lock);
+    List_Init(&self->lru);
+    List_Init(&self->freeEntries);
+    for (int i = 0; i < kDirectoryCacheHashChainsCount; i++) {
+        List_Init(&self->chains[i]);
+    }
+    for (int i = 0; i < capacity; i++) {
+        List_InsertAfterLast(&self->freeEntries, &self->entries[i].lruNode);
+    }
+    self->capacity = capacity;
+
+    *pOutSelf = self;
+    return EOK;
+
+catch:
+    *pOutSelf = NULL;
+    return err;
+}
+
+static List* _Nonnull DirectoryCache_GetChain(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName)
+{
+    uint32_t h = fsid ^ (parentId * 31);
+
+    for (ssize_t i = 0; i < pName->count; i++) {
+        h = (h << 5) + h + (uint8_t)pName->name[i];
+    }
+    return &self->chains[(h ^ (h >> 16)) & kDirectoryCacheHashChainsMask];
+}
+
+static DirectoryCacheEntry* _Nullable DirectoryCache_FindEntry_Locked(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName)
+{
+    ListNode* pCurNode = DirectoryCache_GetChain(self, fsid, parentId, pName)->first;
+
+    while (pCurNode) {
+        DirectoryCacheEntry* pEntry = DirectoryCacheEntryFromHashNode(pCurNode);
+
+        if (pEntry->parentId == parentId && pEntry->fsid == fsid && pEntry->nameLength == pName->count
+            && Bytes_FindFirstDifference(pEntry->name, pName->name, pName->count) == -1) {
+            return pEntry;
+        }
+        pCurNode = pCurNode->next;
+    }
+
+    return NULL;
+}
+
+// Removes the given entry from the hash table and the LRU list and puts it
+// back on the free list.
+static void DirectoryCache_FreeEntry_Locked(DirectoryCacheRef _Nonnull self, DirectoryCacheEntry* _Nonnull pEntry)
+{
+    const PathComponent name = {pEntry->name, pEntry->nameLength};
+
+    List_Remove(DirectoryCache_GetChain(self, pEntry->fsid, pEntry->parentId, &name), &pEntry->hashNode);
+    List_Remove(&self->lru, &pEntry->lruNode);
+    List_InsertAfterLast(&self->freeEntries, &pEntry->lruNode);
+    self->count--;
+}
+
+// Records the mapping (fsid, parentId, name) -> (exists, id). Replaces the
+// least recently used entry if the cache is full.
+static void DirectoryCache_EnterEntry(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, bool exists, InodeId id)
+{
+    if (pName->count > kDirectoryCacheMaxNameLength) {
+        return;
+    }
+
+    Lock_Lock(&self->lock);
+    DirectoryCacheEntry* pEntry = DirectoryCache_FindEntry_Locked(self, fsid, parentId, pName);
+
+    if (pEntry) {
+        List_Remove(&self->lru, &pEntry->lruNode);
+    }
+    else {
+        if (List_IsEmpty(&self->freeEntries) && !List_IsEmpty(&self->lru)) {
+            DirectoryCache_FreeEntry_Locked(self, (DirectoryCacheEntry*)self->lru.first);
+        }
+
+        pEntry = (DirectoryCacheEntry*)List_RemoveFirst(&self->freeEntries);
+        if (pEntry == NULL) {
+            Lock_Unlock(&self->lock);
+            return;
+        }
+
+        pEntry->fsid = fsid;
+        pEntry->parentId = parentId;
+        pEntry->nameLength = (int8_t)pName->count;
+        Bytes_CopyRange(pEntry->name, pName->name, pName->count);
+        List_InsertBeforeFirst(DirectoryCache_GetChain(self, fsid, parentId, pName), &pEntry->hashNode);
+        self->count++;
+    }
+
+    pEntry->exists = exists;
+    pEntry->id = id;
+    List_InsertAfterLast(&self->lru, &pEntry->lruNode);
+    Lock_Unlock(&self->lock);
+}
+
+// Looks up the name 'pName' in the directory 'parentId' of the filesystem
+// 'fsid'. Returns the inode id of the name in 'pOutId' if the result is
+// kDirectoryCache_Hit.
+DirectoryCacheResult DirectoryCache_Lookup(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId* _Nonnull pOutId)
+{
+    DirectoryCacheResult r = kDirectoryCache_Miss;
+
+    *pOutId = 0;
+    Lock_Lock(&self->lock);
+    DirectoryCacheEntry* pEntry = (pName->count <= kDirectoryCacheMaxNameLength) ? DirectoryCache_FindEntry_Locked(self, fsid, parentId, pName) : NULL;
+
+    if (pEntry) {
+        List_Remove(&self->lru, &pEntry->lruNode);
+        List_InsertAfterLast(&self->lru, &pEntry->lruNode);
+
+        if (pEntry->exists) {
+            *pOutId = pEntry->id;
+            self->hitCount++;
+            r = kDirectoryCache_Hit;
+        }
+        else {
+            self->negativeHitCount++;
+            r = kDirectoryCache_NegativeHit;
+        }
+    }
+    else {
+        self->missCount++;
+    }
+    Lock_Unlock(&self->lock);
+
+    return r;
+}
+
+// Records that the name 'pName' in the directory 'parentId' refers to the inode 'id'.
+void DirectoryCache_Enter(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId id)
+{
+    DirectoryCache_EnterEntry(self, fsid, parentId, pName, true, id);
+}
+
+// Records that the name 'pName' does not exist in the directory 'parentId'.
+void DirectoryCache_EnterNegative(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName)
+{
+    DirectoryCache_EnterEntry(self, fsid, parentId, pName, false, 0);
+}
+
+// Forgets everything that is known about the name 'pName' in the directory 'parentId'.
+void DirectoryCache_RemoveName(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName)
+{
+    if (pName->count > kDirectoryCacheMaxNameLength) {
+        return;
+    }
+
+    Lock_Lock(&self->lock);
+    DirectoryCacheEntry* pEntry = DirectoryCache_FindEntry_Locked(self, fsid, parentId, pName);
+    if (pEntry) {
+        DirectoryCache_FreeEntry_Locked(self, pEntry);
+    }
+    Lock_Unlock(&self->lock);
+}
+
+// Forgets all names in the directory 'parentId' which refer to the inode 'id'
+// and all names inside of 'id' if it is a directory. Should be called when
+// 'id' is unlinked from 'parentId'.
+void DirectoryCache_RemoveNode(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, InodeId id)
+{
+    Lock_Lock(&self->lock);
+    List_ForEach(&self->lru, DirectoryCacheEntry, {
+        if (pCurNode->fsid == fsid
+            && ((pCurNode->parentId == parentId && pCurNode->exists && pCurNode->id == id) || pCurNode->parentId == id)) {
+            DirectoryCache_FreeEntry_Locked(self, pCurNode);
+        }
+    });
+    Lock_Unlock(&self->lock);
+}
+
+// Forgets everything that is known about the filesystem 'fsid'. Should be
+// called when the filesystem is mounted or unmounted.
+void DirectoryCache_PurgeFilesystem(DirectoryCacheRef _Nonnull self, FilesystemId fsid)
+{
+    Lock_Lock(&self->lock);
+    List_ForEach(&self->lru, DirectoryCacheEntry, {
+        if (pCurNode->fsid == fsid) {
+            DirectoryCache_FreeEntry_Locked(self, pCurNode);
+        }
+    });
+    Lock_Unlock(&self->lock);
+}
+
+// Returns the size and the lookup statistics of the cache.
+void DirectoryCache_GetInfo(DirectoryCacheRef _Nonnull self, DirectoryCacheInfo* _Nonnull pOutInfo)
+{
+    Lock_Lock(&self->lock);
+    pOutInfo->capacity = self->capacity;
+    pOutInfo->count = self->count;
+    pOutInfo->hitCount = self->hitCount;
+    pOutInfo->negativeHitCount = self->negativeHitCount;
+    pOutInfo->missCount = self->missCount;
+    Lock_Unlock(&self->lock);
+}
+
+// Prints the lookup statistics of the cache.
+void DirectoryCache_Dump(DirectoryCacheRef _Nonnull self)
+{
+    DirectoryCacheInfo info;
+
+    DirectoryCache_GetInfo(self, &info);
+    print("dcache: %d/%d entries, %d hits, %d negative hits, %d misses\n",
+        info.count, info.capacity, (int)info.hitCount, (int)info.negativeHitCount, (int)info.missCount);
+}
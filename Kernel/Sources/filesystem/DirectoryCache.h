@@ -0,0 +1,68 @@
+//
+//  DirectoryCache.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 3/24/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef DirectoryCache_h
+#define DirectoryCache_h
+
+#include <klib/klib.h>
+#include <System/Directory.h>
+#include "PathComponent.h"
+
+struct _DirectoryCache;
+typedef struct _DirectoryCache* DirectoryCacheRef;
+
+
+// Names longer than this are not cached
+#define kDirectoryCacheMaxNameLength    32
+
+// The result of a directory cache lookup
+typedef enum DirectoryCacheResult {
+    kDirectoryCache_Miss = 0,       // Nothing is known about the name
+    kDirectoryCache_Hit,            // The name exists and refers to the returned inode
+    kDirectoryCache_NegativeHit,    // The name is known to not exist
+} DirectoryCacheResult;
+
+
+extern DirectoryCacheRef _Nonnull  gDirectoryCache;
+
+// Creates a directory cache which remembers up to 'capacity' (filesystem,
+// parent directory, name) -> inode id mappings. The cache also remembers names
+// that do not exist in a directory. The least recently used mapping is replaced
+// once the cache is full.
+extern errno_t DirectoryCache_Create(int capacity, DirectoryCacheRef _Nullable * _Nonnull pOutSelf);
+
+// Looks up the name 'pName' in the directory 'parentId' of the filesystem
+// 'fsid'. Returns the inode id of the name in 'pOutId' if the result is
+// kDirectoryCache_Hit.
+extern DirectoryCacheResult DirectoryCache_Lookup(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId* _Nonnull pOutId);
+
+// Records that the name 'pName' in the directory 'parentId' refers to the inode 'id'.
+extern void DirectoryCache_Enter(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId id);
+
+// Records that the name 'pName' does not exist in the directory 'parentId'.
+extern void DirectoryCache_EnterNegative(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName);
+
+// Forgets everything that is known about the name 'pName' in the directory 'parentId'.
+extern void DirectoryCache_RemoveName(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName);
+
+// Forgets all names in the directory 'parentId' which refer to the inode 'id'
+// and all names inside of 'id' if it is a directory. Should be called when
+// 'id' is unlinked from 'parentId'.
+extern void DirectoryCache_RemoveNode(DirectoryCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, InodeId id);
+
+// Forgets everything that is known about the filesystem 'fsid'. Should be
+// called when the filesystem is mounted or unmounted.
+extern void DirectoryCache_PurgeFilesystem(DirectoryCacheRef _Nonnull self, FilesystemId fsid);
+
+// Returns the size and the lookup statistics of the cache.
+extern void DirectoryCache_GetInfo(DirectoryCacheRef _Nonnull self, DirectoryCacheInfo* _Nonnull pOutInfo);
+
+// Prints the lookup statistics of the cache.
+extern void DirectoryCache_Dump(DirectoryCacheRef _Nonnull self);
+
+#endif /* DirectoryCache_h */
@@ -7,6 +7,7 @@
 //
 
 #include "Filesystem.h"
+#include "DirectoryCache.h"
 #include <System/IOChannel.h>
 
 
@@ -24,6 +25,8 @@ errno_t File_Create(FilesystemRef _Nonnull pFilesystem, unsigned int mode, Inode
     try(IOChannel_AbstractCreate(&kFileClass, (IOResourceRef)pFilesystem, mode, (IOChannelRef*)&pFile));
     pFile->inode = Inode_ReacquireUnlocked(pNode);
     pFile->offset = 0ll;
+    Lock_Init(&pFile->asyncLock);
+    SList_Init(&pFile->asyncRequests);
 
 catch:
     *pOutFile = pFile;
@@ -39,6 +42,8 @@ errno_t File_CreateCopy(FileRef _Nonnull pInFile, FileRef _Nullable * _Nonnull p
     try(IOChannel_AbstractCreateCopy((IOChannelRef)pInFile, (IOChannelRef*)&pNewFile));
     pNewFile->inode = Inode_ReacquireUnlocked(pInFile->inode);
     pNewFile->offset = pInFile->offset;
+    Lock_Init(&pNewFile->asyncLock);
+    SList_Init(&pNewFile->asyncRequests);
 
 catch:
     *pOutFile = pNewFile;
@@ -51,6 +56,8 @@ void File_deinit(FileRef _Nonnull self)
         Inode_Relinquish(self->inode);
         self->inode = NULL;
     }
+    SList_Deinit(&self->asyncRequests);
+    Lock_Deinit(&self->asyncLock);
 }
 
 errno_t File_ioctl(IOChannelRef _Nonnull self, int cmd, va_list ap)
@@ -161,6 +168,10 @@ errno_t Directory_ioctl(IOChannelRef _Nonnull self, int cmd, va_list ap)
             *((int*) va_arg(ap, int*)) = kIOChannelType_Directory;
             return EOK;
 
+        case kDirectoryCommand_GetCacheInfo:
+            DirectoryCache_GetInfo(gDirectoryCache, va_arg(ap, DirectoryCacheInfo*));
+            return EOK;
+
         default:
             return Object_SuperN(ioctl, IOChannel, self, cmd, ap);
     }
@@ -225,6 +236,10 @@ static FilesystemId Filesystem_GetNextAvailableId(void)
     return (FilesystemId) AtomicInt_Increment(&gNextAvailableId);
 }
 
+#define InodeFromHashNode(__pNode) \
+    ((InodeRef)(((char*)(__pNode)) - offsetof(Inode, hashNode)))
+
+
 // Creates an instance of a filesystem subclass. Users of a concrete filesystem
 // should not use this function to allocate an instance of the concrete filesystem.
 // This function is for use by Filesystem subclassers to define the filesystem
@@ -237,7 +252,13 @@ errno_t Filesystem_Create(ClassRef pClass, FilesystemRef _Nullable * _Nonnull pO
     try(_Object_Create(pClass, 0, (ObjectRef*)&self));
     self->fsid = Filesystem_GetNextAvailableId();
     Lock_Init(&self->inodeManagementLock);
-    PointerArray_Init(&self->inodesInUse, 16);
+    List_Init(&self->cachedInodes);
+    self->cachedInodeCount = 0;
+    self->maxCachedInodeCount = kDefaultMaxCachedInodeCount;
+    self->inodeCount = 0;
+    for (int i = 0; i < kInodeHashChainsCount; i++) {
+        List_Init(&self->inodeChains[i]);
+    }
 
     *pOutFileSys = self;
     return EOK;
@@ -249,10 +270,100 @@ catch:
 
 void Filesystem_deinit(FilesystemRef _Nonnull self)
 {
-    PointerArray_Deinit(&self->inodesInUse);
+    Filesystem_PurgeCachedNodes(self);
+    for (int i = 0; i < kInodeHashChainsCount; i++) {
+        List_Deinit(&self->inodeChains[i]);
+    }
+    List_Deinit(&self->cachedInodes);
     Lock_Deinit(&self->inodeManagementLock);
 }
 
+static List* _Nonnull Filesystem_GetInodeChain(FilesystemRef _Nonnull self, InodeId id)
+{
+    return &self->inodeChains[id & kInodeHashChainsMask];
+}
+
+static InodeRef _Nullable Filesystem_FindNode_Locked(FilesystemRef _Nonnull self, InodeId id)
+{
+    ListNode* pCurNode = Filesystem_GetInodeChain(self, id)->first;
+
+    while (pCurNode) {
+        InodeRef pNode = InodeFromHashNode(pCurNode);
+
+        if (Inode_GetId(pNode) == id) {
+            return pNode;
+        }
+        pCurNode = pCurNode->next;
+    }
+
+    return NULL;
+}
+
+static void Filesystem_AddNode_Locked(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode)
+{
+    List_InsertBeforeFirst(Filesystem_GetInodeChain(self, Inode_GetId(pNode)), &pNode->hashNode);
+    self->inodeCount++;
+}
+
+static void Filesystem_RemoveNode_Locked(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode)
+{
+    List_Remove(Filesystem_GetInodeChain(self, Inode_GetId(pNode)), &pNode->hashNode);
+    self->inodeCount--;
+}
+
+// Moves cached inodes, starting with the least recently used one, from the
+// inode cache to 'pEvicted' until the cache holds at most 'maxCount' inodes.
+// The caller should destroy the evicted inodes after it has dropped the inode
+// management lock.
+static void Filesystem_TrimNodeCache_Locked(FilesystemRef _Nonnull self, int maxCount, List* _Nonnull pEvicted)
+{
+    while (self->cachedInodeCount > maxCount) {
+        InodeRef pNode = (InodeRef)List_RemoveFirst(&self->cachedInodes);
+
+        self->cachedInodeCount--;
+        Filesystem_RemoveNode_Locked(self, pNode);
+        List_InsertAfterLast(pEvicted, &pNode->lruNode);
+    }
+}
+
+static void Filesystem_DestroyEvictedNodes(List* _Nonnull pEvicted)
+{
+    List_ForEach(pEvicted, Inode, {
+        Inode_Destroy(pCurNode);
+    });
+    List_Init(pEvicted);
+}
+
+// Sets the maximum number of unreferenced inodes that the filesystem keeps in
+// its inode cache. Cached inodes in excess of the new maximum are destroyed.
+// A maximum of 0 disables the inode cache.
+void Filesystem_SetMaxCachedNodeCount(FilesystemRef _Nonnull self, int count)
+{
+    List evicted;
+
+    List_Init(&evicted);
+    Lock_Lock(&self->inodeManagementLock);
+    self->maxCachedInodeCount = __max(count, 0);
+    Filesystem_TrimNodeCache_Locked(self, self->maxCachedInodeCount, &evicted);
+    Lock_Unlock(&self->inodeManagementLock);
+
+    Filesystem_DestroyEvictedNodes(&evicted);
+}
+
+// Destroys all unreferenced inodes in the inode cache. This should be called
+// before the filesystem is unmounted.
+void Filesystem_PurgeCachedNodes(FilesystemRef _Nonnull self)
+{
+    List evicted;
+
+    List_Init(&evicted);
+    Lock_Lock(&self->inodeManagementLock);
+    Filesystem_TrimNodeCache_Locked(self, 0, &evicted);
+    Lock_Unlock(&self->inodeManagementLock);
+
+    Filesystem_DestroyEvictedNodes(&evicted);
+}
+
 // Allocates a new inode on disk and in-core. The allocation is protected
 // by the same lock that is used to protect the acquisition, relinquishing,
 // write-back and deletion of inodes. The returned inode id is not visible to
@@ -266,7 +377,7 @@ errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, User
     Lock_Lock(&self->inodeManagementLock);
 
     try(Filesystem_OnAllocateNodeOnDisk(self, type, pContext, &pNode));
-    try(PointerArray_Add(&self->inodesInUse, pNode));
+    Filesystem_AddNode_Locked(self, pNode);
     pNode->useCount++;
     
     Inode_SetUserId(pNode, uid);
@@ -280,11 +391,6 @@ errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, User
 
 catch:
     Lock_Unlock(&self->inodeManagementLock);
-    
-    if (pNode) {
-        Inode_Unlink(pNode);
-        Filesystem_RelinquishNode(self, pNode);
-    }
     *pOutNode = NULL;
     return err;
 }
@@ -305,18 +411,17 @@ errno_t Filesystem_AcquireNodeWithId(FilesystemRef _Nonnull self, InodeId id, vo
 
     Lock_Lock(&self->inodeManagementLock);
 
-    for (int i = 0; i < PointerArray_GetCount(&self->inodesInUse); i++) {
-        InodeRef pCurNode = (InodeRef)PointerArray_GetAt(&self->inodesInUse, i);
-
-        if (Inode_GetId(pCurNode) == id) {
-            pNode = pCurNode;
-            break;
+    pNode = Filesystem_FindNode_Locked(self, id);
+    if (pNode) {
+        if (pNode->useCount == 0) {
+            // Pick the inode up from the inode cache
+            List_Remove(&self->cachedInodes, &pNode->lruNode);
+            self->cachedInodeCount--;
         }
     }
-
-    if (pNode == NULL) {
+    else {
         try(Filesystem_OnReadNodeFromDisk(self, id, pContext, &pNode));
-        try(PointerArray_Add(&self->inodesInUse, pNode));
+        Filesystem_AddNode_Locked(self, pNode);
     }
 
     pNode->useCount++;
@@ -355,43 +460,66 @@ InodeRef _Nonnull Filesystem_ReacquireUnlockedNode(FilesystemRef _Nonnull self,
 
 // Relinquishes the given node back to the filesystem. This method will invoke
 // the filesystem onRemoveNodeFromDisk() if no directory is referencing the inode
-// anymore. This will remove the inode from disk.
+// anymore. This will remove the inode from disk. A modified inode is written
+// back to disk without holding the inode management lock. The inode moves to
+// the inode cache once its last reference has been relinquished.
 void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nullable _Locked pNode)
 {
+    bool doRemove = false;
+    List evicted;
+
     if (pNode == NULL) {
         return;
     }
     
-    Lock_Lock(&self->inodeManagementLock);
-
     // XXX take FS readonly status into account here
+    // The caller holds a reference to the inode which guarantees that the inode
+    // stays in the inode table while we write it back
     assert(pNode->linkCount >= 0);
-    if (pNode->linkCount == 0) {
-        Filesystem_OnRemoveNodeFromDisk(self, pNode);
-    }
-    else if (Inode_IsModified(pNode)) {
-        Filesystem_OnWriteNodeToDisk(self, pNode);
+    if (pNode->linkCount > 0 && Inode_IsModified(pNode)) {
+        Inode_Lock(pNode);
+        if (Inode_IsModified(pNode)) {
+            Filesystem_OnWriteNodeToDisk(self, pNode);
+            Inode_ClearModified(pNode);
+        }
+        Inode_Unlock(pNode);
     }
-    Inode_ClearModified(pNode);
+
+
+    List_Init(&evicted);
+    Lock_Lock(&self->inodeManagementLock);
 
     assert(pNode->useCount > 0);
     pNode->useCount--;
     if (pNode->useCount == 0) {
-        PointerArray_Remove(&self->inodesInUse, pNode);
-        Inode_Destroy(pNode);
+        if (pNode->linkCount == 0) {
+            Filesystem_RemoveNode_Locked(self, pNode);
+            doRemove = true;
+        }
+        else {
+            List_InsertAfterLast(&self->cachedInodes, &pNode->lruNode);
+            self->cachedInodeCount++;
+            Filesystem_TrimNodeCache_Locked(self, self->maxCachedInodeCount, &evicted);
+        }
     }
     //XXX Inode_Unlock(pNode);
 
-
     Lock_Unlock(&self->inodeManagementLock);
+
+
+    if (doRemove) {
+        Filesystem_OnRemoveNodeFromDisk(self, pNode);
+        Inode_Destroy(pNode);
+    }
+    Filesystem_DestroyEvictedNodes(&evicted);
 }
 
 // Returns true if the filesystem can be safely unmounted which means that no
-// inodes owned by the filesystem is currently in memory.
+// inodes owned by the filesystem is currently in use.
 bool Filesystem_CanSafelyUnmount(FilesystemRef _Nonnull self)
 {
     Lock_Lock(&self->inodeManagementLock);
-    const bool ok = PointerArray_IsEmpty(&self->inodesInUse);
+    const bool ok = (self->inodeCount == self->cachedInodeCount);
     Lock_Unlock(&self->inodeManagementLock);
     return ok;
 }
@@ -23,6 +23,8 @@
 OPEN_CLASS_WITH_REF(File, IOChannel,
     InodeRef _Nonnull   inode;
     FileOffset          offset;
+    Lock                asyncLock;          // Protects asyncRequests
+    SList               asyncRequests;      // Pending asynchronous requests at the current position in submission order. The first one is executing
 );
 
 typedef struct _FileMethodTable {
@@ -127,10 +129,27 @@ extern errno_t Directory_CreateCopy(DirectoryRef _Nonnull pInDir, DirectoryRef _
 // Every inode has a lock associated with it. The filesystem (XXX currently)
 // must lock the inode before it accesses or modifies any of its properties. 
 //
+// Inode cache
+//
+// The filesystem keeps all in-core inodes in a hash table keyed by inode id.
+// An inode whose use count drops to zero is not destroyed right away. It is
+// written back to disk if necessary and it is then moved to an LRU list of
+// unreferenced inodes. A later acquisition of the same inode picks it up from
+// there without having to read it from disk again. The least recently used
+// inodes are destroyed once the list grows beyond its maximum size.
+//
+#define kInodeHashChainsCount           16
+#define kInodeHashChainsMask            (kInodeHashChainsCount - 1)
+#define kDefaultMaxCachedInodeCount     32
+
 OPEN_CLASS(Filesystem, IOResource,
     FilesystemId        fsid;
     Lock                inodeManagementLock;
-    PointerArray        inodesInUse;
+    List                cachedInodes;               // Unreferenced inodes. Least recently used inode first
+    int                 cachedInodeCount;
+    int                 maxCachedInodeCount;
+    int                 inodeCount;                 // Number of inodes in the inode table (in use and cached)
+    List                inodeChains[kInodeHashChainsCount];
 );
 typedef struct _FilesystemMethodTable {
     IOResourceMethodTable   super;
@@ -403,9 +422,18 @@ extern errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType typ
 extern errno_t Filesystem_AcquireNodeWithId(FilesystemRef _Nonnull self, InodeId id, void* _Nullable pContext, InodeRef _Nullable _Locked * _Nonnull pOutNode);
 
 // Returns true if the filesystem can be safely unmounted which means that no
-// inodes owned by the filesystem is currently in memory.
+// inodes owned by the filesystem is currently in use.
 extern bool Filesystem_CanSafelyUnmount(FilesystemRef _Nonnull self);
 
+// Sets the maximum number of unreferenced inodes that the filesystem keeps in
+// its inode cache. Cached inodes in excess of the new maximum are destroyed.
+// A maximum of 0 disables the inode cache.
+extern void Filesystem_SetMaxCachedNodeCount(FilesystemRef _Nonnull self, int count);
+
+// Destroys all unreferenced inodes in the inode cache. This should be called
+// before the filesystem is unmounted.
+extern void Filesystem_PurgeCachedNodes(FilesystemRef _Nonnull self);
+
 #define Filesystem_OnAllocateNodeOnDisk(__self, __type, __pContext, __pOutNode) \
 Object_InvokeN(onAllocateNodeOnDisk, Filesystem, __self, __type, __pContext, __pOutNode)
 
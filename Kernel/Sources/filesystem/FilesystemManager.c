@@ -7,6 +7,7 @@
 //
 
 #include "FilesystemManager.h"
+#include "DirectoryCache.h"
 #include <dispatcher/Lock.h>
 
 
@@ -154,6 +155,7 @@ static errno_t FilesystemManager_Mount_Locked(FilesystemManagerRef _Nonnull self
 
     // Notify the filesystem that we are mounting it
     try(Filesystem_OnMount(pFileSysToMount, pDriver, pParams, paramsSize));
+    DirectoryCache_PurgeFilesystem(gDirectoryCache, Filesystem_GetId(pFileSysToMount));
 
 
     // Update our mount table
@@ -198,6 +200,10 @@ static errno_t FilesystemManager_Unmount_Locked(FilesystemManagerRef _Nonnull se
     }
 
 
+    // Drop the cached names and inodes before the filesystem lets go of its disk
+    DirectoryCache_PurgeFilesystem(gDirectoryCache, unmountingFsid);
+    Filesystem_PurgeCachedNodes(pMount->mountedFilesystem);
+
     // The error returned from OnUnmount is purely advisory but will not stop the unmount from completing
     err = Filesystem_OnUnmount(pMount->mountedFilesystem);
 
@@ -30,6 +30,8 @@ enum {
 // See the description of the Filesystem class to learn about how locking for
 // Inodes works.
 typedef struct _Inode {
+    ListNode            lruNode;    // Must be the first field. On the filesystem inode cache LRU list while useCount == 0 (protected by the FS inode management lock)
+    ListNode            hashNode;   // Filesystem inode table chain (protected by the FS inode management lock)
     TimeInterval        accessTime;
     TimeInterval        modificationTime;
     TimeInterval        statusChangeTime;
@@ -8,6 +8,11 @@
 
 #include "SerenaFSPriv.h"
 #include <driver/MonotonicClock.h>
+#include <filesystem/DirectoryCache.h>
+
+
+// Stands in for the contents of a file block that has not been allocated yet
+static const uint8_t gZeroBlock[kSFSBlockSize];
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -27,12 +32,6 @@ static bool DirectoryNode_IsEmpty(InodeRef _Nonnull _Locked self)
 // MARK: Allocation Bitmaps
 ////////////////////////////////////////////////////////////////////////////////
 
-// Returns true if the allocation block 'lba' is in use and false otherwise
-static bool AllocationBitmap_IsBlockInUse(const uint8_t *bitmap, LogicalBlockAddress lba)
-{
-    return ((bitmap[lba >> 3] & (1 << (7 - (lba & 0x07)))) != 0) ? true : false;
-}
-
 // Sets the in-use bit corresponding to the logical block address 'lba' as in-use or not
 static void AllocationBitmap_SetBlockInUse(uint8_t *bitmap, LogicalBlockAddress lba, bool inUse)
 {
@@ -174,6 +173,7 @@ errno_t SerenaFS_Create(User rootDirUser, SerenaFSRef _Nullable * _Nonnull pOutF
     
     try(Filesystem_Create(&kSerenaFSClass, (FilesystemRef*)&self));
     Lock_Init(&self->lock);
+    Lock_Init(&self->allocationLock);
     ConditionVariable_Init(&self->notifier);
     self->isReadOnly = false;
 
@@ -190,57 +190,126 @@ void SerenaFS_deinit(SerenaFSRef _Nonnull self)
     // Can not be that we are getting deallocated while being mounted
     assert(self->diskDriver == NULL);
     ConditionVariable_Deinit(&self->notifier);
+    Lock_Deinit(&self->allocationLock);
     Lock_Deinit(&self->lock);
 }
 
-static errno_t SerenaFS_WriteBackAllocationBitmapForLba(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
+// Writes all allocation bitmap blocks that have been modified since the last
+// sync back to disk. Allocating and deallocating blocks only marks the affected
+// bitmap blocks as dirty so that appending to a file doesn't cost a bitmap
+// write per block.
+static errno_t SerenaFS_SyncAllocationBitmap(SerenaFSRef _Nonnull self)
 {
-    const LogicalBlockAddress idxOfAllocBitmapBlockModified = (lba >> 3) / kSFSBlockSize;
-    const uint8_t* pBlock = &self->allocationBitmap[idxOfAllocBitmapBlockModified * kSFSBlockSize];
-    const LogicalBlockAddress allocationBitmapBlockLba = self->allocationBitmapLba + idxOfAllocBitmapBlockModified;
+    decl_try_err();
 
-    return DiskDriver_PutBlock(self->diskDriver, pBlock, allocationBitmapBlockLba);
-}
+    Lock_Lock(&self->allocationLock);
+    for (;;) {
+        const int idx = Bits_FindFirstSet(BitPointer_Make(self->allocationBitmapDirtyBits, 0), self->allocationBitmapBlockCount);
+        if (idx < 0) {
+            break;
+        }
 
-static errno_t SerenaFS_AllocateBlock_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress* _Nonnull pOutLba)
-{
-    decl_try_err();
-    LogicalBlockAddress lba = 0;    // Safe because LBA #0 is the volume header which is always allocated when the FS is mounted
+        const uint8_t* pBlock = &self->allocationBitmap[idx * kSFSBlockSize];
+        const size_t nBytesToCopy = __min(kSFSBlockSize, self->allocationBitmapByteSize - idx * kSFSBlockSize);
+        DiskBlockRef pDiskBlock;
 
-    for (LogicalBlockAddress i = 1; i < self->volumeBlockCount; i++) {
-        if (!AllocationBitmap_IsBlockInUse(self->allocationBitmap, i)) {
-            lba = i;
+        err = BlockCache_AcquireBlock(gBlockCache, self->diskDriver, self->allocationBitmapLba + idx, kAcquireBlock_Cleared, &pDiskBlock);
+        if (err != EOK) {
             break;
         }
+        Bytes_CopyRange(DiskBlock_GetData(pDiskBlock), pBlock, nBytesToCopy);
+        BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
+        Bits_Clear(BitPointer_Make(self->allocationBitmapDirtyBits, idx));
+    }
+    Lock_Unlock(&self->allocationLock);
+
+    return err;
+}
+
+// Marks the allocation bitmap blocks which hold the in-use bits of the blocks
+// [lba, lba + nBlocks) as dirty.
+static void SerenaFS_MarkAllocationBitmapDirty_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount nBlocks)
+{
+    const LogicalBlockAddress firstIdx = (lba >> 3) / kSFSBlockSize;
+    const LogicalBlockAddress lastIdx = ((lba + nBlocks - 1) >> 3) / kSFSBlockSize;
+
+    Bits_SetRange(BitPointer_Make(self->allocationBitmapDirtyBits, firstIdx), lastIdx - firstIdx + 1);
+}
+
+// Finds the first free block in the range [startLba, endLba). Returns 0 if
+// there is no free block in this range.
+static LogicalBlockAddress SerenaFS_FindFreeBlock_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress startLba, LogicalBlockAddress endLba)
+{
+    if (startLba >= endLba) {
+        return 0;
+    }
+
+    const int idx = Bits_FindFirstCleared(BitPointer_Make(self->allocationBitmap, startLba), endLba - startLba);
+    return (idx >= 0) ? startLba + idx : 0;
+}
+
+// Allocates up to 'nMaxBlocks' contiguous free disk blocks and marks them as in
+// use in the allocation bitmap. Returns the address of the first block and the
+// number of blocks allocated. The number of blocks is less than 'nMaxBlocks' if
+// the first free run that was found is shorter than that. The search starts at
+// 'hint' and wraps around to the start of the disk. Passing the LBA that
+// follows the previous block of a file as the hint keeps sequentially written
+// files contiguous on disk. Pass 0 if there is no preference in which case the
+// search continues where the previous allocation left off. The allocation
+// bitmap is protected by the allocation lock because blocks may be allocated
+// by writes to different files at the same time.
+static errno_t SerenaFS_AllocateBlocks(SerenaFSRef _Nonnull self, LogicalBlockAddress hint, LogicalBlockCount nMaxBlocks, LogicalBlockAddress* _Nonnull pOutLba, LogicalBlockCount* _Nonnull pOutBlockCount)
+{
+    Lock_Lock(&self->allocationLock);
+
+    LogicalBlockAddress startLba = (hint > 0) ? hint : self->allocationCursor;
+    if (startLba < 1 || startLba >= self->volumeBlockCount) {
+        startLba = 1;   // LBA #0 is the volume header which is always allocated when the FS is mounted
+    }
+
+    LogicalBlockAddress lba = SerenaFS_FindFreeBlock_Locked(self, startLba, self->volumeBlockCount);
+    if (lba == 0) {
+        lba = SerenaFS_FindFreeBlock_Locked(self, 1, startLba);
     }
     if (lba == 0) {
-        throw(ENOSPC);
+        Lock_Unlock(&self->allocationLock);
+        *pOutLba = 0;
+        *pOutBlockCount = 0;
+        return ENOSPC;
     }
 
-    AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, true);
-    try(SerenaFS_WriteBackAllocationBitmapForLba(self, lba));
+    const LogicalBlockCount nAvailable = __min(nMaxBlocks, self->volumeBlockCount - lba);
+    const int runLength = (nAvailable > 1) ? Bits_FindFirstSet(BitPointer_Make(self->allocationBitmap, lba + 1), nAvailable - 1) : 0;
+    const LogicalBlockCount nBlocks = (runLength >= 0) ? 1 + runLength : nAvailable;
+
+    Bits_SetRange(BitPointer_Make(self->allocationBitmap, lba), nBlocks);
+    SerenaFS_MarkAllocationBitmapDirty_Locked(self, lba, nBlocks);
+    self->allocationCursor = lba + nBlocks;
+    Lock_Unlock(&self->allocationLock);
 
     *pOutLba = lba;
+    *pOutBlockCount = nBlocks;
     return EOK;
+}
 
-catch:
-    if (lba > 0) {
-        AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, false);
-    }
-    *pOutLba = 0;
-    return err;
+// Allocates a single free disk block. See SerenaFS_AllocateBlocks().
+static errno_t SerenaFS_AllocateBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress hint, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    LogicalBlockCount nBlocks;
+
+    return SerenaFS_AllocateBlocks(self, hint, 1, pOutLba, &nBlocks);
 }
 
-static void SerenaFS_DeallocateBlock_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
+static void SerenaFS_DeallocateBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
 {
     if (lba == 0) {
         return;
     }
 
+    Lock_Lock(&self->allocationLock);
     AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, false);
-
-    // XXX check for error here?
-    SerenaFS_WriteBackAllocationBitmapForLba(self, lba);
+    SerenaFS_MarkAllocationBitmapDirty_Locked(self, lba, 1);
+    Lock_Unlock(&self->allocationLock);
 }
 
 // Invoked when Filesystem_AllocateNode() is called. Subclassers should
@@ -253,7 +322,7 @@ errno_t SerenaFS_onAllocateNodeOnDisk(SerenaFSRef _Nonnull self, FileType type,
     void* pBlockMap = NULL;
 
     try(kalloc_cleared(sizeof(SFSBlockMap), &pBlockMap));
-    try(SerenaFS_AllocateBlock_Locked(self, &lba));
+    try(SerenaFS_AllocateBlock(self, 0, &lba));
 
     try(Inode_Create(
         Filesystem_GetId(self),
@@ -273,7 +342,7 @@ errno_t SerenaFS_onAllocateNodeOnDisk(SerenaFSRef _Nonnull self, FileType type,
 
 catch:
     kfree(pBlockMap);
-    SerenaFS_DeallocateBlock_Locked(self, lba);
+    SerenaFS_DeallocateBlock(self, lba);
     *pOutNode = NULL;
     return err;
 }
@@ -287,14 +356,15 @@ errno_t SerenaFS_onReadNodeFromDisk(SerenaFSRef _Nonnull self, InodeId id, void*
 {
     decl_try_err();
     const LogicalBlockAddress lba = (LogicalBlockAddress)id;
+    DiskBlockRef pDiskBlock = NULL;
     void* pBlockMap = NULL;
 
     try(kalloc(sizeof(SFSBlockMap), &pBlockMap));
-    try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba));
+    try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_ReadOnly, &pDiskBlock));
 
-    const SFSInode* ip = (const SFSInode*)self->tmpBlock;
+    const SFSInode* ip = (const SFSInode*)DiskBlock_GetData(pDiskBlock);
     Bytes_CopyRange(pBlockMap, &ip->blockMap, sizeof(SFSBlockMap));
-    return Inode_Create(
+    err = Inode_Create(
         Filesystem_GetId(self),
         id,
         ip->type,
@@ -308,6 +378,8 @@ errno_t SerenaFS_onReadNodeFromDisk(SerenaFSRef _Nonnull self, InodeId id, void*
         ip->statusChangeTime,
         pBlockMap,
         pOutNode);
+    BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+    return err;
 
 catch:
     kfree(pBlockMap);
@@ -323,9 +395,13 @@ errno_t SerenaFS_onWriteNodeToDisk(SerenaFSRef _Nonnull self, InodeRef _Nonnull
     const LogicalBlockAddress lba = (LogicalBlockAddress)Inode_GetId(pNode);
     const SFSBlockMap* pBlockMap = (const SFSBlockMap*)Inode_GetBlockMap(pNode);
     const TimeInterval curTime = MonotonicClock_GetCurrentTime();
-    SFSInode* ip = (SFSInode*)self->tmpBlock;
+    DiskBlockRef pDiskBlock;
 
-    Bytes_ClearRange(ip, kSFSBlockSize);
+    const errno_t err = BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_Cleared, &pDiskBlock);
+    if (err != EOK) {
+        return err;
+    }
+    SFSInode* ip = (SFSInode*)DiskBlock_GetData(pDiskBlock);
 
     ip->accessTime = (Inode_IsAccessed(pNode)) ? curTime : Inode_GetAccessTime(pNode);
     ip->modificationTime = (Inode_IsUpdated(pNode)) ? curTime : Inode_GetModificationTime(pNode);
@@ -337,23 +413,91 @@ errno_t SerenaFS_onWriteNodeToDisk(SerenaFSRef _Nonnull self, InodeRef _Nonnull
     ip->linkCount = Inode_GetLinkCount(pNode);
     ip->type = Inode_GetFileType(pNode);
     Bytes_CopyRange(&ip->blockMap, pBlockMap, sizeof(SFSBlockMap));
+    BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
 
-    return DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, lba);
+    // The inode may reference blocks that were allocated since the last time
+    // the allocation bitmap was written back
+    return SerenaFS_SyncAllocationBitmap(self);
 }
 
-static void SerenaFS_DeallocateFileContentBlocks_Locked(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode)
+// Deallocates the blocks referenced by the block pointers [firstIdx, kSFSBlockPointersPerBlock)
+// in the indirect block 'lba' and clears those pointers. The indirect block itself
+// is deallocated too if nothing in it is left in use. 'nLevels' is 1 for an indirect
+// block and 2 for a double indirect block. 'firstIdxInLastLevel' is the first
+// pointer to free in the indirect block that 'firstIdx' refers to if 'nLevels' is 2.
+static void SerenaFS_DeallocateIndirectBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress lba, int firstIdx, int firstIdxInLastLevel, int nLevels)
 {
-    const SFSBlockMap* pBlockMap = (const SFSBlockMap*)Inode_GetBlockMap(pNode);
+    const bool isFreeingWholeBlock = (firstIdx == 0 && firstIdxInLastLevel == 0);
+    DiskBlockRef pDiskBlock;
 
-    for (int i = 0; i < kSFSMaxDirectDataBlockPointers; i++) {
-        if (pBlockMap->p[i] == 0) {
-            break;
+    if (lba == 0) {
+        return;
+    }
+
+    // Leave the blocks alone if we can't look at the block pointers. Better to
+    // leak a few blocks than to free blocks that are still in use
+    if (BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_Update, &pDiskBlock) != EOK) {
+        return;
+    }
+    LogicalBlockAddress* bp = (LogicalBlockAddress*)DiskBlock_GetData(pDiskBlock);
+
+    for (int i = firstIdx; i < kSFSBlockPointersPerBlock; i++) {
+        if (nLevels > 1) {
+            const int firstSubIdx = (i == firstIdx) ? firstIdxInLastLevel : 0;
+
+            SerenaFS_DeallocateIndirectBlock(self, bp[i], firstSubIdx, 0, nLevels - 1);
+            if (firstSubIdx == 0) {
+                bp[i] = 0;
+            }
+        }
+        else if (bp[i] != 0) {
+            SerenaFS_DeallocateBlock(self, bp[i]);
+            bp[i] = 0;
         }
+    }
 
-        SerenaFS_DeallocateBlock_Locked(self, pBlockMap->p[i]);
+    if (isFreeingWholeBlock) {
+        BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+        SerenaFS_DeallocateBlock(self, lba);
+    }
+    else {
+        BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
     }
 }
 
+// Deallocates all file blocks starting at the file block 'firstFba' and all
+// indirect blocks that are no longer needed after that.
+static void SerenaFS_DeallocateFileContentBlocksFrom(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, int firstFba)
+{
+    SFSBlockMap* pBlockMap = (SFSBlockMap*)Inode_GetBlockMap(pNode);
+
+    for (int i = firstFba; i < kSFSMaxDirectDataBlockPointers; i++) {
+        if (pBlockMap->p[i] != 0) {
+            SerenaFS_DeallocateBlock(self, pBlockMap->p[i]);
+            pBlockMap->p[i] = 0;
+        }
+    }
+
+    const int firstIndirectIdx = __max(firstFba - kSFSMaxDirectDataBlockPointers, 0);
+    if (firstIndirectIdx < kSFSBlockPointersPerBlock) {
+        SerenaFS_DeallocateIndirectBlock(self, pBlockMap->indirect, firstIndirectIdx, 0, 1);
+        if (firstIndirectIdx == 0) {
+            pBlockMap->indirect = 0;
+        }
+    }
+
+    const int firstDoubleIndirectIdx = __max(firstFba - kSFSMaxDirectDataBlockPointers - kSFSBlockPointersPerBlock, 0);
+    SerenaFS_DeallocateIndirectBlock(self, pBlockMap->doubleIndirect, firstDoubleIndirectIdx >> kSFSBlockPointersPerBlockShift, firstDoubleIndirectIdx & kSFSBlockPointersPerBlockMask, 2);
+    if (firstDoubleIndirectIdx == 0) {
+        pBlockMap->doubleIndirect = 0;
+    }
+}
+
+static void SerenaFS_DeallocateFileContentBlocks_Locked(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode)
+{
+    SerenaFS_DeallocateFileContentBlocksFrom(self, pNode, 0);
+}
+
 // Invoked when Filesystem_RelinquishNode() has determined that the inode is
 // no longer being referenced by any directory and that the on-disk
 // representation should be deleted from the disk and deallocated. This
@@ -363,7 +507,7 @@ void SerenaFS_onRemoveNodeFromDisk(SerenaFSRef _Nonnull self, InodeRef _Nonnull
     const LogicalBlockAddress lba = (LogicalBlockAddress)Inode_GetId(pNode);
 
     SerenaFS_DeallocateFileContentBlocks_Locked(self, pNode);
-    SerenaFS_DeallocateBlock_Locked(self, lba);
+    SerenaFS_DeallocateBlock(self, lba);
 }
 
 // Checks whether the given user should be granted access to the given node based
@@ -448,8 +592,8 @@ static errno_t SerenaFS_GetDirectoryEntry(
     MutablePathComponent* _Nullable pOutFilename)
 {
     decl_try_err();
-    const SFSDirectoryEntry* pDirBuffer = (const SFSDirectoryEntry*)self->tmpBlock;
     const FileOffset fileSize = Inode_GetFileSize(pNode);
+    DiskBlockRef pDiskBlock = NULL;
     FileOffset offset = 0ll;
     LogicalBlockAddress lba = 0;
     SFSDirectoryEntry* pEmptyEntry = NULL;
@@ -491,11 +635,15 @@ static errno_t SerenaFS_GetDirectoryEntry(
         }
 
         try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba));
+
+        // The directory block stays acquired while we are looking at its entries
+        const SFSDirectoryEntry* pDirBuffer;
         if (lba == 0) {
-            Bytes_ClearRange(self->tmpBlock, kSFSBlockSize);
+            pDirBuffer = (const SFSDirectoryEntry*)gZeroBlock;
         }
         else {
-            try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba));
+            try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_ReadOnly, &pDiskBlock));
+            pDirBuffer = (const SFSDirectoryEntry*)DiskBlock_GetData(pDiskBlock);
         }
 
         const int nDirEntries = nBytesAvailable / sizeof(SFSDirectoryEntry);
@@ -506,36 +654,124 @@ static errno_t SerenaFS_GetDirectoryEntry(
             pOutEmptyPtr->fileOffset = offset + pOutEmptyPtr->offset;
         }
         if (hasMatch) {
+            if (pOutEntryPtr) {
+                pOutEntryPtr->lba = lba;
+                pOutEntryPtr->offset = ((uint8_t*)pMatchingEntry) - ((uint8_t*)pDirBuffer);
+                pOutEntryPtr->fileOffset = offset + pOutEntryPtr->offset;
+            }
+            if (pOutId) {
+                *pOutId = pMatchingEntry->id;
+            }
+            if (pOutFilename) {
+                const ssize_t len = String_LengthUpTo(pMatchingEntry->filename, kSFSMaxFilenameLength);
+                if (len > pOutFilename->capacity) {
+                    throw(ERANGE);
+                }
+
+                String_CopyUpTo(pOutFilename->name, pMatchingEntry->filename, len);
+                pOutFilename->count = len;
+            }
             break;
         }
 
+        BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+        pDiskBlock = NULL;
         offset += (FileOffset)nBytesAvailable;
     }
 
-    if (hasMatch) {
-        if (pOutEntryPtr) {
-            pOutEntryPtr->lba = lba;
-            pOutEntryPtr->offset = ((uint8_t*)pMatchingEntry) - ((uint8_t*)pDirBuffer);
-            pOutEntryPtr->fileOffset = offset + pOutEntryPtr->offset;
+    BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+    return (hasMatch) ? EOK : ENOENT;
+
+catch:
+    BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+    return err;
+}
+
+// Allocates a new block and writes zeros to it.
+static errno_t SerenaFS_AllocateClearedBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress hint, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    decl_try_err();
+    DiskBlockRef pDiskBlock;
+
+    try(SerenaFS_AllocateBlock(self, hint, pOutLba));
+    err = BlockCache_AcquireBlock(gBlockCache, self->diskDriver, *pOutLba, kAcquireBlock_Cleared, &pDiskBlock);
+    if (err != EOK) {
+        SerenaFS_DeallocateBlock(self, *pOutLba);
+        *pOutLba = 0;
+        return err;
+    }
+    return BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
+
+catch:
+    return err;
+}
+
+// Makes sure that the indirect block that '*pIndirectLba' points to exists if
+// 'mode' is write by allocating an empty indirect block if necessary.
+static errno_t SerenaFS_GetIndirectBlockPointer(SerenaFSRef _Nonnull self, LogicalBlockAddress* _Nonnull pIndirectLba, LogicalBlockAddress hint, SFSBlockMode mode)
+{
+    if (*pIndirectLba == 0 && mode == kSFSBlockMode_Write) {
+        return SerenaFS_AllocateClearedBlock(self, (hint > 0) ? hint + 1 : 0, pIndirectLba);
+    }
+    return EOK;
+}
+
+// Allocates a block for file data. The block is taken from 'pRun' if a run is
+// provided and it has blocks left. Otherwise a new block is allocated.
+static errno_t SerenaFS_AllocateDataBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress hint, SFSBlockRun* _Nullable pRun, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    if (pRun && pRun->count > 0) {
+        *pOutLba = pRun->lba;
+        pRun->lba++;
+        pRun->count--;
+        return EOK;
+    }
+    return SerenaFS_AllocateBlock(self, hint, pOutLba);
+}
+
+// Returns the block pointer at index 'idx' in the indirect block 'indirectLba'.
+// Returns 0 if 'indirectLba' is 0 or the block pointer is 0 and 'mode' is read.
+// Allocates a new block and stores its LBA in the indirect block if the block
+// pointer is 0 and 'mode' is write. The new block is cleared if 'isIndirect' is
+// true because it will serve as an indirect block itself. Otherwise the new
+// block is a data block which is taken from 'pRun' if possible.
+static errno_t SerenaFS_GetBlockPointerInIndirectBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress indirectLba, int idx, SFSBlockMode mode, bool isIndirect, SFSBlockRun* _Nullable pRun, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    decl_try_err();
+    DiskBlockRef pDiskBlock;
+
+    *pOutLba = 0;
+    if (indirectLba == 0) {
+        return EOK;
+    }
+
+    try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, indirectLba, (mode == kSFSBlockMode_Write) ? kAcquireBlock_Update : kAcquireBlock_ReadOnly, &pDiskBlock));
+    LogicalBlockAddress* bp = (LogicalBlockAddress*)DiskBlock_GetData(pDiskBlock);
+    LogicalBlockAddress lba = bp[idx];
+
+    if (lba == 0 && mode == kSFSBlockMode_Write) {
+        const LogicalBlockAddress hint = (idx > 0 && bp[idx - 1] > 0) ? bp[idx - 1] + 1 : indirectLba + 1;
+
+        if (isIndirect) {
+            err = SerenaFS_AllocateClearedBlock(self, hint, &lba);
         }
-        if (pOutId) {
-            *pOutId = pMatchingEntry->id;
+        else {
+            err = SerenaFS_AllocateDataBlock(self, hint, pRun, &lba);
         }
-        if (pOutFilename) {
-            const ssize_t len = String_LengthUpTo(pMatchingEntry->filename, kSFSMaxFilenameLength);
-            if (len > pOutFilename->capacity) {
-                throw(ERANGE);
-            }
-
-            String_CopyUpTo(pOutFilename->name, pMatchingEntry->filename, len);
-            pOutFilename->count = len;
+        if (err == EOK) {
+            bp[idx] = lba;
+            BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
+        }
+        else {
+            BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
         }
-        return EOK;
     }
     else {
-        return ENOENT;
+        BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
     }
 
+    *pOutLba = lba;
+
 catch:
     return err;
 }
@@ -546,24 +782,44 @@ catch:
 // block addresses increment by one until the end of the file. Note that not every
 // logical block address may be backed by an actual disk block. A missing disk block
 // must be substituted by an empty block. 0 is returned if no absolute logical
-// block address exists for 'fba'.
+// block address exists for 'fba'. Newly allocated data blocks are taken from
+// 'pRun' as long as it has blocks left if 'pRun' is not NULL.
 // XXX 'fba' should be LogicalBlockAddress. However we want to be able to detect overflows
-static errno_t SerenaFS_GetLogicalBlockAddressForFileBlockAddress(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, SFSBlockMode mode, LogicalBlockAddress* _Nonnull pOutLba)
+static errno_t SerenaFS_MapFileBlockAddress(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, SFSBlockMode mode, SFSBlockRun* _Nullable pRun, LogicalBlockAddress* _Nonnull pOutLba)
 {
     decl_try_err();
+    SFSBlockMap* pBlockMap = Inode_GetBlockMap(pNode);
+    LogicalBlockAddress lba;
 
-    if (fba < 0 || fba >= kSFSMaxDirectDataBlockPointers) {
+    if (fba < 0 || fba >= kSFSMaxFileBlockCount) {
         throw(EFBIG);
     }
 
-    SFSBlockMap* pBlockMap = Inode_GetBlockMap(pNode);
-    LogicalBlockAddress lba = pBlockMap->p[fba];
+    if (fba < kSFSMaxDirectDataBlockPointers) {
+        lba = pBlockMap->p[fba];
 
-    if (lba == 0 && mode == kSFSBlockMode_Write) {
-        // XXX fix locking here
-        try(SerenaFS_AllocateBlock_Locked(self, &lba));
-        pBlockMap->p[fba] = lba;
+        if (lba == 0 && mode == kSFSBlockMode_Write) {
+            const LogicalBlockAddress hint = (fba > 0 && pBlockMap->p[fba - 1] > 0) ? pBlockMap->p[fba - 1] + 1 : 0;
+
+            try(SerenaFS_AllocateDataBlock(self, hint, pRun, &lba));
+            pBlockMap->p[fba] = lba;
+        }
+    }
+    else if (fba < kSFSMaxDirectDataBlockPointers + kSFSBlockPointersPerBlock) {
+        const int idx = fba - kSFSMaxDirectDataBlockPointers;
+
+        try(SerenaFS_GetIndirectBlockPointer(self, &pBlockMap->indirect, pBlockMap->p[kSFSMaxDirectDataBlockPointers - 1], mode));
+        try(SerenaFS_GetBlockPointerInIndirectBlock(self, pBlockMap->indirect, idx, mode, false, pRun, &lba));
     }
+    else {
+        const int idx = fba - kSFSMaxDirectDataBlockPointers - kSFSBlockPointersPerBlock;
+        LogicalBlockAddress indirectLba;
+
+        try(SerenaFS_GetIndirectBlockPointer(self, &pBlockMap->doubleIndirect, 0, mode));
+        try(SerenaFS_GetBlockPointerInIndirectBlock(self, pBlockMap->doubleIndirect, idx >> kSFSBlockPointersPerBlockShift, mode, true, NULL, &indirectLba));
+        try(SerenaFS_GetBlockPointerInIndirectBlock(self, indirectLba, idx & kSFSBlockPointersPerBlockMask, mode, false, pRun, &lba));
+    }
+
     *pOutLba = lba;
     return EOK;
 
@@ -572,6 +828,12 @@ catch:
     return err;
 }
 
+// Same as SerenaFS_MapFileBlockAddress() without a pre-allocated block run.
+static errno_t SerenaFS_GetLogicalBlockAddressForFileBlockAddress(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, SFSBlockMode mode, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    return SerenaFS_MapFileBlockAddress(self, pNode, fba, mode, NULL, pOutLba);
+}
+
 // Reads 'nBytesToRead' bytes from the file 'pNode' starting at offset 'offset'.
 // This functions reads a block full of data from teh backing store and then
 // invokes 'cb' with this block of data. 'cb' is expected to process the data.
@@ -595,6 +857,8 @@ static errno_t SerenaFS_xRead(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Lock
         const int blockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);   //XXX blockIdx should be 64bit
         const ssize_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
         const ssize_t nBytesAvailable = (ssize_t)__min((FileOffset)(kSFSBlockSize - blockOffset), __min(fileSize - offset, (FileOffset)nBytesToRead));
+        DiskBlockRef pDiskBlock = NULL;
+        const uint8_t* pData = gZeroBlock;
         LogicalBlockAddress lba;
 
         if (nBytesAvailable <= 0) {
@@ -602,12 +866,10 @@ static errno_t SerenaFS_xRead(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Lock
         }
 
         errno_t e1 = SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba);
-        if (e1 == EOK) {
-            if (lba == 0) {
-                Bytes_ClearRange(self->tmpBlock, kSFSBlockSize);
-            }
-            else {
-                e1 = DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba);
+        if (e1 == EOK && lba > 0) {
+            e1 = BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_ReadOnly, &pDiskBlock);
+            if (e1 == EOK) {
+                pData = DiskBlock_GetData(pDiskBlock);
             }
         }
         if (e1 != EOK) {
@@ -615,7 +877,8 @@ static errno_t SerenaFS_xRead(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Lock
             break;
         }
 
-        nBytesToRead -= cb(pContext, self->tmpBlock + blockOffset, nBytesAvailable);
+        nBytesToRead -= cb(pContext, pData + blockOffset, nBytesAvailable);
+        BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
         offset += (FileOffset)nBytesAvailable;
     }
 
@@ -642,31 +905,174 @@ static errno_t SerenaFS_xWrite(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Loc
         const int blockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);   //XXX blockIdx should be 64bit
         const ssize_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
         const ssize_t nBytesAvailable = __min(kSFSBlockSize - blockOffset, nBytesToWrite);
+        const AcquireBlock acquireMode = (nBytesAvailable == kSFSBlockSize) ? kAcquireBlock_Replace : kAcquireBlock_Update;
+        DiskBlockRef pDiskBlock;
         LogicalBlockAddress lba;
 
         errno_t e1 = SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Write, &lba);
         if (e1 == EOK) {
+            e1 = BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, acquireMode, &pDiskBlock);
+        }
+        if (e1 != EOK) {
+            err = (nBytesWritten == 0) ? e1 : EOK;
+            break;
+        }
+        
+        cb(DiskBlock_GetData(pDiskBlock) + blockOffset, pContext, nBytesAvailable);
+        BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
+
+        nBytesWritten += nBytesAvailable;
+        offset += (FileOffset)nBytesAvailable;
+    }
+
+    if (nBytesWritten > 0) {
+        if (offset > Inode_GetFileSize(pNode)) {
+            Inode_SetFileSize(pNode, offset);
+        }
+        Inode_SetModified(pNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
+    }
+    *pOutBytesWritten = nBytesWritten;
+    return err;
+}
+
+// Reads whole blocks from the file 'pNode' starting at the block aligned offset
+// 'offset' straight into 'pBuffer'. The data does not pass through a cache
+// block unless the block happens to be cached already. Blocks are handed to
+// the disk driver in batches of up to kSFSMaxDirectIOSegments blocks. Stops at
+// the last full block before the end of the file.
+static errno_t SerenaFS_xReadBlocksDirect(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset offset, uint8_t* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull pOutBytesRead)
+{
+    decl_try_err();
+    const FileOffset fileSize = Inode_GetFileSize(pNode);
+    DiskBlockSegment segs[kSFSMaxDirectIOSegments];
+    ssize_t nBytesRead = 0;
+
+    assert((offset & (FileOffset)kSFSBlockSizeMask) == 0ll);
+
+    while (err == EOK && nBytesToRead >= kSFSBlockSize && fileSize - offset >= (FileOffset)kSFSBlockSize) {
+        ssize_t nBatchBytes = 0;
+        int nSegs = 0;
+
+        while (nSegs < kSFSMaxDirectIOSegments && nBytesToRead - nBatchBytes >= kSFSBlockSize && fileSize - offset - nBatchBytes >= (FileOffset)kSFSBlockSize) {
+            const int blockIdx = (int)((offset + nBatchBytes) >> (FileOffset)kSFSBlockSizeShift);   //XXX blockIdx should be 64bit
+            LogicalBlockAddress lba;
+
+            err = SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba);
+            if (err != EOK) {
+                break;
+            }
+
             if (lba == 0) {
-                Bytes_ClearRange(self->tmpBlock, kSFSBlockSize);
+                Bytes_ClearRange(pBuffer + nBatchBytes, kSFSBlockSize);
             }
             else {
-                e1 = DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba);
+                segs[nSegs].buffer = pBuffer + nBatchBytes;
+                segs[nSegs].lba = lba;
+                nSegs++;
             }
+            nBatchBytes += kSFSBlockSize;
         }
-        if (e1 != EOK) {
-            err = (nBytesWritten == 0) ? e1 : EOK;
+
+        if (nSegs > 0) {
+            const errno_t e1 = BlockCache_ReadBlocksDirect(gBlockCache, self->diskDriver, segs, nSegs);
+            if (e1 != EOK) {
+                err = e1;
+                break;
+            }
+        }
+
+        pBuffer += nBatchBytes;
+        nBytesToRead -= nBatchBytes;
+        nBytesRead += nBatchBytes;
+        offset += (FileOffset)nBatchBytes;
+    }
+
+    if (nBytesRead > 0) {
+        Inode_SetModified(pNode, kInodeFlag_Accessed);
+        err = EOK;
+    }
+    *pOutBytesRead = nBytesRead;
+    return err;
+}
+
+// Writes whole blocks from 'pBuffer' to the file 'pNode' starting at the block
+// aligned offset 'offset'. The data is written straight from 'pBuffer' to the
+// disk and it replaces whatever copy of the blocks the block cache may hold.
+// Blocks are handed to the disk driver in batches of up to
+// kSFSMaxDirectIOSegments blocks.
+static errno_t SerenaFS_xWriteBlocksDirect(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset offset, const uint8_t* _Nonnull pBuffer, ssize_t nBytesToWrite, ssize_t* _Nonnull pOutBytesWritten)
+{
+    decl_try_err();
+    DiskBlockSegment segs[kSFSMaxDirectIOSegments];
+    ssize_t nBytesWritten = 0;
+
+    assert((offset & (FileOffset)kSFSBlockSizeMask) == 0ll);
+
+    while (err == EOK && nBytesToWrite >= kSFSBlockSize) {
+        const int firstBlockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);   //XXX blockIdx should be 64bit
+        const int nBatchBlocks = __min(kSFSMaxDirectIOSegments, nBytesToWrite >> kSFSBlockSizeShift);
+        LogicalBlockAddress prevLba = 0;
+        LogicalBlockAddress hint = 0;
+        SFSBlockRun run = {0, 0};
+        int nSegs = 0;
+        int nUnmapped = 0;
+
+        // Find out how many blocks in this batch don't have a disk block yet
+        // and allocate them in one go so that they end up next to each other
+        // and next to the block that precedes the first one of them
+        if (firstBlockIdx > 0) {
+            SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, firstBlockIdx - 1, kSFSBlockMode_Read, &prevLba);
+        }
+        for (int i = 0; i < nBatchBlocks; i++) {
+            LogicalBlockAddress lba;
+
+            if (SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, firstBlockIdx + i, kSFSBlockMode_Read, &lba) != EOK) {
+                break;
+            }
+            if (lba == 0) {
+                if (nUnmapped == 0 && prevLba > 0) {
+                    hint = prevLba + 1;
+                }
+                nUnmapped++;
+            }
+            prevLba = lba;
+        }
+        if (nUnmapped > 0) {
+            // Blocks that don't fit in the run are allocated one by one below
+            SerenaFS_AllocateBlocks(self, hint, nUnmapped, &run.lba, &run.count);
+        }
+
+        while (nSegs < nBatchBlocks) {
+            LogicalBlockAddress lba;
+
+            err = SerenaFS_MapFileBlockAddress(self, pNode, firstBlockIdx + nSegs, kSFSBlockMode_Write, &run, &lba);
+            if (err != EOK) {
+                break;
+            }
+
+            segs[nSegs].buffer = (void*)(pBuffer + nSegs * kSFSBlockSize);
+            segs[nSegs].lba = lba;
+            nSegs++;
+        }
+        while (run.count > 0) {
+            SerenaFS_DeallocateBlock(self, run.lba++);
+            run.count--;
+        }
+        if (nSegs == 0) {
             break;
         }
-        
-        cb(self->tmpBlock + blockOffset, pContext, nBytesAvailable);
-        e1 = DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, lba);
+
+        const errno_t e1 = BlockCache_WriteBlocksDirect(gBlockCache, self->diskDriver, segs, nSegs);
         if (e1 != EOK) {
-            err = (nBytesWritten == 0) ? e1 : EOK;
+            err = e1;
             break;
         }
 
-        nBytesWritten += nBytesAvailable;
-        offset += (FileOffset)nBytesAvailable;
+        const ssize_t nBatchBytes = nSegs * kSFSBlockSize;
+        pBuffer += nBatchBytes;
+        nBytesToWrite -= nBatchBytes;
+        nBytesWritten += nBatchBytes;
+        offset += (FileOffset)nBatchBytes;
     }
 
     if (nBytesWritten > 0) {
@@ -674,6 +1080,7 @@ static errno_t SerenaFS_xWrite(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Loc
             Inode_SetFileSize(pNode, offset);
         }
         Inode_SetModified(pNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
+        err = EOK;
     }
     *pOutBytesWritten = nBytesWritten;
     return err;
@@ -686,6 +1093,7 @@ static errno_t SerenaFS_xWrite(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Loc
 errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriver, const void* _Nonnull pParams, ssize_t paramsSize)
 {
     decl_try_err();
+    DiskBlockRef pDiskBlock = NULL;
 
     Lock_Lock(&self->lock);
 
@@ -702,9 +1110,15 @@ errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriv
         throw(EIO);
     }
 
-    try(DiskDriver_GetBlock(pDriver, self->tmpBlock, 0));
-    const SFSVolumeHeader* vhp = (const SFSVolumeHeader*)self->tmpBlock;
-    if (vhp->signature != kSFSSignature_SerenaFS || vhp->version != kSFSVersion_v1) {
+    try(BlockCache_AcquireBlock(gBlockCache, pDriver, 0, kAcquireBlock_ReadOnly, &pDiskBlock));
+    const SFSVolumeHeader* vhp = (const SFSVolumeHeader*)DiskBlock_GetData(pDiskBlock);
+    if (vhp->signature != kSFSSignature_SerenaFS) {
+        throw(EIO);
+    }
+    // v1 volumes use all block map slots as direct block pointers. We don't
+    // support them anymore because v2 interprets the last two slots as the
+    // indirect and double indirect block pointers.
+    if (vhp->version != kSFSVersion_v2) {
         throw(EIO);
     }
     if (vhp->blockSize != kSFSBlockSize || vhp->volumeBlockCount < kSFSVolume_MinBlockCount || vhp->allocationBitmapByteSize < 1) {
@@ -725,14 +1139,21 @@ errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriv
     self->allocationBitmapByteSize = allocBitmapByteSize;
     self->volumeBlockCount = vhp->volumeBlockCount;
 
+    BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+    pDiskBlock = NULL;
+
     try(kalloc(allocBitmapByteSize, (void**)&self->allocationBitmap));
+    try(kalloc_cleared((self->allocationBitmapBlockCount + 7) >> 3, (void**)&self->allocationBitmapDirtyBits));
+    self->allocationCursor = 1;
     uint8_t* pAllocBitmap = self->allocationBitmap;
 
     for (LogicalBlockAddress lba = 0; lba < self->allocationBitmapBlockCount; lba++) {
         const size_t nBytesToCopy = __min(kSFSBlockSize, allocBitmapByteSize);
 
-        try(DiskDriver_GetBlock(pDriver, self->tmpBlock, self->allocationBitmapLba + lba));
-        Bytes_CopyRange(pAllocBitmap, self->tmpBlock, nBytesToCopy);
+        try(BlockCache_AcquireBlock(gBlockCache, pDriver, self->allocationBitmapLba + lba, kAcquireBlock_ReadOnly, &pDiskBlock));
+        Bytes_CopyRange(pAllocBitmap, DiskBlock_GetData(pDiskBlock), nBytesToCopy);
+        BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
+        pDiskBlock = NULL;
         allocBitmapByteSize -= nBytesToCopy;
         pAllocBitmap += diskBlockSize;
     }
@@ -742,6 +1163,7 @@ errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriv
     self->diskDriver = Object_RetainAs(pDriver, DiskDriver);
 
 catch:
+    BlockCache_RelinquishBlock(gBlockCache, pDiskBlock);
     Lock_Unlock(&self->lock);
     return err;
 }
@@ -764,9 +1186,14 @@ errno_t SerenaFS_onUnmount(SerenaFSRef _Nonnull self)
 
     // XXX make sure that there are no inodes in use anymore
 
-    // XXX flush all still cached file data to disk (synchronously)
+    // Flush all still cached file data and the allocation bitmap to disk
+    // (synchronously) and drop the disk from the block cache
+    err = SerenaFS_SyncAllocationBitmap(self);
+    const errno_t e2 = BlockCache_PurgeDisk(gBlockCache, self->diskDriver);
+    if (err == EOK) {
+        err = e2;
+    }
 
-    // XXX flush the allocation bitmap to disk (synchronously)
     // XXX free the allocation bitmap and clear self->volumeBlockCount
 
     // XXX clear rootDirLba
@@ -823,13 +1250,45 @@ errno_t SerenaFS_acquireRootNode(SerenaFSRef _Nonnull self, InodeRef _Nullable _
 errno_t SerenaFS_acquireNodeForName(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pName, User user, InodeRef _Nullable _Locked * _Nonnull pOutNode)
 {
     decl_try_err();
+    const FilesystemId fsid = Filesystem_GetId(self);
+    const InodeId parentId = Inode_GetId(pParentNode);
+    const bool isDotOrDotDot = (pName->count >= 1 && pName->count <= 2 && pName->name[0] == '.' && pName->name[pName->count - 1] == '.');
     SFSDirectoryQuery q;
     InodeId entryId;
 
     try(SerenaFS_CheckAccess_Locked(self, pParentNode, user, kFilePermission_Execute));
+
+    // "." and ".." are cheap to look up because they are always the first two
+    // entries of a directory. Everything else goes through the directory cache
+    // first
+    if (!isDotOrDotDot) {
+        switch (DirectoryCache_Lookup(gDirectoryCache, fsid, parentId, pName, &entryId)) {
+            case kDirectoryCache_Hit:
+                try(Filesystem_AcquireNodeWithId((FilesystemRef)self, entryId, NULL, pOutNode));
+                return EOK;
+
+            case kDirectoryCache_NegativeHit:
+                throw(ENOENT);
+
+            default:
+                break;
+        }
+    }
+
     q.kind = kSFSDirectoryQuery_PathComponent;
     q.u.pc = pName;
-    try(SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, NULL, &entryId, NULL));
+    err = SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, NULL, &entryId, NULL);
+    if (!isDotOrDotDot) {
+        if (err == EOK) {
+            DirectoryCache_Enter(gDirectoryCache, fsid, parentId, pName, entryId);
+        }
+        else if (err == ENOENT) {
+            DirectoryCache_EnterNegative(gDirectoryCache, fsid, parentId, pName);
+        }
+    }
+    if (err != EOK) {
+        throw(err);
+    }
     try(Filesystem_AcquireNodeWithId((FilesystemRef)self, entryId, NULL, pOutNode));
     return EOK;
 
@@ -890,15 +1349,16 @@ static errno_t SerenaFS_RemoveDirectoryEntry(SerenaFSRef _Nonnull self, InodeRef
     decl_try_err();
     SFSDirectoryEntryPointer mp;
     SFSDirectoryQuery q;
+    DiskBlockRef pDiskBlock;
 
     q.kind = kSFSDirectoryQuery_InodeId;
     q.u.id = idToRemove;
     try(SerenaFS_GetDirectoryEntry(self, pDirNode, &q, NULL, &mp, NULL, NULL));
 
-    try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, mp.lba));
-    SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(self->tmpBlock + mp.offset);
+    try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, mp.lba, kAcquireBlock_Update, &pDiskBlock));
+    SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(DiskBlock_GetData(pDiskBlock) + mp.offset);
     Bytes_ClearRange(dep, sizeof(SFSDirectoryEntry));
-    try(DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, mp.lba));
+    BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
 
     if (Inode_GetFileSize(pDirNode) - (FileOffset)sizeof(SFSDirectoryEntry) == mp.fileOffset) {
         Inode_DecrementFileSize(pDirNode, sizeof(SFSDirectoryEntry));
@@ -919,6 +1379,7 @@ catch:
 static errno_t SerenaFS_InsertDirectoryEntry(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode, const PathComponent* _Nonnull pName, InodeId id, SFSDirectoryEntryPointer* _Nullable pEmptyPtr)
 {
     decl_try_err();
+    DiskBlockRef pDiskBlock;
 
     if (pName->count > kSFSMaxFilenameLength) {
         return ENAMETOOLONG;
@@ -926,51 +1387,37 @@ static errno_t SerenaFS_InsertDirectoryEntry(SerenaFSRef _Nonnull self, InodeRef
 
     if (pEmptyPtr && pEmptyPtr->lba > 0) {
         // Reuse an empty entry
-        try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, pEmptyPtr->lba));
-        SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(self->tmpBlock + pEmptyPtr->offset);
+        try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, pEmptyPtr->lba, kAcquireBlock_Update, &pDiskBlock));
+        SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(DiskBlock_GetData(pDiskBlock) + pEmptyPtr->offset);
 
         char* p = String_CopyUpTo(dep->filename, pName->name, pName->count);
         while (p < &dep->filename[kSFSMaxFilenameLength]) *p++ = '\0';
         dep->id = id;
 
-        try(DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, pEmptyPtr->lba));
+        BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
     }
     else {
         // Append a new entry
-        SFSBlockMap* pBlockMap = Inode_GetBlockMap(pDirNode);
         const FileOffset size = Inode_GetFileSize(pDirNode);
         const int remainder = size & kSFSBlockSizeMask;
+        const int fba = (int)(size >> (FileOffset)kSFSBlockSizeShift);
         SFSDirectoryEntry* dep;
         LogicalBlockAddress lba;
-        int idx = -1;
 
         if (remainder > 0) {
-            idx = size / kSFSBlockSize;
-            lba = pBlockMap->p[idx];
-
-            try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba));
-            dep = (SFSDirectoryEntry*)(self->tmpBlock + remainder);
+            try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pDirNode, fba, kSFSBlockMode_Read, &lba));
+            try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_Update, &pDiskBlock));
+            dep = (SFSDirectoryEntry*)(DiskBlock_GetData(pDiskBlock) + remainder);
         }
         else {
-            for (int i = 0; i < kSFSMaxDirectDataBlockPointers; i++) {
-                if (pBlockMap->p[i] == 0) {
-                    idx = i;
-                    break;
-                }
-            }
-            if (idx == -1) {
-                throw(EIO);
-            }
-
-            try(SerenaFS_AllocateBlock_Locked(self, &lba));
-            Bytes_ClearRange(self->tmpBlock, kSFSBlockSize);
-            dep = (SFSDirectoryEntry*)self->tmpBlock;
+            try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pDirNode, fba, kSFSBlockMode_Write, &lba));
+            try(BlockCache_AcquireBlock(gBlockCache, self->diskDriver, lba, kAcquireBlock_Cleared, &pDiskBlock));
+            dep = (SFSDirectoryEntry*)DiskBlock_GetData(pDiskBlock);
         }
 
         String_CopyUpTo(dep->filename, pName->name, pName->count);
         dep->id = id;
-        try(DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, lba));
-        pBlockMap->p[idx] = lba;
+        BlockCache_RelinquishBlockWriting(gBlockCache, pDiskBlock, kWriteBlock_Deferred);
 
         Inode_IncrementFileSize(pDirNode, sizeof(SFSDirectoryEntry));
     }
@@ -1044,6 +1491,7 @@ errno_t SerenaFS_createDirectory(SerenaFSRef _Nonnull self, const PathComponent*
     InodeId newDirId = 0;
     try(SerenaFS_CreateDirectoryDiskNode(self, Inode_GetId(pParentNode), user.uid, user.gid, permissions, &newDirId));
     try(SerenaFS_InsertDirectoryEntry(self, pParentNode, pName, newDirId, &ep));
+    DirectoryCache_Enter(gDirectoryCache, Filesystem_GetId(self), Inode_GetId(pParentNode), pName, newDirId);
     return EOK;
 
 catch:
@@ -1165,6 +1613,7 @@ errno_t SerenaFS_createFile(SerenaFSRef _Nonnull self, const PathComponent* _Non
     // Create the new file and add it to its parent directory
     try(Filesystem_AllocateNode((FilesystemRef)self, kFileType_RegularFile, user.uid, user.gid, permissions, NULL, pOutNode));
     try(SerenaFS_InsertDirectoryEntry(self, pParentNode, pName, Inode_GetId(*pOutNode), &ep));
+    DirectoryCache_Enter(gDirectoryCache, Filesystem_GetId(self), Inode_GetId(pParentNode), pName, Inode_GetId(*pOutNode));
 
     return EOK;
 
@@ -1230,40 +1679,108 @@ static ssize_t xCopyOutFileContent(void* _Nonnull pOut, const void* _Nonnull pIn
     return nBytesToRead;
 }
 
+// Reads file content into 'pBuffer'. Whole blocks at block aligned file offsets
+// are read directly into 'pBuffer'. Partial blocks are copied out of the block
+// cache.
 errno_t SerenaFS_read(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
-    InodeRef _Locked pNode = File_GetInode(pFile);
+    decl_try_err();
+    InodeRef pNode = File_GetInode(pFile);
+    uint8_t* pDst = pBuffer;
+    ssize_t nBytesRead = 0;
 
-    const errno_t err = SerenaFS_xRead(self, 
-        pNode, 
-        File_GetOffset(pFile),
-        nBytesToRead,
-        (SFSReadCallback)xCopyOutFileContent,
-        pBuffer,
-        nOutBytesRead);
-    File_IncrementOffset(pFile, *nOutBytesRead);
+    // Reads of different files proceed in parallel. They only serialize on the
+    // inode lock and on disk blocks they share in the block cache
+    Inode_Lock(pNode);
+    FileOffset offset = File_GetOffset(pFile);
+
+    while (nBytesToRead > 0) {
+        const ssize_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
+        ssize_t nChunkBytesRead;
+
+        if (blockOffset == 0 && nBytesToRead >= kSFSBlockSize && Inode_GetFileSize(pNode) - offset >= (FileOffset)kSFSBlockSize) {
+            err = SerenaFS_xReadBlocksDirect(self, pNode, offset, pDst, nBytesToRead & ~kSFSBlockSizeMask, &nChunkBytesRead);
+        }
+        else {
+            err = SerenaFS_xRead(self, 
+                pNode, 
+                offset,
+                __min(kSFSBlockSize - blockOffset, nBytesToRead),
+                (SFSReadCallback)xCopyOutFileContent,
+                pDst,
+                &nChunkBytesRead);
+        }
+        if (err != EOK || nChunkBytesRead == 0) {
+            break;
+        }
+
+        pDst += nChunkBytesRead;
+        nBytesToRead -= nChunkBytesRead;
+        nBytesRead += nChunkBytesRead;
+        offset += (FileOffset)nChunkBytesRead;
+    }
+
+    if (nBytesRead > 0) {
+        err = EOK;
+    }
+    File_IncrementOffset(pFile, nBytesRead);
+    Inode_Unlock(pNode);
+
+    *nOutBytesRead = nBytesRead;
     return err;
 }
 
+// Writes the contents of 'pBuffer' to the file. Whole blocks at block aligned
+// file offsets are written directly from 'pBuffer' to the disk. Partial blocks
+// are merged into the block cache and written back later.
 errno_t SerenaFS_write(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile, const void* _Nonnull pBuffer, ssize_t nBytesToWrite, ssize_t* _Nonnull nOutBytesWritten)
 {
-    InodeRef _Locked pNode = File_GetInode(pFile);
+    decl_try_err();
+    InodeRef pNode = File_GetInode(pFile);
+    const uint8_t* pSrc = pBuffer;
+    ssize_t nBytesWritten = 0;
     FileOffset offset;
 
+    Inode_Lock(pNode);
     if (File_IsAppendOnWrite(pFile)) {
         offset = Inode_GetFileSize(pNode);
     } else {
         offset = File_GetOffset(pFile);
     }
 
-    const errno_t err = SerenaFS_xWrite(self, 
-        pNode, 
-        offset,
-        nBytesToWrite,
-        (SFSWriteCallback)Bytes_CopyRange,
-        pBuffer,
-        nOutBytesWritten);
-    File_IncrementOffset(pFile, *nOutBytesWritten);
+    while (nBytesToWrite > 0) {
+        const ssize_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
+        ssize_t nChunkBytesWritten;
+
+        if (blockOffset == 0 && nBytesToWrite >= kSFSBlockSize) {
+            err = SerenaFS_xWriteBlocksDirect(self, pNode, offset, pSrc, nBytesToWrite & ~kSFSBlockSizeMask, &nChunkBytesWritten);
+        }
+        else {
+            err = SerenaFS_xWrite(self, 
+                pNode, 
+                offset,
+                __min(kSFSBlockSize - blockOffset, nBytesToWrite),
+                (SFSWriteCallback)Bytes_CopyRange,
+                (void*)pSrc,
+                &nChunkBytesWritten);
+        }
+        if (err != EOK || nChunkBytesWritten == 0) {
+            break;
+        }
+
+        pSrc += nChunkBytesWritten;
+        nBytesToWrite -= nChunkBytesWritten;
+        nBytesWritten += nChunkBytesWritten;
+        offset += (FileOffset)nChunkBytesWritten;
+    }
+
+    if (nBytesWritten > 0) {
+        err = EOK;
+    }
+    File_IncrementOffset(pFile, nBytesWritten);
+    Inode_Unlock(pNode);
+
+    *nOutBytesWritten = nBytesWritten;
     return err;
 }
 
@@ -1271,18 +1788,10 @@ errno_t SerenaFS_write(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile, const
 // smaller size 'length'. Does not support increasing the size of a file.
 static void SerenaFS_xTruncateFile(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset length)
 {
-    const FileOffset oldLength = Inode_GetFileSize(pNode);
-    const FileOffset oldLengthRoundedUpToBlockBoundary = __Ceil_PowerOf2(oldLength, kSFSBlockSize);
-    const int firstBlockIdx = (int)(oldLengthRoundedUpToBlockBoundary >> (FileOffset)kSFSBlockSizeShift);    //XXX blockIdx should be 64bit
-    SFSBlockMap* pBlockMap = Inode_GetBlockMap(pNode);
+    const FileOffset newLengthRoundedUpToBlockBoundary = __Ceil_PowerOf2(length, kSFSBlockSize);
+    const int firstBlockIdx = (int)(newLengthRoundedUpToBlockBoundary >> (FileOffset)kSFSBlockSizeShift);    //XXX blockIdx should be 64bit
 
-    for (int i = firstBlockIdx; i < kSFSMaxDirectDataBlockPointers; i++) {
-        if (pBlockMap->p[i] != 0) {
-            // XXX locking
-            SerenaFS_DeallocateBlock_Locked(self, pBlockMap->p[i]);
-            pBlockMap->p[i] = 0;
-        }
-    }
+    SerenaFS_DeallocateFileContentBlocksFrom(self, pNode, firstBlockIdx);
 
     Inode_SetFileSize(pNode, length);
     Inode_SetModified(pNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
@@ -1367,6 +1876,7 @@ errno_t SerenaFS_unlink(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNo
 
     // Remove the directory entry in the parent directory
     try(SerenaFS_RemoveDirectoryEntry(self, pParentNode, Inode_GetId(pNodeToUnlink)));
+    DirectoryCache_RemoveNode(gDirectoryCache, Filesystem_GetId(self), Inode_GetId(pParentNode), Inode_GetId(pNodeToUnlink));
     SerenaFS_xTruncateFile(self, pParentNode, Inode_GetFileSize(pParentNode));
 
 
@@ -1384,6 +1894,7 @@ catch:
 errno_t SerenaFS_rename(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull _Locked pNewParentNode, User user)
 {
     // XXX implement me
+    // XXX remove 'pName' and enter 'pNewName' in the directory cache
     return EACCESS;
 }
 
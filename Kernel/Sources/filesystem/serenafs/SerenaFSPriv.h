@@ -10,6 +10,7 @@
 #define SerenaFSPriv_h
 
 #include "SerenaFS.h"
+#include <filesystem/BlockCache.h>
 #include <dispatcher/ConditionVariable.h>
 #include <dispatcher/Lock.h>
 
@@ -19,7 +20,12 @@
 #define kSFSBlockSizeMask                   (kSFSBlockSize - 1)
 #define kSFSDirectoryEntriesPerBlock        (kSFSBlockSize / sizeof(SFSDirectoryEntry))
 #define kSFSDirectoryEntriesPerBlockMask    (kSFSDirectoryEntriesPerBlock - 1)
-#define kSFSMaxDirectDataBlockPointers      114
+#define kSFSMaxDirectDataBlockPointers      112
+#define kSFSBlockPointersPerBlockShift      7
+#define kSFSBlockPointersPerBlock           (1 << kSFSBlockPointersPerBlockShift)
+#define kSFSBlockPointersPerBlockMask       (kSFSBlockPointersPerBlock - 1)
+#define kSFSMaxFileBlockCount               (kSFSMaxDirectDataBlockPointers + kSFSBlockPointersPerBlock + kSFSBlockPointersPerBlock * kSFSBlockPointersPerBlock)
+#define kSFSMaxDirectIOSegments             16
 
 
 //
@@ -54,8 +60,9 @@ enum {
 // version field occupies exactly one byte and each sub-version field is treated
 // as a unsigned binary encoded number.
 enum {
-    kSFSVersion_v1 = 0x00010000,                // v1.0.0
-    kSFSVersion_Current = kSFSVersion_v1,       // Version to use for formatting a new disk
+    kSFSVersion_v1 = 0x00010000,                // v1.0.0 (direct block pointers only)
+    kSFSVersion_v2 = 0x00020000,                // v2.0.0 (indirect and double indirect block pointers)
+    kSFSVersion_Current = kSFSVersion_v2,       // Version to use for formatting a new disk
 };
 
 enum {
@@ -106,9 +113,19 @@ typedef struct SFSVolumeHeader {
 // with a pointer to the disk node block map. So inodes manipulate the block map
 // directly instead of copying it back and forth. That's okay because the inode
 // lock effectively protects the disk node sitting behind the inode. 
+//
+// The block map stores the LBAs of the first kSFSMaxDirectDataBlockPointers
+// file blocks directly. The LBAs of the next kSFSBlockPointersPerBlock file
+// blocks are stored in the indirect block. The double indirect block stores
+// the LBAs of up to kSFSBlockPointersPerBlock indirect blocks which in turn
+// store the LBAs of the remaining file blocks. A block pointer of 0 means that
+// the file block (or the whole range of file blocks covered by an indirect
+// block) is not backed by a disk block and reads as all zeros.
 
 typedef struct SFSBlockMap {
     LogicalBlockAddress p[kSFSMaxDirectDataBlockPointers];
+    LogicalBlockAddress indirect;
+    LogicalBlockAddress doubleIndirect;
 } SFSBlockMap;
 
 typedef struct SFSInode {
@@ -196,16 +213,18 @@ CLASS_IVARS(SerenaFS, Filesystem,
 
     DiskDriverRef _Nullable diskDriver;
     
+    Lock                    allocationLock;                 // Protects the allocation bitmap, the dirty bits and the cursor
     LogicalBlockAddress     allocationBitmapLba;            // Info for writing the allocation bitmap back to disk
     LogicalBlockCount       allocationBitmapBlockCount;     // -"-
     uint8_t* _Nullable      allocationBitmap;
     size_t                  allocationBitmapByteSize;
+    uint8_t* _Nullable      allocationBitmapDirtyBits;      // One bit per allocation bitmap block; set if the block needs to be written back to disk
+    LogicalBlockAddress     allocationCursor;               // Next-fit cursor: the search for a free block starts here if the caller has no preference
     uint32_t                volumeBlockCount;
 
     LogicalBlockAddress     rootDirLba;                     // Root directory LBA (This is the inode id at the same time)
 
     bool                    isReadOnly;                     // true if mounted read-only; false if mounted read-write
-    uint8_t                 tmpBlock[kSFSBlockSize];
 );
 
 typedef ssize_t (*SFSReadCallback)(void* _Nonnull pDst, const void* _Nonnull pSrc, ssize_t n);
@@ -216,6 +235,13 @@ typedef enum SFSBlockMode {
     kSFSBlockMode_Write
 } SFSBlockMode;
 
+// A run of contiguous disk blocks that has been allocated ahead of time for a
+// sequence of file blocks that are about to be written
+typedef struct SFSBlockRun {
+    LogicalBlockAddress lba;
+    LogicalBlockCount   count;
+} SFSBlockRun;
+
 
 static InodeId SerenaFS_GetNextAvailableInodeId_Locked(SerenaFSRef _Nonnull self);
 static errno_t SerenaFS_FormatWithEmptyFilesystem(SerenaFSRef _Nonnull self);
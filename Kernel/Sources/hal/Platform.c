@@ -79,6 +79,15 @@ bool chipset_is_ntsc(void)
     return (chipset_get_version() & (1 << 4)) != 0;
 }
 
+// Returns true if a level 2 (PORTS) interrupt is pending. Eg a CIA A interrupt
+// that hasn't been serviced yet
+bool chipset_is_ports_interrupt_pending(void)
+{
+    CHIPSET_BASE_DECL(cp);
+
+    return (*CHIPSET_REG_16(cp, INTREQR) & INTREQF_PORTS) != 0;
+}
+
 // See: <https://eab.abime.net/showthread.php?t=34838>
 uint8_t chipset_get_version(void)
 {
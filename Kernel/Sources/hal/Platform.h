@@ -175,7 +175,7 @@ extern int cpu_guarded_write(void* _Nonnull dst, const void* _Nonnull buffer, in
 
 extern void cpu_sleep(int cpu_type);
 
-extern void cpu_call_as_user(Cpu_UserClosure _Nonnull pClosure, void* _Nullable pContext);
+extern void cpu_call_as_user(Cpu_UserClosure _Nonnull pClosure, void* _Nullable pContext, uintptr_t arg);
 extern void cpu_abort_call_as_user(void);
 
 extern _Noreturn cpu_non_recoverable_error(void);
@@ -834,6 +834,7 @@ extern char* chipset_get_upper_dma_limit(int chipset_version);
 
 extern void chipset_enable_interrupt(int interruptId);
 extern void chipset_disable_interrupt(int interruptId);
+extern bool chipset_is_ports_interrupt_pending(void);
 
 
 #define INTERRUPT_ID_QUANTUM_TIMER  INTERRUPT_ID_CIA_A_TIMER_B
@@ -842,6 +843,8 @@ extern void chipset_start_quantum_timer(void);
 extern void chipset_stop_quantum_timer(void);
 extern int32_t chipset_get_quantum_timer_duration_ns(void);
 extern int32_t chipset_get_quantum_timer_elapsed_ns(void);
+extern int chipset_get_quantum_timer_elapsed_cycles(int period_cycles);
+extern void chipset_set_quantum_timer_period(int cur_period_cycles, int new_period_cycles);
 
 extern uint32_t chipset_get_hsync_counter(void);
 
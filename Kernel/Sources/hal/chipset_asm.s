@@ -19,6 +19,8 @@
     xdef _chipset_stop_quantum_timer
     xdef _chipset_get_quantum_timer_duration_ns
     xdef _chipset_get_quantum_timer_elapsed_ns
+    xdef _chipset_get_quantum_timer_elapsed_cycles
+    xdef _chipset_set_quantum_timer_period
 
 
 ;-------------------------------------------------------------------------------
@@ -242,3 +244,81 @@ _chipset_get_quantum_timer_elapsed_ns:
     sub.w   d1, d0
     muls    SYS_DESC_BASE + sd_ns_per_quantum_timer_cycle, d0
     rts
+
+
+;-------------------------------------------------------------------------------
+; int chipset_get_quantum_timer_elapsed_cycles(int period_cycles)
+; Returns the number of timer cycles that have elapsed in the current timer
+; period. 'period_cycles' is the length of the current period in terms of timer
+; cycles.
+_chipset_get_quantum_timer_elapsed_cycles:
+    cargs cgqtec_period_cycles.l
+    moveq.l #0, d1
+    move.b  CIAATBHI, d1
+    asl.w   #8, d1
+    move.b  CIAATBLO, d1
+
+    move.l  cgqtec_period_cycles(sp), d0
+    sub.l   d1, d0
+    rts
+
+
+;-------------------------------------------------------------------------------
+; void chipset_set_quantum_timer_period(int cur_period_cycles, int new_period_cycles)
+; Changes the length of the current quantum timer period from 'cur_period_cycles'
+; to 'new_period_cycles' timer cycles. All following periods will be
+; 'new_period_cycles' long. The cycles that have already elapsed in the current
+; period are taken into account so that the timer does not drift. The new period
+; must be longer than the number of cycles that have already elapsed. The current
+; period ends a few cycles from now if this isn't the case.
+QUANTUM_TIMER_RELOAD_CYCLES     equ     4
+QUANTUM_TIMER_MIN_CYCLES        equ     64
+
+_chipset_set_quantum_timer_period:
+    cargs csqtp_cur_period_cycles.l, csqtp_new_period_cycles.l
+    move.l  csqtp_cur_period_cycles(sp), d0
+    move.l  csqtp_new_period_cycles(sp), d1
+    move.l  d2, -(sp)
+    DISABLE_INTERRUPTS -(sp)
+
+    ; stop the timer
+    move.b  CIAACRB, d2
+    and.b   #%11101110, d2
+    move.b  d2, CIAACRB
+
+    ; d0 = elapsed cycles = cur_period_cycles - current_cycles
+    moveq.l #0, d2
+    move.b  CIAATBHI, d2
+    asl.w   #8, d2
+    move.b  CIAATBLO, d2
+    sub.l   d2, d0
+
+    ; d2 = remaining cycles = new_period_cycles - elapsed cycles - reload cycles
+    move.l  d1, d2
+    sub.l   d0, d2
+    subq.l  #QUANTUM_TIMER_RELOAD_CYCLES, d2
+    cmp.l   #QUANTUM_TIMER_MIN_CYCLES, d2
+    bge.s   .L1
+    moveq.l #QUANTUM_TIMER_MIN_CYCLES, d2
+.L1:
+
+    ; load the counter with the remaining cycles and restart the timer
+    move.b  d2, CIAATBLO
+    lsr.w   #8, d2
+    move.b  d2, CIAATBHI
+    move.b  CIAACRB, d2
+    or.b    #%00010001, d2
+    and.b   #%10010001, d2
+    move.b  d2, CIAACRB
+
+    ; set the latch to the new period. Writing the latch of a running timer in
+    ; continuous mode does not affect the counter. The counter is reloaded from
+    ; the latch at the next underflow
+    move.b  d1, CIAATBLO
+    lsr.w   #8, d1
+    move.b  d1, CIAATBHI
+
+    RESTORE_INTERRUPTS (sp)+
+    move.l  (sp)+, d2
+    rts
+
@@ -407,23 +407,24 @@ _cpu_sleep:
 
 
 ;-----------------------------------------------------------------------
-; void cpu_call_as_user(Cpu_UserClosure _Nonnull pClosure, void* _Nullable pContext)
-; Invokes the given closure in user space. Preserves the kernel integer register
-; state. Note however that this function does not preserve the floating point 
-; register state.
+; void cpu_call_as_user(Cpu_UserClosure _Nonnull pClosure, void* _Nullable pContext, uintptr_t arg)
+; Invokes the given closure in user space. 'arg' is passed to the closure as
+; its second argument. Closures which only take a context argument simply ignore
+; it. Preserves the kernel integer register state. Note however that this
+; function does not preserve the floating point register state.
 _cpu_call_as_user:
     inline
-    cargs cau_closure_ptr.l, cau_context_ptr.l
+    cargs cau_closure_ptr.l, cau_context_ptr.l, cau_arg.l
         move.l  cau_closure_ptr(sp), a0
         move.l  cau_context_ptr(sp), a1
+        move.l  cau_arg(sp), d1
         movem.l d2 - d7 / a2 - a6, -(sp)
 
         ; zero out all integer registers to ensure that we do not leak kernel
-        ; state into user space. We do not need to zero a0 and a1 because they
-        ; hold the closure and context pointers which the userspace knows about
-        ; anyway.
+        ; state into user space. We do not need to zero a0, a1 and d1 because
+        ; they hold the closure, context and argument which the userspace knows
+        ; about anyway.
         moveq.l #0, d0
-        moveq.l #0, d1
         moveq.l #0, d2
         moveq.l #0, d3
         moveq.l #0, d4
@@ -440,9 +441,10 @@ _cpu_call_as_user:
         and.w   #$dfff, sr
         
         ; we are now in user mode
+        move.l  d1, -(sp)
         move.l  a1, -(sp)
         jsr     (a0)
-        addq.l  #4, sp
+        addq.l  #8, sp
 
         ; go back to superuser mode
         trap    #1
@@ -278,6 +278,13 @@ IRQHandler_L2:
     DISABLE_ALL_IRQS
     movem.l d0 - d1 / d7 / a0 - a1, -(sp)
 
+    ; remember whether we interrupted user or supervisor mode code. The quantum
+    ; timer is on this level and the scheduler uses this to charge the quantum
+    ; to the user or the kernel time of the running VP. The S bit of the SR in
+    ; the exception stack frame is bit 5 of the byte above the saved registers
+    btst    #5, 20(sp)
+    seq     _gVirtualProcessorSchedulerStorage + vps_irq_from_user
+
     move.b  CIAAICR, d7     ; implicitly acknowledges CIA A IRQs
 
     btst    #ICRB_TA, d7
@@ -130,8 +130,14 @@ mtc_current_time_seconds        so.l    1       ; 4
 mtc_current_time_nanoseconds    so.l    1       ; 4
 mtc_current_quantum             so.l    1       ; 4
 mtc_ns_per_quantum              so.l    1       ; 4
+mtc_tick_quantums               so.l    1       ; 4
+mtc_interrupt_count             so.l    1       ; 4
+mtc_max_tick_quantums           so.l    1       ; 4
+mtc_cycles_per_quantum          so.w    1       ; 2
+mtc_is_tickless                 so.b    1       ; 1
+mtc_reserved                    so.b    1       ; 1
 mtc_SIZEOF                      so
-    ifeq (mtc_SIZEOF == 16)
+    ifeq (mtc_SIZEOF == 32)
         fail "MonotonicClock structure size is incorrect."
     endif
 
@@ -139,6 +145,7 @@ mtc_SIZEOF                      so
 ; The VirtualProcessorScheduler
 CSWB_SIGNAL_SWITCH                  equ     0
 CSWB_HW_HAS_FPU                     equ     0
+CSWB_HW_FPU_IS_68060                equ     1
 SCHED_FLAG_VOLUNTARY_CSW_ENABLED    equ     0
 
 VP_PRIORITY_COUNT                   equ     64
@@ -154,10 +161,9 @@ vps_csw_scratch                     so.l    1       ; 4
 vps_csw_signals                     so.b    1       ; 1
 vps_csw_hw                          so.b    1       ; 1
 vps_flags                           so.b    1       ; 1
-vps_reserved                        so.b    1       ; 1
+vps_irq_from_user                   so.b    1       ; 1
 vps_quantums_per_quarter_second     so.l    1       ; 4
-vps_timeout_queue_first             so.l    1       ; 4
-vps_timeout_queue_last              so.l    1       ; 4
+vps_timeout_wheel                   so.b    1056    ; 1056
 vps_sleep_queue_first               so.l    1       ; 4
 vps_sleep_queue_last                so.l    1       ; 4
 vps_scheduler_wait_queue_first      so.l    1       ; 4
@@ -165,7 +171,7 @@ vps_scheduler_wait_queue_last       so.l    1       ; 4
 vps_finalizer_queue_first           so.l    1       ; 4
 vps_finalizer_queue_last            so.l    1       ; 4
 vps_SIZEOF                          so
-    ifeq (vps_SIZEOF == 580)
+    ifeq (vps_SIZEOF == 1628)
         fail "VirtualProcessorScheduler structure size is incorrect."
     endif
 
@@ -230,12 +236,12 @@ vp_owner_queue_entry_next               so.l    1           ; 4
 vp_owner_queue_entry_prev               so.l    1           ; 4
 vp_owner_self                           so.l    1           ; 4
 vp_syscall_entry_ksp                    so.l    1           ; 4
-vp_timeout_queue_entry_next             so.l    1           ; 4
-vp_timeout_queue_entry_prev             so.l    1           ; 4
-vp_timeout_deadline                     so.l    1           ; 4
+vp_timeout_entry_next                   so.l    1           ; 4
+vp_timeout_entry_prev                   so.l    1           ; 4
+vp_timeout_entry_deadline               so.l    1           ; 4
+vp_timeout_entry_slot                   so.w    1           ; 2
+vp_timeout_entry_reserved               so.b    2           ; 2
 vp_timeout_owner                        so.l    1           ; 4
-vp_timeout_is_valid                     so.b    1           ; 1
-vp_timeout_reserved                     so.b    3           ; 3
 vp_waiting_on_wait_queue                so.l    1           ; 4
 vp_wait_start_time                      so.l    1           ; 4
 vp_wakeup_reason                        so.b    1           ; 1
@@ -245,12 +251,21 @@ vp_state                                so.b    1           ; 1
 vp_flags                                so.b    1           ; 1
 vp_quantum_allowance                    so.b    1           ; 1
 vp_suspension_count                     so.b    1           ; 1
-vp_reserved                             so.b    1           ; 1
+vp_inheritedPriority                    so.b    1           ; 1
 vp_dispatchQueue                        so.l    1           ; 4
 vp_dispatchQueueConcurrencyLaneIndex    so.b    1           ; 1
 vp_reserved2                            so.b    3           ; 3
+vp_contended_locks_first                so.l    1           ; 4
+vp_contended_locks_last                 so.l    1           ; 4
+vp_waiting_on_lock                      so.l    1           ; 4
+vp_stats_parent                         so.l    1           ; 4
+vp_stats_user_quantums                  so.l    1           ; 4
+vp_stats_kernel_quantums                so.l    1           ; 4
+vp_stats_wait_quantums                  so.l    1           ; 4
+vp_stats_voluntary_csw_count            so.l    1           ; 4
+vp_stats_involuntary_csw_count          so.l    1           ; 4
 vp_SIZEOF                       so
-    ifeq (vp_SIZEOF == 492)
+    ifeq (vp_SIZEOF == 528)
         fail "VirtualProcessor structure size is incorrect."
     endif
 
@@ -284,9 +299,9 @@ irc_nextAvailableId                         so.l    1       ; 4
 irc_spuriousInterruptCount                  so.l    1       ; 4
 irc_uninitializedInterruptCount             so.l    1       ; 4
 irc_nonMaskableInterruptCount               so.l    1       ; 4
-irc_lock                                    so.l    4       ; 16
+irc_lock                                    so.b    28      ; 28 (ULock)
 irc_SIZEOF                                  so
-    ifeq (irc_SIZEOF == 224)
+    ifeq (irc_SIZEOF == 236)
         fail "InterruptController structure size is incorrect."
     endif
 
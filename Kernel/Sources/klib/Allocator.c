@@ -22,27 +22,61 @@
 
 // A memory block structure describes a freed or allocated block of memory. The
 // structure is placed right in front of the memory block. Note that the block
-// size includes the header size.
+// size includes the header size. The low bits of the size field are used to
+// tag a block as allocated and to record whether the block immediately below
+// it is allocated. A free block additionally stores its size in the
+// 'prev_size' field of the block immediately above it (boundary tag). This
+// allows us to find and merge free neighbors in constant time.
 typedef struct _MemBlock {
-    struct _MemBlock* _Nullable next;
-    ssize_t                   size;   // The size includes sizeof(MemBlock). Max size of a free block is 4GB; max size of an allocated block is 2GB
+    size_t      prev_size;      // Size of the block immediately below this one. Only valid if that block is free
+    size_t      size;           // The size includes sizeof(MemBlock) | MEMBLOCK_FLAG_XXX. Must be the last field
 } MemBlock;
 
+#define MEMBLOCK_FLAG_ALLOCATED         1   // This block is allocated
+#define MEMBLOCK_FLAG_PREV_ALLOCATED    2   // The block immediately below this block is allocated
+#define MEMBLOCK_FLAGS_MASK             (MEMBLOCK_FLAG_ALLOCATED | MEMBLOCK_FLAG_PREV_ALLOCATED)
+
+#define MemBlock_GetSize(__pBlock) \
+    ((__pBlock)->size & ~MEMBLOCK_FLAGS_MASK)
+
+#define MemBlock_IsAllocated(__pBlock) \
+    (((__pBlock)->size & MEMBLOCK_FLAG_ALLOCATED) != 0)
+
+#define MemBlock_IsPrevAllocated(__pBlock) \
+    (((__pBlock)->size & MEMBLOCK_FLAG_PREV_ALLOCATED) != 0)
+
+#define MemBlock_GetNext(__pBlock) \
+    ((MemBlock*)(((char*)(__pBlock)) + MemBlock_GetSize(__pBlock)))
+
+#define MemBlock_GetPrev(__pBlock) \
+    ((MemBlock*)(((char*)(__pBlock)) - (__pBlock)->prev_size))
+
+
+// A free memory block. The free list links are stored in the otherwise unused
+// payload area of the block.
+typedef struct _FreeMemBlock {
+    MemBlock                        header;
+    struct _FreeMemBlock* _Nullable next;
+    struct _FreeMemBlock* _Nullable prev;
+} FreeMemBlock;
+
+#define MIN_FREE_BLOCK_SIZE __Ceil_PowerOf2(sizeof(FreeMemBlock), HEAP_ALIGNMENT)
+
 
 // A heap memory region is a region of contiguous memory which is managed by the
-// heap. Each such region has its own private list of free memory blocks.
+// heap. Each such region has its own private list of free memory blocks. The
+// top of a region is marked by an allocated sentinel block header of size 0.
 typedef struct _MemRegion {
-    SListNode           node;
-    char* _Nonnull      lower;
-    char* _Nonnull      upper;
-    MemBlock* _Nullable first_free_block;   // Every memory region has its own private free list. Note that the blocks on this list are ordered by increasing base address
+    SListNode                   node;
+    char* _Nonnull              lower;
+    char* _Nonnull              upper;
+    FreeMemBlock* _Nullable     first_free_block;   // Every memory region has its own private, unordered and doubly linked free list
 } MemRegion;
 
 
 // An allocator manages memory from a pool of memory contiguous regions.
 typedef struct _Allocator {
     SList               regions;
-    MemBlock* _Nullable first_allocated_block;  // Unordered list of allocated blocks (no matter from which memory region they were allocated)
 } Allocator;
 
 
@@ -66,23 +100,31 @@ static MemRegion* MemRegion_Create(char* _Nonnull pMemRegionHeader, const Memory
 {
     char* pMemRegionBase = __Ceil_Ptr_PowerOf2(pMemRegionHeader, HEAP_ALIGNMENT);
     char* pFreeLower = __Ceil_Ptr_PowerOf2(pMemRegionBase + sizeof(MemRegion), HEAP_ALIGNMENT);
-    char* pFreeUpper = __Floor_Ptr_PowerOf2(pMemDesc->upper, HEAP_ALIGNMENT);
+    char* pFreeUpper = __Floor_Ptr_PowerOf2(pMemDesc->upper - sizeof(MemBlock), HEAP_ALIGNMENT);
 
-    // Make sure that the MemRegion and the first free MemBlock fit in the memory
-    // area
-    if (pFreeUpper > pMemDesc->upper) {
+    // Make sure that the MemRegion, the first free MemBlock and the sentinel
+    // fit in the memory area
+    if (pFreeUpper > pMemDesc->upper || pFreeUpper < pFreeLower) {
         return NULL;
     }
-    if (pFreeUpper - pFreeLower <= sizeof(MemBlock)) {
+    if (pFreeUpper - pFreeLower < MIN_FREE_BLOCK_SIZE) {
         return NULL;
     }
 
 
     // Create a single free mem block that covers the whole remaining memory
-    // region (everything minus the MemRegion structure).
-    MemBlock* pFreeBlock = (MemBlock*)pFreeLower;
+    // region (everything minus the MemRegion structure and the sentinel).
+    FreeMemBlock* pFreeBlock = (FreeMemBlock*)pFreeLower;
+    pFreeBlock->header.prev_size = 0;
+    pFreeBlock->header.size = (pFreeUpper - pFreeLower) | MEMBLOCK_FLAG_PREV_ALLOCATED;
     pFreeBlock->next = NULL;
-    pFreeBlock->size = pFreeUpper - pFreeLower;
+    pFreeBlock->prev = NULL;
+
+
+    // Create the sentinel which marks the top of the region
+    MemBlock* pSentinel = (MemBlock*)pFreeUpper;
+    pSentinel->prev_size = pFreeUpper - pFreeLower;
+    pSentinel->size = MEMBLOCK_FLAG_ALLOCATED;
 
 
     // Create the MemRegion header
@@ -102,60 +144,78 @@ static bool MemRegion_IsManaging(const MemRegion* _Nonnull pMemRegion, char* _Nu
     return (pAddress >= pMemRegion->lower && pAddress < pMemRegion->upper) ? true : false;
 }
 
+static void MemRegion_InsertFreeBlock(MemRegion* _Nonnull pMemRegion, FreeMemBlock* _Nonnull pBlock)
+{
+    pBlock->prev = NULL;
+    pBlock->next = pMemRegion->first_free_block;
+    if (pMemRegion->first_free_block) {
+        pMemRegion->first_free_block->prev = pBlock;
+    }
+    pMemRegion->first_free_block = pBlock;
+}
+
+static void MemRegion_RemoveFreeBlock(MemRegion* _Nonnull pMemRegion, FreeMemBlock* _Nonnull pBlock)
+{
+    if (pBlock->prev) {
+        pBlock->prev->next = pBlock->next;
+    } else {
+        pMemRegion->first_free_block = pBlock->next;
+    }
+    if (pBlock->next) {
+        pBlock->next->prev = pBlock->prev;
+    }
+    pBlock->next = NULL;
+    pBlock->prev = NULL;
+}
+
 // Allocates 'nBytesToAlloc' from the given memory region. Note that
 // 'nBytesToAlloc' has to include the heap block header and the correct alignment.
-static MemBlock* _Nullable MemRegion_AllocMemBlock(MemRegion* _Nonnull pMemRegion, ssize_t nBytesToAlloc)
+static MemBlock* _Nullable MemRegion_AllocMemBlock(MemRegion* _Nonnull pMemRegion, size_t nBytesToAlloc)
 {
     // first fit search
-    MemBlock* pCurBlock = pMemRegion->first_free_block;
-    MemBlock* pFoundBlock = NULL;
-    MemBlock* pPrevFoundBlock = NULL;
+    FreeMemBlock* pFoundBlock = pMemRegion->first_free_block;
     
-    while (pCurBlock) {
-        if (pCurBlock->size >= nBytesToAlloc) {
-            pFoundBlock = pCurBlock;
+    while (pFoundBlock) {
+        if (MemBlock_GetSize(&pFoundBlock->header) >= nBytesToAlloc) {
             break;
         }
-        
-        pPrevFoundBlock = pCurBlock;
-        pCurBlock = pCurBlock->next;
+        pFoundBlock = pFoundBlock->next;
     }
     
     if (pFoundBlock == NULL) {
         return NULL;
     }
     
-    MemBlock* pAllocatedBlock = NULL;
+    const size_t foundSize = MemBlock_GetSize(&pFoundBlock->header);
+    MemBlock* pAllocatedBlock = &pFoundBlock->header;
 
-    if (pFoundBlock->size == nBytesToAlloc) {
+    if (foundSize - nBytesToAlloc < MIN_FREE_BLOCK_SIZE) {
         // Case 1: We want to allocate the whole free block
-        if (pPrevFoundBlock) {
-            pPrevFoundBlock->next = pFoundBlock->next;
-        }
-        else {
-            pMemRegion->first_free_block = pFoundBlock->next;
-        }
-        // Size doesn't change
-        pFoundBlock->next = NULL;
-        pAllocatedBlock = pFoundBlock;
+        MemRegion_RemoveFreeBlock(pMemRegion, pFoundBlock);
+        pAllocatedBlock->size |= MEMBLOCK_FLAG_ALLOCATED;
+        MemBlock_GetNext(pAllocatedBlock)->size |= MEMBLOCK_FLAG_PREV_ALLOCATED;
     }
     else {
-        // Case 2: We want to allocate the first 'nBytesToAlloc' bytes of the free block
-        MemBlock* pRemainingFreeBlock = (MemBlock*)((char*)pCurBlock + nBytesToAlloc);
+        // Case 2: We want to allocate the first 'nBytesToAlloc' bytes of the
+        // free block. The remainder takes over the free list slot of the found
+        // block
+        FreeMemBlock* pRemainingFreeBlock = (FreeMemBlock*)((char*)pFoundBlock + nBytesToAlloc);
+        const size_t remainingSize = foundSize - nBytesToAlloc;
 
+        pRemainingFreeBlock->header.size = remainingSize | MEMBLOCK_FLAG_PREV_ALLOCATED;
         pRemainingFreeBlock->next = pFoundBlock->next;
-        pRemainingFreeBlock->size = pFoundBlock->size - nBytesToAlloc;
-
-        if (pPrevFoundBlock) {
-            pPrevFoundBlock->next = pRemainingFreeBlock;
-        }
-        else {
+        pRemainingFreeBlock->prev = pFoundBlock->prev;
+        if (pFoundBlock->prev) {
+            pFoundBlock->prev->next = pRemainingFreeBlock;
+        } else {
             pMemRegion->first_free_block = pRemainingFreeBlock;
         }
+        if (pFoundBlock->next) {
+            pFoundBlock->next->prev = pRemainingFreeBlock;
+        }
+        MemBlock_GetNext(&pRemainingFreeBlock->header)->prev_size = remainingSize;
 
-        pFoundBlock->size = nBytesToAlloc;
-        pFoundBlock->next = NULL;
-        pAllocatedBlock = pFoundBlock;
+        pAllocatedBlock->size = nBytesToAlloc | MEMBLOCK_FLAG_ALLOCATED | (pAllocatedBlock->size & MEMBLOCK_FLAG_PREV_ALLOCATED);
     }
     
     
@@ -164,95 +224,41 @@ static MemBlock* _Nullable MemRegion_AllocMemBlock(MemRegion* _Nonnull pMemRegio
 }
 
 // Deallocates the given memory block. Expects that the memory block is managed
-// by the given mem region. Expects that the memory block is already removed from
-// the allocators list of allocated memory blocks.
+// by the given mem region. Coalesces the block with its free neighbors. This
+// is a constant time operation thanks to the boundary tags.
 // \param pMemRegion the memory region header
 // \param pBlockToFree pointer to the header of the memory block to free
-void MemRegion_FreeMemBlock(MemRegion* _Nonnull pMemRegion, MemBlock* _Nonnull pBlockToFree)
+static void MemRegion_FreeMemBlock(MemRegion* _Nonnull pMemRegion, MemBlock* _Nonnull pBlockToFree)
 {
-    assert(pBlockToFree->next == NULL);
-    
-    
-    // Compute the lower and the upper bound of the block that we want to free.
-    char* pLowerToFree = (char*)pBlockToFree;
-    char* pUpperToFree = pLowerToFree + pBlockToFree->size;
-    
-    
-        // Find the free memory blocks just below and above 'pBlockToFree'. These
-    // will be the predecessor and successor of 'pBlockToFree' on the free list
-    bool isUpperFreeBlockAdjacent = false;
-    bool isLowerFreeBlockAdjacent = false;
-    MemBlock* pLowerFreeBlock = NULL;
-    MemBlock* pUpperFreeBlock = NULL;
-    MemBlock* pCurBlock = pMemRegion->first_free_block;
-
-    while (pCurBlock) {
-        char* pCurBlockLower = (char*)pCurBlock;
-        char* pCurBlockUpper = pCurBlockLower + pCurBlock->size;
-
-        if (pCurBlockUpper <= pLowerToFree) {
-            pLowerFreeBlock = pCurBlock;
-            isLowerFreeBlockAdjacent = pCurBlockUpper == pLowerToFree;
-        }
-        else if (pCurBlockLower >= pUpperToFree) {
-            pUpperFreeBlock = pCurBlock;
-            isUpperFreeBlockAdjacent = pCurBlockLower == pUpperToFree;
-            break;
-        }
+    MemBlock* pBlock = pBlockToFree;
+    size_t size = MemBlock_GetSize(pBlock);
+    MemBlock* pUpperBlock = MemBlock_GetNext(pBlock);
 
-        pCurBlock = pCurBlock->next;
-    }
-    
 
-    // Update the free list
-    if (!isLowerFreeBlockAdjacent && !isUpperFreeBlockAdjacent) {
-        // Case 1: our block is surrounded by allocated blocks.
-        // Merging: nothing.
-        if (pLowerFreeBlock) {
-            pBlockToFree->next = pLowerFreeBlock->next;
-            pLowerFreeBlock->next = pBlockToFree;
-        }
-        else {
-            pBlockToFree->next = pUpperFreeBlock;
-            pMemRegion->first_free_block = pBlockToFree;
-        }
-    }
-    else if (isUpperFreeBlockAdjacent && !isLowerFreeBlockAdjacent) {
-        // Case 2: our block has a free upper neighbor and an allocated lower neighbor
-        // Merging: upper & me
-        pBlockToFree->size += pUpperFreeBlock->size;
-
-        if (pLowerFreeBlock) {
-            pBlockToFree->next = pUpperFreeBlock->next;
-            pLowerFreeBlock->next = pBlockToFree;
-        }
-        else {
-            pBlockToFree->next = pUpperFreeBlock->next;
-            pMemRegion->first_free_block = pBlockToFree;
-        }
+    // Merge with the lower neighbor if it is free
+    if (!MemBlock_IsPrevAllocated(pBlock)) {
+        MemBlock* pLowerBlock = MemBlock_GetPrev(pBlock);
 
-        pUpperFreeBlock->next = NULL;
-        pUpperFreeBlock->size = 0;
+        MemRegion_RemoveFreeBlock(pMemRegion, (FreeMemBlock*)pLowerBlock);
+        size += MemBlock_GetSize(pLowerBlock);
+        pBlock = pLowerBlock;
     }
-    else if (!isUpperFreeBlockAdjacent && isLowerFreeBlockAdjacent) {
-        // Case 3: our block has a free lower neighbor and an allocated upper neighbor
-        // Merging: lower & me
-        pLowerFreeBlock->size += pBlockToFree->size;
 
-        pBlockToFree->next = NULL;
-        pBlockToFree->size = 0;
-    }
-    else {
-        // Case 4: our block is surrounded by free blocks
-        // Merging: upper & lower & me
-        pLowerFreeBlock->size = pLowerFreeBlock->size + pBlockToFree->size + pUpperFreeBlock->size;
-        pLowerFreeBlock->next = pUpperFreeBlock->next;
-
-        pBlockToFree->next = NULL;
-        pBlockToFree->size = 0;
-        pUpperFreeBlock->next = NULL;
-        pUpperFreeBlock->size = 0;
+
+    // Merge with the upper neighbor if it is free
+    if (!MemBlock_IsAllocated(pUpperBlock)) {
+        MemRegion_RemoveFreeBlock(pMemRegion, (FreeMemBlock*)pUpperBlock);
+        size += MemBlock_GetSize(pUpperBlock);
+        pUpperBlock = MemBlock_GetNext(pUpperBlock);
     }
+
+
+    // Note that the block below a free block is always allocated because free
+    // blocks are always merged
+    pBlock->size = size | MEMBLOCK_FLAG_PREV_ALLOCATED;
+    pUpperBlock->prev_size = size;
+    pUpperBlock->size &= ~MEMBLOCK_FLAG_PREV_ALLOCATED;
+    MemRegion_InsertFreeBlock(pMemRegion, (FreeMemBlock*)pBlock);
 }
 
 
@@ -277,7 +283,6 @@ errno_t Allocator_Create(const MemoryDescriptor* _Nonnull pMemDesc, AllocatorRef
     char* pFirstMemRegionBase = pAllocatorBase + sizeof(Allocator);
 
     AllocatorRef pAllocator = (AllocatorRef)pAllocatorBase;
-    pAllocator->first_allocated_block = NULL;
     SList_Init(&pAllocator->regions);
     
     MemRegion* pFirstRegion;
@@ -341,7 +346,7 @@ errno_t Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, ssize_t nbytes
     
     
     // Compute how many bytes we have to take from free memory
-    const int nBytesToAlloc = __Ceil_PowerOf2(sizeof(MemBlock) + nbytes, HEAP_ALIGNMENT);
+    const size_t nBytesToAlloc = __max(__Ceil_PowerOf2(sizeof(MemBlock) + nbytes, HEAP_ALIGNMENT), MIN_FREE_BLOCK_SIZE);
     
     
     // Note that the code here assumes desc 0 is chip RAM and all the others are
@@ -366,10 +371,6 @@ errno_t Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, ssize_t nbytes
     throw_ifnull(pMemBlock, ENOMEM);
 
 
-    // Add the allocated block to the list of allocated blocks
-    pMemBlock->next = pAllocator->first_allocated_block;
-    pAllocator->first_allocated_block = pMemBlock;
-
     // Calculate and return the user memory block pointer
     *pOutPtr = ((char*)pMemBlock) + sizeof(MemBlock);
     return EOK;
@@ -379,6 +380,28 @@ catch:
     return err;
 }
 
+#if DEBUG
+// Returns true if 'pBlock' looks like a valid allocated memory block that is
+// managed by 'pMemRegion'.
+static bool MemRegion_IsValidAllocatedBlock(const MemRegion* _Nonnull pMemRegion, const MemBlock* _Nonnull pBlock)
+{
+    const char* pBlockLower = (const char*)pBlock;
+    const size_t size = MemBlock_GetSize(pBlock);
+
+    if (((uintptr_t)pBlockLower & (HEAP_ALIGNMENT - 1)) != 0 || pBlockLower < pMemRegion->lower) {
+        return false;
+    }
+    if (!MemBlock_IsAllocated(pBlock) || size < MIN_FREE_BLOCK_SIZE || (size & (HEAP_ALIGNMENT - 1)) != 0) {
+        return false;
+    }
+    if (pBlockLower + size > pMemRegion->upper - sizeof(MemBlock)) {
+        return false;
+    }
+
+    return MemBlock_IsPrevAllocated(MemBlock_GetNext(pBlock));
+}
+#endif
+
 // Attempts to deallocate the given memory block. Returns EOK on success and
 // ENOTBLK if the allocator does not manage the given memory block.
 errno_t Allocator_DeallocateBytes(AllocatorRef _Nonnull pAllocator, void* _Nullable ptr)
@@ -396,30 +419,12 @@ errno_t Allocator_DeallocateBytes(AllocatorRef _Nonnull pAllocator, void* _Nulla
     
     MemBlock* pBlockToFree = (MemBlock*)(((char*)ptr) - sizeof(MemBlock));
     
-    
-    // Remove the block 'ptr' from the list of allocated blocks
-    MemBlock* pPrevBlock = NULL;
-    MemBlock* pCurBlock = pAllocator->first_allocated_block;
-    while (pCurBlock) {
-        if (pCurBlock == pBlockToFree) {
-            if (pPrevBlock) {
-                pPrevBlock->next = pBlockToFree->next;
-            } else {
-                pAllocator->first_allocated_block = pBlockToFree->next;
-            }
-            pBlockToFree->next = NULL;
-            break;
-        }
-        
-        pPrevBlock = pCurBlock;
-        pCurBlock = pCurBlock->next;
-    }
-    
-
+#if DEBUG
     // Looks like 'ptr' isn't a pointer to an allocated memory block
-    if (pBlockToFree->next != NULL) {
+    if (!MemRegion_IsValidAllocatedBlock(pMemRegion, pBlockToFree)) {
         return ENOTBLK;
     }
+#endif
     
     
     // Tell the memory region to free the memory block
@@ -433,12 +438,12 @@ void Allocator_Dump(AllocatorRef _Nonnull pAllocator)
     print("Free:\n");
     MemRegion* pCurRegion = (MemRegion*)pAllocator->regions.first;
     while (pCurRegion != NULL) {
-        MemBlock* pCurBlock = pCurRegion->first_free_block;
+        FreeMemBlock* pCurBlock = pCurRegion->first_free_block;
         int i = 1;
 
         print(" Region: 0x%p - 0x%p, s: 0x%p\n", pCurRegion->lower, pCurRegion->upper, pCurRegion->first_free_block);
         while (pCurBlock) {
-            print("  %d:  0x%p: {a: 0x%p, n: 0x%p, s: %lu}\n", i, ((char*)pCurBlock) + sizeof(MemBlock), pCurBlock, pCurBlock->next, pCurBlock->size);
+            print("  %d:  0x%p: {a: 0x%p, n: 0x%p, s: %lu}\n", i, ((char*)pCurBlock) + sizeof(MemBlock), pCurBlock, pCurBlock->next, MemBlock_GetSize(&pCurBlock->header));
             pCurBlock = pCurBlock->next;
             i++;
         }
@@ -447,16 +452,22 @@ void Allocator_Dump(AllocatorRef _Nonnull pAllocator)
     }
     print("\n");
 
-    MemBlock* pCurBlock = pAllocator->first_allocated_block;
-    int i = 1;
-    print("Allocated (s: 0x%p):\n", pCurBlock);
-    while (pCurBlock) {
-        char* pCurBlockBase = (char*)pCurBlock;
-        MemRegion* pMemRegion = Allocator_GetMemRegionManaging_Locked(pAllocator, pCurBlockBase);
-        
-        print(" %d:  0x%p, {a: 0x%p, n: 0x%p s: %lu}\n", i, pCurBlockBase + sizeof(MemBlock), pCurBlock, pCurBlock->next, pCurBlock->size);
-        pCurBlock = pCurBlock->next;
-        i++;
+    print("Allocated:\n");
+    pCurRegion = (MemRegion*)pAllocator->regions.first;
+    while (pCurRegion != NULL) {
+        MemBlock* pCurBlock = (MemBlock*)__Ceil_Ptr_PowerOf2(((char*)pCurRegion) + sizeof(MemRegion), HEAP_ALIGNMENT);
+        int i = 1;
+
+        // Walk the region block by block until we hit the sentinel
+        while (MemBlock_GetSize(pCurBlock) > 0) {
+            if (MemBlock_IsAllocated(pCurBlock)) {
+                print(" %d:  0x%p, {a: 0x%p, s: %lu}\n", i, ((char*)pCurBlock) + sizeof(MemBlock), pCurBlock, MemBlock_GetSize(pCurBlock));
+                i++;
+            }
+            pCurBlock = MemBlock_GetNext(pCurBlock);
+        }
+
+        pCurRegion = (MemRegion*)pCurRegion->node.next;
     }
     print("\n");
 }
@@ -68,7 +68,8 @@ int Bits_FindFirstSet(const BitPointer pBits, size_t nbits)
     const BitPointer pLastBit = BitPointer_AddBitOffset(pBits, nbits - 1);
     
     if (pBits.bytePointer == pLastBit.bytePointer) {
-        return index_of_first_1_in_byte(*pBits.bytePointer, pBits.bitIndex, pLastBit.bitIndex);
+        const int idx = index_of_first_1_in_byte(*pBits.bytePointer, pBits.bitIndex, pLastBit.bitIndex);
+        return (idx != -1) ? idx - pBits.bitIndex : -1;
     }
     else {
         char* middle_byte_p = pBits.bytePointer + 1;
@@ -77,7 +78,7 @@ int Bits_FindFirstSet(const BitPointer pBits, size_t nbits)
         
         // first byte
         idx = index_of_first_1_in_byte(*pBits.bytePointer, pBits.bitIndex, 7);
-        if (idx != -1) { return idx; }
+        if (idx != -1) { return idx - pBits.bitIndex; }
         
         // middle range
         if (middle_byte_count > 0) {
@@ -107,7 +108,8 @@ int Bits_FindLastSet(const BitPointer pBits, size_t nbits)
     const BitPointer pLastBit = BitPointer_AddBitOffset(pBits, nbits - 1);
     
     if (pBits.bytePointer == pLastBit.bytePointer) {
-        return index_of_last_1_in_byte(*pBits.bytePointer, pLastBit.bitIndex, pBits.bitIndex);
+        const int idx = index_of_last_1_in_byte(*pBits.bytePointer, pLastBit.bitIndex, pBits.bitIndex);
+        return (idx != -1) ? idx - pBits.bitIndex : -1;
     }
     else {
         char* middle_byte_p = pBits.bytePointer + 1;
@@ -130,7 +132,7 @@ int Bits_FindLastSet(const BitPointer pBits, size_t nbits)
         
         // first byte
         idx = index_of_last_1_in_byte(*pBits.bytePointer, 7, pBits.bitIndex);
-        if (idx != -1) { return idx; }
+        if (idx != -1) { return idx - pBits.bitIndex; }
         
         return -1;
     }
@@ -148,7 +150,8 @@ int Bits_FindFirstCleared(const BitPointer pBits, size_t nbits)
     const BitPointer pLastBit = BitPointer_AddBitOffset(pBits, nbits - 1);
     
     if (pBits.bytePointer == pLastBit.bytePointer) {
-        return index_of_first_0_in_byte(*pBits.bytePointer, pBits.bitIndex, pLastBit.bitIndex);
+        const int idx = index_of_first_0_in_byte(*pBits.bytePointer, pBits.bitIndex, pLastBit.bitIndex);
+        return (idx != -1) ? idx - pBits.bitIndex : -1;
     }
     else {
         char* middle_byte_p = pBits.bytePointer + 1;
@@ -157,7 +160,7 @@ int Bits_FindFirstCleared(const BitPointer pBits, size_t nbits)
         
         // first byte
         idx = index_of_first_0_in_byte(*pBits.bytePointer, pBits.bitIndex, 7);
-        if (idx != -1) { return idx; }
+        if (idx != -1) { return idx - pBits.bitIndex; }
         
         // middle range
         if (middle_byte_count > 0) {
@@ -187,7 +190,8 @@ int Bits_FindLastCleared(const BitPointer pBits, size_t nbits)
     const BitPointer pLastBit = BitPointer_AddBitOffset(pBits, nbits - 1);
     
     if (pBits.bytePointer == pLastBit.bytePointer) {
-        return index_of_last_0_in_byte(*pBits.bytePointer, pLastBit.bitIndex, pBits.bitIndex);
+        const int idx = index_of_last_0_in_byte(*pBits.bytePointer, pLastBit.bitIndex, pBits.bitIndex);
+        return (idx != -1) ? idx - pBits.bitIndex : -1;
     }
     else {
         char* middle_byte_p = pBits.bytePointer + 1;
@@ -210,7 +214,7 @@ int Bits_FindLastCleared(const BitPointer pBits, size_t nbits)
         
         // first byte
         idx = index_of_last_0_in_byte(*pBits.bytePointer, 7, pBits.bitIndex);
-        if (idx != -1) { return idx; }
+        if (idx != -1) { return idx - pBits.bitIndex; }
         
         return -1;
     }
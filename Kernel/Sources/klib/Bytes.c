@@ -34,12 +34,28 @@ int Bytes_FindFirst(const void* _Nonnull pBytes, size_t nbytes, int mark)
 // appears in the given range.
 int Bytes_FindFirstNotEquals(const void* _Nonnull pBytes, size_t nbytes, int mark)
 {
-    const char* p = (const char*)pBytes;
-    const char* cur_p = p;
-    const char* end_p = p + nbytes;
-    
+    const uint8_t* p = (const uint8_t*)pBytes;
+    const uint8_t* cur_p = p;
+    const uint8_t* end_p = p + nbytes;
+    const uint8_t mark8 = (uint8_t)mark;
+    
+    // Leading bytes up to the first word boundary
+    while (cur_p < end_p && ((uintptr_t)cur_p & (sizeof(uint32_t) - 1)) != 0) {
+        if (*cur_p != mark8) {
+            return cur_p - p;
+        }
+        cur_p++;
+    }
+
+    // Compare a word at a time. The byte loop below locates the exact byte
+    // once we've found a word that contains a mismatch
+    const uint32_t mark32 = mark8 * 0x01010101u;
+    while (end_p - cur_p >= sizeof(uint32_t) && *((const uint32_t*)cur_p) == mark32) {
+        cur_p += sizeof(uint32_t);
+    }
+
     while (cur_p < end_p) {
-        if (*cur_p != mark) {
+        if (*cur_p != mark8) {
             return cur_p - p;
         }
         cur_p++;
@@ -71,14 +87,28 @@ int Bytes_FindLast(const void* _Nonnull pBytes, size_t nbytes, int mark)
 // appears in the given range.
 int Bytes_FindLastNotEquals(const void* _Nonnull pBytes, size_t nbytes, int mark)
 {
-    const char* p = (const char*)pBytes;
-    const char* cur_p = p;
+    const uint8_t* p = (const uint8_t*)pBytes;
+    const uint8_t* cur_p = p + nbytes;
+    const uint8_t mark8 = (uint8_t)mark;
     
-    while (cur_p >= p) {
-        if (*cur_p != mark) {
+    // Trailing bytes down to the last word boundary
+    while (cur_p > p && ((uintptr_t)cur_p & (sizeof(uint32_t) - 1)) != 0) {
+        cur_p--;
+        if (*cur_p != mark8) {
             return cur_p - p;
         }
+    }
+
+    const uint32_t mark32 = mark8 * 0x01010101u;
+    while (cur_p - p >= sizeof(uint32_t) && *((const uint32_t*)(cur_p - sizeof(uint32_t))) == mark32) {
+        cur_p -= sizeof(uint32_t);
+    }
+
+    while (cur_p > p) {
         cur_p--;
+        if (*cur_p != mark8) {
+            return cur_p - p;
+        }
     }
     
     return -1;
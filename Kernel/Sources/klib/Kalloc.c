@@ -10,11 +10,62 @@
 #include "Allocator.h"
 #include <dispatcher/Lock.h>
 #include "Bytes.h"
+#include "List.h"
+#include "Log.h"
+
+
+// Small allocations are served from per size class slabs. A slab is a fixed
+// size chunk of memory which is allocated from the general purpose allocator
+// and which is carved up into equally sized object slots. Every slot is
+// prefixed by a SlabObjectHeader which allows kfree() to find the owning slab
+// in constant time.
+#define SLAB_BYTE_SIZE      2048
+#define SIZE_CLASS_COUNT    5
+#define SIZE_CLASS_MIN_SIZE 16
+#define SIZE_CLASS_MAX_SIZE (SIZE_CLASS_MIN_SIZE << (SIZE_CLASS_COUNT - 1))
+
+// Note that bit #2 is never set in the size field of a general purpose memory
+// block because block sizes are always a multiple of the heap alignment. This
+// is what allows us to tell slab objects apart from general purpose blocks.
+#define SLAB_OBJECT_TAG     0x51ab0004
+
+
+struct _Slab;
+
+typedef struct _SlabObjectHeader {
+    struct _Slab* _Nonnull  slab;
+    uint32_t                tag;    // Must be the last field. Always SLAB_OBJECT_TAG
+} SlabObjectHeader;
+
+// A free object slot. The link is stored in the (unused) payload of the slot
+typedef struct _SlabFreeObject {
+    struct _SlabFreeObject* _Nullable   next;
+} SlabFreeObject;
+
+typedef struct _SizeClass {
+    Lock            lock;
+    List            partial_slabs;      // Slabs with at least one free object slot
+    int             object_size;        // Max payload size of an object in this class
+    int             slot_size;          // Object size + header size
+    int             objects_per_slab;
+    int             slab_count;
+    int             objects_in_use;
+    int             peak_objects_in_use;
+} SizeClass;
+
+typedef struct _Slab {
+    ListNode                    node;   // Linked into the partial slab list of the size class if the slab isn't full
+    SizeClass* _Nonnull         size_class;
+    SlabFreeObject* _Nullable   first_free_object;
+    int                         in_use_count;
+} Slab;
 
 
 static Lock         gLock;
 static AllocatorRef gUnifiedMemory;       // CPU + Chipset access (memory range [0..<chipset_upper_dma_limit])
 static AllocatorRef gCpuOnlyMemory;       // CPU only access      (memory range [chipset_upper_dma_limit...])
+static SizeClass    gSizeClasses[SIZE_CLASS_COUNT];
+static unsigned int gOptions;
 
 
 static MemoryDescriptor adjusted_memory_descriptor(const MemoryDescriptor* pMemDesc, char* _Nonnull pInitialHeapBottom, char* _Nonnull pInitialHeapTop)
@@ -70,12 +121,193 @@ catch:
     return err;
 }
 
-// Initializes the kalloc heap.
-errno_t kalloc_init(const SystemDescription* _Nonnull pSysDesc, void* _Nonnull pInitialHeapBottom, void* _Nonnull pInitialHeapTop)
+// Allocates 'nbytes' from the general purpose allocators.
+static errno_t allocate_bytes(ssize_t nbytes, unsigned int options, void* _Nullable * _Nonnull pOutPtr)
+{
+    decl_try_err();
+
+    Lock_Lock(&gLock);
+    if ((options & KALLOC_OPTION_UNIFIED) != 0) {
+        err = Allocator_AllocateBytes(gUnifiedMemory, nbytes, pOutPtr);
+    } else {
+        err = Allocator_AllocateBytes(gCpuOnlyMemory, nbytes, pOutPtr);
+        if (err == ENOMEM) {
+            err = Allocator_AllocateBytes(gUnifiedMemory, nbytes, pOutPtr);
+        }
+    }
+    Lock_Unlock(&gLock);
+
+    return err;
+}
+
+// Returns 'ptr' to the general purpose allocator that manages it.
+static void deallocate_bytes(void* _Nullable ptr)
+{
+    Lock_Lock(&gLock);
+    const errno_t err = Allocator_DeallocateBytes(gUnifiedMemory, ptr);
+
+    if (err == ENOTBLK) {
+        try_bang(Allocator_DeallocateBytes(gCpuOnlyMemory, ptr));
+    } else if (err != EOK) {
+        abort();
+    }
+    Lock_Unlock(&gLock);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Size Classes
+////////////////////////////////////////////////////////////////////////////////
+
+static void SizeClass_Init(SizeClass* _Nonnull self, int objectSize)
+{
+    Lock_Init(&self->lock);
+    List_Init(&self->partial_slabs);
+    self->object_size = objectSize;
+    self->slot_size = sizeof(SlabObjectHeader) + objectSize;
+    self->objects_per_slab = (SLAB_BYTE_SIZE - __Ceil_PowerOf2(sizeof(Slab), 8)) / self->slot_size;
+    self->slab_count = 0;
+    self->objects_in_use = 0;
+    self->peak_objects_in_use = 0;
+}
+
+// Returns the size class that should be used to allocate an object of size
+// 'nbytes'. Returns NULL if the object is too big to be served by a size class.
+static SizeClass* _Nullable SizeClass_ForSize(ssize_t nbytes)
+{
+    if (nbytes > SIZE_CLASS_MAX_SIZE) {
+        return NULL;
+    }
+
+    int idx = 0;
+    ssize_t classSize = SIZE_CLASS_MIN_SIZE;
+    while (classSize < nbytes) {
+        classSize <<= 1;
+        idx++;
+    }
+
+    return &gSizeClasses[idx];
+}
+
+// Allocates a new slab for the given size class and threads all its object
+// slots on the slab's free list.
+static errno_t SizeClass_CreateSlab_Locked(SizeClass* _Nonnull self, Slab* _Nullable * _Nonnull pOutSlab)
+{
+    decl_try_err();
+    Slab* pSlab;
+
+    try(allocate_bytes(SLAB_BYTE_SIZE, 0, (void**)&pSlab));
+    ListNode_Init(&pSlab->node);
+    pSlab->size_class = self;
+    pSlab->first_free_object = NULL;
+    pSlab->in_use_count = 0;
+
+    char* pSlot = (char*)pSlab + __Ceil_PowerOf2(sizeof(Slab), 8);
+    for (int i = 0; i < self->objects_per_slab; i++) {
+        SlabObjectHeader* pHeader = (SlabObjectHeader*)pSlot;
+        SlabFreeObject* pObject = (SlabFreeObject*)(pSlot + sizeof(SlabObjectHeader));
+
+        pHeader->slab = pSlab;
+        pHeader->tag = SLAB_OBJECT_TAG;
+        pObject->next = pSlab->first_free_object;
+        pSlab->first_free_object = pObject;
+        pSlot += self->slot_size;
+    }
+
+    self->slab_count++;
+    *pOutSlab = pSlab;
+    return EOK;
+
+catch:
+    *pOutSlab = NULL;
+    return err;
+}
+
+static errno_t SizeClass_AllocateObject(SizeClass* _Nonnull self, void* _Nullable * _Nonnull pOutPtr)
+{
+    decl_try_err();
+    Slab* pSlab;
+
+    Lock_Lock(&self->lock);
+    pSlab = (Slab*)self->partial_slabs.first;
+    if (pSlab == NULL) {
+        try(SizeClass_CreateSlab_Locked(self, &pSlab));
+        List_InsertBeforeFirst(&self->partial_slabs, &pSlab->node);
+    }
+
+    SlabFreeObject* pObject = pSlab->first_free_object;
+    pSlab->first_free_object = pObject->next;
+    pSlab->in_use_count++;
+    if (pSlab->first_free_object == NULL) {
+        // Full slabs are not tracked. kfree() will put the slab back on the
+        // partial list once an object is returned to it.
+        List_Remove(&self->partial_slabs, &pSlab->node);
+    }
+
+    self->objects_in_use++;
+    if (self->objects_in_use > self->peak_objects_in_use) {
+        self->peak_objects_in_use = self->objects_in_use;
+    }
+    Lock_Unlock(&self->lock);
+
+    *pOutPtr = pObject;
+    return EOK;
+
+catch:
+    Lock_Unlock(&self->lock);
+    *pOutPtr = NULL;
+    return err;
+}
+
+static void SizeClass_DeallocateObject(SizeClass* _Nonnull self, Slab* _Nonnull pSlab, void* _Nonnull ptr)
+{
+    SlabFreeObject* pObject = (SlabFreeObject*)ptr;
+    Slab* pSlabToFree = NULL;
+
+    Lock_Lock(&self->lock);
+    const bool wasFull = (pSlab->first_free_object == NULL);
+
+    pObject->next = pSlab->first_free_object;
+    pSlab->first_free_object = pObject;
+    pSlab->in_use_count--;
+    self->objects_in_use--;
+
+    if (wasFull) {
+        List_InsertBeforeFirst(&self->partial_slabs, &pSlab->node);
+    }
+
+    // Give an empty slab back to the general purpose allocator, unless it is
+    // the only partial slab left. We keep that one around to avoid thrashing
+    if (pSlab->in_use_count == 0 && self->partial_slabs.first != self->partial_slabs.last) {
+        List_Remove(&self->partial_slabs, &pSlab->node);
+        self->slab_count--;
+        pSlabToFree = pSlab;
+    }
+    Lock_Unlock(&self->lock);
+
+    if (pSlabToFree) {
+        deallocate_bytes(pSlabToFree);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Kalloc
+////////////////////////////////////////////////////////////////////////////////
+
+// Initializes the kalloc heap. 'options' is a combination of the
+// KALLOC_INIT_OPTION_XXX flags.
+errno_t kalloc_init(const SystemDescription* _Nonnull pSysDesc, void* _Nonnull pInitialHeapBottom, void* _Nonnull pInitialHeapTop, unsigned int options)
 {
     decl_try_err();
 
+    gOptions = options;
     Lock_Init(&gLock);
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass_Init(&gSizeClasses[i], SIZE_CLASS_MIN_SIZE << i);
+    }
     try(create_allocator(&pSysDesc->memory, pInitialHeapBottom, pInitialHeapTop, MEM_TYPE_UNIFIED_MEMORY, &gUnifiedMemory));
     try(create_allocator(&pSysDesc->memory, pInitialHeapBottom, pInitialHeapTop, MEM_TYPE_MEMORY, &gCpuOnlyMemory));
     return EOK;
@@ -92,15 +324,15 @@ errno_t kalloc_options(ssize_t nbytes, unsigned int options, void* _Nullable * _
     
     assert(nbytes >= 0);
     
-    Lock_Lock(&gLock);
-    if ((options & KALLOC_OPTION_UNIFIED) != 0) {
-        try(Allocator_AllocateBytes(gUnifiedMemory, nbytes, pOutPtr));
+    // Small CPU-only allocations are served by the size classes. Everything
+    // else goes straight to the general purpose allocators
+    SizeClass* pSizeClass = (nbytes > 0 && (options & KALLOC_OPTION_UNIFIED) == 0) ? SizeClass_ForSize(nbytes) : NULL;
+
+    if (pSizeClass) {
+        try(SizeClass_AllocateObject(pSizeClass, pOutPtr));
     } else {
-        if (Allocator_AllocateBytes(gCpuOnlyMemory, nbytes, pOutPtr) == ENOMEM) {
-            try(Allocator_AllocateBytes(gUnifiedMemory, nbytes, pOutPtr));
-        }
+        try(allocate_bytes(nbytes, options, pOutPtr));
     }
-    Lock_Unlock(&gLock);
 
     // Zero the memory if requested
     if ((options & KALLOC_OPTION_CLEAR) != 0) {
@@ -110,7 +342,6 @@ errno_t kalloc_options(ssize_t nbytes, unsigned int options, void* _Nullable * _
     return EOK;
 
 catch:
-    Lock_Unlock(&gLock);
     *pOutPtr = NULL;
     return err;
 }
@@ -118,15 +349,18 @@ catch:
 // Frees kernel memory allocated with the kalloc() function.
 void kfree(void* _Nullable ptr)
 {
-    Lock_Lock(&gLock);
-    const errno_t err = Allocator_DeallocateBytes(gUnifiedMemory, ptr);
+    if (ptr == NULL || ptr == CHAR_PTR_MAX) {
+        return;
+    }
 
-    if (err == ENOTBLK) {
-        try_bang(Allocator_DeallocateBytes(gCpuOnlyMemory, ptr));
-    } else if (err != EOK) {
-        abort();
+    const SlabObjectHeader* pHeader = (const SlabObjectHeader*)((char*)ptr - sizeof(SlabObjectHeader));
+    if (pHeader->tag == SLAB_OBJECT_TAG) {
+        Slab* pSlab = pHeader->slab;
+        
+        SizeClass_DeallocateObject(pSlab->size_class, pSlab, ptr);
+    } else {
+        deallocate_bytes(ptr);
     }
-    Lock_Unlock(&gLock);
 }
 
 // Adds the given memory region as a CPU-only access memory region to the kalloc
@@ -159,4 +393,21 @@ void kalloc_dump(void)
     Allocator_DumpMemoryRegions(gCpuOnlyMemory);
     print("\n");
     Lock_Unlock(&gLock);
+
+    if ((gOptions & KALLOC_INIT_OPTION_SIZE_CLASS_STATS) != 0) {
+        print("Size classes:\n");
+        for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+            SizeClass* pSizeClass = &gSizeClasses[i];
+
+            Lock_Lock(&pSizeClass->lock);
+            print("   %d: slabs: %d, in use: %d/%d, peak: %d\n",
+                pSizeClass->object_size,
+                pSizeClass->slab_count,
+                pSizeClass->objects_in_use,
+                pSizeClass->slab_count * pSizeClass->objects_per_slab,
+                pSizeClass->peak_objects_in_use);
+            Lock_Unlock(&pSizeClass->lock);
+        }
+        print("\n");
+    }
 }
@@ -21,8 +21,14 @@
 #define KALLOC_OPTION_CLEAR      2
 
 
+// kalloc_init options
+// Have kalloc_dump() report the occupancy of the small object size classes
+#define KALLOC_INIT_OPTION_SIZE_CLASS_STATS  1
+
+
 // Allocates memory from the kernel heap. Returns NULL if the memory could not be
 // allocated. 'options' is a combination of the HEAP_ALLOC_OPTION_XXX flags.
+// Small CPU-only allocations are served from per size class slabs.
 extern errno_t kalloc_options(ssize_t nbytes, unsigned int options, void* _Nullable * _Nonnull pOutPtr);
 
 // Allocates uninitialized CPU-accessible memory from the kernel heap. Returns
@@ -50,7 +56,8 @@ extern errno_t kalloc_add_memory_region(const MemoryDescriptor* _Nonnull pMemDes
 // Dumps a description of the kalloc heap to the console
 extern void kalloc_dump(void);
 
-// Initializes the kalloc heap.
-extern errno_t kalloc_init(const SystemDescription* _Nonnull pSysDesc, void* _Nonnull pInitialHeapBottom, void* _Nonnull pInitialHeapTop);
+// Initializes the kalloc heap. 'options' is a combination of the
+// KALLOC_INIT_OPTION_XXX flags.
+extern errno_t kalloc_init(const SystemDescription* _Nonnull pSysDesc, void* _Nonnull pInitialHeapBottom, void* _Nonnull pInitialHeapTop, unsigned int options);
 
 #endif /* kalloc_h */
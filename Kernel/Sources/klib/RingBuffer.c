@@ -43,18 +43,23 @@ size_t RingBuffer_PutByte(RingBuffer* _Nonnull pBuffer, char byte)
 }
 
 // Puts a sequence of bytes into the ring buffer by copying them. Returns the
-// number of bytes that have been successfully copied into the buffer.
+// number of bytes that have been successfully copied into the buffer. The bytes
+// are copied in at most two contiguous spans: from the write index to the end
+// of the storage and from the start of the storage on.
 size_t RingBuffer_PutBytes(RingBuffer* _Nonnull pBuffer, const void* _Nonnull pBytes, size_t count)
 {
-    const int avail = RingBuffer_WritableCount(pBuffer);
+    const size_t nBytesToCopy = __min(RingBuffer_WritableCount(pBuffer), count);
     
-    if (count == 0 || avail == 0) {
+    if (nBytesToCopy == 0) {
         return 0;
     }
     
-    const int nBytesToCopy = __min(avail, count);
-    for (int i = 0; i < nBytesToCopy; i++) {
-        pBuffer->data[RingBuffer_MaskIndex(pBuffer, pBuffer->writeIdx + i)] = ((const char*)pBytes)[i];
+    const size_t idx = RingBuffer_MaskIndex(pBuffer, pBuffer->writeIdx);
+    const size_t nFirstSpan = __min(nBytesToCopy, pBuffer->capacity - idx);
+
+    Bytes_CopyRange(&pBuffer->data[idx], pBytes, nFirstSpan);
+    if (nFirstSpan < nBytesToCopy) {
+        Bytes_CopyRange(pBuffer->data, &((const char*)pBytes)[nFirstSpan], nBytesToCopy - nFirstSpan);
     }
     pBuffer->writeIdx += nBytesToCopy;
     
@@ -76,18 +81,22 @@ size_t RingBuffer_GetByte(RingBuffer* _Nonnull pBuffer, char* _Nonnull pByte)
 // Gets a sequence of bytes from the ring buffer. The bytes are copied. Returns
 // 0 if the buffer is empty. Returns the number of bytes that have been copied
 // to 'pBytes'. 0 is returned if nothing has been copied because 'count' is 0
-// or the ring buffer is empty.
+// or the ring buffer is empty. The bytes are copied in at most two contiguous
+// spans.
 size_t RingBuffer_GetBytes(RingBuffer* _Nonnull pBuffer, void* _Nonnull pBytes, size_t count)
 {
-    const int avail = RingBuffer_ReadableCount(pBuffer);
+    const size_t nBytesToCopy = __min(RingBuffer_ReadableCount(pBuffer), count);
     
-    if (count == 0 || avail == 0) {
+    if (nBytesToCopy == 0) {
         return 0;
     }
     
-    const int nBytesToCopy = __min(avail, count);
-    for (int i = 0; i < nBytesToCopy; i++) {
-        ((char*)pBytes)[i] = pBuffer->data[RingBuffer_MaskIndex(pBuffer, pBuffer->readIdx + i)];
+    const size_t idx = RingBuffer_MaskIndex(pBuffer, pBuffer->readIdx);
+    const size_t nFirstSpan = __min(nBytesToCopy, pBuffer->capacity - idx);
+
+    Bytes_CopyRange(pBytes, &pBuffer->data[idx], nFirstSpan);
+    if (nFirstSpan < nBytesToCopy) {
+        Bytes_CopyRange(&((char*)pBytes)[nFirstSpan], pBuffer->data, nBytesToCopy - nFirstSpan);
     }
     pBuffer->readIdx += nBytesToCopy;
     
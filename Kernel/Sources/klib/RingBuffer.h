@@ -48,6 +48,22 @@ static inline size_t RingBuffer_WritableCount(RingBuffer* _Nonnull pBuffer) {
     return pBuffer->capacity - (pBuffer->writeIdx - pBuffer->readIdx);
 }
 
+// Returns the first contiguous span of free space in the ring buffer. The span
+// starts at the write index and ends at the read index or the end of the
+// storage, whichever comes first. Returns the size of the span. Bytes may be
+// placed directly in the span and are then made readable by calling
+// RingBuffer_CommitWrite().
+static inline size_t RingBuffer_GetWritableSpan(RingBuffer* _Nonnull pBuffer, char* _Nullable * _Nonnull pOutSpan) {
+    const size_t idx = RingBuffer_MaskIndex(pBuffer, pBuffer->writeIdx);
+    *pOutSpan = &pBuffer->data[idx];
+    return __min(RingBuffer_WritableCount(pBuffer), pBuffer->capacity - idx);
+}
+
+// Makes the first 'count' bytes of the writable span readable.
+static inline void RingBuffer_CommitWrite(RingBuffer* _Nonnull pBuffer, size_t count) {
+    pBuffer->writeIdx += count;
+}
+
 // Removes all bytes from the ring buffer.
 static inline void RingBuffer_RemoveAll(RingBuffer* _Nonnull pBuffer) {
     pBuffer->readIdx = 0;
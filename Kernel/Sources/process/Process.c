@@ -7,6 +7,8 @@
 //
 
 #include "ProcessPriv.h"
+#include <dispatcher/PollQueue.h>
+#include <driver/MonotonicClock.h>
 #include <filesystem/FilesystemManager.h>
 #include "Pipe.h"
 
@@ -174,6 +176,66 @@ void* _Nonnull Process_GetArgumentsBaseAddress(ProcessRef _Nonnull pProc)
     return ptr;
 }
 
+// Returns the execution statistics of the process. The dispatch queues of the
+// process roll their statistics up into these statistics.
+struct _ExecutionStats* _Nonnull Process_GetExecutionStats(ProcessRef _Nonnull pProc)
+{
+    // The statistics live as long as the process. No need to lock here
+    return &pProc->stats;
+}
+
+// Copies the last path component of argv[0] to 'pOutName'. Returns an empty
+// name if the process has not received its arguments yet.
+static void Process_GetName_Locked(ProcessRef _Nonnull pProc, char* _Nonnull pOutName)
+{
+    const ProcessArguments* pArgs = (const ProcessArguments*) pProc->argumentsBase;
+    const char* pPath = (pArgs && pArgs->argc > 0) ? pArgs->argv[0] : NULL;
+    const char* pName = pPath;
+    int i = 0;
+
+    if (pPath) {
+        while (*pPath != '\0') {
+            if (*pPath++ == '/') {
+                pName = pPath;
+            }
+        }
+
+        while (pName[i] != '\0' && i < kProcessInfo_MaxNameLength - 1) {
+            pOutName[i] = pName[i];
+            i++;
+        }
+    }
+    pOutName[i] = '\0';
+}
+
+// Returns information about the process and its dispatch queues. Note that this
+// function does not fill in the 'nextPid' field.
+void Process_GetInfo(ProcessRef _Nonnull pProc, ProcessInfo* _Nonnull pOutInfo)
+{
+    Lock_Lock(&pProc->lock);
+    pOutInfo->pid = pProc->pid;
+    pOutInfo->ppid = pProc->ppid;
+    Process_GetName_Locked(pProc, pOutInfo->name);
+
+    pOutInfo->dispatchQueueCount = 0;
+    for (int od = 0; od < ObjectArray_GetCount(&pProc->privateResources); od++) {
+        ObjectRef pResource = ObjectArray_GetAt(&pProc->privateResources, od);
+
+        if (pResource && Object_InstanceOf(pResource, DispatchQueue)) {
+            DispatchQueueInfo* pQueueInfo = &pOutInfo->dispatchQueues[pOutInfo->dispatchQueueCount++];
+
+            DispatchQueue_GetInfo((DispatchQueueRef) pResource, pQueueInfo);
+            pQueueInfo->od = od;
+            if (pOutInfo->dispatchQueueCount == kProcessInfo_MaxDispatchQueueCount) {
+                break;
+            }
+        }
+    }
+    Lock_Unlock(&pProc->lock);
+
+    ExecutionStats_Get(&pProc->stats, &pOutInfo->stats);
+}
+
 // Destroys the private resource identified by the given descriptor. The resource
 // is deallocated and removed from the resource table.
 errno_t Process_DisposePrivateResource(ProcessRef _Nonnull pProc, int od)
@@ -182,6 +244,11 @@ errno_t Process_DisposePrivateResource(ProcessRef _Nonnull pProc, int od)
     ObjectRef pResource;
 
     if ((err = Process_UnregisterPrivateResource(pProc, od, &pResource)) == EOK) {
+        if (Object_InstanceOf(pResource, DispatchSource)) {
+            // A queued source closure may hold on to the source for a little
+            // while longer. Make sure that it won't invoke the user closure
+            DispatchSource_Cancel((DispatchSourceRef) pResource);
+        }
         Object_Release(pResource);
     }
     return err;
@@ -346,8 +413,8 @@ catch:
     return err;
 }
 
-// Creates an anonymous pipe.
-errno_t Process_CreatePipe(ProcessRef _Nonnull pProc, int* _Nonnull pOutReadChannel, int* _Nonnull pOutWriteChannel)
+// Creates an anonymous pipe with a buffer of (at least) 'bufferSize' bytes.
+errno_t Process_CreatePipe(ProcessRef _Nonnull pProc, size_t bufferSize, int* _Nonnull pOutReadChannel, int* _Nonnull pOutWriteChannel)
 {
     decl_try_err();
     PipeRef pPipe = NULL;
@@ -355,7 +422,7 @@ errno_t Process_CreatePipe(ProcessRef _Nonnull pProc, int* _Nonnull pOutReadChan
     bool needsUnlock = false;
     bool isReadChannelRegistered = false;
 
-    try(Pipe_Create(kPipe_DefaultBufferSize, &pPipe));
+    try(Pipe_Create(bufferSize, &pPipe));
     try(IOResource_Open(pPipe, NULL /*XXX*/, kOpen_Read, pProc->realUser, &rdChannel));
     try(IOResource_Open(pPipe, NULL /*XXX*/, kOpen_Write, pProc->realUser, &wrChannel));
 
@@ -516,6 +583,77 @@ errno_t Process_vIOControl(ProcessRef _Nonnull pProc, int fd, int cmd, va_list a
     return err;
 }
 
+// Waits until at least one of the I/O channels in 'pEntries' is ready for one
+// of the requested events or 'timeout' has elapsed. The entries are added to
+// the poll queues of their resources and a single poll waiter blocks on behalf
+// of all of them. A descriptor that doesn't refer to an I/O channel is reported
+// as kPollEvent_Invalid.
+errno_t Process_Poll(ProcessRef _Nonnull pProc, IOChannelPollEntry* _Nonnull pEntries, int count, TimeInterval timeout, int* _Nonnull pOutReadyCount)
+{
+    decl_try_err();
+    IOChannelRef* pChannels = NULL;
+    PollEntry* pPollEntries = NULL;
+    PollWaiter waiter;
+    const bool mayWait = TimeInterval_Greater(timeout, kTimeInterval_Zero);
+    const TimeInterval deadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), timeout);
+    int readyCount = 0;
+
+    if (count < 0 || count > kIOChannel_MaxPollCount) {
+        *pOutReadyCount = 0;
+        return EINVAL;
+    }
+
+    try(kalloc_cleared(__max(count, 1) * sizeof(IOChannelRef), (void**) &pChannels));
+    try(kalloc(__max(count, 1) * sizeof(PollEntry), (void**) &pPollEntries));
+    PollWaiter_Init(&waiter);
+
+    for (int i = 0; i < count; i++) {
+        PollEntry_Init(&pPollEntries[i], &waiter);
+        if (Process_CopyIOChannelForDescriptor(pProc, pEntries[i].ioc, &pChannels[i]) != EOK) {
+            pChannels[i] = NULL;
+        }
+    }
+
+    while (true) {
+        readyCount = 0;
+        for (int i = 0; i < count; i++) {
+            const int revents = (pChannels[i]) ? IOChannel_Poll(pChannels[i], pEntries[i].events, (mayWait) ? &pPollEntries[i] : NULL) : kPollEvent_Invalid;
+
+            pEntries[i].revents = revents;
+            if (revents != 0) {
+                readyCount++;
+            }
+        }
+
+        if (readyCount > 0 || !mayWait) {
+            break;
+        }
+
+        // All entries are on their poll queues now. A resource that changed
+        // state since we polled it has already signaled the waiter
+        const errno_t e1 = PollWaiter_Wait(&waiter, deadline);
+        if (e1 == ETIMEDOUT) {
+            break;
+        }
+        else if (e1 != EOK) {
+            err = e1;
+            break;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        PollQueue_Remove(&pPollEntries[i]);
+        Object_Release(pChannels[i]);
+    }
+    PollWaiter_Deinit(&waiter);
+
+catch:
+    kfree(pPollEntries);
+    kfree(pChannels);
+    *pOutReadyCount = (err == EOK) ? readyCount : 0;
+    return err;
+}
+
 // Returns EOK if the given file is accessible assuming the given access mode;
 // returns a suitable error otherwise. If the mode is 0, then a check whether the
 // file exists at all is executed.
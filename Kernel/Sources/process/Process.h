@@ -11,8 +11,11 @@
 
 #include <klib/klib.h>
 #include <filesystem/Filesystem.h>
+#include <System/DispatchQueue.h>
 #include <System/Process.h>
 
+struct _ExecutionStats;
+
 OPAQUE_CLASS(Process, Object);
 typedef struct _ProcessMethodTable {
     ObjectMethodTable   super;
@@ -69,6 +72,14 @@ extern UserId Process_GetRealUserId(ProcessRef _Nonnull pProc);
 // relative to the process address space.
 extern void* _Nonnull Process_GetArgumentsBaseAddress(ProcessRef _Nonnull pProc);
 
+// Returns the execution statistics of the process. The dispatch queues of the
+// process roll their statistics up into these statistics.
+extern struct _ExecutionStats* _Nonnull Process_GetExecutionStats(ProcessRef _Nonnull pProc);
+
+// Returns information about the process and its dispatch queues. Note that this
+// function does not fill in the 'nextPid' field.
+extern void Process_GetInfo(ProcessRef _Nonnull pProc, ProcessInfo* _Nonnull pOutInfo);
+
 // Spawns a new process that will be a child of the given process. The spawn
 // arguments specify how the child process should be created, which arguments
 // and environment it will receive and which descriptors it will inherit.
@@ -83,6 +94,18 @@ extern errno_t Process_DispatchUserClosure(ProcessRef _Nonnull pProc, int od, un
 // after the given deadline.
 extern errno_t Process_DispatchUserClosureAsyncAfter(ProcessRef _Nonnull pProc, int od, TimeInterval deadline, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext);
 
+// Dispatches the execution of the given user closure on the given dispatch queue
+// as a member of the given dispatch group.
+extern errno_t Process_DispatchUserClosureInGroup(ProcessRef _Nonnull pProc, int od, int gd, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext);
+
+// Dispatches the 'count' user closures in 'pWork' asynchronously on the given
+// dispatch queue.
+extern errno_t Process_DispatchUserClosureBatch(ProcessRef _Nonnull pProc, int od, const Dispatch_Work* _Nonnull pWork, size_t count);
+
+// Invokes the given user closure 'iterations' times on the given dispatch queue
+// and waits until all iterations have finished executing.
+extern errno_t Process_DispatchUserApply(ProcessRef _Nonnull pProc, int od, size_t iterations, Dispatch_ApplyClosure _Nonnull pUserClosure, void* _Nullable pContext);
+
 // Returns the dispatch queue associated with the virtual processor on which the
 // calling code is running. Note this function assumes that it will ALWAYS be
 // called from a system call context and thus the caller will necessarily run in
@@ -93,6 +116,30 @@ extern int Process_GetCurrentDispatchQueue(ProcessRef _Nonnull pProc);
 extern errno_t Process_CreateDispatchQueue(ProcessRef _Nonnull pProc, int minConcurrency, int maxConcurrency, int qos, int priority, int* _Nullable pOutDescriptor);
 
 
+// Creates a new dispatch group and binds it to the process.
+extern errno_t Process_CreateDispatchGroup(ProcessRef _Nonnull pProc, int* _Nonnull pOutDescriptor);
+
+// Enters or leaves the given dispatch group.
+extern errno_t Process_EnterLeaveDispatchGroup(ProcessRef _Nonnull pProc, int gd, bool isEnter);
+
+// Blocks the caller until the given dispatch group is empty.
+extern errno_t Process_WaitDispatchGroup(ProcessRef _Nonnull pProc, int gd, TimeInterval deadline);
+
+// Dispatches the given user closure on the given queue once the given dispatch
+// group is empty.
+extern errno_t Process_NotifyDispatchGroup(ProcessRef _Nonnull pProc, int gd, int od, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext);
+
+
+// Creates a new dispatch source which invokes the given user closure on the
+// given dispatch queue and binds it to the process.
+extern errno_t Process_CreateDispatchSource(ProcessRef _Nonnull pProc, int od, const Dispatch_SourceParams* _Nonnull pParams, Dispatch_SourceClosure _Nonnull pUserClosure, void* _Nullable pContext, int* _Nonnull pOutDescriptor);
+
+// Starts an asynchronous read or write of the I/O channel 'ioc' on the kernel
+// async I/O queue. The closure of the request is dispatched on the queue 'od'
+// once the I/O has finished.
+extern errno_t Process_ReadWriteAsync(ProcessRef _Nonnull pProc, int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest, bool isWrite);
+
+
 // Destroys the private resource identified by the given descriptor. The resource
 // is deallocated and removed from the resource table.
 extern errno_t Process_DisposePrivateResource(ProcessRef _Nonnull pProc, int od);
@@ -165,8 +212,8 @@ extern errno_t Process_CreateDirectory(ProcessRef _Nonnull pProc, const char* _N
 // the open directory.
 extern errno_t Process_OpenDirectory(ProcessRef _Nonnull pProc, const char* _Nonnull pPath, int* _Nonnull pOutDescriptor);
 
-// Creates an anonymous pipe.
-extern errno_t Process_CreatePipe(ProcessRef _Nonnull pProc, int* _Nonnull pOutReadChannel, int* _Nonnull pOutWriteChannel);
+// Creates an anonymous pipe with a buffer of (at least) 'bufferSize' bytes.
+extern errno_t Process_CreatePipe(ProcessRef _Nonnull pProc, size_t bufferSize, int* _Nonnull pOutReadChannel, int* _Nonnull pOutWriteChannel);
 
 // Returns information about the file at the given path.
 extern errno_t Process_GetFileInfo(ProcessRef _Nonnull pProc, const char* _Nonnull pPath, FileInfo* _Nonnull pOutInfo);
@@ -191,6 +238,11 @@ extern errno_t Process_TruncateFileFromIOChannel(ProcessRef _Nonnull pProc, int
 // resource identified by the given descriptor.
 extern errno_t Process_vIOControl(ProcessRef _Nonnull pProc, int fd, int cmd, va_list ap);
 
+// Waits until at least one of the I/O channels in 'pEntries' is ready for one
+// of the requested events or 'timeout' has elapsed. Updates the 'revents' field
+// of every entry and returns the number of ready entries.
+extern errno_t Process_Poll(ProcessRef _Nonnull pProc, IOChannelPollEntry* _Nonnull pEntries, int count, TimeInterval timeout, int* _Nonnull pOutReadyCount);
+
 // Returns EOK if the given file is accessible assuming the given access mode;
 // returns a suitable error otherwise. If the mode is 0, then a check whether the
 // file exists at all is executed.
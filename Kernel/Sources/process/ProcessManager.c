@@ -67,6 +67,25 @@ ProcessRef _Nullable ProcessManager_CopyProcessForPid(ProcessManagerRef _Nonnull
     return pProc;
 }
 
+// Returns the smallest PID of a registered process that is greater than 'pid'.
+// Returns 0 if no such process exists. This allows a caller to enumerate all
+// processes even while processes come and go.
+ProcessId ProcessManager_GetNextPid(ProcessManagerRef _Nonnull pManager, ProcessId pid)
+{
+    ProcessId nextPid = 0;
+
+    Lock_Lock(&pManager->lock);
+    for (int i = 0; i < ObjectArray_GetCount(&pManager->procs); i++) {
+        ProcessRef pCurProc = (ProcessRef) ObjectArray_GetAt(&pManager->procs, i);
+
+        if (pCurProc->pid > pid && (nextPid == 0 || pCurProc->pid < nextPid)) {
+            nextPid = pCurProc->pid;
+        }
+    }
+    Lock_Unlock(&pManager->lock);
+    return nextPid;
+}
+
 // Registers the given process with the process manager. Note that this function
 // does not validate whether the process is already registered or has a PID
 // that's equal to some other registered process.
@@ -37,6 +37,11 @@ extern ProcessRef _Nonnull ProcessManager_CopyRootProcess(ProcessManagerRef _Non
 // once no longer needed.
 extern ProcessRef _Nullable ProcessManager_CopyProcessForPid(ProcessManagerRef _Nonnull pManager, int pid);
 
+// Returns the smallest PID of a registered process that is greater than 'pid'.
+// Returns 0 if no such process exists. This allows a caller to enumerate all
+// processes even while processes come and go.
+extern ProcessId ProcessManager_GetNextPid(ProcessManagerRef _Nonnull pManager, ProcessId pid);
+
 
 // Registers the given process with the process manager. Note that this function
 // does not validate whether the process is already registered or has a PID
@@ -66,6 +66,9 @@ CLASS_IVARS(Process, Object,
     IntArray                        childPids;      // PIDs of all my child processes
     List                            tombstones;     // Tombstones of child processes that have terminated and have not yet been consumed by waitpid()
     ConditionVariable               tombstoneSignaler;
+
+    // Accounting
+    ExecutionStats                  stats;          // Accumulated execution statistics of all dispatch queues of the process
 );
 
 
@@ -89,6 +92,10 @@ extern void Process_DestroyAllTombstones_Locked(ProcessRef _Nonnull self);
 // Creates a new tombstone for the given child process with the given exit status
 extern errno_t Process_OnChildDidTerminate(ProcessRef _Nonnull self, ProcessId childPid, int childExitCode);
 
+// Invokes 'func' on every dispatch queue of the process. The process lock is
+// not held while 'func' executes.
+extern void Process_ForEachDispatchQueue(ProcessRef _Nonnull self, void (*func)(DispatchQueueRef _Nonnull));
+
 // Runs on the kernel main dispatch queue and terminates the given process.
 extern void _Process_DoTerminate(ProcessRef _Nonnull self);
 
@@ -191,7 +191,12 @@ errno_t Process_UnregisterPrivateResource(ProcessRef _Nonnull self, int od, Obje
 void Process_DisposeAllPrivateResources_Locked(ProcessRef _Nonnull self)
 {
     for (ssize_t desc = 0; desc < ObjectArray_GetCount(&self->privateResources); desc++) {
-        Object_Release(ObjectArray_GetAt(&self->privateResources, desc));
+        ObjectRef pResource = ObjectArray_GetAt(&self->privateResources, desc);
+
+        if (pResource && Object_InstanceOf(pResource, DispatchSource)) {
+            DispatchSource_Cancel((DispatchSourceRef) pResource);
+        }
+        Object_Release(pResource);
     }
 }
 
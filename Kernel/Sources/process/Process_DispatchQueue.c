@@ -9,7 +9,42 @@
 #include "ProcessPriv.h"
 #include <dispatcher/VirtualProcessorPool.h>
 #include <System/DispatchQueue.h>
+#include <System/IOChannel.h>
 
+// Max number of user closures of a batch that are copied to the stack. Larger
+// batches are copied to a temporary kernel buffer
+#define kMaxDispatchBatchStackCount 16
+
+
+// Invokes 'func' on every dispatch queue of the process. The process lock is
+// not held while 'func' executes.
+void Process_ForEachDispatchQueue(ProcessRef _Nonnull pProc, void (*func)(DispatchQueueRef _Nonnull))
+{
+    for (int od = 0; ; od++) {
+        ObjectRef pResource = NULL;
+        bool isDone;
+
+        Lock_Lock(&pProc->lock);
+        isDone = (od >= ObjectArray_GetCount(&pProc->privateResources));
+        if (!isDone) {
+            pResource = ObjectArray_GetAt(&pProc->privateResources, od);
+            if (pResource && Object_InstanceOf(pResource, DispatchQueue)) {
+                Object_Retain(pResource);
+            } else {
+                pResource = NULL;
+            }
+        }
+        Lock_Unlock(&pProc->lock);
+
+        if (isDone) {
+            break;
+        }
+        if (pResource) {
+            func((DispatchQueueRef) pResource);
+            Object_Release(pResource);
+        }
+    }
+}
 
 // Creates a new dispatch queue and binds it to the process.
 errno_t Process_CreateDispatchQueue(ProcessRef _Nonnull pProc, int minConcurrency, int maxConcurrency, int qos, int priority, int* _Nullable pOutDescriptor)
@@ -66,10 +101,24 @@ errno_t Process_DispatchUserClosure(ProcessRef _Nonnull pProc, int od, unsigned
     // else would be able to do a system call anymore.
     if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
         if (Object_InstanceOf(pQueue, DispatchQueue)) {
-            if ((options & kDispatchOption_Sync) == kDispatchOption_Sync) {
-                err = DispatchQueue_DispatchSync(pQueue, DispatchQueueClosure_MakeUser(pUserClosure, pContext));
-            } else {
-                err = DispatchQueue_DispatchAsync(pQueue, DispatchQueueClosure_MakeUser(pUserClosure, pContext));
+            const DispatchQueueClosure closure = DispatchQueueClosure_MakeUser(pUserClosure, pContext);
+
+            switch (options & (kDispatchOption_Sync | kDispatchOption_Barrier)) {
+                case kDispatchOption_Sync:
+                    err = DispatchQueue_DispatchSync(pQueue, closure);
+                    break;
+
+                case kDispatchOption_Barrier:
+                    err = DispatchQueue_DispatchBarrierAsync(pQueue, closure);
+                    break;
+
+                case kDispatchOption_Sync | kDispatchOption_Barrier:
+                    err = DispatchQueue_DispatchBarrierSync(pQueue, closure);
+                    break;
+
+                default:
+                    err = DispatchQueue_DispatchAsync(pQueue, closure);
+                    break;
             }
         } else {
             err = EBADF;
@@ -79,6 +128,166 @@ errno_t Process_DispatchUserClosure(ProcessRef _Nonnull pProc, int od, unsigned
     return err;
 }
 
+// Looks up the dispatch group for the given descriptor and returns a strong
+// reference to it.
+static errno_t Process_CopyDispatchGroupForDescriptor(ProcessRef _Nonnull pProc, int gd, DispatchGroupRef _Nullable * _Nonnull pOutGroup)
+{
+    decl_try_err();
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, gd, (ObjectRef*) pOutGroup)) == EOK) {
+        if (!Object_InstanceOf(*pOutGroup, DispatchGroup)) {
+            Object_Release(*pOutGroup);
+            *pOutGroup = NULL;
+            err = EBADF;
+        }
+    }
+    return err;
+}
+
+// Dispatches the execution of the given user closure on the given dispatch queue
+// as a member of the given dispatch group.
+errno_t Process_DispatchUserClosureInGroup(ProcessRef _Nonnull pProc, int od, int gd, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue = NULL;
+    DispatchGroupRef pGroup = NULL;
+
+    try(Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue));
+    if (!Object_InstanceOf(pQueue, DispatchQueue)) {
+        throw(EBADF);
+    }
+    try(Process_CopyDispatchGroupForDescriptor(pProc, gd, &pGroup));
+    err = DispatchQueue_DispatchGroupAsync(pQueue, pGroup, DispatchQueueClosure_MakeUser(pUserClosure, pContext));
+
+catch:
+    Object_Release(pGroup);
+    Object_Release(pQueue);
+    return err;
+}
+
+// Creates a new dispatch group and binds it to the process.
+errno_t Process_CreateDispatchGroup(ProcessRef _Nonnull pProc, int* _Nonnull pOutDescriptor)
+{
+    decl_try_err();
+    DispatchGroupRef pGroup = NULL;
+
+    Lock_Lock(&pProc->lock);
+
+    *pOutDescriptor = -1;
+    try(DispatchGroup_Create(&pGroup));
+    try(Process_RegisterPrivateResource_Locked(pProc, (ObjectRef) pGroup, pOutDescriptor));
+
+catch:
+    Object_Release(pGroup);
+    Lock_Unlock(&pProc->lock);
+    return err;
+}
+
+// Enters or leaves the given dispatch group.
+errno_t Process_EnterLeaveDispatchGroup(ProcessRef _Nonnull pProc, int gd, bool isEnter)
+{
+    decl_try_err();
+    DispatchGroupRef pGroup;
+
+    if ((err = Process_CopyDispatchGroupForDescriptor(pProc, gd, &pGroup)) == EOK) {
+        if (isEnter) {
+            DispatchGroup_Enter(pGroup);
+        } else {
+            err = DispatchGroup_Leave(pGroup);
+        }
+        Object_Release(pGroup);
+    }
+    return err;
+}
+
+// Blocks the caller until the given dispatch group is empty.
+errno_t Process_WaitDispatchGroup(ProcessRef _Nonnull pProc, int gd, TimeInterval deadline)
+{
+    decl_try_err();
+    DispatchGroupRef pGroup;
+
+    if ((err = Process_CopyDispatchGroupForDescriptor(pProc, gd, &pGroup)) == EOK) {
+        err = DispatchGroup_Wait(pGroup, deadline);
+        Object_Release(pGroup);
+    }
+    return err;
+}
+
+// Dispatches the given user closure on the given queue once the given dispatch
+// group is empty.
+errno_t Process_NotifyDispatchGroup(ProcessRef _Nonnull pProc, int gd, int od, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext)
+{
+    decl_try_err();
+    DispatchGroupRef pGroup = NULL;
+    DispatchQueueRef pQueue = NULL;
+
+    try(Process_CopyDispatchGroupForDescriptor(pProc, gd, &pGroup));
+    try(Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue));
+    if (!Object_InstanceOf(pQueue, DispatchQueue)) {
+        throw(EBADF);
+    }
+    err = DispatchGroup_Notify(pGroup, pQueue, DispatchQueueClosure_MakeUser(pUserClosure, pContext));
+
+catch:
+    Object_Release(pQueue);
+    Object_Release(pGroup);
+    return err;
+}
+
+// Dispatches the 'count' user closures in 'pWork' asynchronously on the given
+// dispatch queue. The whole batch is copied into the kernel and handed to the
+// queue in one go. Either all closures are enqueued or none of them is. Small
+// batches are copied to the stack and larger ones to a temporary kernel buffer.
+errno_t Process_DispatchUserClosureBatch(ProcessRef _Nonnull pProc, int od, const Dispatch_Work* _Nonnull pWork, size_t count)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue = NULL;
+    DispatchQueueClosure stackClosures[kMaxDispatchBatchStackCount];
+    DispatchQueueClosure* pClosures = stackClosures;
+
+    if (count > INT_MAX) {
+        return EINVAL;
+    }
+
+    try(Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue));
+    if (!Object_InstanceOf(pQueue, DispatchQueue)) {
+        throw(EBADF);
+    }
+
+    if (count > kMaxDispatchBatchStackCount) {
+        try(kalloc(sizeof(DispatchQueueClosure) * count, (void**) &pClosures));
+    }
+    for (size_t i = 0; i < count; i++) {
+        pClosures[i] = DispatchQueueClosure_MakeUser((Closure1Arg_Func)pWork[i].func, pWork[i].context);
+    }
+    err = DispatchQueue_DispatchAsyncBatch(pQueue, pClosures, (int) count);
+
+catch:
+    if (pClosures != stackClosures) {
+        kfree(pClosures);
+    }
+    Object_Release(pQueue);
+    return err;
+}
+
+// Invokes the given user closure 'iterations' times on the given dispatch queue
+// and waits until all iterations have finished executing.
+errno_t Process_DispatchUserApply(ProcessRef _Nonnull pProc, int od, size_t iterations, Dispatch_ApplyClosure _Nonnull pUserClosure, void* _Nullable pContext)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue;
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
+        if (Object_InstanceOf(pQueue, DispatchQueue)) {
+            err = DispatchQueue_Apply(pQueue, iterations, DispatchQueueApplyClosure_MakeUser((DispatchQueueApply_Func)pUserClosure, pContext));
+        } else {
+            err = EBADF;
+        }
+        Object_Release(pQueue);
+    }
+    return err;
+}
+
 // Dispatches the execution of the given user closure on the given dispatch queue
 // after the given deadline.
 errno_t Process_DispatchUserClosureAsyncAfter(ProcessRef _Nonnull pProc, int od, TimeInterval deadline, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext)
@@ -99,3 +308,229 @@ errno_t Process_DispatchUserClosureAsyncAfter(ProcessRef _Nonnull pProc, int od,
     }
     return err;
 }
+
+// Creates a new dispatch source which invokes the given user closure on the
+// given dispatch queue and binds it to the process.
+errno_t Process_CreateDispatchSource(ProcessRef _Nonnull pProc, int od, const Dispatch_SourceParams* _Nonnull pParams, Dispatch_SourceClosure _Nonnull pUserClosure, void* _Nullable pContext, int* _Nonnull pOutDescriptor)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue = NULL;
+    IOChannelRef pChannel = NULL;
+    DispatchSourceRef pSource = NULL;
+    const DispatchSourceClosure closure = DispatchSourceClosure_MakeUser((DispatchSource_Func)pUserClosure, pContext);
+
+    *pOutDescriptor = -1;
+    try(Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue));
+    if (!Object_InstanceOf(pQueue, DispatchQueue)) {
+        throw(EBADF);
+    }
+
+    switch (pParams->type) {
+        case kDispatchSourceType_IOChannel:
+            try(Process_CopyIOChannelForDescriptor(pProc, pParams->ioc, &pChannel));
+            try(DispatchSource_CreateIOChannel(pChannel, pParams->events, pQueue, closure, &pSource));
+            break;
+
+        case kDispatchSourceType_Timer:
+            try(DispatchSource_CreateTimer(pParams->deadline, pParams->interval, pQueue, closure, &pSource));
+            break;
+
+        default:
+            throw(EINVAL);
+    }
+
+    Lock_Lock(&pProc->lock);
+    err = Process_RegisterPrivateResource_Locked(pProc, (ObjectRef) pSource, pOutDescriptor);
+    Lock_Unlock(&pProc->lock);
+    if (err != EOK) {
+        DispatchSource_Cancel(pSource);
+    }
+
+catch:
+    Object_Release(pSource);
+    Object_Release(pChannel);
+    Object_Release(pQueue);
+    return err;
+}
+
+
+// An asynchronous read or write which executes on the kernel async I/O queue.
+// The parameters are copied out of the user request when the request is
+// started. The results are written back to the user request.
+typedef struct _AsyncIORequest {
+    SListNode                           node;           // Entry in the file's list of pending requests at the current position
+    IOChannelRef _Nullable              channel;        // strong reference
+    DispatchQueueRef _Nullable          queue;          // Completion queue (strong reference)
+    IOChannelAsyncRequest* _Nonnull     userRequest;
+    void* _Nonnull                      buffer;
+    ssize_t                             nBytes;
+    FileOffset                          offset;
+    IOChannel_AsyncClosure _Nonnull     closure;
+    bool                                isWrite;
+} AsyncIORequest;
+
+static void AsyncIORequest_Destroy(AsyncIORequest* _Nullable pReq)
+{
+    if (pReq) {
+        Object_Release(pReq->channel);
+        pReq->channel = NULL;
+        Object_Release(pReq->queue);
+        pReq->queue = NULL;
+        kfree(pReq);
+    }
+}
+
+// Executes the read or write of the request. A request with an absolute offset
+// executes on a private copy of the file. This way the position of the shared
+// channel stays put and concurrent requests for the same file don't race.
+static errno_t AsyncIORequest_Transfer(AsyncIORequest* _Nonnull pReq, ssize_t* _Nonnull pOutBytesTransferred)
+{
+    decl_try_err();
+    IOChannelRef pChannel = pReq->channel;
+    FileRef pFile = NULL;
+
+    *pOutBytesTransferred = 0;
+    if (pReq->offset != kIOChannel_CurrentPosition) {
+        try(File_CreateCopy((FileRef) pReq->channel, &pFile));
+        try(IOChannel_Seek((IOChannelRef) pFile, pReq->offset, NULL, SEEK_SET));
+        pChannel = (IOChannelRef) pFile;
+    }
+
+    if (pReq->isWrite) {
+        err = IOChannel_Write(pChannel, pReq->buffer, pReq->nBytes, pOutBytesTransferred);
+    } else {
+        err = IOChannel_Read(pChannel, pReq->buffer, pReq->nBytes, pOutBytesTransferred);
+    }
+
+catch:
+    if (pFile) {
+        IOChannel_Close((IOChannelRef) pFile);
+        Object_Release(pFile);
+    }
+    return err;
+}
+
+// Executes on the kernel async I/O queue. Performs the I/O and then dispatches
+// the user closure on the completion queue. The completion is dropped if the
+// completion queue has been terminated in the meantime.
+static void AsyncIORequest_Perform(AsyncIORequest* _Nonnull pReq)
+{
+    ssize_t nBytesTransferred;
+    const errno_t err = AsyncIORequest_Transfer(pReq, &nBytesTransferred);
+
+    pReq->userRequest->nBytesTransferred = nBytesTransferred;
+    pReq->userRequest->error = err;
+
+    (void) DispatchQueue_DispatchAsync(pReq->queue, DispatchQueueClosure_MakeUser((Closure1Arg_Func)pReq->closure, pReq->userRequest));
+}
+
+// Executes a request with an absolute offset on the kernel async I/O queue.
+static void AsyncIORequest_PerformAndDestroy(AsyncIORequest* _Nonnull pReq)
+{
+    AsyncIORequest_Perform(pReq);
+    AsyncIORequest_Destroy(pReq);
+}
+
+// Executes the pending requests at the current position of a file one after
+// the other on the kernel async I/O queue. 'pFirstReq' is the first request in
+// the file's list of pending requests. A request stays on the list while it is
+// executing so that new requests know that they have to queue up behind it.
+// Requests of different files execute concurrently.
+static void AsyncIORequest_PerformPending(AsyncIORequest* _Nonnull pFirstReq)
+{
+    FileRef pFile = (FileRef) pFirstReq->channel;
+    AsyncIORequest* pReq = pFirstReq;
+
+    while (pReq) {
+        AsyncIORequest_Perform(pReq);
+
+        // The next request holds its own reference to the file. Destroying the
+        // current request may drop the last reference if there is none
+        Lock_Lock(&pFile->asyncLock);
+        SList_RemoveFirst(&pFile->asyncRequests);
+        AsyncIORequest* pNextReq = (AsyncIORequest*) pFile->asyncRequests.first;
+        Lock_Unlock(&pFile->asyncLock);
+
+        AsyncIORequest_Destroy(pReq);
+        pReq = pNextReq;
+    }
+}
+
+// Queues a request at the current position of a file behind the pending
+// requests of the same file. Starts the execution of the pending requests if
+// there weren't any before.
+static errno_t AsyncIORequest_EnqueuePending(AsyncIORequest* _Nonnull pReq)
+{
+    decl_try_err();
+    FileRef pFile = (FileRef) pReq->channel;
+
+    Lock_Lock(&pFile->asyncLock);
+    const bool isIdle = SList_IsEmpty(&pFile->asyncRequests);
+    SList_InsertAfterLast(&pFile->asyncRequests, &pReq->node);
+
+    if (isIdle) {
+        err = DispatchQueue_DispatchAsync(gAsyncIODispatchQueue, DispatchQueueClosure_Make((Closure1Arg_Func)AsyncIORequest_PerformPending, pReq));
+        if (err != EOK) {
+            SList_RemoveFirst(&pFile->asyncRequests);
+        }
+    }
+    Lock_Unlock(&pFile->asyncLock);
+
+    return err;
+}
+
+// Starts an asynchronous read or write of the I/O channel 'ioc' on the kernel
+// async I/O queue. The closure of the request is dispatched on the queue 'od'
+// once the I/O has finished. Requests with an absolute offset may execute
+// concurrently. Requests at the current position of a channel execute one
+// after the other in the order in which they were started because each of them
+// depends on where the previous one left the position. Requests at the current
+// position of different channels execute concurrently.
+errno_t Process_ReadWriteAsync(ProcessRef _Nonnull pProc, int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest, bool isWrite)
+{
+    decl_try_err();
+    AsyncIORequest* pReq = NULL;
+
+    if (pRequest->closure == NULL || (pRequest->buffer == NULL && pRequest->nBytes > 0)
+        || (pRequest->offset < 0 && pRequest->offset != kIOChannel_CurrentPosition)) {
+        return EINVAL;
+    }
+
+    try(kalloc_cleared(sizeof(AsyncIORequest), (void**) &pReq));
+    SListNode_Init(&pReq->node);
+
+    // The request holds on to the completion queue. The descriptor may be
+    // closed or reused for another queue before the I/O finishes
+    try(Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pReq->queue));
+    if (!Object_InstanceOf(pReq->queue, DispatchQueue)) {
+        throw(EBADF);
+    }
+
+    try(Process_CopyIOChannelForDescriptor(pProc, ioc, &pReq->channel));
+    if ((IOChannel_GetMode(pReq->channel) & ((isWrite) ? kOpen_Write : kOpen_Read)) == 0) {
+        throw(EBADF);
+    }
+    // Only file I/O is guaranteed to finish. A read from a pipe or a terminal
+    // may block forever and it would tie up a VP of the async I/O queue
+    if (!Object_InstanceOf(pReq->channel, File)) {
+        throw(ESPIPE);
+    }
+
+    pReq->userRequest = pRequest;
+    pReq->buffer = pRequest->buffer;
+    pReq->nBytes = __SSizeByClampingSize(pRequest->nBytes);
+    pReq->offset = pRequest->offset;
+    pReq->closure = pRequest->closure;
+    pReq->isWrite = isWrite;
+
+    if (pReq->offset == kIOChannel_CurrentPosition) {
+        try(AsyncIORequest_EnqueuePending(pReq));
+    } else {
+        try(DispatchQueue_DispatchAsync(gAsyncIODispatchQueue, DispatchQueueClosure_Make((Closure1Arg_Func)AsyncIORequest_PerformAndDestroy, pReq)));
+    }
+    pReq = NULL;
+
+catch:
+    AsyncIORequest_Destroy(pReq);
+    return err;
+}
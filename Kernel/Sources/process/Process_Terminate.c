@@ -194,11 +194,18 @@ void _Process_DoTerminate(ProcessRef _Nonnull pProc)
 
     // Terminate all dispatch queues. This takes care of aborting user space
     // invocations.
-    DispatchQueue_Terminate(pProc->mainDispatchQueue);
+    Process_ForEachDispatchQueue(pProc, DispatchQueue_Terminate);
 
 
-    // Wait for all dispatch queues to have reached 'terminated' state
-    DispatchQueue_WaitForTerminationCompleted(pProc->mainDispatchQueue);
+    // Wait for all dispatch queues to have reached 'terminated' state. No queue
+    // of the process executes a closure from here on. So the queues can be
+    // safely deallocated when the process releases its private resources
+    Process_ForEachDispatchQueue(pProc, DispatchQueue_WaitForTerminationCompleted);
+
+
+    // Take back the dispatch sources whose closure was flushed from one of our
+    // queues after the source had been cancelled
+    DispatchSource_ReclaimFlushed();
 
 
     // Terminate all my children and wait for them to be dead
@@ -15,6 +15,8 @@
 #include <driver/InterruptController.h>
 #include <driver/MonotonicClock.h>
 #include <driver/RamDisk.h>
+#include <filesystem/BlockCache.h>
+#include <filesystem/DirectoryCache.h>
 #include <filesystem/FilesystemManager.h>
 #include <filesystem/serenafs/SerenaFS.h>
 #include <hal/Platform.h>
@@ -22,6 +24,21 @@
 #include <process/ProcessManager.h>
 #include "BootAllocator.h"
 
+// Kernel heap boot options. Set to KALLOC_INIT_OPTION_SIZE_CLASS_STATS to get a
+// report of the kernel heap size class occupancy at boot time.
+#define kKallocBootOptions  0
+
+// Monotonic clock boot options. Set to MONOTONIC_CLOCK_OPTION_TICKLESS to only
+// take a quantum timer interrupt when the next timeout or time slice expires
+// instead of taking one every quantum.
+#define kMonotonicClockBootOptions  0
+
+// Maximum number of bytes that the disk block cache should use
+#define kBlockCacheMaxByteSize  SIZE_KB(32)
+
+// Maximum number of names that the directory name lookup cache should remember
+#define kDirectoryCacheCapacity 128
+
 extern char _text, _etext, _data, _edata, _bss, _ebss;
 static char* gInitialHeapBottom;
 static char* gInitialHeapTop;
@@ -90,7 +107,7 @@ _Noreturn OnBoot(SystemDescription* _Nonnull pSysDesc)
 static _Noreturn OnStartup(const SystemDescription* _Nonnull pSysDesc)
 {
     // Initialize the kernel heap
-    try_bang(kalloc_init(pSysDesc, gInitialHeapBottom, gInitialHeapTop));
+    try_bang(kalloc_init(pSysDesc, gInitialHeapBottom, gInitialHeapTop, kKallocBootOptions));
     
 
     // Initialize the interrupt controller
@@ -98,7 +115,7 @@ static _Noreturn OnStartup(const SystemDescription* _Nonnull pSysDesc)
 
     
     // Initialize the monotonic clock
-    try_bang(MonotonicClock_CreateForLocalCPU(pSysDesc));
+    try_bang(MonotonicClock_CreateForLocalCPU(pSysDesc, kMonotonicClockBootOptions));
 
     
     // Inform the scheduler that the heap exists now and that it should finish
@@ -112,6 +129,8 @@ static _Noreturn OnStartup(const SystemDescription* _Nonnull pSysDesc)
     
     // Initialize the dispatch queue services
     try_bang(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, 0, gVirtualProcessorPool, NULL, (DispatchQueueRef*)&gMainDispatchQueue));
+    try_bang(DispatchQueue_Create(0, 4, kDispatchQos_Utility, kDispatchPriority_Normal, gVirtualProcessorPool, NULL, (DispatchQueueRef*)&gAsyncIODispatchQueue));
+    try_bang(DispatchSource_InitServices());
     
     
     // Enable interrupts
@@ -141,7 +160,7 @@ static void _Nonnull init_boot_filesystem(void)
     const FilePermissions dirPerms = FilePermissions_Make(ownerPerms, otherPerms, otherPerms);
     User dirUser = {kRootUserId, kRootGroupId};
 
-    try(RamDisk_Create(512, 128, 128, &pRamDisk));
+    try(RamDisk_Create(512, 2048, 128, &pRamDisk));
     try(SerenaFS_FormatDrive((DiskDriverRef)pRamDisk, dirUser, dirPerms));
 
 
@@ -190,11 +209,22 @@ static void OnMain(void)
     krt_init();
     
 
+    // Create the disk block and directory name lookup caches
+    try_bang(BlockCache_Create(kBlockCacheMaxByteSize, &gBlockCache));
+    try_bang(DirectoryCache_Create(kDirectoryCacheCapacity, &gDirectoryCache));
+
+
     // Figure out what boot filesystem to use and initialize the filesystem
     // manager with it.
     init_boot_filesystem();
 
 
+    // Report the kernel heap state if requested
+    if ((kKallocBootOptions & KALLOC_INIT_OPTION_SIZE_CLASS_STATS) != 0) {
+        kalloc_dump();
+    }
+
+
     // Create the root process
     ProcessRef pRootProc;
     try_bang(RootProcess_Create(&pRootProc));
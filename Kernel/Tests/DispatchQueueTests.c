@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <System/System.h>
+#include "Asserts.h"
 
 // XXX
 // XXX Port these to user space (was written for kernel space originally)
@@ -313,3 +314,327 @@ void DispatchQueue_RunTests(void)
 
 }
 #endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Timer stress
+////////////////////////////////////////////////////////////////////////////////
+
+#define TIMER_STRESS_COUNT          1000
+#define TIMER_STRESS_SOURCE_COUNT   64
+
+typedef struct TimerStressState {
+    TimeInterval    deadlines[TIMER_STRESS_COUNT];
+    volatile int8_t fired[TIMER_STRESS_COUNT];
+    volatile int8_t sourceFired[TIMER_STRESS_SOURCE_COUNT];
+    int             sources[TIMER_STRESS_SOURCE_COUNT];
+    int64_t         worstLatencyUsec;
+    volatile int    firedCount;
+    volatile int    sourceFiredCount;
+    TimeInterval    lastTraceTime;
+    int             readyCount;
+    int64_t         worstReadyLatencyUsec;
+    TraceEvent      events[kTrace_MaxEventCount];
+} TimerStressState;
+
+static TimerStressState gTimerStress;
+
+
+static int64_t elapsed_usec(TimeInterval t0, TimeInterval t1)
+{
+    return ((int64_t)t1.tv_sec - (int64_t)t0.tv_sec) * 1000000ll + ((int64_t)t1.tv_nsec - (int64_t)t0.tv_nsec) / 1000ll;
+}
+
+static void OnStressTimerFired(void* _Nullable pContext)
+{
+    const TimeInterval now = MonotonicClock_GetTime();
+    const int i = (int)pContext;
+    const int64_t latencyUsec = elapsed_usec(gTimerStress.deadlines[i], now);
+
+    if (latencyUsec > gTimerStress.worstLatencyUsec) {
+        gTimerStress.worstLatencyUsec = latencyUsec;
+    }
+    gTimerStress.fired[i]++;
+    gTimerStress.firedCount++;
+}
+
+static void OnStressSourceFired(void* _Nullable pContext, unsigned int count)
+{
+    gTimerStress.sourceFired[(int)pContext]++;
+    gTimerStress.sourceFiredCount++;
+}
+
+// Picks up the timer-due events that the kernel recorded since the last call.
+// A timer-due event is recorded when a timer is taken off the timer wheel of
+// its queue and it carries the number of microseconds that the timer was late
+// at this point. Timers of other queues are filtered out by checking that the
+// deadline of the timer falls into the 2s to 4s window after 't0' that the
+// stress timers use.
+static void collect_timer_due_events(TimeInterval t0)
+{
+    size_t count;
+
+    assertOK(Trace_Snapshot(gTimerStress.events, kTrace_MaxEventCount, &count));
+    for (size_t i = 0; i < count; i++) {
+        const TraceEvent* pEvent = &gTimerStress.events[i];
+
+        if (pEvent->type != kTraceEvent_DispatchTimerDue || TimeInterval_LessEquals(pEvent->time, gTimerStress.lastTraceTime)) {
+            continue;
+        }
+
+        const int64_t deadlineUsec = elapsed_usec(t0, pEvent->time) - (int64_t)pEvent->arg1;
+        if (deadlineUsec < 2000000ll || deadlineUsec >= 4000000ll) {
+            continue;
+        }
+
+        if ((int64_t)pEvent->arg1 > gTimerStress.worstReadyLatencyUsec) {
+            gTimerStress.worstReadyLatencyUsec = pEvent->arg1;
+        }
+        gTimerStress.readyCount++;
+    }
+
+    if (count > 0) {
+        gTimerStress.lastTraceTime = gTimerStress.events[count - 1].time;
+    }
+}
+
+// Arms TIMER_STRESS_COUNT timers on two serial queues. The timers on the second
+// queue are cancelled by destroying the queue before they come due. Every other
+// one of TIMER_STRESS_SOURCE_COUNT timer sources is cancelled individually.
+// Checks that every timer that wasn't cancelled fired exactly once and that no
+// cancelled timer fired. Prints how long it took to arm the timers, the worst
+// case latency from a timer deadline to the point where the timer is taken off
+// the timer wheel and becomes ready to execute and the worst case latency from
+// a timer deadline to the execution of the timer closure.
+void timer_stress_test(int argc, char *argv[])
+{
+    int firingQueue, cancelledQueue;
+
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &firingQueue));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Utility, kDispatchPriority_Normal, &cancelledQueue));
+    memset(&gTimerStress, 0, sizeof(gTimerStress));
+    assertOK(Trace_SetEnabled(true));
+
+    // Spread the deadlines over a couple of seconds and arm them in an order
+    // that doesn't match the deadline order
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    gTimerStress.lastTraceTime = t0;
+    for (int i = 0; i < TIMER_STRESS_COUNT; i++) {
+        const int64_t offsetUsec = 2000000ll + ((i * 7919) % 2000) * 1000ll;
+        const int64_t nsec = (int64_t)t0.tv_nsec + (offsetUsec % 1000000ll) * 1000ll;
+
+        gTimerStress.deadlines[i] = TimeInterval_Make(t0.tv_sec + offsetUsec / 1000000ll + nsec / 1000000000ll, nsec % 1000000000ll);
+        if ((i & 1) == 0) {
+            assertOK(DispatchQueue_DispatchAsyncAfter(firingQueue, gTimerStress.deadlines[i], OnStressTimerFired, (void*)i));
+        } else {
+            assertOK(DispatchQueue_DispatchAsyncAfter(cancelledQueue, gTimerStress.deadlines[i], OnStressTimerFired, (void*)i));
+        }
+    }
+    const TimeInterval t1 = MonotonicClock_GetTime();
+
+    assertOK(DispatchQueue_Destroy(cancelledQueue));
+    const TimeInterval t2 = MonotonicClock_GetTime();
+
+
+    // One-shot timer sources which share their deadlines with the queue timers
+    for (int i = 0; i < TIMER_STRESS_SOURCE_COUNT; i++) {
+        assertOK(DispatchSource_CreateTimer(firingQueue, gTimerStress.deadlines[i * (TIMER_STRESS_COUNT / TIMER_STRESS_SOURCE_COUNT)], kTimeInterval_Zero, OnStressSourceFired, (void*)i, &gTimerStress.sources[i]));
+    }
+    for (int i = 1; i < TIMER_STRESS_SOURCE_COUNT; i += 2) {
+        assertOK(DispatchSource_Destroy(gTimerStress.sources[i]));
+    }
+
+
+    while (gTimerStress.firedCount < TIMER_STRESS_COUNT / 2 || gTimerStress.sourceFiredCount < TIMER_STRESS_SOURCE_COUNT / 2) {
+        Delay(TimeInterval_MakeMilliseconds(100));
+        collect_timer_due_events(t0);
+    }
+
+    // Give a cancelled timer that fires late a chance to show up
+    Delay(TimeInterval_MakeMilliseconds(200));
+    collect_timer_due_events(t0);
+    assertOK(Trace_SetEnabled(false));
+
+    for (int i = 0; i < TIMER_STRESS_COUNT; i++) {
+        assertEquals(((i & 1) == 0) ? 1 : 0, gTimerStress.fired[i]);
+    }
+    for (int i = 0; i < TIMER_STRESS_SOURCE_COUNT; i++) {
+        assertEquals(((i & 1) == 0) ? 1 : 0, gTimerStress.sourceFired[i]);
+    }
+    assertEquals(TIMER_STRESS_COUNT / 2, gTimerStress.firedCount);
+    assertEquals(true, gTimerStress.readyCount > 0 && gTimerStress.readyCount <= TIMER_STRESS_COUNT / 2);
+
+    for (int i = 0; i < TIMER_STRESS_SOURCE_COUNT; i += 2) {
+        assertOK(DispatchSource_Destroy(gTimerStress.sources[i]));
+    }
+    assertOK(DispatchQueue_Destroy(firingQueue));
+
+    printf("armed:         %d timers in %lld us\n", TIMER_STRESS_COUNT, elapsed_usec(t0, t1));
+    printf("cancelled:     %d timers in %lld us\n", TIMER_STRESS_COUNT / 2, elapsed_usec(t1, t2));
+    printf("traced:        %d of %d timers\n", gTimerStress.readyCount, TIMER_STRESS_COUNT / 2);
+    printf("worst ready latency: %lld us\n", gTimerStress.worstReadyLatencyUsec);
+    printf("worst exec latency:  %lld us\n", gTimerStress.worstLatencyUsec);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Monotonic clock
+////////////////////////////////////////////////////////////////////////////////
+
+// The scheduler clock takes at least one interrupt to end a 100ms delay in
+// periodic and in tickless mode. Compare the printed count of the two modes to
+// see how many interrupts the tickless mode saves.
+void clock_info_test(int argc, char *argv[])
+{
+    MonotonicClockInfo info0, info1;
+
+    assertOK(MonotonicClock_GetInfo(&info0));
+    Delay(TimeInterval_MakeMilliseconds(100));
+    assertOK(MonotonicClock_GetInfo(&info1));
+
+    assertEquals(info0.isTickless, info1.isTickless);
+    assertEquals(true, info1.interruptCount > info0.interruptCount);
+    printf("%s: %lu clock interrupts in 100ms\n", (info1.isTickless) ? "tickless" : "periodic", (unsigned long)(info1.interruptCount - info0.interruptCount));
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: DispatchSync round trip
+////////////////////////////////////////////////////////////////////////////////
+
+#define SYNC_BENCHMARK_COUNT    10000
+
+static void OnSyncBenchmarkClosure(void* _Nullable pContext)
+{
+    (*(volatile int*)pContext)++;
+}
+
+// Measures the average round trip time of a DispatchSync() of an empty closure
+// on an idle serial queue. User closures always go through the queue VP. The
+// kernel benchmark compares the inline fast path for kernel closures with the
+// queued path.
+void dispatch_sync_benchmark(int argc, char *argv[])
+{
+    volatile int count = 0;
+    int queue;
+
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+
+    // Warm up the queue so that it has a VP and cached work items
+    assertOK(DispatchQueue_DispatchSync(queue, OnSyncBenchmarkClosure, (void*)&count));
+
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    for (int i = 0; i < SYNC_BENCHMARK_COUNT; i++) {
+        assertOK(DispatchQueue_DispatchSync(queue, OnSyncBenchmarkClosure, (void*)&count));
+    }
+    const TimeInterval t1 = MonotonicClock_GetTime();
+
+    assertEquals(SYNC_BENCHMARK_COUNT + 1, count);
+    assertOK(DispatchQueue_Destroy(queue));
+
+    const int64_t usec = elapsed_usec(t0, t1);
+    printf("sync:        %d round trips in %lld us (%lld ns each)\n", SYNC_BENCHMARK_COUNT, usec, (usec * 1000ll) / SYNC_BENCHMARK_COUNT);
+
+#if DEBUG
+    TimeInterval inlineTime, queuedTime;
+
+    assertOK(DispatchQueue_BenchmarkSync(SYNC_BENCHMARK_COUNT, &inlineTime, &queuedTime));
+    const int64_t inlineUsec = elapsed_usec(kTimeInterval_Zero, inlineTime);
+    const int64_t queuedUsec = elapsed_usec(kTimeInterval_Zero, queuedTime);
+    printf("kernel sync: %d inline round trips in %lld us (%lld ns each)\n", SYNC_BENCHMARK_COUNT, inlineUsec, (inlineUsec * 1000ll) / SYNC_BENCHMARK_COUNT);
+    printf("kernel sync: %d queued round trips in %lld us (%lld ns each)\n", SYNC_BENCHMARK_COUNT, queuedUsec, (queuedUsec * 1000ll) / SYNC_BENCHMARK_COUNT);
+#endif
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Concurrent DispatchAsync throughput
+////////////////////////////////////////////////////////////////////////////////
+
+#define CONCURRENT_BENCHMARK_COUNT  10000
+#define CONCURRENT_BENCHMARK_LANES  4
+
+static void OnConcurrentBenchmarkClosure(void* _Nullable pContext)
+{
+}
+
+// Measures how long it takes to dispatch and execute a large number of empty
+// closures on a concurrent queue. The closures are spread across the lanes of
+// the queue and the lane VPs steal from each other once their own lane is empty.
+void concurrent_dispatch_benchmark(int argc, char *argv[])
+{
+    int queue, group;
+
+    assertOK(DispatchQueue_Create(CONCURRENT_BENCHMARK_LANES, CONCURRENT_BENCHMARK_LANES, kDispatchQos_Utility, kDispatchPriority_Normal, &queue));
+    assertOK(DispatchGroup_Create(&group));
+
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    for (int i = 0; i < CONCURRENT_BENCHMARK_COUNT; i++) {
+        assertOK(DispatchQueue_DispatchGroupAsync(queue, group, OnConcurrentBenchmarkClosure, NULL));
+    }
+    const TimeInterval t1 = MonotonicClock_GetTime();
+    assertOK(DispatchGroup_Wait(group, kTimeInterval_Infinity));
+    const TimeInterval t2 = MonotonicClock_GetTime();
+
+    assertOK(DispatchGroup_Destroy(group));
+    assertOK(DispatchQueue_Destroy(queue));
+
+    printf("dispatched:  %d closures in %lld us\n", CONCURRENT_BENCHMARK_COUNT, elapsed_usec(t0, t1));
+    printf("completed:   %d closures in %lld us\n", CONCURRENT_BENCHMARK_COUNT, elapsed_usec(t0, t2));
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Kernel trace buffer
+////////////////////////////////////////////////////////////////////////////////
+
+static TraceEvent gTraceEvents[kTrace_MaxEventCount];
+
+static void OnTracedClosure(void* _Nullable pContext)
+{
+    Delay(TimeInterval_MakeMilliseconds(10));
+}
+
+// Runs a closure on a serial queue with tracing enabled and checks that the
+// trace buffer recorded the execution of the work item and the context switches
+// and waits that it caused.
+void trace_test(int argc, char *argv[])
+{
+    int queue, itemStarts = 0, itemEnds = 0, switches = 0, waits = 0;
+    size_t count;
+
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Utility, kDispatchPriority_Normal, &queue));
+    assertOK(Trace_SetEnabled(true));
+    assertOK(DispatchQueue_DispatchSync(queue, OnTracedClosure, NULL));
+    assertOK(Trace_SetEnabled(false));
+    assertOK(Trace_Snapshot(gTraceEvents, kTrace_MaxEventCount, &count));
+    assertOK(DispatchQueue_Destroy(queue));
+
+    for (size_t i = 0; i < count; i++) {
+        switch (gTraceEvents[i].type) {
+            case kTraceEvent_DispatchItemStart: itemStarts++; break;
+            case kTraceEvent_DispatchItemEnd:   itemEnds++; break;
+            case kTraceEvent_SwitchIn:          switches++; break;
+            case kTraceEvent_WaitStart:         waits++; break;
+            default:                            break;
+        }
+
+        if (i > 0) {
+            assertEquals(true, TimeInterval_LessEquals(gTraceEvents[i - 1].time, gTraceEvents[i].time));
+        }
+    }
+
+    printf("events: %zu, switches: %d, waits: %d\n", count, switches, waits);
+    assertEquals(true, itemStarts > 0 && itemEnds > 0);
+    assertEquals(true, switches > 0 && waits > 0);
+    printf("ok\n");
+}
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <System/System.h>
+#include "Asserts.h"
 
 
 static void pwd(void)
@@ -173,3 +174,439 @@ void readdir_test(int argc, char *argv[])
     }
     _close(fd);
 }
+
+static void get_dcache_info(DirectoryCacheInfo* _Nonnull pInfo)
+{
+    int fd;
+
+    assertOK(Directory_Open("/", &fd));
+    assertOK(IOChannel_Control(fd, kDirectoryCommand_GetCacheInfo, pInfo));
+    assertOK(IOChannel_Close(fd));
+}
+
+// Looks up the same existing and missing paths over and over again and checks
+// that the lookups after the first one are answered by the directory cache.
+void dcache_test(int argc, char *argv[])
+{
+    DirectoryCacheInfo before, after;
+    FileInfo info;
+
+    _mkdir("/Users");
+    _mkdir("/Users/Admin");
+
+    assertOK(File_GetInfo("/Users/Admin", &info));
+    assertEquals(ENOENT, File_GetInfo("/Users/Nobody", &info));
+
+    get_dcache_info(&before);
+    for (int i = 0; i < 16; i++) {
+        assertOK(File_GetInfo("/Users/Admin", &info));
+        assertEquals(ENOENT, File_GetInfo("/Users/Nobody", &info));
+    }
+    get_dcache_info(&after);
+
+    assertEquals(true, after.hitCount - before.hitCount >= 2 * 16);
+    assertEquals(true, after.negativeHitCount - before.negativeHitCount >= 16);
+    assertEquals(before.missCount, after.missCount);
+    printf("dcache: %d/%d entries, %lu hits, %lu negative hits, %lu misses\n",
+        after.count, after.capacity, after.hitCount, after.negativeHitCount, after.missCount);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Parallel readers
+////////////////////////////////////////////////////////////////////////////////
+
+#define PARALLEL_READ_FILE_SIZE     (16 * 1024)
+#define PARALLEL_READ_ITERATIONS    32
+
+typedef struct ReaderState {
+    const char* _Nonnull    path;
+    volatile bool           isDone;
+} ReaderState;
+
+
+static int64_t elapsed_usec(TimeInterval t0, TimeInterval t1)
+{
+    return (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000ll + (int64_t)((t1.tv_nsec - t0.tv_nsec) / 1000l);
+}
+
+static void create_test_file(const char* _Nonnull path)
+{
+    static char buf[1024];
+    ssize_t nBytesWritten;
+    int fd;
+
+    memset(buf, 0x5a, sizeof(buf));
+    assertOK(File_Create(path, kOpen_Write | kOpen_Truncate, 0666, &fd));
+    for (int i = 0; i < PARALLEL_READ_FILE_SIZE / sizeof(buf); i++) {
+        assertOK(IOChannel_Write(fd, buf, sizeof(buf), &nBytesWritten));
+        assertEquals(sizeof(buf), nBytesWritten);
+    }
+    assertOK(IOChannel_Close(fd));
+}
+
+static void read_test_file(const char* _Nonnull path)
+{
+    char buf[512];
+    ssize_t nBytesRead;
+    int fd;
+
+    for (int i = 0; i < PARALLEL_READ_ITERATIONS; i++) {
+        ssize_t nTotalBytesRead = 0;
+
+        assertOK(File_Open(path, kOpen_Read, &fd));
+        do {
+            assertOK(IOChannel_Read(fd, buf, sizeof(buf), &nBytesRead));
+            nTotalBytesRead += nBytesRead;
+        } while (nBytesRead > 0);
+        assertOK(IOChannel_Close(fd));
+        assertEquals(PARALLEL_READ_FILE_SIZE, nTotalBytesRead);
+    }
+}
+
+static void OnReadFile(void* _Nullable pContext)
+{
+    ReaderState* pState = (ReaderState*)pContext;
+
+    read_test_file(pState->path);
+    pState->isDone = true;
+}
+
+// Reads two files first one after the other and then in parallel on two
+// dispatch queues and prints how long each variant took.
+void parallel_read_test(int argc, char *argv[])
+{
+    ReaderState state[2] = {{"/tmp_read_a", false}, {"/tmp_read_b", false}};
+    int queue[2];
+
+    create_test_file(state[0].path);
+    create_test_file(state[1].path);
+
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    read_test_file(state[0].path);
+    read_test_file(state[1].path);
+    const TimeInterval t1 = MonotonicClock_GetTime();
+
+    for (int i = 0; i < 2; i++) {
+        assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Utility, kDispatchPriority_Normal, &queue[i]));
+    }
+    const TimeInterval t2 = MonotonicClock_GetTime();
+    for (int i = 0; i < 2; i++) {
+        assertOK(DispatchQueue_DispatchAsync(queue[i], OnReadFile, &state[i]));
+    }
+    while (!state[0].isDone || !state[1].isDone) {
+        Delay(TimeInterval_MakeMilliseconds(1));
+    }
+    const TimeInterval t3 = MonotonicClock_GetTime();
+
+    const int64_t serialUsec = elapsed_usec(t0, t1);
+    const int64_t parallelUsec = elapsed_usec(t2, t3);
+    printf("serial:   %lld us\n", serialUsec);
+    printf("parallel: %lld us\n", parallelUsec);
+    if (parallelUsec > 0) {
+        printf("speedup:  %lld%%\n", (serialUsec * 100ll) / parallelUsec);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        assertOK(DispatchQueue_Destroy(queue[i]));
+        assertOK(File_Unlink(state[i].path));
+    }
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Direct I/O
+////////////////////////////////////////////////////////////////////////////////
+
+#define DIRECT_READ_SIZE        (64 * 1024)
+#define DIRECT_READ_FILE_SIZE   (64 * 1024) // Goes through the indirect block map
+#define DIRECT_READ_ITERATIONS  16
+
+static int64_t time_sequential_reads(const char* _Nonnull path, FileOffset startOffset, char* _Nonnull buf)
+{
+    ssize_t nBytesRead;
+    int fd;
+
+    assertOK(File_Open(path, kOpen_Read, &fd));
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    for (int i = 0; i < DIRECT_READ_ITERATIONS; i++) {
+        assertOK(File_Seek(fd, startOffset, NULL, SEEK_SET));
+        assertOK(IOChannel_Read(fd, buf, DIRECT_READ_SIZE, &nBytesRead));
+        assertEquals(DIRECT_READ_FILE_SIZE - startOffset, nBytesRead);
+    }
+    const TimeInterval t1 = MonotonicClock_GetTime();
+    assertOK(IOChannel_Close(fd));
+
+    return elapsed_usec(t0, t1);
+}
+
+// Compares 64k sequential reads which start at a block aligned file offset and
+// thus go straight from the disk to the caller's buffer with reads that start at
+// an unaligned offset and are copied out of the block cache.
+void direct_read_benchmark(int argc, char *argv[])
+{
+    const char* path = "/tmp_direct_read";
+    char* buf = malloc(DIRECT_READ_SIZE);
+    ssize_t nBytesWritten;
+    int fd;
+
+    assertNotNULL(buf);
+    for (int i = 0; i < DIRECT_READ_FILE_SIZE; i++) {
+        buf[i] = (char)i;
+    }
+    assertOK(File_Create(path, kOpen_Write | kOpen_Truncate, 0666, &fd));
+    assertOK(IOChannel_Write(fd, buf, DIRECT_READ_FILE_SIZE, &nBytesWritten));
+    assertEquals(DIRECT_READ_FILE_SIZE, nBytesWritten);
+    assertOK(IOChannel_Close(fd));
+
+    const int64_t alignedUsec = time_sequential_reads(path, 0ll, buf);
+    for (int i = 0; i < DIRECT_READ_FILE_SIZE; i++) {
+        assertEquals((char)i, buf[i]);
+    }
+    const int64_t unalignedUsec = time_sequential_reads(path, 1ll, buf);
+    for (int i = 1; i < DIRECT_READ_FILE_SIZE; i++) {
+        assertEquals((char)i, buf[i - 1]);
+    }
+
+    printf("aligned:   %lld us\n", alignedUsec);
+    printf("unaligned: %lld us\n", unalignedUsec);
+
+    assertOK(File_Unlink(path));
+    free(buf);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Splice
+////////////////////////////////////////////////////////////////////////////////
+
+#define SPLICE_FILE_SIZE    (48 * 1024 + 100)   // Whole blocks plus a partial block at the end
+#define SPLICE_PIPE_SIZE    (8 * 1024)
+
+static struct {
+    int             fd;
+    int             wioc;
+    ssize_t         nBytesSpliced;
+} gSplice;
+
+static void OnSpliceFileToPipe(void* _Nullable pContext)
+{
+    assertOK(IOChannel_Splice(gSplice.fd, gSplice.wioc, SPLICE_FILE_SIZE + 1, 0, &gSplice.nBytesSpliced));
+    assertOK(IOChannel_Close(gSplice.wioc));
+}
+
+// Splices a file into a pipe and a file into another file and verifies that
+// the data arrives intact.
+void splice_test(int argc, char *argv[])
+{
+    const char* srcPath = "/tmp_splice_src";
+    const char* dstPath = "/tmp_splice_dst";
+    char* buf = malloc(SPLICE_FILE_SIZE);
+    ssize_t nBytes, nTotalBytesRead = 0;
+    int rioc, queue, dstFd;
+
+    assertNotNULL(buf);
+    for (int i = 0; i < SPLICE_FILE_SIZE; i++) {
+        buf[i] = (char)(i * 7);
+    }
+    assertOK(File_Create(srcPath, kOpen_Write | kOpen_Truncate, 0666, &gSplice.fd));
+    assertOK(IOChannel_Write(gSplice.fd, buf, SPLICE_FILE_SIZE, &nBytes));
+    assertEquals(SPLICE_FILE_SIZE, nBytes);
+    assertOK(IOChannel_Close(gSplice.fd));
+
+
+    // File -> Pipe
+    assertOK(File_Open(srcPath, kOpen_Read, &gSplice.fd));
+    assertOK(Pipe_CreateWithCapacity(SPLICE_PIPE_SIZE, &rioc, &gSplice.wioc));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+    assertOK(DispatchQueue_DispatchAsync(queue, OnSpliceFileToPipe, NULL));
+
+    memset(buf, 0, SPLICE_FILE_SIZE);
+    do {
+        assertOK(IOChannel_Read(rioc, &buf[nTotalBytesRead], SPLICE_FILE_SIZE - nTotalBytesRead, &nBytes));
+        nTotalBytesRead += nBytes;
+    } while (nBytes > 0 && nTotalBytesRead < SPLICE_FILE_SIZE);
+
+    assertOK(DispatchQueue_Destroy(queue));
+    assertEquals(SPLICE_FILE_SIZE, gSplice.nBytesSpliced);
+    assertEquals(SPLICE_FILE_SIZE, nTotalBytesRead);
+    for (int i = 0; i < SPLICE_FILE_SIZE; i++) {
+        assertEquals((char)(i * 7), buf[i]);
+    }
+    assertOK(IOChannel_Close(rioc));
+    printf("file -> pipe: %zd bytes\n", nTotalBytesRead);
+
+
+    // File -> File
+    assertOK(File_Seek(gSplice.fd, 0ll, NULL, SEEK_SET));
+    assertOK(File_Create(dstPath, kOpen_Write | kOpen_Truncate, 0666, &dstFd));
+    assertOK(IOChannel_Splice(gSplice.fd, dstFd, SPLICE_FILE_SIZE, 0, &nBytes));
+    assertEquals(SPLICE_FILE_SIZE, nBytes);
+    assertOK(IOChannel_Close(dstFd));
+    assertOK(IOChannel_Close(gSplice.fd));
+
+    memset(buf, 0, SPLICE_FILE_SIZE);
+    assertOK(File_Open(dstPath, kOpen_Read, &dstFd));
+    assertOK(IOChannel_Read(dstFd, buf, SPLICE_FILE_SIZE, &nBytes));
+    assertEquals(SPLICE_FILE_SIZE, nBytes);
+    for (int i = 0; i < SPLICE_FILE_SIZE; i++) {
+        assertEquals((char)(i * 7), buf[i]);
+    }
+    assertOK(IOChannel_Close(dstFd));
+    printf("file -> file: %zd bytes\n", nBytes);
+
+    assertOK(File_Unlink(dstPath));
+    assertOK(File_Unlink(srcPath));
+    free(buf);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Block allocation
+
+#define ALLOC_FILE_COUNT 3
+#define ALLOC_BLOCK_SIZE 512
+#define ALLOC_BLOCKS_PER_FILE 24
+
+// Appends one block at a time to a few files in round-robin order. Every
+// append asks the allocator for the block that follows the file's previous
+// block, so most searches start at an LBA that is not a multiple of 8 and
+// run into blocks that were just handed to one of the other files. A block
+// that is handed out twice shows up as a file that contains data of another
+// file.
+void alloc_interleave_test(int argc, char *argv[])
+{
+    const char* paths[ALLOC_FILE_COUNT] = {"/tmp_alloc_a", "/tmp_alloc_b", "/tmp_alloc_c"};
+    int fds[ALLOC_FILE_COUNT];
+    char buf[ALLOC_BLOCK_SIZE];
+    ssize_t nBytes;
+
+    for (int f = 0; f < ALLOC_FILE_COUNT; f++) {
+        assertOK(File_Create(paths[f], kOpen_Write | kOpen_Truncate, 0666, &fds[f]));
+    }
+    for (int b = 0; b < ALLOC_BLOCKS_PER_FILE; b++) {
+        for (int f = 0; f < ALLOC_FILE_COUNT; f++) {
+            memset(buf, 'a' + f * ALLOC_BLOCKS_PER_FILE + b, sizeof(buf));
+            assertOK(IOChannel_Write(fds[f], buf, sizeof(buf), &nBytes));
+            assertEquals(sizeof(buf), nBytes);
+        }
+    }
+    for (int f = 0; f < ALLOC_FILE_COUNT; f++) {
+        assertOK(IOChannel_Close(fds[f]));
+    }
+
+    for (int f = 0; f < ALLOC_FILE_COUNT; f++) {
+        assertOK(File_Open(paths[f], kOpen_Read, &fds[f]));
+        for (int b = 0; b < ALLOC_BLOCKS_PER_FILE; b++) {
+            assertOK(IOChannel_Read(fds[f], buf, sizeof(buf), &nBytes));
+            assertEquals(sizeof(buf), nBytes);
+            for (int i = 0; i < sizeof(buf); i++) {
+                assertEquals((char)('a' + f * ALLOC_BLOCKS_PER_FILE + b), buf[i]);
+            }
+        }
+        assertOK(IOChannel_Close(fds[f]));
+        assertOK(File_Unlink(paths[f]));
+    }
+    printf("ok\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Asynchronous I/O
+
+#define ASYNC_IO_BLOCK_SIZE 512
+#define ASYNC_IO_BLOCK_COUNT 8
+
+static struct {
+    int     group;
+    char    buf[ASYNC_IO_BLOCK_COUNT][ASYNC_IO_BLOCK_SIZE];
+    IOChannelAsyncRequest   req[ASYNC_IO_BLOCK_COUNT];
+} gAsyncIO;
+
+static void OnAsyncIODone(IOChannelAsyncRequest* _Nonnull pRequest)
+{
+    assertOK(pRequest->error);
+    assertEquals(ASYNC_IO_BLOCK_SIZE, pRequest->nBytesTransferred);
+    assertOK(DispatchGroup_Leave(gAsyncIO.group));
+}
+
+// Submits one request per block and waits for all of them to complete.
+// Positional requests are submitted in reverse block order. Requests at the
+// current position are submitted in block order and they must execute in
+// that order to hit the right blocks.
+static void async_io_submit(int fd, int queue, bool isWrite, bool atCurrentPosition)
+{
+    for (int n = 0; n < ASYNC_IO_BLOCK_COUNT; n++) {
+        const int i = (atCurrentPosition) ? n : ASYNC_IO_BLOCK_COUNT - 1 - n;
+        IOChannelAsyncRequest* pRequest = &gAsyncIO.req[i];
+
+        pRequest->buffer = gAsyncIO.buf[i];
+        pRequest->nBytes = ASYNC_IO_BLOCK_SIZE;
+        pRequest->offset = (atCurrentPosition) ? kIOChannel_CurrentPosition : (FileOffset)i * ASYNC_IO_BLOCK_SIZE;
+        pRequest->closure = OnAsyncIODone;
+        pRequest->context = NULL;
+
+        assertOK(DispatchGroup_Enter(gAsyncIO.group));
+        if (isWrite) {
+            assertOK(IOChannel_WriteAsync(fd, queue, pRequest));
+        } else {
+            assertOK(IOChannel_ReadAsync(fd, queue, pRequest));
+        }
+    }
+    assertOK(DispatchGroup_Wait(gAsyncIO.group, kTimeInterval_Infinity));
+}
+
+static void async_io_write_read(const char* _Nonnull path, int queue, bool atCurrentPosition)
+{
+    int fd;
+
+    for (int i = 0; i < ASYNC_IO_BLOCK_COUNT; i++) {
+        memset(gAsyncIO.buf[i], 'a' + i, ASYNC_IO_BLOCK_SIZE);
+    }
+    assertOK(File_Create(path, kOpen_ReadWrite | kOpen_Truncate, 0666, &fd));
+    async_io_submit(fd, queue, true, atCurrentPosition);
+
+    memset(gAsyncIO.buf, 0, sizeof(gAsyncIO.buf));
+    assertOK(File_Seek(fd, 0ll, NULL, SEEK_SET));
+    async_io_submit(fd, queue, false, atCurrentPosition);
+    for (int i = 0; i < ASYNC_IO_BLOCK_COUNT; i++) {
+        for (int j = 0; j < ASYNC_IO_BLOCK_SIZE; j++) {
+            assertEquals('a' + i, gAsyncIO.buf[i][j]);
+        }
+    }
+
+    assertOK(IOChannel_Close(fd));
+    assertOK(File_Unlink(path));
+}
+
+// Writes a file block by block with async writes and reads it back the same
+// way. First with positional requests in reverse block order and then with
+// requests at the current position of the channel. Verifies that the blocks
+// land at the right offsets.
+void async_io_test(int argc, char *argv[])
+{
+    const char* path = "/tmp_async_io";
+    int queue, rioc, wioc;
+
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+    assertOK(DispatchGroup_Create(&gAsyncIO.group));
+
+    async_io_write_read(path, queue, false);
+    async_io_write_read(path, queue, true);
+
+
+    // Reads from a pipe may block forever and are rejected
+    assertOK(Pipe_Create(&rioc, &wioc));
+    gAsyncIO.req[0].offset = kIOChannel_CurrentPosition;
+    assertEquals(ESPIPE, IOChannel_ReadAsync(rioc, queue, &gAsyncIO.req[0]));
+    assertEquals(ESPIPE, IOChannel_WriteAsync(wioc, queue, &gAsyncIO.req[0]));
+    assertOK(IOChannel_Close(rioc));
+    assertOK(IOChannel_Close(wioc));
+
+    assertOK(DispatchGroup_Destroy(gAsyncIO.group));
+    assertOK(DispatchQueue_Destroy(queue));
+    printf("ok\n");
+}
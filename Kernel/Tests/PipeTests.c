@@ -14,6 +14,12 @@
 #include "Asserts.h"
 
 
+static int64_t elapsed_usec(TimeInterval t0, TimeInterval t1)
+{
+    return ((int64_t)t1.tv_sec - (int64_t)t0.tv_sec) * 1000000ll + ((int64_t)t1.tv_nsec - (int64_t)t0.tv_nsec) / 1000ll;
+}
+
+
 void pipe_test(int argc, char *argv[])
 {
     int rioc, wioc;
@@ -45,3 +51,431 @@ void pipe_test(int argc, char *argv[])
     assertOK(IOChannel_Close(rioc));
     printf("ok\n");
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Priority inversion on the pipe lock
+////////////////////////////////////////////////////////////////////////////////
+
+#define INVERSION_READ_COUNT        200
+#define INVERSION_SPIN_SECONDS      3
+#define INVERSION_MAX_LATENCY_USEC  100000ll
+
+static struct {
+    int             rioc;
+    int             wioc;
+    volatile bool   isSpinning;
+    volatile bool   isDone;
+    volatile bool   isWriterDone;
+    volatile bool   isReaderDone;
+    int64_t         worstLatencyUsec;
+} gInversion;
+
+// Background: keeps the pipe full. Spends most of its time inside the pipe lock
+// copying bytes
+static void OnInversionWriter(void* _Nullable pContext)
+{
+    static char buf[1024];
+    ssize_t nBytesWritten;
+
+    while (!gInversion.isDone) {
+        IOChannel_Write(gInversion.wioc, buf, sizeof(buf), &nBytesWritten);
+    }
+    gInversion.isWriterDone = true;
+}
+
+// Utility: burns the CPU for a couple of seconds. Without priority inheritance
+// this keeps the writer from ever releasing the pipe lock while the reader is
+// waiting for it
+static void OnInversionSpinner(void* _Nullable pContext)
+{
+    const TimeInterval t0 = MonotonicClock_GetTime();
+
+    gInversion.isSpinning = true;
+    while (elapsed_usec(t0, MonotonicClock_GetTime()) < INVERSION_SPIN_SECONDS * 1000000ll) {}
+    gInversion.isSpinning = false;
+}
+
+// Realtime: periodically reads from the pipe and records how long it had to
+// wait for the pipe lock
+static void OnInversionReader(void* _Nullable pContext)
+{
+    static char buf[64];
+    ssize_t nBytesRead;
+
+    for (int i = 0; i < INVERSION_READ_COUNT; i++) {
+        Delay(TimeInterval_MakeMilliseconds(10));
+
+        const TimeInterval t0 = MonotonicClock_GetTime();
+        assertOK(IOChannel_Read(gInversion.rioc, buf, sizeof(buf), &nBytesRead));
+        const int64_t latencyUsec = elapsed_usec(t0, MonotonicClock_GetTime());
+
+        if (gInversion.isSpinning && latencyUsec > gInversion.worstLatencyUsec) {
+            gInversion.worstLatencyUsec = latencyUsec;
+        }
+    }
+
+    // Keep draining the pipe until the writer has noticed that we are done
+    gInversion.isDone = true;
+    while (!gInversion.isWriterDone) {
+        IOChannel_Read(gInversion.rioc, buf, sizeof(buf), &nBytesRead);
+    }
+    gInversion.isReaderDone = true;
+}
+
+// A realtime reader, a utility spinner and a background writer share the pipe
+// lock. The writer is preempted by the spinner while it is holding the lock
+// and the reader then has to wait for the writer. Priority inheritance lends
+// the reader priority to the writer so that the reader only waits for the
+// writer to finish its copy instead of waiting for the spinner to finish.
+void pipe_priority_inversion_test(int argc, char *argv[])
+{
+    int readerQueue, spinnerQueue, writerQueue;
+
+    assertOK(Pipe_Create(&gInversion.rioc, &gInversion.wioc));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Realtime, kDispatchPriority_Normal, &readerQueue));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Utility, kDispatchPriority_Normal, &spinnerQueue));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Background, kDispatchPriority_Normal, &writerQueue));
+    gInversion.isSpinning = false;
+    gInversion.isDone = false;
+    gInversion.isWriterDone = false;
+    gInversion.isReaderDone = false;
+    gInversion.worstLatencyUsec = 0;
+
+    assertOK(DispatchQueue_DispatchAsync(writerQueue, OnInversionWriter, NULL));
+    assertOK(DispatchQueue_DispatchAsync(readerQueue, OnInversionReader, NULL));
+    Delay(TimeInterval_MakeMilliseconds(100));
+    assertOK(DispatchQueue_DispatchAsync(spinnerQueue, OnInversionSpinner, NULL));
+
+    while (!gInversion.isReaderDone) {
+        Delay(TimeInterval_MakeMilliseconds(100));
+    }
+
+    assertOK(DispatchQueue_Destroy(readerQueue));
+    assertOK(DispatchQueue_Destroy(spinnerQueue));
+    assertOK(DispatchQueue_Destroy(writerQueue));
+    assertOK(IOChannel_Close(gInversion.wioc));
+    assertOK(IOChannel_Close(gInversion.rioc));
+
+    printf("worst read latency under inversion: %lld us\n", gInversion.worstLatencyUsec);
+    assertEquals(true, gInversion.worstLatencyUsec < INVERSION_MAX_LATENCY_USEC);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Context switch ping-pong
+////////////////////////////////////////////////////////////////////////////////
+
+#define PING_PONG_COUNT     5000
+
+static struct {
+    int     pingRioc;
+    int     pingWioc;
+    int     pongRioc;
+    int     pongWioc;
+} gPingPong;
+
+// Echoes every byte it receives on the ping pipe back on the pong pipe. The
+// first byte is the warm up round trip
+static void OnPingPongEcho(void* _Nullable pContext)
+{
+    char b;
+    ssize_t nBytes;
+
+    for (int i = 0; i < PING_PONG_COUNT + 1; i++) {
+        assertOK(IOChannel_Read(gPingPong.pingRioc, &b, 1, &nBytes));
+        assertOK(IOChannel_Write(gPingPong.pongWioc, &b, 1, &nBytes));
+    }
+}
+
+static void ping_pong_round_trip(void)
+{
+    char b = 'x';
+    ssize_t nBytes;
+
+    assertOK(IOChannel_Write(gPingPong.pingWioc, &b, 1, &nBytes));
+    assertOK(IOChannel_Read(gPingPong.pongRioc, &b, 1, &nBytes));
+    assertEquals('x', b);
+}
+
+// Returns the number of context switches of all VPs of this process so far
+static uint32_t ping_pong_switch_count(void)
+{
+    static ProcessInfo info;
+
+    assertOK(Process_GetInfo(Process_GetId(), &info));
+    return info.stats.voluntarySwitchCount + info.stats.involuntarySwitchCount;
+}
+
+// Bounces a byte between the main VP and an echo VP. Every round trip makes
+// both VPs block on a pipe read. The benchmark counts the context switches
+// that the round trips cause and reports the time per switch. Neither VP
+// touches the FPU which means that the context switcher only has to save and
+// restore a NULL FPU state frame.
+void context_switch_benchmark(int argc, char *argv[])
+{
+    int queue;
+
+    assertOK(Pipe_Create(&gPingPong.pingRioc, &gPingPong.pingWioc));
+    assertOK(Pipe_Create(&gPingPong.pongRioc, &gPingPong.pongWioc));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+    assertOK(DispatchQueue_DispatchAsync(queue, OnPingPongEcho, NULL));
+
+    // Warm up so that the echo VP exists and is waiting on the ping pipe
+    ping_pong_round_trip();
+
+    const uint32_t switches0 = ping_pong_switch_count();
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    for (int i = 0; i < PING_PONG_COUNT; i++) {
+        ping_pong_round_trip();
+    }
+    const TimeInterval t1 = MonotonicClock_GetTime();
+    const uint32_t switches = ping_pong_switch_count() - switches0;
+
+    assertOK(DispatchQueue_Destroy(queue));
+    assertOK(IOChannel_Close(gPingPong.pingWioc));
+    assertOK(IOChannel_Close(gPingPong.pingRioc));
+    assertOK(IOChannel_Close(gPingPong.pongWioc));
+    assertOK(IOChannel_Close(gPingPong.pongRioc));
+
+    // Every round trip blocks both VPs at least once
+    assertEquals(true, switches >= 2 * PING_PONG_COUNT);
+
+    const int64_t usec = elapsed_usec(t0, t1);
+    printf("ping-pong:   %d round trips in %lld us (%lld ns per round trip)\n", PING_PONG_COUNT, usec, (usec * 1000ll) / PING_PONG_COUNT);
+    printf("switches:    %lu (%lld ns per switch)\n", (unsigned long)switches, (usec * 1000ll) / switches);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Pipe throughput
+////////////////////////////////////////////////////////////////////////////////
+
+#define THROUGHPUT_PIPE_CAPACITY    (16 * 1024)
+#define THROUGHPUT_TOTAL_BYTES      (256 * 1024)
+#define THROUGHPUT_MAX_CHUNK_SIZE   (16 * 1024)
+
+static struct {
+    int     rioc;
+    int     wioc;
+    size_t  chunkSize;
+    size_t  totalBytes;
+} gThroughput;
+
+// Writes 'totalBytes' bytes to the pipe in chunks of 'chunkSize' bytes
+static void OnThroughputWriter(void* _Nullable pContext)
+{
+    static char buf[THROUGHPUT_MAX_CHUNK_SIZE];
+    ssize_t nBytesWritten;
+
+    for (size_t n = 0; n < gThroughput.totalBytes; n += gThroughput.chunkSize) {
+        assertOK(IOChannel_Write(gThroughput.wioc, buf, gThroughput.chunkSize, &nBytesWritten));
+    }
+}
+
+static void pipe_throughput(size_t chunkSize, size_t totalBytes)
+{
+    static char buf[THROUGHPUT_MAX_CHUNK_SIZE];
+    int queue;
+    ssize_t nBytesRead;
+    size_t nTotalBytesRead = 0;
+
+    gThroughput.chunkSize = chunkSize;
+    gThroughput.totalBytes = totalBytes;
+    assertOK(Pipe_CreateWithCapacity(THROUGHPUT_PIPE_CAPACITY, &gThroughput.rioc, &gThroughput.wioc));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+
+    const TimeInterval t0 = MonotonicClock_GetTime();
+    assertOK(DispatchQueue_DispatchAsync(queue, OnThroughputWriter, NULL));
+    while (nTotalBytesRead < totalBytes) {
+        assertOK(IOChannel_Read(gThroughput.rioc, buf, chunkSize, &nBytesRead));
+        nTotalBytesRead += nBytesRead;
+    }
+    const TimeInterval t1 = MonotonicClock_GetTime();
+
+    assertOK(DispatchQueue_Destroy(queue));
+    assertOK(IOChannel_Close(gThroughput.wioc));
+    assertOK(IOChannel_Close(gThroughput.rioc));
+
+    int64_t usec = elapsed_usec(t0, t1);
+    if (usec <= 0) { usec = 1; }
+    printf("%5zu bytes: %zu bytes in %lld us (%lld KB/s)\n", chunkSize, totalBytes, usec, ((int64_t)totalBytes * 1000000ll) / (usec * 1024ll));
+}
+
+// Moves data through a pipe from a writer VP to the main VP with transfer sizes
+// of 1 byte, 512 bytes and 16KB.
+void pipe_throughput_benchmark(int argc, char *argv[])
+{
+    pipe_throughput(1, THROUGHPUT_TOTAL_BYTES / 16);
+    pipe_throughput(512, THROUGHPUT_TOTAL_BYTES);
+    pipe_throughput(16 * 1024, THROUGHPUT_TOTAL_BYTES);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Polling
+////////////////////////////////////////////////////////////////////////////////
+
+static struct {
+    int     rioc[2];
+    int     wioc[2];
+} gPoll;
+
+// Writes a byte to the second pipe after a short delay
+static void OnPollWriter(void* _Nullable pContext)
+{
+    ssize_t nBytesWritten;
+
+    Delay(TimeInterval_MakeMilliseconds(200));
+    assertOK(IOChannel_Write(gPoll.wioc[1], "x", 1, &nBytesWritten));
+}
+
+// A single VP waits on the read ends of two pipes. Only the second pipe receives
+// data. Also checks that a non-blocking read returns EAGAIN and that a closed
+// write side is reported as a hangup.
+void pipe_poll_test(int argc, char *argv[])
+{
+    IOChannelPollEntry entries[2];
+    int queue, nReady;
+    char b;
+    ssize_t nBytesRead;
+
+    assertOK(Pipe_Create(&gPoll.rioc[0], &gPoll.wioc[0]));
+    assertOK(Pipe_Create(&gPoll.rioc[1], &gPoll.wioc[1]));
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+
+    // Nothing to read yet
+    assertOK(IOChannel_SetNonBlocking(gPoll.rioc[0], true));
+    assertEquals(EAGAIN, IOChannel_Read(gPoll.rioc[0], &b, 1, &nBytesRead));
+    assertEquals(0, nBytesRead);
+
+    for (int i = 0; i < 2; i++) {
+        entries[i].ioc = gPoll.rioc[i];
+        entries[i].events = kPollEvent_Readable;
+        entries[i].revents = 0;
+    }
+    assertOK(IOChannel_Poll(entries, 2, kTimeInterval_Zero, &nReady));
+    assertEquals(0, nReady);
+
+    // Wait for the writer
+    assertOK(DispatchQueue_DispatchAsync(queue, OnPollWriter, NULL));
+    assertOK(IOChannel_Poll(entries, 2, TimeInterval_MakeSeconds(5), &nReady));
+    printf("ready: %d, revents: 0x%x 0x%x\n", nReady, entries[0].revents, entries[1].revents);
+    assertEquals(1, nReady);
+    assertEquals(0, entries[0].revents);
+    assertEquals(kPollEvent_Readable, entries[1].revents);
+    assertOK(IOChannel_Read(gPoll.rioc[1], &b, 1, &nBytesRead));
+    assertEquals('x', b);
+
+    // The write end of an empty pipe is writable
+    entries[0].ioc = gPoll.wioc[0];
+    entries[0].events = kPollEvent_Writable;
+    assertOK(IOChannel_Poll(entries, 1, kTimeInterval_Zero, &nReady));
+    assertEquals(1, nReady);
+    assertEquals(kPollEvent_Writable, entries[0].revents);
+
+    // A closed write side is readable (EOF) and hangs up
+    assertOK(IOChannel_Close(gPoll.wioc[0]));
+    entries[0].ioc = gPoll.rioc[0];
+    entries[0].events = kPollEvent_Readable;
+    assertOK(IOChannel_Poll(entries, 1, kTimeInterval_Infinity, &nReady));
+    assertEquals(1, nReady);
+    assertEquals(kPollEvent_Readable | kPollEvent_Hangup, entries[0].revents);
+
+    assertOK(DispatchQueue_Destroy(queue));
+    assertOK(IOChannel_Close(gPoll.rioc[0]));
+    assertOK(IOChannel_Close(gPoll.wioc[1]));
+    assertOK(IOChannel_Close(gPoll.rioc[1]));
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Dispatch sources
+////////////////////////////////////////////////////////////////////////////////
+
+static struct {
+    int     rioc, wioc;
+    int     group;
+    int     ioSource;
+    int     timerSource;
+    int     invocations;
+    int     nBytesRead;
+    int     expirations;
+} gSource;
+
+static void OnSourceReadable(void* _Nullable pContext, unsigned int events)
+{
+    char buf[4];
+    ssize_t nBytesRead = 0;
+
+    gSource.invocations++;
+    if ((events & kPollEvent_Readable) != 0) {
+        assertOK(IOChannel_Read(gSource.rioc, buf, sizeof(buf), &nBytesRead));
+        gSource.nBytesRead += nBytesRead;
+    }
+
+    // The pipe stays readable (EOF) after the writer has closed its end
+    if ((events & kPollEvent_Hangup) != 0 && nBytesRead == 0) {
+        assertOK(DispatchSource_Destroy(gSource.ioSource));
+        assertOK(DispatchGroup_Leave(gSource.group));
+    }
+}
+
+static void OnSourceTimer(void* _Nullable pContext, unsigned int count)
+{
+    if (gSource.expirations < 5) {
+        gSource.expirations += count;
+
+        if (gSource.expirations >= 5) {
+            assertOK(DispatchSource_Destroy(gSource.timerSource));
+            assertOK(DispatchGroup_Leave(gSource.group));
+        }
+    }
+}
+
+void dispatch_source_test(int argc, char *argv[])
+{
+    ssize_t nBytesWritten;
+    int queue;
+
+    assertOK(DispatchQueue_Create(0, 1, kDispatchQos_Interactive, kDispatchPriority_Normal, &queue));
+    assertOK(DispatchGroup_Create(&gSource.group));
+    assertOK(Pipe_Create(&gSource.rioc, &gSource.wioc));
+    assertOK(IOChannel_SetNonBlocking(gSource.rioc, true));
+
+
+    // Writes which happen while the closure is queued are coalesced. The
+    // closure reads less than what was written and so the source has to fire
+    // again until the pipe is drained
+    assertOK(DispatchGroup_Enter(gSource.group));
+    assertOK(DispatchSource_CreateIOChannel(queue, gSource.rioc, kPollEvent_Readable, OnSourceReadable, NULL, &gSource.ioSource));
+    for (int i = 0; i < 10; i++) {
+        assertOK(IOChannel_Write(gSource.wioc, "x", 1, &nBytesWritten));
+    }
+    assertOK(IOChannel_Close(gSource.wioc));
+    assertOK(DispatchGroup_Wait(gSource.group, kTimeInterval_Infinity));
+    printf("io source: %d invocations\n", gSource.invocations);
+    assertEquals(10, gSource.nBytesRead);
+
+
+    // A repeating timer
+    assertOK(DispatchGroup_Enter(gSource.group));
+    assertOK(DispatchSource_CreateTimer(queue, MonotonicClock_GetTime(), TimeInterval_MakeMilliseconds(20), OnSourceTimer, NULL, &gSource.timerSource));
+    assertOK(DispatchGroup_Wait(gSource.group, kTimeInterval_Infinity));
+    printf("timer source: %d expirations\n", gSource.expirations);
+    assertEquals(true, gSource.expirations >= 5);
+
+    assertOK(DispatchGroup_Destroy(gSource.group));
+    assertOK(DispatchQueue_Destroy(queue));
+    assertOK(IOChannel_Close(gSource.rioc));
+    printf("ok\n");
+}
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <System/System.h>
+#include "Asserts.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Process with a child process
@@ -72,3 +73,61 @@ void child_process_test(int argc, char *argv[])
         child_process();
     }
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Process information
+////////////////////////////////////////////////////////////////////////////////
+
+// Looks up the calling process, enumerates all processes and checks that a
+// lookup of a PID that doesn't exist still tells the caller where the
+// enumeration continues.
+void procinfo_test(int argc, char *argv[])
+{
+    ProcessInfo* pInfo = malloc(sizeof(ProcessInfo));
+    const ProcessId myPid = Process_GetId();
+    ProcessId pid = 1, prevPid = 0;
+    bool didFindSelf = false;
+
+    assertNotNULL(pInfo);
+
+    assertOK(Process_GetInfo(myPid, pInfo));
+    assertEquals(myPid, pInfo->pid);
+    assertEquals(Process_GetParentId(), pInfo->ppid);
+    assertEquals(true, pInfo->dispatchQueueCount >= 1);
+    assertEquals(kDispatchQueue_Main, pInfo->dispatchQueues[0].od);
+
+
+    // The enumeration visits every process once in ascending PID order
+    while (pid > 0) {
+        const errno_t err = Process_GetInfo(pid, pInfo);
+
+        if (err != ESRCH) {
+            assertOK(err);
+            assertEquals(pid, pInfo->pid);
+            printf("pid %d: %s\n", pInfo->pid, pInfo->name);
+        }
+        if (pid == myPid) {
+            didFindSelf = true;
+        }
+
+        assertEquals(true, pInfo->nextPid == 0 || pInfo->nextPid > pid);
+        prevPid = pid;
+        pid = pInfo->nextPid;
+    }
+    assertEquals(true, didFindSelf);
+
+
+    // PID 0 is never assigned. The enumeration continues with the root process
+    pInfo->nextPid = -1;
+    assertEquals(ESRCH, Process_GetInfo(0, pInfo));
+    assertEquals(1, pInfo->nextPid);
+
+    // Nothing comes after the last process
+    pInfo->nextPid = -1;
+    assertEquals(ESRCH, Process_GetInfo(prevPid + 1, pInfo));
+    assertEquals(0, pInfo->nextPid);
+
+    free(pInfo);
+    printf("ok\n");
+}
@@ -12,6 +12,7 @@
 
 // Process
 extern void child_process_test(int argc, char *argv[]);
+extern void procinfo_test(int argc, char *argv[]);
 
 // Console
 extern void interactive_console_test(int argc, char *argv[]);
@@ -21,9 +22,27 @@ extern void chdir_pwd_test(int argc, char *argv[]);
 extern void fileinfo_test(int argc, char *argv[]);
 extern void unlink_test(int argc, char *argv[]);
 extern void readdir_test(int argc, char *argv[]);
+extern void dcache_test(int argc, char *argv[]);
+extern void parallel_read_test(int argc, char *argv[]);
+extern void direct_read_benchmark(int argc, char *argv[]);
+extern void splice_test(int argc, char *argv[]);
+extern void alloc_interleave_test(int argc, char *argv[]);
+extern void async_io_test(int argc, char *argv[]);
 
 // Pipe
 extern void pipe_test(int argc, char *argv[]);
+extern void pipe_priority_inversion_test(int argc, char *argv[]);
+extern void context_switch_benchmark(int argc, char *argv[]);
+extern void pipe_throughput_benchmark(int argc, char *argv[]);
+extern void pipe_poll_test(int argc, char *argv[]);
+extern void dispatch_source_test(int argc, char *argv[]);
+
+// Dispatch Queue
+extern void timer_stress_test(int argc, char *argv[]);
+extern void clock_info_test(int argc, char *argv[]);
+extern void dispatch_sync_benchmark(int argc, char *argv[]);
+extern void concurrent_dispatch_benchmark(int argc, char *argv[]);
+extern void trace_test(int argc, char *argv[]);
 
 // Stdio
 extern void fopen_memory_fixed_size_test(int argc, char *argv[]);
@@ -37,13 +56,30 @@ extern void fopen_memory_variable_size_test(int argc, char *argv[]);
 
 void main_closure(int argc, char *argv[])
 {
+    //RUN_TEST(procinfo_test);
     RUN_TEST(child_process_test);
     //RUN_TEST(interactive_console_test);
     //RUN_TEST(chdir_pwd_test);
     //RUN_TEST(fileinfo_test);
     //RUN_TEST(unlink_test);
     //RUN_TEST(readdir_test);
+    //RUN_TEST(dcache_test);
+    //RUN_TEST(parallel_read_test);
+    //RUN_TEST(direct_read_benchmark);
+    RUN_TEST(splice_test);
+    //RUN_TEST(alloc_interleave_test);
+    //RUN_TEST(async_io_test);
     //RUN_TEST(fopen_memory_fixed_size_test);
     //RUN_TEST(fopen_memory_variable_size_test);
     //RUN_TEST(pipe_test);
+    //RUN_TEST(pipe_priority_inversion_test);
+    //RUN_TEST(context_switch_benchmark);
+    //RUN_TEST(pipe_throughput_benchmark);
+    //RUN_TEST(pipe_poll_test);
+    //RUN_TEST(dispatch_source_test);
+    //RUN_TEST(timer_stress_test);
+    //RUN_TEST(clock_info_test);
+    //RUN_TEST(dispatch_sync_benchmark);
+    //RUN_TEST(concurrent_dispatch_benchmark);
+    //RUN_TEST(trace_test);
 }
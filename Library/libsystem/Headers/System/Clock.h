@@ -17,6 +17,14 @@
 
 __CPP_BEGIN
 
+// Information about the monotonic clock. 'interruptCount' allows a caller to
+// compare the periodic and the tickless mode of the scheduler clock.
+typedef struct MonotonicClockInfo {
+    uint32_t    interruptCount;     // Number of quantum timer interrupts since boot
+    bool        isTickless;         // True if the quantum timer is programmed for the next deadline instead of firing every quantum
+} MonotonicClockInfo;
+
+
 #if !defined(__KERNEL__)
 
 // Blocks the calling execution context for teh seconds and nanoseconds specified
@@ -29,6 +37,10 @@ extern errno_t Delay(TimeInterval delay);
 // @Concurrency: Safe
 extern TimeInterval MonotonicClock_GetTime(void);
 
+// Returns information about the monotonic clock. The information is system wide.
+// @Concurrency: Safe
+extern errno_t MonotonicClock_GetInfo(MonotonicClockInfo* _Nonnull pOutInfo);
+
 #endif /* __KERNEL__ */
 
 __CPP_END
@@ -13,6 +13,7 @@
 #include <System/_syslimits.h>
 #include <System/Error.h>
 #include <System/FilePermissions.h>
+#include <System/IOChannel.h>
 #include <System/Types.h>
 
 __CPP_BEGIN
@@ -23,6 +24,20 @@ typedef struct DirectoryEntry {
 } DirectoryEntry;
 
 
+// Returns the statistics of the kernel's directory name lookup cache. May be
+// sent to any directory I/O channel.
+// IOChannel_Control(int ioc, int cmd, DirectoryCacheInfo* _Nonnull pOutInfo)
+#define kDirectoryCommand_GetCacheInfo  IOChannelSubclassCommand(1)
+
+typedef struct DirectoryCacheInfo {
+    int         capacity;           // Maximum number of names the cache can hold
+    int         count;              // Number of names currently in the cache
+    uint32_t    hitCount;           // Lookups that found an existing name
+    uint32_t    negativeHitCount;   // Lookups that found a name that is known to not exist
+    uint32_t    missCount;          // Lookups that had to go to the filesystem
+} DirectoryCacheInfo;
+
+
 #if !defined(__KERNEL__)
 
 // Creates an empty directory with the name and at the filesystem location specified
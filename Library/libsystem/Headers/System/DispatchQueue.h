@@ -18,6 +18,22 @@ __CPP_BEGIN
 
 typedef void (*Dispatch_Closure)(void* _Nullable arg);
 
+// A closure that is invoked once per iteration by DispatchQueue_Apply(). 'i' is
+// the iteration index.
+typedef void (*Dispatch_ApplyClosure)(void* _Nullable arg, size_t i);
+
+// A closure and its argument. Used to dispatch a batch of closures with a single
+// DispatchQueue_DispatchAsyncBatch() call.
+typedef struct Dispatch_Work {
+    Dispatch_Closure _Nonnull   func;
+    void* _Nullable             context;
+} Dispatch_Work;
+
+// A closure that is invoked by a dispatch source. 'events' are the poll events
+// (kPollEvent_XXX) that an I/O channel source has observed and the number of
+// expirations of a timer source since the last invocation.
+typedef void (*Dispatch_SourceClosure)(void* _Nullable arg, unsigned int events);
+
 #define kDispatchQueue_Main 0
 
 
@@ -64,6 +80,48 @@ extern errno_t DispatchQueue_DispatchAsync(int od, Dispatch_Closure _Nonnull pCl
 // @Concurrency: Safe
 extern errno_t DispatchQueue_DispatchAsyncAfter(int od, TimeInterval deadline, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
 
+// Synchronously executes the given closure as a barrier. A barrier waits until
+// all closures that were dispatched to the queue before it have finished
+// executing and it then executes exclusively: nothing else executes on the
+// queue while the barrier is executing. Closures dispatched after the barrier
+// execute once the barrier has finished. This makes it possible to protect
+// shared data with a concurrent queue: readers are dispatched normally and
+// writers are dispatched as barriers. Barriers make no difference on a serial
+// queue.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_DispatchBarrierSync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
+
+// Asynchronously executes the given closure as a barrier. See
+// DispatchQueue_DispatchBarrierSync().
+// @Concurrency: Safe
+extern errno_t DispatchQueue_DispatchBarrierAsync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
+
+// Asynchronously executes the given closure as a member of the dispatch group
+// 'gd'. The closure enters the group before this function returns and it leaves
+// the group once it has finished executing.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_DispatchGroupAsync(int od, int gd, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
+
+// Schedules the 'count' closures in 'pWork' for asynchronous execution on the
+// given dispatch queue. The closures are enqueued in array order. This is
+// equivalent to calling DispatchQueue_DispatchAsync() once per closure but it
+// is considerably cheaper because the queue only has to be locked and woken up
+// once for the whole batch. Either all closures are enqueued or none of them is
+// if an error is returned.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_DispatchAsyncBatch(int od, const Dispatch_Work* _Nonnull pWork, size_t count);
+
+// Invokes the given closure 'iterations' times with the iteration indices 0 to
+// 'iterations - 1' and returns once all iterations have finished executing. The
+// iterations are spread across the concurrency lanes of the dispatch queue and
+// execute in parallel on a concurrent queue. Iterations do not execute in any
+// particular order. Returns EINTR if the queue was terminated before all
+// iterations had a chance to execute. Note that the calling code must not
+// itself run on the dispatch queue since it would block one of the lanes that
+// should execute the iterations.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_Apply(int od, size_t iterations, Dispatch_ApplyClosure _Nonnull pClosure, void* _Nullable pContext);
+
 
 // Returns the dispatch queue that is associated with the virtual processor that
 // is running the calling code.
@@ -105,14 +163,104 @@ extern errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int
 // @Concurrency: Safe
 extern errno_t DispatchQueue_Destroy(int od);
 
+
+
+// Creates a dispatch group. A dispatch group tracks a set of outstanding tasks.
+// A task is added to the group by entering it and removed from the group by
+// leaving it. Closures dispatched with DispatchQueue_DispatchGroupAsync() are
+// automatically added to and removed from the group. You can wait for a group
+// to become empty or you can ask the group to dispatch a closure once it has
+// become empty.
+// @Concurrency: Safe
+extern errno_t DispatchGroup_Create(int* _Nonnull pOutGroup);
+
+// Destroys the dispatch group. Pending notifications of the group are dropped.
+// @Concurrency: Safe
+extern errno_t DispatchGroup_Destroy(int gd);
+
+// Adds a task to the group.
+// @Concurrency: Safe
+extern errno_t DispatchGroup_Enter(int gd);
+
+// Removes a task from the group. Every leave must balance an earlier enter.
+// @Concurrency: Safe
+extern errno_t DispatchGroup_Leave(int gd);
+
+// Blocks the caller until the group has no more outstanding tasks. Returns
+// ETIMEDOUT if the group still has outstanding tasks at 'deadline'.
+// @Concurrency: Safe
+extern errno_t DispatchGroup_Wait(int gd, TimeInterval deadline);
+
+// Asynchronously executes the given closure on the dispatch queue 'od' once the
+// group has no more outstanding tasks. The closure is dispatched right away if
+// the group is empty.
+// @Concurrency: Safe
+extern errno_t DispatchGroup_Notify(int gd, int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
+
+
+
+// Creates a dispatch source which monitors the I/O channel 'ioc' for the poll
+// events 'events' (kPollEvent_Readable, kPollEvent_Writable). The closure is
+// dispatched asynchronously on the queue 'od' every time the channel becomes
+// ready and it receives the events that are pending. kPollEvent_Hangup is
+// always reported once the peer of a pipe has closed its end. Events which
+// arrive while the closure is queued or executing are coalesced into a single
+// invocation. The source is level-triggered: it keeps firing as long as the
+// channel stays ready. Monitoring the channel does not tie up a virtual
+// processor. Note that the closure may run before this function returns.
+// @Concurrency: Safe
+extern errno_t DispatchSource_CreateIOChannel(int od, int ioc, unsigned int events, Dispatch_SourceClosure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutSource);
+
+// Creates a dispatch source which invokes the closure on the queue 'od' on or
+// after 'deadline' and then every 'interval' if 'interval' is greater than 0.
+// Expirations which happen while the closure is queued or executing are
+// coalesced and the closure receives the number of expirations.
+// @Concurrency: Safe
+extern errno_t DispatchSource_CreateTimer(int od, TimeInterval deadline, TimeInterval interval, Dispatch_SourceClosure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutSource);
+
+// Cancels and destroys the dispatch source. The closure will not be invoked
+// anymore once this function has returned, unless it is executing right now.
+// The source holds on to its queue until it is destroyed.
+// @Concurrency: Safe
+extern errno_t DispatchSource_Destroy(int sd);
+
+
+// Measures the round trip time of 'count' synchronous dispatches of an empty
+// kernel closure on an idle serial kernel queue. Returns the time it took with
+// the inline fast path in 'pOutInlineTime' and the time it took when every
+// closure was handed to the queue's virtual processor in 'pOutQueuedTime'.
+// User closures never take the inline fast path. Only available in DEBUG
+// builds. Release kernels return ENOSYS.
+// @Concurrency: Safe
+#if DEBUG
+extern errno_t DispatchQueue_BenchmarkSync(int count, TimeInterval* _Nonnull pOutInlineTime, TimeInterval* _Nonnull pOutQueuedTime);
+#endif
+
 #endif /* __KERNEL__ */
 
 
 // Private
 enum {
-    kDispatchOption_Sync = 1
+    kDispatchOption_Sync = 1,
+    kDispatchOption_Batch = 2,
+    kDispatchOption_Apply = 4,
+    kDispatchOption_Barrier = 8,
+    kDispatchOption_Group = 16
 };
 
+enum {
+    kDispatchSourceType_IOChannel = 0,
+    kDispatchSourceType_Timer
+};
+
+typedef struct Dispatch_SourceParams {
+    int             type;       // kDispatchSourceType_XXX
+    int             ioc;        // I/O channel sources
+    unsigned int    events;     // I/O channel sources
+    TimeInterval    deadline;   // Timer sources
+    TimeInterval    interval;   // Timer sources
+} Dispatch_SourceParams;
+
 __CPP_END
 
 #endif /* _SYS_DISPATCH_QUEUE_H */
@@ -11,6 +11,7 @@
 
 #include <System/_cmndef.h>
 #include <System/Error.h>
+#include <System/TimeInterval.h>
 #include <System/Types.h>
 
 __CPP_BEGIN
@@ -19,6 +20,14 @@ __CPP_BEGIN
 #define IOChannelCommand(__cmd) -(__cmd)
 #define IsIOChannelCommand(__cmd) ((__cmd) < 0)
 
+// Commands that every I/O channel understands are numbered below
+// kIOChannelCommand_SubclassBase. Commands that only a specific kind of channel
+// understands (e.g. directories) are defined with IOChannelSubclassCommand() so
+// that a subclass can never intercept a generic command that is meant for its
+// superclass.
+#define kIOChannelCommand_SubclassBase  256
+#define IOChannelSubclassCommand(__cmd) IOChannelCommand(kIOChannelCommand_SubclassBase + (__cmd))
+
 // Returns the type of the channel
 // IOChannel_Control(int fd, int cmd, int _Nonnull *pOutType)
 #define kIOChannelCommand_GetType   IOChannelCommand(1)
@@ -30,6 +39,62 @@ typedef enum {
 
 #define kIOChannelCommand_GetMode   IOChannelCommand(2)
 
+// Switches the channel to non-blocking mode if 'flag' is true and back to
+// blocking mode otherwise. A read or write on a non-blocking channel returns
+// EAGAIN instead of blocking the caller if no data or space is available.
+// IOChannel_Control(int fd, int cmd, int flag)
+#define kIOChannelCommand_SetNonBlocking    IOChannelCommand(3)
+
+// Must be the last generic command
+#if kIOChannelCommand_SetNonBlocking <= IOChannelCommand(kIOChannelCommand_SubclassBase)
+#error "generic I/O channel commands must be numbered below kIOChannelCommand_SubclassBase"
+#endif
+
+
+// Poll events. A caller asks for readability and/or writability. Hangup, error
+// and invalid are always reported and don't need to be requested.
+#define kPollEvent_Readable 0x0001  // Data can be read without blocking
+#define kPollEvent_Writable 0x0002  // Data can be written without blocking
+#define kPollEvent_Hangup   0x0004  // The other side of the channel was closed
+#define kPollEvent_Error    0x0008  // The channel is in an error state
+#define kPollEvent_Invalid  0x0010  // The I/O channel descriptor is not valid
+
+// Maximum number of I/O channels that a single IOChannel_Poll() call can wait on
+#define kIOChannel_MaxPollCount 32
+
+typedef struct IOChannelPollEntry {
+    int     ioc;        // The I/O channel to poll
+    short   events;     // The events the caller is interested in
+    short   revents;    // The events that are ready. Set by IOChannel_Poll()
+} IOChannelPollEntry;
+
+
+// Use the current position of the I/O channel for an asynchronous read or write
+// instead of an absolute file offset. The position is advanced by the I/O.
+// Requests at the current position of the same channel execute one after the
+// other in the order in which they were started. Requests on different channels
+// and requests with an absolute offset may overlap
+#define kIOChannel_CurrentPosition  ((FileOffset)-1)
+
+struct IOChannelAsyncRequest;
+
+// Invoked on the completion queue of an asynchronous read or write once the
+// I/O has finished. The 'nBytesTransferred' and 'error' fields of the request
+// tell how the I/O went.
+typedef void (*IOChannel_AsyncClosure)(struct IOChannelAsyncRequest* _Nonnull pRequest);
+
+// Describes an asynchronous read or write. The request must stay alive until
+// its closure has been invoked.
+typedef struct IOChannelAsyncRequest {
+    void* _Nonnull                  buffer;
+    size_t                          nBytes;
+    FileOffset                      offset;             // Absolute file offset or kIOChannel_CurrentPosition
+    IOChannel_AsyncClosure _Nonnull closure;
+    void* _Nullable                 context;            // For use by the closure
+    ssize_t                         nBytesTransferred;  // Set before the closure is invoked
+    errno_t                         error;              // Set before the closure is invoked
+} IOChannelAsyncRequest;
+
 
 #if !defined(__KERNEL__)
 
@@ -58,6 +123,48 @@ extern errno_t IOChannel_Read(int ioc, void* _Nonnull buffer, size_t nBytesToRea
 extern errno_t IOChannel_Write(int ioc, const void* _Nonnull buffer, size_t nBytesToWrite, ssize_t* _Nonnull nOutBytesWritten);
 
 
+// Starts reading up to 'nBytes' bytes from the I/O channel 'ioc' into the
+// buffer of the request and returns right away. The read executes on a kernel
+// virtual processor and the closure of the request is dispatched on the queue
+// 'od' once the read has finished. A request with an absolute offset reads
+// from that offset and leaves the position of the channel alone. 'ioc' must be
+// a file; ESPIPE is returned for any other kind of channel. Use a dispatch
+// source to wait for a pipe or terminal to become readable. The request holds
+// on to the queue 'od' and not its descriptor. Closing or reusing 'od' does not
+// redirect the closure. Returns an error and does not invoke the closure if the
+// read could not be started.
+// @Concurrency: Safe
+extern errno_t IOChannel_ReadAsync(int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest);
+
+// Starts writing 'nBytes' bytes from the buffer of the request to the I/O
+// channel 'ioc'. See IOChannel_ReadAsync().
+// @Concurrency: Safe
+extern errno_t IOChannel_WriteAsync(int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest);
+
+
+// Moves up to 'nBytesToSplice' bytes from the I/O channel 'iocIn' to the I/O
+// channel 'iocOut' without copying the data through a user space buffer. The
+// data is read from the current position of 'iocIn' and written to the current
+// position of 'iocOut'. Whole file blocks are read straight into the buffer of
+// a pipe if 'iocIn' is a file and 'iocOut' is a pipe. The number of bytes moved
+// is returned in 'nOutBytesSpliced'. Returns EOK and 0 bytes if 'iocIn' is at
+// EOF. 'iocIn' must be readable and 'iocOut' must be writable. 'flags' is
+// reserved and must be 0.
+// @Concurrency: Safe
+extern errno_t IOChannel_Splice(int iocIn, int iocOut, size_t nBytesToSplice, unsigned int flags, ssize_t* _Nonnull nOutBytesSpliced);
+
+
+// Waits until at least one of the I/O channels in 'entries' is ready for one
+// of the events that the caller is interested in or 'timeout' has elapsed. Sets
+// the 'revents' field of every entry and returns the number of entries with a
+// non-zero 'revents' field in 'nOutReadyCount'. A zero timeout checks the
+// channels without blocking and kTimeInterval_Infinity waits forever. At most
+// kIOChannel_MaxPollCount entries can be polled at the same time. Returns EOK
+// and 0 ready entries if the wait has timed out.
+// @Concurrency: Safe
+extern errno_t IOChannel_Poll(IOChannelPollEntry* _Nonnull entries, int count, TimeInterval timeout, int* _Nonnull nOutReadyCount);
+
+
 // Closes the given I/O channel. All still pending data is written to the
 // underlying device and then all resources allocated to the I/O channel are
 // freed. If this function encounters an error while flushing pending data to
@@ -79,6 +186,11 @@ extern IOChannelType IOChannel_GetType(int ioc);
 // @Concurrency: Safe
 extern unsigned int IOChannel_GetMode(int ioc);
 
+// Switches the I/O channel to non-blocking mode if 'flag' is true and back to
+// blocking mode otherwise.
+// @Concurrency: Safe
+extern errno_t IOChannel_SetNonBlocking(int ioc, bool flag);
+
 
 // Invokes a I/O channel specific method on the I/O channel 'ioc'.
 // @Concurrency: Safe
@@ -24,6 +24,12 @@ __CPP_BEGIN
 // Note that both I/O channels must be closed to free all pipe resources.
 extern errno_t Pipe_Create(int* _Nonnull rioc, int* _Nonnull wioc);
 
+// Same as Pipe_Create() except that the pipe buffer is able to hold at least
+// 'capacity' bytes. Larger buffers allow the writer and the reader to transfer
+// more data per context switch. A capacity of 0 selects the default buffer size.
+// Returns EINVAL if 'capacity' is larger than 64KB.
+extern errno_t Pipe_CreateWithCapacity(size_t capacity, int* _Nonnull rioc, int* _Nonnull wioc);
+
 #endif /* __KERNEL__ */
 
 __CPP_END
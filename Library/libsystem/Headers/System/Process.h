@@ -12,6 +12,7 @@
 #include <System/_cmndef.h>
 #include <System/_noreturn.h>
 #include <System/Error.h>
+#include <System/TimeInterval.h>
 #include <System/Types.h>
 #include <System/Urt.h>
 
@@ -73,6 +74,43 @@ typedef struct ProcessTerminationStatus {
 } ProcessTerminationStatus;
 
 
+// CPU time and scheduling statistics of a process or dispatch queue.
+typedef struct ExecutionStatistics {
+    TimeInterval    userTime;               // Time spent executing user space code
+    TimeInterval    kernelTime;             // Time spent executing kernel code (system calls, idle time of kernel queues)
+    TimeInterval    waitTime;               // Time spent waiting for a resource, a timeout or work
+    uint32_t        voluntarySwitchCount;   // Number of times the CPU was given up in order to wait
+    uint32_t        involuntarySwitchCount; // Number of times the CPU was taken away because something more important became ready
+} ExecutionStatistics;
+
+
+// Statistics of a dispatch queue that belongs to a process
+typedef struct DispatchQueueInfo {
+    int                 od;             // Descriptor of the dispatch queue
+    int8_t              qos;
+    int8_t              priority;
+    int8_t              concurrency;    // Number of virtual processors currently attached to the queue
+    int8_t              reserved;
+    ExecutionStatistics stats;
+} DispatchQueueInfo;
+
+
+#define kProcessInfo_MaxNameLength          32
+#define kProcessInfo_MaxDispatchQueueCount  8
+
+// Information about a process. The process statistics include the statistics
+// of all its dispatch queues, including queues which no longer exist.
+typedef struct ProcessInfo {
+    ProcessId           pid;
+    ProcessId           ppid;
+    ProcessId           nextPid;                // PID of the next process in the process table; 0 if this is the last process
+    int                 dispatchQueueCount;     // Number of valid entries in 'dispatchQueues'
+    char                name[kProcessInfo_MaxNameLength];   // argv[0] of the process
+    ExecutionStatistics stats;
+    DispatchQueueInfo   dispatchQueues[kProcessInfo_MaxDispatchQueueCount];    // The first kProcessInfo_MaxDispatchQueueCount dispatch queues of the process
+} ProcessInfo;
+
+
 #define kIOChannel_Stdin    0
 #define kIOChannel_Stdout   1
 #define kIOChannel_Stderr   2
@@ -104,6 +142,15 @@ extern errno_t Process_WaitForTerminationOfChild(ProcessId pid, ProcessTerminati
 extern ProcessArguments* _Nonnull Process_GetArguments(void);
 
 
+// Returns information about the process with the PID 'pid'. The root process
+// has the PID 1. All processes may be enumerated by starting with the root
+// process and then following the 'nextPid' fields until 'nextPid' is 0.
+// Returns ESRCH if no process with the PID 'pid' exists. 'nextPid' is filled
+// in anyway in this case so that an enumeration can skip over a process that
+// has exited since its PID was returned.
+extern errno_t Process_GetInfo(ProcessId pid, ProcessInfo* _Nonnull pOutInfo);
+
+
 extern errno_t Process_AllocateAddressSpace(size_t nbytes, void* _Nullable * _Nonnull ptr);
 
 #endif /* __KERNEL__ */
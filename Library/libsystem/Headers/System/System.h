@@ -21,6 +21,7 @@
 #include <System/Pipe.h>
 #include <System/Process.h>
 #include <System/TimeInterval.h>
+#include <System/Trace.h>
 #include <System/Urt.h>
 
 __CPP_BEGIN
@@ -0,0 +1,75 @@
+//
+//  Trace.h
+//  libsystem
+//
+//  Created by Dietmar Planitzer on 4/2/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef _SYS_TRACE_H
+#define _SYS_TRACE_H 1
+
+#include <System/_cmndef.h>
+#include <System/Error.h>
+#include <System/TimeInterval.h>
+#include <System/Types.h>
+
+__CPP_BEGIN
+
+// The kernel trace buffer holds the most recent kTrace_MaxEventCount events
+#define kTrace_MaxEventCount    1024
+
+
+// Trace event types. 'vpid' is the VP that the event is about. The meaning of
+// 'arg0' and 'arg1' depends on the event type.
+enum {
+    kTraceEvent_None = 0,
+    kTraceEvent_SwitchOut,          // vpid: VP that stops running, arg0: its new state, arg1: vpid of the VP that runs next
+    kTraceEvent_SwitchIn,           // vpid: VP that starts running, arg0: its effective priority
+    kTraceEvent_WaitStart,          // vpid: VP that starts waiting, arg0: wait queue, arg1: 1 if the wait is interruptible
+    kTraceEvent_WakeUp,             // vpid: VP that was woken up, arg0: wakeup reason, arg1: wait queue
+    kTraceEvent_TimeoutFired,       // vpid: VP whose wait timed out, arg0: wait queue
+    kTraceEvent_InterruptEnter,     // vpid: interrupted VP, arg0: interrupt ID
+    kTraceEvent_InterruptExit,      // vpid: interrupted VP, arg0: interrupt ID
+    kTraceEvent_DispatchItemStart,  // vpid: executing VP, arg0: dispatch queue, arg1: work item
+    kTraceEvent_DispatchItemEnd,    // vpid: executing VP, arg0: dispatch queue, arg1: work item
+    kTraceEvent_DispatchTimerDue,   // vpid: VP that took the timer off the timer wheel, arg0: dispatch queue, arg1: microseconds since the timer deadline
+};
+
+// Wakeup reasons reported by a kTraceEvent_WakeUp event
+#define kTraceWakeUpReason_Finished     1
+#define kTraceWakeUpReason_Interrupted  2
+#define kTraceWakeUpReason_TimedOut     3
+
+
+typedef struct TraceEvent {
+    TimeInterval    time;       // Monotonic clock time at which the event was recorded
+    uint32_t        arg0;
+    uint32_t        arg1;
+    int             vpid;
+    int8_t          type;
+    int8_t          reserved[3];
+} TraceEvent;
+
+
+#if !defined(__KERNEL__)
+
+// Enables or disables the recording of kernel trace events. The trace buffer is
+// allocated the first time that tracing is enabled and recording is near free
+// while tracing is disabled. Disabling tracing keeps the events that have been
+// recorded so far.
+// @Concurrency: Safe
+extern errno_t Trace_SetEnabled(bool enabled);
+
+// Copies up to 'bufferCount' of the most recent trace events to 'pBuffer'. The
+// events are ordered from oldest to newest. Returns the number of events that
+// were copied in 'pOutCount'. Events which happen while the snapshot is taken
+// are not recorded.
+// @Concurrency: Safe
+extern errno_t Trace_Snapshot(TraceEvent* _Nonnull pBuffer, size_t bufferCount, size_t* _Nonnull pOutCount);
+
+#endif /* __KERNEL__ */
+
+__CPP_END
+
+#endif /* _SYS_TRACE_H */
@@ -18,7 +18,7 @@ enum {
     SC_read = 0,            // errno_t IOChannel_Read(int fd, const char * _Nonnull buffer, size_t nBytesToRead, ssize_t* pOutBytesRead)
     SC_write,               // errno_t IOChannel_Write(int fd, const char * _Nonnull buffer, size_t nBytesToWrite, ssize_t* pOutBytesWritten)
     SC_delay,               // errno_t Delay(TimeInterval ti)
-    SC_dispatch,            // errno_t _DispatchQueue_Dispatch(int od, unsigned long options, Dispatch_Closure _Nonnull pUserClosure, void* _Nullable pContext)
+    SC_dispatch,            // errno_t _DispatchQueue_Dispatch(int od, unsigned long options, Dispatch_Closure _Nullable pUserClosure, void* _Nullable pContext, size_t count)
     SC_alloc_address_space, // errno_t Process_AllocateAddressSpace(int nbytes, void **pOutMem)
     SC_exit,                // _Noreturn Process_Exit(int status)
     SC_spawn_process,       // errno_t Process_Spawn(SpawnArguments * _Nonnull args, ProcessId * _Nullable rpid)
@@ -47,12 +47,27 @@ enum {
     SC_truncate,            // errno_t File_Truncate(const char* _Nonnull path, FileOffset length)
     SC_ftruncate,           // errno_t FileChannel_Truncate(int fd, FileOffset length)
     SC_mkfile,              // errno_t File_Create(const char* _Nonnull path, int options, int permissions, int* _Nonnull fd)
-    SC_mkpipe,              // errno_t Pipe_Create(int* _Nonnull rioc, int* _Nonnull wioc)
+    SC_mkpipe,              // errno_t Pipe_CreateWithCapacity(size_t capacity, int* _Nonnull rioc, int* _Nonnull wioc)
     SC_dispatch_after,      // errno_t DispatchQueue_DispatchAsyncAfter(int od, TimeInterval deadline, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
     SC_dispatch_queue_create,   // errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int qos, int priority, int* _Nonnull pOutQueue)
     SC_dispatch_queue_current,  // int DispatchQueue_GetCurrent(void)
     SC_dispose,             // _Object_Dispose(int od)
     SC_get_monotonic_time,  // TimeInterval MonotonicClock_GetTime(void)
+    SC_dispatch_group_create,   // errno_t DispatchGroup_Create(int* _Nonnull pOutGroup)
+    SC_dispatch_group_enter,    // errno_t DispatchGroup_Enter(int gd)
+    SC_dispatch_group_leave,    // errno_t DispatchGroup_Leave(int gd)
+    SC_dispatch_group_wait,     // errno_t DispatchGroup_Wait(int gd, TimeInterval deadline)
+    SC_dispatch_group_notify,   // errno_t DispatchGroup_Notify(int gd, int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
+    SC_trace_enable,        // errno_t Trace_SetEnabled(bool enabled)
+    SC_trace_snapshot,      // errno_t Trace_Snapshot(TraceEvent* _Nonnull pBuffer, size_t bufferCount, size_t* _Nonnull pOutCount)
+    SC_getprocinfo,         // errno_t Process_GetInfo(ProcessId pid, ProcessInfo* _Nonnull pOutInfo)
+    SC_splice,              // errno_t IOChannel_Splice(int iocIn, int iocOut, size_t nBytesToSplice, unsigned int flags, ssize_t* _Nonnull nOutBytesSpliced)
+    SC_poll,                // errno_t IOChannel_Poll(IOChannelPollEntry* _Nonnull entries, int count, TimeInterval timeout, int* _Nonnull nOutReadyCount)
+    SC_dispatch_source_create,  // errno_t DispatchSource_Create(int od, const Dispatch_SourceParams* _Nonnull pParams, Dispatch_SourceClosure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutSource)
+    SC_read_async,          // errno_t IOChannel_ReadAsync(int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest)
+    SC_write_async,         // errno_t IOChannel_WriteAsync(int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest)
+    SC_dispatch_sync_benchmark, // DEBUG only: errno_t DispatchQueue_BenchmarkSync(int count, TimeInterval* _Nonnull pOutInlineTime, TimeInterval* _Nonnull pOutQueuedTime)
+    SC_get_monotonic_clock_info,    // errno_t MonotonicClock_GetInfo(MonotonicClockInfo* _Nonnull pOutInfo)
 };
 
 
@@ -47,8 +47,23 @@ SC_dispatch_queue_create    equ 34
 SC_dispatch_queue_current   equ 35
 SC_dispose                  equ 36
 SC_SC_get_monotonic_time    equ 37
+SC_dispatch_group_create    equ 38
+SC_dispatch_group_enter     equ 39
+SC_dispatch_group_leave     equ 40
+SC_dispatch_group_wait      equ 41
+SC_dispatch_group_notify    equ 42
+SC_trace_enable             equ 43
+SC_trace_snapshot           equ 44
+SC_getprocinfo              equ 45
+SC_splice                   equ 46
+SC_poll                     equ 47
+SC_dispatch_source_create   equ 48
+SC_read_async               equ 49
+SC_write_async              equ 50
+SC_dispatch_sync_benchmark  equ 51
+SC_get_monotonic_clock_info equ 52
 
-SC_numberOfCalls            equ 38
+SC_numberOfCalls            equ 53
 
 
 ; System call macro.
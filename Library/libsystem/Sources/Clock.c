@@ -22,3 +22,8 @@ TimeInterval MonotonicClock_GetTime(void)
     _syscall(SC_get_monotonic_time, &time);
     return time;
 }
+
+errno_t MonotonicClock_GetInfo(MonotonicClockInfo* _Nonnull pOutInfo)
+{
+    return (errno_t)_syscall(SC_get_monotonic_clock_info, pOutInfo);
+}
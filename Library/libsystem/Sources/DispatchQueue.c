@@ -12,12 +12,37 @@
 
 errno_t DispatchQueue_DispatchSync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
 {
-    return _syscall(SC_dispatch, od, (unsigned long)kDispatchOption_Sync, pClosure, pContext);
+    return _syscall(SC_dispatch, od, (unsigned long)kDispatchOption_Sync, pClosure, pContext, (size_t)0);
 }
 
 errno_t DispatchQueue_DispatchAsync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
 {
-    return _syscall(SC_dispatch, od, (unsigned long)0, pClosure, pContext);
+    return _syscall(SC_dispatch, od, (unsigned long)0, pClosure, pContext, (size_t)0);
+}
+
+errno_t DispatchQueue_DispatchBarrierSync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
+{
+    return _syscall(SC_dispatch, od, (unsigned long)(kDispatchOption_Sync | kDispatchOption_Barrier), pClosure, pContext, (size_t)0);
+}
+
+errno_t DispatchQueue_DispatchBarrierAsync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
+{
+    return _syscall(SC_dispatch, od, (unsigned long)kDispatchOption_Barrier, pClosure, pContext, (size_t)0);
+}
+
+errno_t DispatchQueue_DispatchGroupAsync(int od, int gd, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
+{
+    return _syscall(SC_dispatch, od, (unsigned long)kDispatchOption_Group, pClosure, pContext, (size_t)gd);
+}
+
+errno_t DispatchQueue_DispatchAsyncBatch(int od, const Dispatch_Work* _Nonnull pWork, size_t count)
+{
+    return _syscall(SC_dispatch, od, (unsigned long)kDispatchOption_Batch, NULL, pWork, count);
+}
+
+errno_t DispatchQueue_Apply(int od, size_t iterations, Dispatch_ApplyClosure _Nonnull pClosure, void* _Nullable pContext)
+{
+    return _syscall(SC_dispatch, od, (unsigned long)kDispatchOption_Apply, pClosure, pContext, iterations);
 }
 
 errno_t DispatchQueue_DispatchAsyncAfter(int od, TimeInterval deadline, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
@@ -39,3 +64,73 @@ errno_t DispatchQueue_Destroy(int od)
 {
     return _syscall(SC_dispose, od);
 }
+
+
+errno_t DispatchGroup_Create(int* _Nonnull pOutGroup)
+{
+    return _syscall(SC_dispatch_group_create, pOutGroup);
+}
+
+errno_t DispatchGroup_Destroy(int gd)
+{
+    return _syscall(SC_dispose, gd);
+}
+
+errno_t DispatchGroup_Enter(int gd)
+{
+    return _syscall(SC_dispatch_group_enter, gd);
+}
+
+errno_t DispatchGroup_Leave(int gd)
+{
+    return _syscall(SC_dispatch_group_leave, gd);
+}
+
+errno_t DispatchGroup_Wait(int gd, TimeInterval deadline)
+{
+    return _syscall(SC_dispatch_group_wait, gd, deadline);
+}
+
+errno_t DispatchGroup_Notify(int gd, int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
+{
+    return _syscall(SC_dispatch_group_notify, gd, od, pClosure, pContext);
+}
+
+
+errno_t DispatchSource_CreateIOChannel(int od, int ioc, unsigned int events, Dispatch_SourceClosure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutSource)
+{
+    Dispatch_SourceParams params;
+
+    params.type = kDispatchSourceType_IOChannel;
+    params.ioc = ioc;
+    params.events = events;
+    params.deadline = kTimeInterval_Zero;
+    params.interval = kTimeInterval_Zero;
+
+    return _syscall(SC_dispatch_source_create, od, &params, pClosure, pContext, pOutSource);
+}
+
+errno_t DispatchSource_CreateTimer(int od, TimeInterval deadline, TimeInterval interval, Dispatch_SourceClosure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutSource)
+{
+    Dispatch_SourceParams params;
+
+    params.type = kDispatchSourceType_Timer;
+    params.ioc = -1;
+    params.events = 0;
+    params.deadline = deadline;
+    params.interval = interval;
+
+    return _syscall(SC_dispatch_source_create, od, &params, pClosure, pContext, pOutSource);
+}
+
+errno_t DispatchSource_Destroy(int sd)
+{
+    return _syscall(SC_dispose, sd);
+}
+
+#if DEBUG
+errno_t DispatchQueue_BenchmarkSync(int count, TimeInterval* _Nonnull pOutInlineTime, TimeInterval* _Nonnull pOutQueuedTime)
+{
+    return _syscall(SC_dispatch_sync_benchmark, count, pOutInlineTime, pOutQueuedTime);
+}
+#endif
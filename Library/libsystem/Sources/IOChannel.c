@@ -21,6 +21,26 @@ errno_t IOChannel_Write(int fd, const void* _Nonnull buffer, size_t nBytesToWrit
     return (errno_t)_syscall(SC_write, fd, buffer, nBytesToWrite, nOutBytesWritten);
 }
 
+errno_t IOChannel_ReadAsync(int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest)
+{
+    return (errno_t)_syscall(SC_read_async, ioc, od, pRequest);
+}
+
+errno_t IOChannel_WriteAsync(int ioc, int od, IOChannelAsyncRequest* _Nonnull pRequest)
+{
+    return (errno_t)_syscall(SC_write_async, ioc, od, pRequest);
+}
+
+errno_t IOChannel_Splice(int iocIn, int iocOut, size_t nBytesToSplice, unsigned int flags, ssize_t* _Nonnull nOutBytesSpliced)
+{
+    return (errno_t)_syscall(SC_splice, iocIn, iocOut, nBytesToSplice, flags, nOutBytesSpliced);
+}
+
+errno_t IOChannel_Poll(IOChannelPollEntry* _Nonnull entries, int count, TimeInterval timeout, int* _Nonnull nOutReadyCount)
+{
+    return (errno_t)_syscall(SC_poll, entries, count, timeout, nOutReadyCount);
+}
+
 errno_t IOChannel_Close(int fd)
 {
     return (errno_t)_syscall(SC_close, fd);
@@ -43,6 +63,11 @@ unsigned int IOChannel_GetMode(int fd)
     return (err == 0) ? mode : 0;
 }
 
+errno_t IOChannel_SetNonBlocking(int fd, bool flag)
+{
+    return IOChannel_Control(fd, kIOChannelCommand_SetNonBlocking, (int)flag);
+}
+
 errno_t IOChannel_Control(int fd, int cmd, ...)
 {
     errno_t err;
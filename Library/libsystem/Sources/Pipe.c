@@ -13,5 +13,10 @@
 
 errno_t Pipe_Create(int* _Nonnull rioc, int* _Nonnull wioc)
 {
-    return (errno_t)_syscall(SC_mkpipe, rioc, wioc);
+    return (errno_t)_syscall(SC_mkpipe, rioc, wioc, (size_t)0);
+}
+
+errno_t Pipe_CreateWithCapacity(size_t capacity, int* _Nonnull rioc, int* _Nonnull wioc)
+{
+    return (errno_t)_syscall(SC_mkpipe, rioc, wioc, capacity);
 }
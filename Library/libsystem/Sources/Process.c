@@ -68,6 +68,11 @@ ProcessArguments* _Nonnull Process_GetArguments(void)
     return (ProcessArguments*) _syscall(SC_getpargs);
 }
 
+errno_t Process_GetInfo(ProcessId pid, ProcessInfo* _Nonnull pOutInfo)
+{
+    return (errno_t)_syscall(SC_getprocinfo, pid, pOutInfo);
+}
+
 
 errno_t Process_AllocateAddressSpace(size_t nbytes, void* _Nullable * _Nonnull ptr)
 {
@@ -0,0 +1,21 @@
+//
+//  Trace.c
+//  libsystem
+//
+//  Created by Dietmar Planitzer on 4/2/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include <System/Trace.h>
+#include <System/_syscall.h>
+
+
+errno_t Trace_SetEnabled(bool enabled)
+{
+    return (errno_t)_syscall(SC_trace_enable, (int)enabled);
+}
+
+errno_t Trace_Snapshot(TraceEvent* _Nonnull pBuffer, size_t bufferCount, size_t* _Nonnull pOutCount)
+{
+    return (errno_t)_syscall(SC_trace_snapshot, pBuffer, bufferCount, pOutCount);
+}